@@ -131,6 +131,53 @@ static VALUE rdo_postgres_array_parse(VALUE self, VALUE str) {
   return rb_funcall(ctx.wrapper, rb_intern("replace"), 1, ctx.ary);
 }
 
+/** Build a text[] literal for a flat Array in one pass */
+VALUE rdo_postgres_array_encode_text(VALUE ary) {
+  long  len = RARRAY_LEN(ary);
+  VALUE str = rb_str_buf_new(len * 8 + 2);
+  long  i;
+
+  rb_str_buf_cat(str, "{", 1);
+
+  for (i = 0; i < len; ++i) {
+    VALUE v = rb_ary_entry(ary, i);
+
+    if (i > 0) {
+      rb_str_buf_cat(str, ",", 1);
+    }
+
+    if (NIL_P(v)) {
+      rb_str_buf_cat(str, "NULL", 4);
+      continue;
+    } else if (TYPE(v) == T_ARRAY) {
+      return Qnil;
+    } else if (TYPE(v) != T_STRING) {
+      v = RDO_OBJ_TO_S(v);
+    }
+
+    const char * s   = RSTRING_PTR(v);
+    const char * end = s + RSTRING_LEN(v);
+    const char * run = s;
+
+    rb_str_buf_cat(str, "\"", 1);
+
+    for (; s < end; ++s) {
+      if (*s == '"' || *s == '\\') {
+        rb_str_buf_cat(str, run, s - run);
+        rb_str_buf_cat(str, "\\", 1);
+        run = s;
+      }
+    }
+
+    rb_str_buf_cat(str, run, end - run);
+    rb_str_buf_cat(str, "\"", 1);
+  }
+
+  rb_str_buf_cat(str, "}", 1);
+
+  return str;
+}
+
 /** Parse a bytea string into a binary Ruby String */
 static VALUE rdo_postgres_array_bytea_parse_value(VALUE self, VALUE s) {
   Check_Type((s = rb_call_super(1, &s)), T_STRING);
@@ -155,10 +202,39 @@ static VALUE rdo_postgres_array_bytea_format_value(VALUE self, VALUE v) {
   return formatted;
 }
 
+/** Parse an interval string into a RDO::Postgres::Interval */
+static VALUE rdo_postgres_array_interval_parse_value(VALUE self, VALUE s) {
+  Check_Type((s = rb_call_super(1, &s)), T_STRING);
+  return rdo_postgres_cast_interval(RSTRING_PTR(s), RSTRING_LEN(s),
+      rb_enc_get_index(s));
+}
+
+/** Parse an inet string into a RDO::Postgres::Inet */
+static VALUE rdo_postgres_array_inet_parse_value(VALUE self, VALUE s) {
+  Check_Type((s = rb_call_super(1, &s)), T_STRING);
+  return rdo_postgres_cast_inet(RSTRING_PTR(s), RSTRING_LEN(s));
+}
+
+/** Parse a cidr string into an IPAddr */
+static VALUE rdo_postgres_array_cidr_parse_value(VALUE self, VALUE s) {
+  Check_Type((s = rb_call_super(1, &s)), T_STRING);
+  return rdo_postgres_cast_cidr(RSTRING_PTR(s), RSTRING_LEN(s));
+}
+
+/** Parse a money string into a BigDecimal */
+static VALUE rdo_postgres_array_money_parse_value(VALUE self, VALUE s) {
+  Check_Type((s = rb_call_super(1, &s)), T_STRING);
+  return rdo_postgres_cast_money(RSTRING_PTR(s), RSTRING_LEN(s));
+}
+
 /** Initialize Array extensions */
 void Init_rdo_postgres_arrays(void) {
-  VALUE cArray      = rb_path2class("RDO::Postgres::Array");
-  VALUE cByteaArray = rb_path2class("RDO::Postgres::Array::Bytea");
+  VALUE cArray         = rb_path2class("RDO::Postgres::Array");
+  VALUE cByteaArray    = rb_path2class("RDO::Postgres::Array::Bytea");
+  VALUE cIntervalArray = rb_path2class("RDO::Postgres::Array::Interval");
+  VALUE cInetArray     = rb_path2class("RDO::Postgres::Array::Inet");
+  VALUE cCidrArray     = rb_path2class("RDO::Postgres::Array::Cidr");
+  VALUE cMoneyArray    = rb_path2class("RDO::Postgres::Array::Money");
 
   rb_define_singleton_method(cArray, "parse", rdo_postgres_array_parse, 1);
 
@@ -167,4 +243,16 @@ void Init_rdo_postgres_arrays(void) {
 
   rb_define_method(cByteaArray,
       "format_value", rdo_postgres_array_bytea_format_value, 1);
+
+  rb_define_method(cIntervalArray,
+      "parse_value", rdo_postgres_array_interval_parse_value, 1);
+
+  rb_define_method(cInetArray,
+      "parse_value", rdo_postgres_array_inet_parse_value, 1);
+
+  rb_define_method(cCidrArray,
+      "parse_value", rdo_postgres_array_cidr_parse_value, 1);
+
+  rb_define_method(cMoneyArray,
+      "parse_value", rdo_postgres_array_money_parse_value, 1);
 }
@@ -5,5 +5,15 @@
  * See LICENSE file for details.
  */
 
+#include <ruby.h>
+
+/**
+ * Encode a flat Array as a PostgreSQL array literal of quoted text values.
+ *
+ * This is what RDO::Postgres::Array::Text#to_s produces, without a method
+ * call per element. Returns Qnil if ary contains another Array.
+ */
+VALUE rdo_postgres_array_encode_text(VALUE ary);
+
 /** Initialize Array C extensions */
 void Init_rdo_postgres_arrays(void);
@@ -0,0 +1,579 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include "arrow.h"
+#include "types.h"
+#include "macros.h"
+#include <ruby/encoding.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Writer for the Arrow IPC stream format.
+ *
+ * Each message is a FlatBuffer (Message.fbs/Schema.fbs) followed by a body of
+ * 8-byte aligned buffers. The FlatBuffers are written front to back: a table
+ * is written before the strings, vectors and tables it refers to, and its
+ * offsets are patched once those are written. Everything is built in binary
+ * Ruby Strings, so nothing leaks if an exception is raised.
+ */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "Arrow IPC export assumes a little-endian host"
+#endif
+
+/** Arrow IPC MetadataVersion V5 */
+#define RDO_ARROW_METADATA_V5 4
+
+/** Arrow MessageHeader union members */
+#define RDO_ARROW_HEADER_SCHEMA       1
+#define RDO_ARROW_HEADER_RECORD_BATCH 3
+
+/** Arrow Type union members */
+#define RDO_ARROW_TYPE_INT       2
+#define RDO_ARROW_TYPE_FLOAT     3
+#define RDO_ARROW_TYPE_BINARY    4
+#define RDO_ARROW_TYPE_UTF8      5
+#define RDO_ARROW_TYPE_BOOL      6
+#define RDO_ARROW_TYPE_DATE      8
+#define RDO_ARROW_TYPE_TIMESTAMP 10
+
+/** A scalar or offset field of a FlatBuffers table */
+typedef struct {
+  int     size;   /* 0 if the field is absent */
+  int64_t value;
+  long    pos;    /* set by rdo_arrow_table() */
+} RDOArrowField;
+
+/** How a postgres column is written to Arrow */
+typedef struct {
+  int type;       /* RDO_ARROW_TYPE_* */
+  int width;      /* bytes per value of fixed width types */
+  int zone;       /* timestamptz, converted to UTC */
+} RDOArrowColumn;
+
+/** Map a column type from types.h to its Arrow type */
+static RDOArrowColumn rdo_arrow_column(Oid type, int utf8) {
+  RDOArrowColumn col = { utf8 ? RDO_ARROW_TYPE_UTF8 : RDO_ARROW_TYPE_BINARY, 0, 0 };
+
+  switch (type) {
+    case RDO_PG_INT2OID:
+      col.type = RDO_ARROW_TYPE_INT; col.width = 2;
+      break;
+
+    case RDO_PG_INT4OID:
+      col.type = RDO_ARROW_TYPE_INT; col.width = 4;
+      break;
+
+    case RDO_PG_INT8OID:
+      col.type = RDO_ARROW_TYPE_INT; col.width = 8;
+      break;
+
+    case RDO_PG_FLOAT4OID:
+      col.type = RDO_ARROW_TYPE_FLOAT; col.width = 4;
+      break;
+
+    case RDO_PG_FLOAT8OID:
+      col.type = RDO_ARROW_TYPE_FLOAT; col.width = 8;
+      break;
+
+    case RDO_PG_BOOLOID:
+      col.type = RDO_ARROW_TYPE_BOOL;
+      break;
+
+    case RDO_PG_BYTEAOID:
+      col.type = RDO_ARROW_TYPE_BINARY;
+      break;
+
+    case RDO_PG_DATEOID:
+      col.type = RDO_ARROW_TYPE_DATE; col.width = 4;
+      break;
+
+    case RDO_PG_TIMESTAMPTZOID:
+      col.zone = 1;
+      /* fall through */
+
+    case RDO_PG_TIMESTAMPOID:
+      col.type = RDO_ARROW_TYPE_TIMESTAMP; col.width = 8;
+      break;
+  }
+
+  return col;
+}
+
+/** Append len bytes to buf, returning the position they were written at */
+static long rdo_arrow_put(VALUE buf, const void * bytes, long len) {
+  long pos = RSTRING_LEN(buf);
+  rb_str_cat(buf, bytes, len);
+  return pos;
+}
+
+/** Append len zero bytes to buf, returning their position */
+static long rdo_arrow_zero(VALUE buf, long len) {
+  long pos = RSTRING_LEN(buf);
+  rb_str_resize(buf, pos + len);
+  memset(RSTRING_PTR(buf) + pos, 0, len);
+  return pos;
+}
+
+/** Pad buf with zeros until its length is rem modulo align */
+static void rdo_arrow_align(VALUE buf, long align, long rem) {
+  long pad = (rem - RSTRING_LEN(buf) % align + align) % align;
+  if (pad > 0)
+    rdo_arrow_zero(buf, pad);
+}
+
+/** Point the uoffset at pos to target, which must come after it */
+static void rdo_arrow_patch(VALUE buf, long pos, long target) {
+  uint32_t offset = (uint32_t) (target - pos);
+  memcpy(RSTRING_PTR(buf) + pos, &offset, 4);
+}
+
+/**
+ * Write a table, with its vtable just before it, and return its position.
+ *
+ * Fields are laid out largest first, with the table 4 bytes past an 8 byte
+ * boundary so that 8 byte fields are aligned. Offset fields are written as
+ * zero, to be patched with rdo_arrow_patch().
+ */
+static long rdo_arrow_table(VALUE buf, RDOArrowField * fields, int nfields) {
+  uint16_t vtable[2 + nfields];
+  long     tsize = 4;
+  long     table;
+  int32_t  soffset;
+  int      size, i;
+
+  for (size = 8; size >= 1; size /= 2) {
+    for (i = 0; i < nfields; ++i) {
+      if (fields[i].size == size) {
+        vtable[2 + i] = (uint16_t) tsize;
+        tsize += size;
+      } else if (fields[i].size == 0) {
+        vtable[2 + i] = 0;
+      }
+    }
+  }
+
+  tsize = (tsize + 3) & ~3;
+
+  vtable[0] = (uint16_t) sizeof(vtable);
+  vtable[1] = (uint16_t) tsize;
+
+  rdo_arrow_align(buf, 8, (4 - (long) sizeof(vtable) % 8 + 8) % 8);
+  rdo_arrow_put(buf, vtable, sizeof(vtable));
+
+  table   = rdo_arrow_zero(buf, tsize);
+  soffset = (int32_t) sizeof(vtable);
+  memcpy(RSTRING_PTR(buf) + table, &soffset, 4);
+
+  for (i = 0; i < nfields; ++i) {
+    if (fields[i].size == 0)
+      continue;
+
+    fields[i].pos = table + vtable[2 + i];
+    memcpy(RSTRING_PTR(buf) + fields[i].pos, &fields[i].value, fields[i].size);
+  }
+
+  return table;
+}
+
+/** Write a string and return its position */
+static long rdo_arrow_string(VALUE buf, const char * s) {
+  uint32_t len = (uint32_t) strlen(s);
+  long     pos;
+
+  rdo_arrow_align(buf, 4, 0);
+  pos = rdo_arrow_put(buf, &len, 4);
+  rdo_arrow_put(buf, s, len + 1);
+
+  return pos;
+}
+
+/** Write a vector of n offsets, to be patched, and return its position */
+static long rdo_arrow_offset_vector(VALUE buf, int n) {
+  uint32_t len = (uint32_t) n;
+  long     pos;
+
+  rdo_arrow_align(buf, 4, 0);
+  pos = rdo_arrow_put(buf, &len, 4);
+  rdo_arrow_zero(buf, 4 * n);
+
+  return pos;
+}
+
+/** Write a vector of n pairs of int64 (FieldNode or Buffer structs) */
+static long rdo_arrow_struct_vector(VALUE buf, int64_t * pairs, int n) {
+  uint32_t len = (uint32_t) n;
+  long     pos;
+
+  rdo_arrow_align(buf, 8, 4);
+  pos = rdo_arrow_put(buf, &len, 4);
+  rdo_arrow_put(buf, pairs, 16 * n);
+
+  return pos;
+}
+
+/** Start a Message table, returning the buffer with the root offset patched */
+static VALUE rdo_arrow_message(int header_type, int64_t body_length,
+    long * header_pos) {
+
+  VALUE         buf = rb_str_buf_new(256);
+  RDOArrowField message[] = {
+    { 2, RDO_ARROW_METADATA_V5, 0 },
+    { 1, header_type, 0 },
+    { 4, 0, 0 },
+    { 8, body_length, 0 }
+  };
+
+  rdo_arrow_zero(buf, 4);
+  rdo_arrow_patch(buf, 0, rdo_arrow_table(buf, message, 4));
+  *header_pos = message[2].pos;
+
+  return buf;
+}
+
+/** Prefix the metadata with its continuation marker and length, then the body */
+static VALUE rdo_arrow_frame(VALUE metadata, VALUE body) {
+  int32_t prefix[2] = { -1, 0 };
+  VALUE   out;
+
+  rdo_arrow_align(metadata, 8, 0);
+  prefix[1] = (int32_t) RSTRING_LEN(metadata);
+
+  out = rb_str_buf_new(8 + RSTRING_LEN(metadata) + (NIL_P(body) ? 0 : RSTRING_LEN(body)));
+  rdo_arrow_put(out, prefix, 8);
+  rb_str_buf_append(out, metadata);
+
+  if (!NIL_P(body))
+    rb_str_buf_append(out, body);
+
+  rb_enc_associate_index(out, rb_ascii8bit_encindex());
+
+  return out;
+}
+
+/** Write the Type table for col and return its position */
+static long rdo_arrow_type(VALUE buf, RDOArrowColumn col) {
+  switch (col.type) {
+    case RDO_ARROW_TYPE_INT: {
+      RDOArrowField f[] = { { 4, col.width * 8, 0 }, { 1, 1, 0 } };
+      return rdo_arrow_table(buf, f, 2);
+    }
+
+    case RDO_ARROW_TYPE_FLOAT: {
+      RDOArrowField f[] = { { 2, col.width == 4 ? 1 : 2, 0 } };
+      return rdo_arrow_table(buf, f, 1);
+    }
+
+    case RDO_ARROW_TYPE_DATE: {
+      RDOArrowField f[] = { { 2, 0, 0 } };
+      return rdo_arrow_table(buf, f, 1);
+    }
+
+    case RDO_ARROW_TYPE_TIMESTAMP: {
+      RDOArrowField f[] = { { 2, 2, 0 }, { col.zone ? 4 : 0, 0, 0 } };
+      long table = rdo_arrow_table(buf, f, 2);
+      if (col.zone)
+        rdo_arrow_patch(buf, f[1].pos, rdo_arrow_string(buf, "UTC"));
+      return table;
+    }
+
+    default:
+      return rdo_arrow_table(buf, NULL, 0);
+  }
+}
+
+VALUE rdo_postgres_arrow_schema(PGresult * res, int utf8) {
+  int   nfields = PQnfields(res);
+  long  header;
+  VALUE buf     = rdo_arrow_message(RDO_ARROW_HEADER_SCHEMA, 0, &header);
+  long  vector;
+  int   j;
+
+  RDOArrowField schema[] = { { 0, 0, 0 }, { 4, 0, 0 } };
+  rdo_arrow_patch(buf, header, rdo_arrow_table(buf, schema, 2));
+
+  vector = rdo_arrow_offset_vector(buf, nfields);
+  rdo_arrow_patch(buf, schema[1].pos, vector);
+
+  for (j = 0; j < nfields; ++j) {
+    RDOArrowColumn col     = rdo_arrow_column(PQftype(res, j), utf8);
+    RDOArrowField  field[] = {
+      { 4, 0, 0 },
+      { 1, 1, 0 },
+      { 1, col.type, 0 },
+      { 4, 0, 0 },
+      { 0, 0, 0 },
+      { 4, 0, 0 }
+    };
+
+    rdo_arrow_patch(buf, vector + 4 + 4 * j, rdo_arrow_table(buf, field, 6));
+    rdo_arrow_patch(buf, field[0].pos, rdo_arrow_string(buf, PQfname(res, j)));
+    rdo_arrow_patch(buf, field[3].pos, rdo_arrow_type(buf, col));
+    rdo_arrow_patch(buf, field[5].pos, rdo_arrow_offset_vector(buf, 0));
+  }
+
+  return rdo_arrow_frame(buf, Qnil);
+}
+
+/** Days since 1970-01-01 of a date in the proleptic Gregorian calendar */
+static int64_t rdo_arrow_days_from_civil(int64_t y, int64_t m, int64_t d) {
+  y -= m <= 2;
+
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + doe - 719468;
+}
+
+/**
+ * Parse an ISO date or timestamp into microseconds since the epoch.
+ *
+ * Returns 0 if the value cannot be parsed (e.g. infinity), which is written
+ * as null.
+ */
+static int rdo_arrow_parse_timestamp(const char * s, int64_t * micros) {
+  char    * p;
+  int64_t   y, mo, d, hh = 0, mi = 0, ss = 0, us = 0, offset = 0;
+  int       digits = 0;
+
+  y = strtoll(s, &p, 10);
+  if (p == s || *p++ != '-') return 0;
+  mo = strtoll(p, &p, 10);
+  if (*p++ != '-') return 0;
+  d = strtoll(p, &p, 10);
+
+  if (*p == ' ' && isdigit((unsigned char) p[1])) {
+    hh = strtoll(p + 1, &p, 10);
+    if (*p++ != ':') return 0;
+    mi = strtoll(p, &p, 10);
+    if (*p++ != ':') return 0;
+    ss = strtoll(p, &p, 10);
+
+    if (*p == '.') {
+      for (++p; isdigit((unsigned char) *p); ++p) {
+        if (digits < 6) {
+          us = us * 10 + (*p - '0');
+          ++digits;
+        }
+      }
+      for (; digits < 6; ++digits)
+        us *= 10;
+    }
+  }
+
+  if (*p == '+' || *p == '-') {
+    int64_t sign = *p == '-' ? -1 : 1;
+    int64_t oh, om = 0, os = 0;
+
+    oh = strtoll(p + 1, &p, 10);
+    if (*p == ':') {
+      om = strtoll(p + 1, &p, 10);
+      if (*p == ':')
+        os = strtoll(p + 1, &p, 10);
+    }
+
+    offset = sign * (oh * 3600 + om * 60 + os);
+  }
+
+  if (strncmp(p, " BC", 3) == 0) {
+    y = 1 - y;
+    p += 3;
+  }
+
+  if (*p != '\0') return 0;
+
+  *micros = ((rdo_arrow_days_from_civil(y, mo, d) * 86400
+        + hh * 3600 + mi * 60 + ss - offset) * 1000000) + us;
+
+  return 1;
+}
+
+/** Decode a hex-format bytea into out, which needs len / 2 bytes */
+static long rdo_arrow_unhex(const char * s, long len, char * out) {
+  long i, n = 0;
+
+  for (i = 2; i + 1 < len; i += 2) {
+    char pair[3] = { s[i], s[i + 1], '\0' };
+    out[n++] = (char) strtol(pair, NULL, 16);
+  }
+
+  return n;
+}
+
+/** Append a body buffer, padded to 8 bytes, recording its offset and length */
+static void rdo_arrow_body_buffer(VALUE body, const char * bytes, long len,
+    int64_t * spec) {
+
+  spec[0] = RSTRING_LEN(body);
+  spec[1] = len;
+
+  if (len > 0)
+    rdo_arrow_put(body, bytes, len);
+
+  rdo_arrow_align(body, 8, 0);
+}
+
+/**
+ * Write the buffers of column j for rows [from, to) to body.
+ *
+ * Returns the null count, filling in the buffer specs (two or three pairs).
+ */
+static int64_t rdo_arrow_column_buffers(PGresult * res, RDOArrowColumn col,
+    int j, int from, int to, VALUE body, int64_t * specs) {
+
+  long    rows     = to - from;
+  long    bitmap_n = (rows + 7) / 8;
+  VALUE   validity = rb_str_new(NULL, bitmap_n);
+  VALUE   data     = Qnil;
+  VALUE   offsets  = Qnil;
+  int64_t nulls    = 0;
+  long    i;
+
+  memset(RSTRING_PTR(validity), 0, bitmap_n);
+
+  if (col.type == RDO_ARROW_TYPE_BOOL) {
+    data = rb_str_new(NULL, bitmap_n);
+    memset(RSTRING_PTR(data), 0, bitmap_n);
+  } else if (col.width > 0) {
+    data = rb_str_new(NULL, rows * col.width);
+    memset(RSTRING_PTR(data), 0, rows * col.width);
+  } else {
+    offsets = rb_str_new(NULL, (rows + 1) * 4);
+    data    = rb_str_buf_new(rows * 8);
+    memset(RSTRING_PTR(offsets), 0, 4);
+  }
+
+  for (i = 0; i < rows; ++i) {
+    int    row   = from + (int) i;
+    int    valid = !PQgetisnull(res, row, j);
+    char * value = PQgetvalue(res, row, j);
+    char * slot  = col.width > 0 ? RSTRING_PTR(data) + i * col.width : NULL;
+
+    if (valid) {
+      switch (col.type) {
+        case RDO_ARROW_TYPE_INT: {
+          int64_t v = strtoll(value, NULL, 10);
+          if (col.width == 2) { int16_t n = (int16_t) v; memcpy(slot, &n, 2); }
+          else if (col.width == 4) { int32_t n = (int32_t) v; memcpy(slot, &n, 4); }
+          else memcpy(slot, &v, 8);
+          break;
+        }
+
+        case RDO_ARROW_TYPE_FLOAT: {
+          double v = strtod(value, NULL);
+          if (col.width == 4) { float f = (float) v; memcpy(slot, &f, 4); }
+          else memcpy(slot, &v, 8);
+          break;
+        }
+
+        case RDO_ARROW_TYPE_BOOL:
+          if (value[0] == 't')
+            RSTRING_PTR(data)[i / 8] |= (char) (1 << (i % 8));
+          break;
+
+        case RDO_ARROW_TYPE_DATE:
+        case RDO_ARROW_TYPE_TIMESTAMP: {
+          int64_t micros;
+          if (!rdo_arrow_parse_timestamp(value, &micros)) {
+            valid = 0;
+          } else if (col.type == RDO_ARROW_TYPE_DATE) {
+            int32_t days = (int32_t) (micros / (86400LL * 1000000LL));
+            memcpy(slot, &days, 4);
+          } else {
+            memcpy(slot, &micros, 8);
+          }
+          break;
+        }
+
+        default: {
+          long len = PQgetlength(res, row, j);
+
+          if (PQftype(res, j) == RDO_PG_BYTEAOID
+              && len >= 2 && value[0] == '\\' && value[1] == 'x') {
+            long pos = RSTRING_LEN(data);
+            rb_str_resize(data, pos + len / 2);
+            rb_str_set_len(data, pos + rdo_arrow_unhex(value, len, RSTRING_PTR(data) + pos));
+          } else if (PQftype(res, j) == RDO_PG_BYTEAOID) {
+            size_t         n;
+            unsigned char * bytes = PQunescapeBytea((unsigned char *) value, &n);
+            rdo_arrow_put(data, bytes, (long) n);
+            PQfreemem(bytes);
+          } else {
+            rdo_arrow_put(data, value, len);
+          }
+        }
+      }
+    }
+
+    if (valid) {
+      RSTRING_PTR(validity)[i / 8] |= (char) (1 << (i % 8));
+    } else {
+      nulls++;
+    }
+
+    if (!NIL_P(offsets)) {
+      if (RSTRING_LEN(data) > INT32_MAX) {
+        rb_raise(rb_path2class("RDO::Exception"),
+            "Arrow record batch too large: use fewer rows per batch");
+      }
+
+      int32_t end = (int32_t) RSTRING_LEN(data);
+      memcpy(RSTRING_PTR(offsets) + (i + 1) * 4, &end, 4);
+    }
+  }
+
+  rdo_arrow_body_buffer(body, RSTRING_PTR(validity), bitmap_n, specs);
+
+  if (!NIL_P(offsets)) {
+    rdo_arrow_body_buffer(body, RSTRING_PTR(offsets), (rows + 1) * 4, specs + 2);
+    rdo_arrow_body_buffer(body, RSTRING_PTR(data), RSTRING_LEN(data), specs + 4);
+  } else {
+    rdo_arrow_body_buffer(body, RSTRING_PTR(data), RSTRING_LEN(data), specs + 2);
+  }
+
+  return nulls;
+}
+
+VALUE rdo_postgres_arrow_record_batch(PGresult * res, int utf8, int from, int to) {
+  int     nfields = PQnfields(res);
+  int     nbuffers = 0;
+  int64_t nodes[nfields * 2 + 1];
+  int64_t buffers[nfields * 6 + 1];
+  VALUE   body    = rb_str_buf_new(0);
+  VALUE   buf;
+  long    header;
+  int     j;
+
+  for (j = 0; j < nfields; ++j) {
+    RDOArrowColumn col = rdo_arrow_column(PQftype(res, j), utf8);
+
+    nodes[j * 2]     = to - from;
+    nodes[j * 2 + 1] = rdo_arrow_column_buffers(res, col, j, from, to, body,
+        buffers + nbuffers * 2);
+
+    nbuffers += col.width > 0 || col.type == RDO_ARROW_TYPE_BOOL ? 2 : 3;
+  }
+
+  buf = rdo_arrow_message(RDO_ARROW_HEADER_RECORD_BATCH, RSTRING_LEN(body), &header);
+
+  RDOArrowField batch[] = { { 8, to - from, 0 }, { 4, 0, 0 }, { 4, 0, 0 } };
+  rdo_arrow_patch(buf, header, rdo_arrow_table(buf, batch, 3));
+  rdo_arrow_patch(buf, batch[1].pos, rdo_arrow_struct_vector(buf, nodes, nfields));
+  rdo_arrow_patch(buf, batch[2].pos, rdo_arrow_struct_vector(buf, buffers, nbuffers));
+
+  return rdo_arrow_frame(buf, body);
+}
+
+VALUE rdo_postgres_arrow_end_of_stream(void) {
+  int32_t eos[2] = { -1, 0 };
+  return RDO_BINARY_STRING((char *) eos, 8);
+}
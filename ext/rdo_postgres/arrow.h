@@ -0,0 +1,25 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include <ruby.h>
+#include <libpq-fe.h>
+
+/** Default number of rows in each Arrow record batch */
+#define RDO_PG_ARROW_BATCH_ROWS 65536
+
+/**
+ * Return the Arrow IPC Schema message for the columns of res.
+ *
+ * Text columns are Utf8 if utf8 is non-zero, otherwise Binary.
+ */
+VALUE rdo_postgres_arrow_schema(PGresult * res, int utf8);
+
+/** Return an Arrow IPC RecordBatch message for rows [from, to) of res */
+VALUE rdo_postgres_arrow_record_batch(PGresult * res, int utf8, int from, int to);
+
+/** Return the end-of-stream marker of the Arrow IPC stream format */
+VALUE rdo_postgres_arrow_end_of_stream(void);
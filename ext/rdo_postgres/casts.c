@@ -7,6 +7,9 @@
 
 #include "casts.h"
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include "macros.h"
 #include "types.h"
 
@@ -30,21 +33,14 @@ static VALUE rdo_postgres_cast_bytea_hex(char * hex, size_t len) {
   }
 
   size_t   buflen = (len - 2) / 2;
-  char   * buffer = malloc(sizeof(char) * buflen);
+  VALUE    str    = rb_str_new(NULL, buflen);
   char   * s      = hex + 2;
-  char   * b      = buffer;
-
-  if (buffer == NULL) {
-    rb_raise(rb_eRuntimeError,
-        "Failed to allocate %ld bytes for bytea conversion", buflen);
-  }
+  char   * b      = RSTRING_PTR(str);
 
+  // decode straight into the String, rather than through a temporary buffer
   for (; *s; s += 2, ++b)
     *b = (RDOPostgres_HexLookup[*s] << 4) + (RDOPostgres_HexLookup[*(s + 1)]);
 
-  VALUE str = rb_str_new(buffer, buflen);
-  free(buffer);
-
   return str;
 }
 
@@ -71,16 +67,425 @@ VALUE rdo_postgres_cast_bytea(char * escaped, size_t len) {
     return rdo_postgres_cast_bytea_escape(escaped, len);
 }
 
+/** Read an unsigned integer, advancing s; returns 0 if no digits were read */
+static int rdo_postgres_cast_read_int(char ** s, char * end, long long * n) {
+  char * start = *s;
+
+  for (*n = 0; *s < end && isdigit(**s); ++(*s))
+    *n = (*n * 10) + (**s - '0');
+
+  return *s != start;
+}
+
+/** Parse the "HH:MM:SS[.ffffff]" part of an interval into microseconds */
+static int rdo_postgres_cast_interval_time(char ** s, char * end,
+    long long hours, long long * micros) {
+
+  long long mins, secs, frac = 0;
+  int       digits = 0;
+
+  if (*((*s)++) != ':' || !rdo_postgres_cast_read_int(s, end, &mins))
+    return 0;
+
+  if (*s >= end || *((*s)++) != ':' || !rdo_postgres_cast_read_int(s, end, &secs))
+    return 0;
+
+  if (*s < end && **s == '.') {
+    for (++(*s); *s < end && isdigit(**s); ++(*s), ++digits) {
+      if (digits < 6)
+        frac = (frac * 10) + (**s - '0');
+    }
+
+    for (; digits < 6; ++digits)
+      frac *= 10;
+  }
+
+  *micros = (((hours * 60 + mins) * 60 + secs) * 1000000) + frac;
+
+  return 1;
+}
+
+/**
+ * Parse an interval in the default "postgres" IntervalStyle.
+ *
+ * e.g. "1 year 2 mons -3 days +04:05:06.789"
+ *
+ * Other styles are returned as Strings.
+ */
+VALUE rdo_postgres_cast_interval(char * s, size_t len, int enc) {
+  char      * p      = s;
+  char      * end    = s + len;
+  long long   months = 0;
+  long long   days   = 0;
+  long long   micros = 0;
+  long long   n;
+  int         sign;
+
+  while (p < end) {
+    if (*p == ' ') {
+      ++p;
+      continue;
+    }
+
+    sign = 1;
+    if (*p == '-' || *p == '+')
+      sign = (*(p++) == '-') ? -1 : 1;
+
+    if (!rdo_postgres_cast_read_int(&p, end, &n))
+      return RDO_STRING(s, len, enc);
+
+    if (p < end && *p == ':') {
+      long long t;
+      if (!rdo_postgres_cast_interval_time(&p, end, n, &t))
+        return RDO_STRING(s, len, enc);
+      micros += sign * t;
+      continue;
+    }
+
+    if (p >= end || *(p++) != ' ')
+      return RDO_STRING(s, len, enc);
+
+    if (strncmp(p, "year", 4) == 0) {
+      months += sign * n * 12;
+    } else if (strncmp(p, "mon", 3) == 0) {
+      months += sign * n;
+    } else if (strncmp(p, "day", 3) == 0) {
+      days += sign * n;
+    } else {
+      return RDO_STRING(s, len, enc);
+    }
+
+    while (p < end && isalpha(*p))
+      ++p;
+  }
+
+  return rb_funcall(rb_path2class("RDO::Postgres::Interval"),
+      rb_intern("new"), 3, LL2NUM(months), LL2NUM(days), LL2NUM(micros));
+}
+
+/**
+ * Cast an inet value to a RDO::Postgres::Inet.
+ *
+ * An inet may have a host part (e.g. 192.168.0.5/24), which IPAddr would mask
+ * off, so the host and prefix are kept separately.
+ */
+VALUE rdo_postgres_cast_inet(char * s, size_t len) {
+  return rb_funcall(rb_path2class("RDO::Postgres::Inet"), rb_intern("new"), 1,
+      rb_str_new(s, len));
+}
+
+/**
+ * Cast a cidr value to an IPAddr.
+ *
+ * IPAddr.new takes the "addr/prefix" form as it is. A cidr has no host part,
+ * so applying the netmask loses nothing.
+ */
+VALUE rdo_postgres_cast_cidr(char * s, size_t len) {
+  return rb_funcall(rb_path2class("IPAddr"), rb_intern("new"), 1, rb_str_new(s, len));
+}
+
+/**
+ * Cast a money value to a BigDecimal.
+ *
+ * Currency symbols and group separators are dropped. The text output of
+ * money depends on lc_monetary, and this assumes '.' as the decimal point, as
+ * in the C locale. Queries that cannot rely on that should select the value
+ * as numeric instead.
+ */
+VALUE rdo_postgres_cast_money(char * s, size_t len) {
+  char   buf[len + 2];
+  char * b = buf;
+  size_t i = 0;
+
+  for (; i < len; ++i) {
+    if (s[i] == '-' || s[i] == '(') {
+      *(b++) = '-';
+    } else if (isdigit(s[i]) || s[i] == '.') {
+      *(b++) = s[i];
+    }
+  }
+
+  *b = '\0';
+
+  return RDO_DECIMAL(buf);
+}
+
+/** Cast json/jsonb either to a String, or parsed with JSON.parse */
+static VALUE rdo_postgres_cast_json(char * s, size_t len, int enc, int flags) {
+  VALUE str = RDO_STRING(s, len, enc);
+
+  if (flags & RDO_PG_CAST_PARSE_JSON) {
+    return rb_funcall(rb_path2class("JSON"), rb_intern("parse"), 1, str);
+  }
+
+  return str;
+}
+
+/**
+ * Copy one element of a composite or range into buf, removing quotes and escapes.
+ *
+ * Reading stops at the first unquoted character in delims. Returns 0 if the
+ * element was empty and unquoted, which means NULL (or an infinite bound).
+ */
+static int rdo_postgres_cast_read_element(char ** s, char * end,
+    const char * delims, char * buf, size_t * len) {
+
+  char * b      = buf;
+  int    quotes = 0;
+  int    quoted = 0;
+
+  for (; *s < end; ++(*s)) {
+    char c = **s;
+
+    if (c == '"') {
+      if (quotes && *s + 1 < end && *(*s + 1) == '"') {
+        *(b++) = *(++(*s)); // doubled quote
+      } else {
+        quotes = !quotes;
+        quoted = 1;
+      }
+    } else if (c == '\\' && *s + 1 < end) {
+      *(b++) = *(++(*s));
+    } else if (!quotes && strchr(delims, c) != NULL) {
+      break;
+    } else {
+      *(b++) = c;
+    }
+  }
+
+  *b   = '\0';
+  *len = b - buf;
+
+  return quoted || *len > 0;
+}
+
+/** Copy one key or value of an hstore into buf; returns 0 for an unquoted NULL */
+static int rdo_postgres_cast_read_hstore_token(char ** s, char * end,
+    char * buf, size_t * len) {
+
+  char * b = buf;
+
+  while (*s < end && isspace(**s))
+    ++(*s);
+
+  if (*s < end && **s == '"') {
+    for (++(*s); *s < end && **s != '"'; ++(*s)) {
+      if (**s == '\\' && *s + 1 < end)
+        ++(*s);
+      *(b++) = **s;
+    }
+    ++(*s);
+  } else {
+    for (; *s < end && !isspace(**s) && **s != ',' && **s != '='; ++(*s))
+      *(b++) = **s;
+
+    if (b - buf == 4 && strncasecmp(buf, "NULL", 4) == 0) {
+      *len = 0;
+      return 0;
+    }
+  }
+
+  *b   = '\0';
+  *len = b - buf;
+
+  return 1;
+}
+
+/**
+ * Cast an hstore to a Hash of String => String (or nil).
+ *
+ * e.g. "a"=>"1", "b"=>NULL
+ */
+VALUE rdo_postgres_cast_hstore(char * s, size_t len, int enc) {
+  VALUE  hash = rb_hash_new();
+  VALUE  tmp  = rb_str_buf_new(len + 1);
+  char * buf  = RSTRING_PTR(tmp);
+  char * p    = s;
+  char * end  = s + len;
+  size_t n;
+
+  while (p < end) {
+    rdo_postgres_cast_read_hstore_token(&p, end, buf, &n);
+    VALUE key = RDO_STRING(buf, n, enc);
+
+    while (p < end && isspace(*p))
+      ++p;
+
+    if (end - p < 2 || p[0] != '=' || p[1] != '>') {
+      RB_GC_GUARD(tmp);
+      return RDO_STRING(s, len, enc);
+    }
+
+    p += 2;
+
+    rb_hash_aset(hash, key,
+        rdo_postgres_cast_read_hstore_token(&p, end, buf, &n)
+          ? RDO_STRING(buf, n, enc) : Qnil);
+
+    while (p < end && (isspace(*p) || *p == ','))
+      ++p;
+  }
+
+  RB_GC_GUARD(tmp);
+
+  return hash;
+}
+
+/**
+ * Cast a composite (row) value.
+ *
+ * With fields as an Array of [name, decoder] pairs (see
+ * rdo_postgres_cast_decoded_value()), a Hash of name => value is returned.
+ * If fields is nil (an anonymous record) an Array of Strings is returned,
+ * since the text format does not say what type each field is. The same
+ * Array is returned if the value does not have as many fields as listed,
+ * e.g. after ALTER TYPE, until the driver reloads its types.
+ */
+VALUE rdo_postgres_cast_composite(char * s, size_t len, VALUE fields,
+    int enc, int flags) {
+
+  VALUE  tmp    = rb_str_buf_new(len + 1);
+  char * buf    = RSTRING_PTR(tmp);
+  char * p      = s;
+  char * end    = s + len;
+  VALUE  values = NIL_P(fields) ? rb_ary_new() : rb_hash_new();
+  long   i      = 0;
+  size_t n;
+
+  if (len < 2 || *(p++) != '(') {
+    return RDO_STRING(s, len, enc);
+  }
+
+  if (!NIL_P(fields)) {
+    // count the fields first, so none is decoded as the wrong type
+    do {
+      rdo_postgres_cast_read_element(&p, end, ",)", buf, &n);
+      ++i;
+    } while (p < end && *(p++) == ',');
+
+    if (i != RARRAY_LEN(fields)) {
+      return rdo_postgres_cast_composite(s, len, Qnil, enc, flags);
+    }
+
+    p = s + 1;
+    i = 0;
+  }
+
+  do {
+    int   present = rdo_postgres_cast_read_element(&p, end, ",)", buf, &n);
+    VALUE field   = NIL_P(fields) ? Qnil : rb_ary_entry(fields, i++);
+    VALUE value   = Qnil;
+
+    if (present) {
+      value = NIL_P(field)
+        ? RDO_STRING(buf, n, enc)
+        : rdo_postgres_cast_decoded_value(buf, n, rb_ary_entry(field, 1), enc, flags);
+    }
+
+    if (NIL_P(fields)) {
+      rb_ary_push(values, value);
+    } else if (!NIL_P(field)) {
+      rb_hash_aset(values, rb_ary_entry(field, 0), value);
+    }
+  } while (p < end && *(p++) == ',');
+
+  RB_GC_GUARD(tmp);
+
+  return values;
+}
+
+/**
+ * Cast a range to a RDO::Postgres::Range, with bounds cast as subtype.
+ *
+ * e.g. "[1,10)", "(,2020-01-01]", "empty"
+ *
+ * Infinite bounds are nil, as in Ruby's beginless and endless ranges.
+ */
+VALUE rdo_postgres_cast_range(char * s, size_t len, Oid subtype,
+    int enc, int flags) {
+
+  VALUE  cRange = rb_path2class("RDO::Postgres::Range");
+  VALUE  tmp;
+  VALUE  lower  = Qnil;
+  VALUE  upper  = Qnil;
+  char * buf;
+  char * p      = s;
+  char * end    = s + len;
+  int    lower_inc, upper_inc;
+  size_t n;
+
+  if (len == 5 && strncasecmp(s, "empty", 5) == 0) {
+    return rb_funcall(cRange, rb_intern("empty"), 0);
+  }
+
+  if (len < 3 || (*p != '[' && *p != '(')) {
+    return RDO_STRING(s, len, enc);
+  }
+
+  tmp       = rb_str_buf_new(len + 1);
+  buf       = RSTRING_PTR(tmp);
+  lower_inc = *(p++) == '[';
+
+  if (rdo_postgres_cast_read_element(&p, end, ",", buf, &n)) {
+    lower = rdo_postgres_cast_raw_value(buf, n, subtype, enc, flags);
+  }
+
+  if (p < end)
+    ++p;
+
+  if (rdo_postgres_cast_read_element(&p, end, ")]", buf, &n)) {
+    upper = rdo_postgres_cast_raw_value(buf, n, subtype, enc, flags);
+  }
+
+  upper_inc = p < end && *p == ']';
+
+  RB_GC_GUARD(tmp);
+
+  return rb_funcall(cRange, rb_intern("new"), 4, lower, upper,
+      (!NIL_P(upper) && !upper_inc) ? Qtrue : Qfalse,
+      (!NIL_P(lower) && !lower_inc) ? Qtrue : Qfalse);
+}
+
+/** Cast a non-NULL value with a decoder from the driver's type map */
+VALUE rdo_postgres_cast_decoded_value(char * value, int length, VALUE decoder,
+    int enc, int flags) {
+
+  switch (TYPE(decoder)) {
+    case T_ARRAY:
+      return rdo_postgres_cast_composite(value, length, decoder, enc, flags);
+
+    case T_SYMBOL:
+      if (SYM2ID(decoder) == rb_intern("hstore"))
+        return rdo_postgres_cast_hstore(value, length, enc);
+      return RDO_BINARY_STRING(value, length);
+
+    default:
+      return rdo_postgres_cast_raw_value(value, length, NUM2UINT(decoder), enc, flags);
+  }
+}
+
 /** Get the value as a ruby type */
-VALUE rdo_postgres_cast_value(PGresult * res, int row, int col, int enc) {
+VALUE rdo_postgres_cast_value(PGresult * res, int row, int col, int enc, int flags) {
+  return rdo_postgres_cast_typed_value(res, row, col, PQftype(res, col), enc, flags);
+}
+
+/** Get the value as a ruby type, decoding it as type (e.g. the base of a domain) */
+VALUE rdo_postgres_cast_typed_value(PGresult * res, int row, int col, Oid type,
+    int enc, int flags) {
+
   if (PQgetisnull(res, row, col)) {
     return Qnil;
   }
 
-  char * value  = PQgetvalue(res, row, col);
-  int    length = PQgetlength(res, row, col);
+  return rdo_postgres_cast_raw_value(PQgetvalue(res, row, col),
+      PQgetlength(res, row, col), type, enc, flags);
+}
+
+/** Get a value that is not part of a PGresult (e.g. spooled) as a ruby type */
+VALUE rdo_postgres_cast_raw_value(char * value, int length, Oid type,
+    int enc, int flags) {
 
-  switch (PQftype(res, col)) {
+  switch (type) {
     case RDO_PG_INT2OID:
     case RDO_PG_INT4OID:
     case RDO_PG_INT8OID:
@@ -112,12 +517,36 @@ VALUE rdo_postgres_cast_value(PGresult * res, int row, int col, int enc) {
     case RDO_PG_CHAROID:
     case RDO_PG_VARCHAROID:
     case RDO_PG_BPCHAROID:
+    case RDO_PG_UUIDOID:
+    case RDO_PG_TIMEOID:
+    case RDO_PG_TIMETZOID:
       return RDO_STRING(value, length, enc);
 
+    case RDO_PG_JSONOID:
+    case RDO_PG_JSONBOID:
+      return rdo_postgres_cast_json(value, length, enc, flags);
+
+    case RDO_PG_INTERVALOID:
+      return rdo_postgres_cast_interval(value, length, enc);
+
+    case RDO_PG_INETOID:
+      return rdo_postgres_cast_inet(value, length);
+
+    case RDO_PG_CIDROID:
+      return rdo_postgres_cast_cidr(value, length);
+
+    case RDO_PG_MONEYOID:
+      return rdo_postgres_cast_money(value, length);
+
     case RDO_PG_TEXTARRAYOID:
     case RDO_PG_CHARARRAYOID:
     case RDO_PG_BPCHARARRAYOID:
     case RDO_PG_VARCHARARRAYOID:
+    case RDO_PG_UUIDARRAYOID:
+    case RDO_PG_TIMEARRAYOID:
+    case RDO_PG_TIMETZARRAYOID:
+    case RDO_PG_JSONARRAYOID:
+    case RDO_PG_JSONBARRAYOID:
       return RDO_PG_ARRAY("Text", value, length);
 
     case RDO_PG_INT2ARRAYOID:
@@ -147,6 +576,39 @@ VALUE rdo_postgres_cast_value(PGresult * res, int row, int col, int enc) {
     case RDO_PG_TIMESTAMPTZARRAYOID:
       return RDO_PG_ARRAY("TimestampTZ", value, length);
 
+    case RDO_PG_INTERVALARRAYOID:
+      return RDO_PG_ARRAY("Interval", value, length);
+
+    case RDO_PG_INETARRAYOID:
+      return RDO_PG_ARRAY("Inet", value, length);
+
+    case RDO_PG_CIDRARRAYOID:
+      return RDO_PG_ARRAY("Cidr", value, length);
+
+    case RDO_PG_MONEYARRAYOID:
+      return RDO_PG_ARRAY("Money", value, length);
+
+    case RDO_PG_RECORDOID:
+      return rdo_postgres_cast_composite(value, length, Qnil, enc, flags);
+
+    case RDO_PG_INT4RANGEOID:
+      return rdo_postgres_cast_range(value, length, RDO_PG_INT4OID, enc, flags);
+
+    case RDO_PG_INT8RANGEOID:
+      return rdo_postgres_cast_range(value, length, RDO_PG_INT8OID, enc, flags);
+
+    case RDO_PG_NUMRANGEOID:
+      return rdo_postgres_cast_range(value, length, RDO_PG_NUMERICOID, enc, flags);
+
+    case RDO_PG_DATERANGEOID:
+      return rdo_postgres_cast_range(value, length, RDO_PG_DATEOID, enc, flags);
+
+    case RDO_PG_TSRANGEOID:
+      return rdo_postgres_cast_range(value, length, RDO_PG_TIMESTAMPOID, enc, flags);
+
+    case RDO_PG_TSTZRANGEOID:
+      return rdo_postgres_cast_range(value, length, RDO_PG_TIMESTAMPTZOID, enc, flags);
+
     default:
       return RDO_BINARY_STRING(value, length);
   }
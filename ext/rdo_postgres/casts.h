@@ -9,11 +9,54 @@
 #include <ruby.h>
 #include <libpq-fe.h>
 
+/** Flag for rdo_postgres_cast_value() to parse json/jsonb into Hash/Array */
+#define RDO_PG_CAST_PARSE_JSON 1
+
 /** Cast the given value from the result to a ruby type */
-VALUE rdo_postgres_cast_value(PGresult * res, int row, int col, int enc);
+VALUE rdo_postgres_cast_value(PGresult * res, int row, int col, int enc, int flags);
+
+/** Cast the given value as if its column had the given type */
+VALUE rdo_postgres_cast_typed_value(PGresult * res, int row, int col, Oid type,
+    int enc, int flags);
+
+/** Cast a non-NULL, NUL-terminated value of the given type */
+VALUE rdo_postgres_cast_raw_value(char * value, int length, Oid type,
+    int enc, int flags);
 
 /** Special case for casting a bytea value */
 VALUE rdo_postgres_cast_bytea(char * escaped, size_t len);
 
+/** Cast an interval to a RDO::Postgres::Interval */
+VALUE rdo_postgres_cast_interval(char * s, size_t len, int enc);
+
+/** Cast an inet value to a RDO::Postgres::Inet, keeping its host address */
+VALUE rdo_postgres_cast_inet(char * s, size_t len);
+
+/** Cast a cidr value to an IPAddr */
+VALUE rdo_postgres_cast_cidr(char * s, size_t len);
+
+/** Cast a money value to a BigDecimal */
+VALUE rdo_postgres_cast_money(char * s, size_t len);
+
+/** Cast an hstore to a Hash */
+VALUE rdo_postgres_cast_hstore(char * s, size_t len, int enc);
+
+/** Cast a composite to a Hash of its fields, or an Array for an anonymous record */
+VALUE rdo_postgres_cast_composite(char * s, size_t len, VALUE fields,
+    int enc, int flags);
+
+/** Cast a range to a RDO::Postgres::Range, casting its bounds as subtype */
+VALUE rdo_postgres_cast_range(char * s, size_t len, Oid subtype,
+    int enc, int flags);
+
+/**
+ * Cast a non-NULL, NUL-terminated value with a decoder from the type map.
+ *
+ * The decoder is a built-in Oid, :hstore, or an Array of [name, decoder]
+ * pairs for the fields of a composite type.
+ */
+VALUE rdo_postgres_cast_decoded_value(char * value, int length, VALUE decoder,
+    int enc, int flags);
+
 /** Initialize the casting framework */
 void Init_rdo_postgres_casts(void);
@@ -7,16 +7,45 @@
 
 #include "driver.h"
 #include "statements.h"
+#include "largeobject.h"
+#include "prefetch.h"
+#include "replication.h"
+#include "casts.h"
+#include "literals.h"
 #include "macros.h"
 #include <ruby.h>
+#include <ruby/io.h>
+#include <ruby/thread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/socket.h>
 #include <postgres.h>
 
+/** Keep hold of Ruby objects referenced by the driver during GC */
+static void rdo_postgres_driver_mark(RDOPostgresDriver * driver) {
+  rb_gc_mark(driver->intern_columns);
+  rb_gc_mark(driver->type_map);
+  rb_gc_mark(driver->explain_sampler);
+}
+
+/** Forget queued DEALLOCATEs, e.g. when the connection is closed */
+static void rdo_postgres_driver_clear_deallocations(RDOPostgresDriver * driver) {
+  int i = 0;
+  for (; i < driver->dealloc_count; ++i)
+    free(driver->dealloc_names[i]);
+
+  driver->dealloc_count = 0;
+}
+
 /** During GC, free any stranded connection */
 static void rdo_postgres_driver_free(RDOPostgresDriver * driver) {
   if (driver->ref_count > 0)
     return;
 
+  rdo_postgres_driver_clear_deallocations(driver);
+  free(driver->dealloc_names);
+
   PQfinish(driver->conn_ptr);
   driver->is_open  = 0;
   driver->conn_ptr = NULL;
@@ -34,57 +63,215 @@ static VALUE rdo_postgres_driver_allocate(VALUE klass) {
   driver->ref_count  = 0;
   driver->is_open    = 0;
   driver->stmt_count = 0;
+  driver->generation = 0;
   driver->encoding   = -1;
 
-  VALUE self = Data_Wrap_Struct(klass, 0,
+  driver->dealloc_names    = NULL;
+  driver->dealloc_count    = 0;
+  driver->dealloc_capacity = 0;
+
+  driver->intern_limit   = 0;
+  driver->intern_columns = Qnil;
+  driver->cast_flags     = 0;
+
+  driver->consume_results = 0;
+  driver->simple_query    = 0;
+  driver->decode_threads  = 0;
+  driver->query_timeout   = 0;
+  driver->has_deadline    = 0;
+  driver->in_transaction  = 0;
+  driver->type_map        = Qnil;
+  driver->explain_sampler = Qnil;
+
+  VALUE self = Data_Wrap_Struct(klass, rdo_postgres_driver_mark,
       rdo_postgres_driver_free, driver);
 
   return self;
 }
 
+/** State for connecting with PQconnectStart() and PQconnectPoll() */
+typedef struct {
+  PGconn         * conn;
+  struct timeval * deadline;
+} RDOPostgresConnect;
+
+/** Close a connection that failed to open and raise with its error message */
+static void rdo_postgres_driver_connect_failed(PGconn * conn, const char * reason) {
+  VALUE msg = rb_str_new2(reason == NULL ? PQerrorMessage(conn) : reason);
+  PQfinish(conn);
+  RDO_ERROR("PostgreSQL connection failed: %s", RSTRING_PTR(msg));
+}
+
+/**
+ * Poll until the connection is made, failed or the deadline passed.
+ *
+ * The GVL is released while waiting on the socket, so other threads can
+ * connect at the same time.
+ */
+static VALUE rdo_postgres_driver_connect_poll(VALUE arg) {
+  RDOPostgresConnect        * connect = (RDOPostgresConnect *) arg;
+  PostgresPollingStatusType   status  = PGRES_POLLING_WRITING;
+  struct timeval              now;
+  struct timeval              remaining;
+  struct timeval            * timeout = NULL;
+  int                         ready;
+
+  while (status == PGRES_POLLING_READING || status == PGRES_POLLING_WRITING) {
+    if (PQstatus(connect->conn) == CONNECTION_BAD) {
+      return Qfalse;
+    }
+
+    if (connect->deadline != NULL) {
+      gettimeofday(&now, NULL);
+      if (!timercmp(&now, connect->deadline, <)) {
+        return Qnil;
+      }
+      timersub(connect->deadline, &now, &remaining);
+      timeout = &remaining;
+    }
+
+    ready = rb_wait_for_single_fd(PQsocket(connect->conn),
+        status == PGRES_POLLING_READING ? RB_WAITFD_IN : RB_WAITFD_OUT,
+        timeout);
+
+    if (ready < 0) {
+      rb_sys_fail("rb_wait_for_single_fd()");
+    } else if (ready > 0) {
+      status = PQconnectPoll(connect->conn);
+    }
+  }
+
+  return status == PGRES_POLLING_OK ? Qtrue : Qfalse;
+}
+
+/**
+ * Open a new connection without blocking other threads.
+ *
+ * Honours the connect_timeout the driver was given, which libpq itself only
+ * applies to blocking connects.
+ */
+static PGconn * rdo_postgres_driver_connect(VALUE self) {
+  VALUE              conninfo = rb_funcall(self, rb_intern("connect_db_string"), 0);
+  VALUE              seconds  = rb_funcall(self, rb_intern("connect_timeout"), 0);
+  struct timeval     deadline;
+  struct timeval     interval;
+  RDOPostgresConnect connect;
+  VALUE              connected;
+  int                state = 0;
+
+  connect.conn     = PQconnectStart(StringValueCStr(conninfo));
+  connect.deadline = NULL;
+
+  if (connect.conn == NULL) {
+    RDO_ERROR("PostgreSQL connection failed: out of memory");
+  }
+
+  if (!NIL_P(seconds)) {
+    interval = rb_time_interval(seconds);
+    gettimeofday(&deadline, NULL);
+    timeradd(&deadline, &interval, &deadline);
+    connect.deadline = &deadline;
+  }
+
+  connected = rb_protect(rdo_postgres_driver_connect_poll, (VALUE) &connect, &state);
+
+  if (state) {
+    PQfinish(connect.conn);
+    rb_jump_tag(state);
+  } else if (NIL_P(connected)) {
+    rdo_postgres_driver_connect_failed(connect.conn, "timeout expired");
+  } else if (!RTEST(connected)) {
+    rdo_postgres_driver_connect_failed(connect.conn, NULL);
+  }
+
+  return connect.conn;
+}
+
+/** Disconnect from the postgres server, and release memory */
+static VALUE rdo_postgres_driver_close(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  // the sampler's thread and connection are started again when next needed
+  if (!NIL_P(driver->explain_sampler)) {
+    rb_funcall(driver->explain_sampler, rb_intern("stop"), 0);
+  }
+
+  PQfinish(driver->conn_ptr);
+  driver->conn_ptr   = NULL;
+  driver->is_open    = 0;
+  driver->encoding   = -1;
+
+  rdo_postgres_driver_clear_deallocations(driver);
+
+  return Qtrue;
+}
+
 /** Connect to the postgres server */
 static VALUE rdo_postgres_driver_open(VALUE self) {
   RDOPostgresDriver * driver;
   Data_Get_Struct(self, RDOPostgresDriver, driver);
 
   if (driver->is_open) {
-    return Qtrue;
+    if (PQstatus(driver->conn_ptr) != CONNECTION_BAD) {
+      return Qtrue;
+    }
+
+    // e.g. shut down after an unanswered cancel; reconnect
+    rdo_postgres_driver_close(self);
   }
 
-  driver->conn_ptr = PQconnectdb(
-      RSTRING_PTR(rb_funcall(self, rb_intern("connect_db_string"), 0)));
+  driver->conn_ptr = rdo_postgres_driver_connect(self);
 
-  if (driver->conn_ptr == NULL || PQstatus(driver->conn_ptr) == CONNECTION_BAD) {
-    RDO_ERROR("PostgreSQL connection failed: %s",
-        PQerrorMessage(driver->conn_ptr));
-  } else if (PQprotocolVersion(driver->conn_ptr) < 3) {
+  if (PQprotocolVersion(driver->conn_ptr) < 3) {
     RDO_ERROR("rdo-postgres requires PostgreSQL protocol version >= 3 (using %u). "
         "PostgreSQL >= 7.4 required.",
         PQprotocolVersion(driver->conn_ptr));
   } else {
     PQsetNoticeProcessor(driver->conn_ptr, &rdo_postgres_driver_notice_processor, NULL);
     driver->is_open    = 1;
-    driver->stmt_count = 0;
+    driver->generation++;
+    driver->in_transaction = 0;
     driver->encoding   = rb_enc_find_index(
         RSTRING_PTR(rb_funcall(self, rb_intern("encoding"), 0)));
+    driver->intern_limit   = NUM2INT(
+        rb_funcall(self, rb_intern("intern_strings_limit"), 0));
+    driver->intern_columns = rb_funcall(self, rb_intern("intern_strings_columns"), 0);
+    driver->cast_flags     = 0;
+    if (RTEST(rb_funcall(self, rb_intern("parse_json?"), 0)))
+      driver->cast_flags |= RDO_PG_CAST_PARSE_JSON;
+    driver->consume_results = RTEST(
+        rb_funcall(self, rb_intern("consume_results?"), 0));
+    driver->simple_query    = RTEST(
+        rb_funcall(self, rb_intern("simple_query?"), 0));
+    driver->decode_threads  = NUM2INT(
+        rb_funcall(self, rb_intern("decode_threads"), 0));
+    driver->query_timeout   = NUM2DBL(
+        rb_funcall(self, rb_intern("default_query_timeout"), 0));
     rb_funcall(self, rb_intern("after_open"), 0);
   }
 
   return Qtrue;
 }
 
-/** Disconnect from the postgres server, and release memory */
-static VALUE rdo_postgres_driver_close(VALUE self) {
-  RDOPostgresDriver * driver;
-  Data_Get_Struct(self, RDOPostgresDriver, driver);
-
-  PQfinish(driver->conn_ptr);
-  driver->conn_ptr   = NULL;
-  driver->is_open    = 0;
-  driver->stmt_count = 0;
-  driver->encoding   = -1;
-
-  return Qtrue;
+/**
+ * Reopen a connection that was shut down, e.g. after an unanswered cancel.
+ *
+ * If it was lost inside a transaction block, later statements would run
+ * outside it, so an error is raised instead, until #open is called.
+ */
+static void rdo_postgres_driver_reopen_if_broken(VALUE self, RDOPostgresDriver * driver) {
+  if (driver->is_open && PQstatus(driver->conn_ptr) == CONNECTION_BAD) {
+    if (driver->in_transaction) {
+      RDO_ERROR("The connection was lost inside a transaction; "
+          "call #open to reconnect");
+    }
+
+    // a timeout set with #query_timeout= outlives the reopen
+    double query_timeout = driver->query_timeout;
+    rdo_postgres_driver_open(self);
+    driver->query_timeout = query_timeout;
+  }
 }
 
 /** Preciate test if connection is open */
@@ -94,21 +281,51 @@ static VALUE rdo_postgres_driver_open_p(VALUE self) {
   return driver->is_open ? Qtrue : Qfalse;
 }
 
-/** Prepare a statement for execution */
-static VALUE rdo_postgres_driver_prepare(VALUE self, VALUE cmd) {
+/** Predicate test if the connection is inside a transaction block */
+static VALUE rdo_postgres_driver_in_transaction_p(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open)) {
+    return Qfalse;
+  }
+
+  return PQtransactionStatus(driver->conn_ptr) == PQTRANS_IDLE ? Qfalse : Qtrue;
+}
+
+/**
+ * Prepare a statement for execution.
+ *
+ * If deferred is true, the statement is prepared on its first execution, in
+ * the same round trip as that execution. In simple query mode nothing is
+ * prepared, and a SimpleStatement is returned instead.
+ */
+static VALUE rdo_postgres_driver_prepare(int argc, VALUE * args, VALUE self) {
+  VALUE cmd;
+  VALUE deferred;
+
+  rb_scan_args(argc, args, "11", &cmd, &deferred);
   Check_Type(cmd, T_STRING);
 
   RDOPostgresDriver * driver;
   Data_Get_Struct(self, RDOPostgresDriver, driver);
 
+  rdo_postgres_driver_reopen_if_broken(self, driver);
+
   if (!(driver->is_open)) {
     RDO_ERROR("Unable to prepare statement: connection is not open");
   }
 
+  if (driver->simple_query) {
+    return rb_funcall(rb_path2class("RDO::Postgres::SimpleStatement"),
+        rb_intern("new"), 2, self, cmd);
+  }
+
   char name[32];
   sprintf(name, "rdo_stmt_%i", ++driver->stmt_count);
 
-  return rdo_postgres_statement_executor_new(self, cmd, rb_str_new2(name));
+  return rdo_postgres_statement_executor_new(self, cmd, rb_str_new2(name),
+      RTEST(deferred));
 }
 
 /** Quote a string literal for safe insertion in a statement */
@@ -126,15 +343,521 @@ static VALUE rdo_postgres_driver_quote(VALUE self, VALUE str) {
     RDO_ERROR("Unable to quote string: connection is not open");
   }
 
-  char * quoted = malloc(sizeof(char) * RSTRING_LEN(str) * 2 + 1);
-  PQescapeStringConn(driver->conn_ptr, quoted,
-      RSTRING_PTR(str), RSTRING_LEN(str), NULL);
+  return rdo_postgres_literal_escape(driver, str);
+}
+
+/**
+ * Execute sql through the simple query protocol, with args interpolated.
+ *
+ * sql may hold several statements separated by semicolons, which are sent in
+ * a single round trip. The result of the last one is returned.
+ */
+static VALUE rdo_postgres_driver_simple_execute(int argc, VALUE * args, VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (argc < 1) {
+    rb_raise(rb_eArgError, "wrong number of arguments (0 for 1+)");
+  }
+
+  rdo_postgres_driver_reopen_if_broken(self, driver);
+
+  if (!(driver->is_open)) {
+    RDO_ERROR("Unable to execute statement: connection is not open");
+  }
+
+  VALUE      sql = rdo_postgres_literal_interpolate(driver, args[0], argc - 1, args + 1);
+  PGresult * res;
+
+  rdo_postgres_driver_start_deadline(driver);
+
+  res = rdo_postgres_driver_exec_result(driver,
+      PQsendQuery(driver->conn_ptr, StringValueCStr(sql)));
+
+  switch (PQresultStatus(res)) {
+    case PGRES_BAD_RESPONSE:
+    case PGRES_FATAL_ERROR:
+      {
+        char msg[sizeof(char) * (strlen(PQresultErrorMessage(res)) + 1)];
+        strcpy(msg, PQresultErrorMessage(res));
+        PQclear(res);
+        RDO_ERROR("Failed to execute statement: %s", msg);
+      }
+
+    default:
+      return rdo_postgres_statements_result_new(driver, res);
+  }
+}
+
+/** Add a statement name to the DEALLOCATE queue (called during GC) */
+void rdo_postgres_driver_defer_deallocate(RDOPostgresDriver * driver, char * stmt_name) {
+  if (driver->dealloc_count == driver->dealloc_capacity) {
+    int     capacity = driver->dealloc_capacity ? driver->dealloc_capacity * 2 : RDO_PG_DEALLOCATE_BATCH;
+    char ** names    = realloc(driver->dealloc_names, sizeof(char *) * capacity);
+
+    if (names == NULL) { // leave the statement allocated rather than fail in GC
+      free(stmt_name);
+      return;
+    }
+
+    driver->dealloc_names    = names;
+    driver->dealloc_capacity = capacity;
+  }
+
+  driver->dealloc_names[driver->dealloc_count++] = stmt_name;
+}
+
+/**
+ * Send all queued DEALLOCATEs as one multi-statement query.
+ *
+ * The server stops at the first statement that fails, so each result read
+ * accounts for one name, and any names after the failing one are kept queued
+ * for the next flush.
+ */
+void rdo_postgres_driver_flush_deallocations(RDOPostgresDriver * driver, int force) {
+  if (driver->dealloc_count == 0
+      || (!force && driver->dealloc_count < RDO_PG_DEALLOCATE_BATCH)) {
+    return;
+  }
+
+  // DEALLOCATE would fail inside an aborted transaction; wait for it to end
+  if (PQtransactionStatus(driver->conn_ptr) == PQTRANS_INERROR) {
+    return;
+  }
+
+  size_t     len = 1;
+  int        processed = 0;
+  int        i;
+  PGresult * res;
+
+  for (i = 0; i < driver->dealloc_count; ++i)
+    len += strlen(driver->dealloc_names[i]) + 12;
+
+  char * cmd = malloc(sizeof(char) * len);
+  char * c   = cmd;
+
+  if (cmd == NULL) {
+    rb_raise(rb_eNoMemError,
+        "Failed to allocate %ld bytes for DEALLOCATE", len);
+  }
+
+  for (i = 0; i < driver->dealloc_count; ++i)
+    c += sprintf(c, "DEALLOCATE %s;", driver->dealloc_names[i]);
+
+  if (!PQsendQuery(driver->conn_ptr, cmd)) {
+    free(cmd);
+    return;
+  }
+
+  free(cmd);
+
+  while ((res = PQgetResult(driver->conn_ptr)) != NULL) {
+    ++processed;
+    PQclear(res);
+  }
+
+  for (i = 0; i < processed && i < driver->dealloc_count; ++i)
+    free(driver->dealloc_names[i]);
+
+  driver->dealloc_count -= i;
+  memmove(driver->dealloc_names, driver->dealloc_names + i,
+      sizeof(char *) * driver->dealloc_count);
+}
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+
+/**
+ * Send each queued DEALLOCATE on the pipeline, rather than in its own round trip.
+ *
+ * Each is followed by its own sync, so one that fails cannot abort the rest.
+ */
+int rdo_postgres_driver_pipeline_deallocations(RDOPostgresDriver * driver) {
+  if (PQtransactionStatus(driver->conn_ptr) == PQTRANS_INERROR) {
+    return 0;
+  }
+
+  int sent = 0;
+  int i    = 0;
+
+  for (; i < driver->dealloc_count; ++i) {
+    char cmd[strlen(driver->dealloc_names[i]) + 12];
+    sprintf(cmd, "DEALLOCATE %s", driver->dealloc_names[i]);
+
+    if (PQsendQueryParams(driver->conn_ptr, cmd, 0, NULL, NULL, NULL, NULL, 0)
+        && PQpipelineSync(driver->conn_ptr)) {
+      ++sent;
+    }
+  }
+
+  rdo_postgres_driver_clear_deallocations(driver);
+
+  return sent;
+}
+
+#endif
+
+/** Block on the socket until it is readable or timeout passes */
+int rdo_postgres_driver_wait_readable(RDOPostgresDriver * driver, struct timeval * timeout) {
+  int sock = PQsocket(driver->conn_ptr);
+
+  if (sock < 0) {
+    RDO_ERROR("Unable to wait on connection: %s", PQerrorMessage(driver->conn_ptr));
+  }
+
+  int ready = rb_wait_for_single_fd(sock, RB_WAITFD_IN, timeout);
+
+  if (ready < 0) {
+    rb_sys_fail("rb_wait_for_single_fd()");
+  }
+
+  return ready != 0;
+}
+
+/** Read any pending input from the server, raising if the connection failed */
+static void rdo_postgres_driver_consume_input(RDOPostgresDriver * driver) {
+  if (!PQconsumeInput(driver->conn_ptr)) {
+    RDO_ERROR("Failed to read from connection: %s",
+        PQerrorMessage(driver->conn_ptr));
+  }
+}
+
+/** Set the deadline for the current call, from the query_timeout */
+void rdo_postgres_driver_start_deadline(RDOPostgresDriver * driver) {
+  struct timeval interval;
+
+  driver->has_deadline = driver->query_timeout > 0;
+
+  // kept as it was if the connection is already lost
+  if (driver->conn_ptr != NULL && PQstatus(driver->conn_ptr) != CONNECTION_BAD) {
+    driver->in_transaction = PQtransactionStatus(driver->conn_ptr) != PQTRANS_IDLE;
+  }
+
+  if (driver->has_deadline) {
+    interval.tv_sec  = (time_t) driver->query_timeout;
+    interval.tv_usec = (suseconds_t) ((driver->query_timeout - interval.tv_sec) * 1e6);
+    gettimeofday(&(driver->deadline), NULL);
+    timeradd(&(driver->deadline), &interval, &(driver->deadline));
+  }
+}
+
+/**
+ * Wait until PQgetResult() will not block, or deadline (if not NULL) passes.
+ *
+ * Returns 0 on timeout. Connection failures return 1, so that PQgetResult()
+ * reports them.
+ */
+static int rdo_postgres_driver_await(RDOPostgresDriver * driver,
+    struct timeval * deadline) {
+
+  struct timeval   now;
+  struct timeval   remaining;
+  struct timeval * timeout = NULL;
+
+  for (;;) {
+    if (!PQconsumeInput(driver->conn_ptr) || !PQisBusy(driver->conn_ptr)) {
+      return 1;
+    }
+
+    if (deadline != NULL) {
+      gettimeofday(&now, NULL);
+      if (!timercmp(&now, deadline, <)) {
+        return 0;
+      }
+      timersub(deadline, &now, &remaining);
+      timeout = &remaining;
+    }
+
+    rdo_postgres_driver_wait_readable(driver, timeout);
+  }
+}
+
+/** Arguments for PQcancel() called without the GVL */
+typedef struct {
+  PGcancel * cancel;
+  char       errbuf[256];
+  int        sent;
+} RDOPostgresCancel;
+
+/** PQcancel() opens a new connection to the server, so runs without the GVL */
+static void * rdo_postgres_driver_cancel_without_gvl(void * arg) {
+  RDOPostgresCancel * cancel = (RDOPostgresCancel *) arg;
+  cancel->sent = PQcancel(cancel->cancel, cancel->errbuf, sizeof(cancel->errbuf));
+  return NULL;
+}
+
+/**
+ * Cancel the running query and read its results, so the connection can be
+ * used again.
+ *
+ * If that takes longer than RDO_PG_CANCEL_GRACE seconds, the socket is shut
+ * down, and 0 is returned. The connection is then reopened on next use.
+ */
+static int rdo_postgres_driver_cancel_and_drain(RDOPostgresDriver * driver) {
+  RDOPostgresCancel cancel = { .cancel = PQgetCancel(driver->conn_ptr), .sent = 0 };
+  struct timeval    grace  = { .tv_sec = RDO_PG_CANCEL_GRACE, .tv_usec = 0 };
+  struct timeval    deadline;
+  PGresult        * res;
+
+  driver->has_deadline = 0;
+
+  if (cancel.cancel != NULL) {
+    rb_thread_call_without_gvl(rdo_postgres_driver_cancel_without_gvl, &cancel,
+        NULL, NULL);
+    PQfreeCancel(cancel.cancel);
+  }
+
+  gettimeofday(&deadline, NULL);
+  timeradd(&deadline, &grace, &deadline);
+
+  if (cancel.sent) {
+    while (rdo_postgres_driver_await(driver, &deadline)) {
+      if ((res = PQgetResult(driver->conn_ptr)) == NULL) {
+        return 1;
+      }
+      PQclear(res);
+    }
+  }
+
+  shutdown(PQsocket(driver->conn_ptr), SHUT_RDWR);
+  PQconsumeInput(driver->conn_ptr);
+
+  return 0;
+}
+
+/** Cancel the running query and raise RDO::Postgres::TimeoutError */
+static void rdo_postgres_driver_cancel(RDOPostgresDriver * driver) {
+  if (!rdo_postgres_driver_cancel_and_drain(driver)) {
+    rb_raise(rb_path2class("RDO::Postgres::TimeoutError"),
+        "Query timed out after %gs and could not be cancelled; "
+        "the connection has been closed", driver->query_timeout);
+  }
+
+  rb_raise(rb_path2class("RDO::Postgres::TimeoutError"),
+      "Query timed out after %gs and was cancelled", driver->query_timeout);
+}
+
+void rdo_postgres_driver_abandon(RDOPostgresDriver * driver) {
+  if (driver->conn_ptr == NULL || PQstatus(driver->conn_ptr) == CONNECTION_BAD
+      || PQtransactionStatus(driver->conn_ptr) != PQTRANS_ACTIVE) {
+    return;
+  }
 
-  VALUE newstr = rb_str_new2(quoted);
+  rdo_postgres_driver_cancel_and_drain(driver);
+}
+
+/** Wait for the next result without the GVL, cancelling at the deadline */
+PGresult * rdo_postgres_driver_get_result(RDOPostgresDriver * driver) {
+  if (!rdo_postgres_driver_await(driver,
+        driver->has_deadline ? &(driver->deadline) : NULL)) {
+    rdo_postgres_driver_cancel(driver);
+  }
+
+  return PQgetResult(driver->conn_ptr);
+}
+
+/** State shared between exec_result() and its ensure block */
+typedef struct {
+  RDOPostgresDriver * driver;
+  PGresult          * last;
+  int                 done;
+} RDOPostgresExec;
+
+/** Read every result of the query, keeping the first error or the last result */
+static VALUE rdo_postgres_driver_exec_read(VALUE arg) {
+  RDOPostgresExec * exec = (RDOPostgresExec *) arg;
+  PGresult        * res;
+
+  while ((res = rdo_postgres_driver_get_result(exec->driver)) != NULL) {
+    if (exec->last != NULL && PQresultStatus(exec->last) == PGRES_FATAL_ERROR) {
+      PQclear(res);
+    } else {
+      PQclear(exec->last);
+      exec->last = res;
+    }
+  }
+
+  exec->done = 1;
+
+  return Qnil;
+}
+
+/** Ensure block for exec_read(), cancelling the query if it was interrupted */
+static VALUE rdo_postgres_driver_exec_read_ensure(VALUE arg) {
+  RDOPostgresExec * exec = (RDOPostgresExec *) arg;
+
+  if (!exec->done) {
+    PQclear(exec->last);
+    exec->last = NULL;
+    rdo_postgres_driver_abandon(exec->driver);
+  }
+
+  return Qnil;
+}
+
+/** Read all results of a sent query, like PQexec() */
+PGresult * rdo_postgres_driver_exec_result(RDOPostgresDriver * driver, int sent) {
+  RDOPostgresExec exec = { .driver = driver, .last = NULL, .done = 0 };
+
+  if (!sent) {
+    return PQmakeEmptyPGresult(driver->conn_ptr, PGRES_FATAL_ERROR);
+  }
+
+  rb_ensure(
+      rdo_postgres_driver_exec_read, (VALUE) &exec,
+      rdo_postgres_driver_exec_read_ensure, (VALUE) &exec);
+
+  if (exec.last == NULL) {
+    return PQmakeEmptyPGresult(driver->conn_ptr, PGRES_FATAL_ERROR);
+  }
+
+  return exec.last;
+}
+
+/** Seconds a query may run before it is cancelled, or nil for no limit */
+static VALUE rdo_postgres_driver_query_timeout(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+  return driver->query_timeout > 0 ? DBL2NUM(driver->query_timeout) : Qnil;
+}
 
-  free(quoted);
+/** Set the seconds a query may run before it is cancelled (nil for no limit) */
+static VALUE rdo_postgres_driver_set_query_timeout(VALUE self, VALUE seconds) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
 
-  return newstr;
+  driver->query_timeout = NIL_P(seconds) ? 0 : NUM2DBL(seconds);
+
+  if (driver->query_timeout < 0) {
+    rb_raise(rb_eArgError, "query_timeout must not be negative");
+  }
+
+  return seconds;
+}
+
+/** Look up type in the type_map, which only holds types that resolve elsewhere */
+Oid rdo_postgres_driver_resolve_type(RDOPostgresDriver * driver, Oid type) {
+  if (NIL_P(driver->type_map)) {
+    return type;
+  }
+
+  VALUE resolved = rb_hash_lookup2(driver->type_map, UINT2NUM(type), Qnil);
+
+  return RB_INTEGER_TYPE_P(resolved) ? NUM2UINT(resolved) : type;
+}
+
+/** Look up a decoder (e.g. the fields of a composite) in the type_map */
+VALUE rdo_postgres_driver_type_decoder(RDOPostgresDriver * driver, Oid type) {
+  if (NIL_P(driver->type_map)) {
+    return Qnil;
+  }
+
+  VALUE decoder = rb_hash_lookup2(driver->type_map, UINT2NUM(type), Qnil);
+
+  return RB_INTEGER_TYPE_P(decoder) ? Qnil : decoder;
+}
+
+/** Set the Hash of type Oid => built-in type Oid used to decode results */
+static VALUE rdo_postgres_driver_set_type_map(VALUE self, VALUE map) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!NIL_P(map)) {
+    Check_Type(map, T_HASH);
+  }
+
+  driver->type_map = map;
+
+  return map;
+}
+
+/** Set the ExplainSampler told how long each StatementExecutor#execute takes */
+static VALUE rdo_postgres_driver_set_explain_sampler(VALUE self, VALUE sampler) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+  driver->explain_sampler = sampler;
+  return sampler;
+}
+
+/** Convert a PGnotify into a Hash of :channel, :payload and :pid */
+static VALUE rdo_postgres_driver_notify_to_hash(RDOPostgresDriver * driver,
+    PGnotify * notify) {
+
+  VALUE hash = rb_hash_new();
+
+  rb_hash_aset(hash, ID2SYM(rb_intern("channel")),
+      RDO_STRING(notify->relname, strlen(notify->relname), driver->encoding));
+  rb_hash_aset(hash, ID2SYM(rb_intern("payload")),
+      RDO_STRING(notify->extra, strlen(notify->extra), driver->encoding));
+  rb_hash_aset(hash, ID2SYM(rb_intern("pid")), INT2NUM(notify->be_pid));
+
+  PQfreemem(notify);
+
+  return hash;
+}
+
+/** Return all notifications received so far, without blocking */
+static VALUE rdo_postgres_driver_notifications(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open)) {
+    RDO_ERROR("Unable to read notifications: connection is not open");
+  }
+
+  VALUE      list = rb_ary_new();
+  PGnotify * notify;
+
+  rdo_postgres_driver_consume_input(driver);
+
+  while ((notify = PQnotifies(driver->conn_ptr)) != NULL) {
+    rb_ary_push(list, rdo_postgres_driver_notify_to_hash(driver, notify));
+  }
+
+  return list;
+}
+
+/** Block until a notification arrives, or timeout seconds pass */
+static VALUE rdo_postgres_driver_wait_for_notify(int argc, VALUE * args, VALUE self) {
+  VALUE timeout_secs;
+  rb_scan_args(argc, args, "01", &timeout_secs);
+
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open)) {
+    RDO_ERROR("Unable to wait for notifications: connection is not open");
+  }
+
+  struct timeval   deadline;
+  struct timeval   now;
+  struct timeval   remaining;
+  struct timeval * timeout = NULL;
+  PGnotify       * notify;
+
+  if (!NIL_P(timeout_secs)) {
+    gettimeofday(&now, NULL);
+    remaining = rb_time_interval(timeout_secs);
+    timeradd(&now, &remaining, &deadline);
+    timeout = &remaining;
+  }
+
+  for (;;) {
+    rdo_postgres_driver_consume_input(driver);
+
+    if ((notify = PQnotifies(driver->conn_ptr)) != NULL) {
+      return rdo_postgres_driver_notify_to_hash(driver, notify);
+    }
+
+    if (timeout != NULL) {
+      gettimeofday(&now, NULL);
+      if (!timercmp(&now, &deadline, <)) {
+        return Qnil;
+      }
+      timersub(&deadline, &now, &remaining);
+    }
+
+    rdo_postgres_driver_wait_readable(driver, timeout);
+  }
 }
 
 void Init_rdo_postgres_driver(void) {
@@ -160,11 +883,46 @@ void Init_rdo_postgres_driver(void) {
 
   rb_define_method(
       cPostgresConnection,
-      "prepare", rdo_postgres_driver_prepare, 1);
+      "in_transaction?", rdo_postgres_driver_in_transaction_p, 0);
+
+  rb_define_method(
+      cPostgresConnection,
+      "prepare", rdo_postgres_driver_prepare, -1);
 
   rb_define_method(
       cPostgresConnection,
       "quote", rdo_postgres_driver_quote, 1);
 
+  rb_define_method(
+      cPostgresConnection,
+      "query_timeout", rdo_postgres_driver_query_timeout, 0);
+
+  rb_define_method(
+      cPostgresConnection,
+      "query_timeout=", rdo_postgres_driver_set_query_timeout, 1);
+
+  rb_define_private_method(
+      cPostgresConnection,
+      "read_notifications", rdo_postgres_driver_notifications, 0);
+
+  rb_define_private_method(
+      cPostgresConnection,
+      "type_map=", rdo_postgres_driver_set_type_map, 1);
+
+  rb_define_private_method(
+      cPostgresConnection,
+      "simple_execute", rdo_postgres_driver_simple_execute, -1);
+
+  rb_define_private_method(
+      cPostgresConnection,
+      "explain_sampler=", rdo_postgres_driver_set_explain_sampler, 1);
+
+  rb_define_private_method(
+      cPostgresConnection,
+      "wait_for_notification", rdo_postgres_driver_wait_for_notify, -1);
+
   Init_rdo_postgres_statements();
+  Init_rdo_postgres_large_objects();
+  Init_rdo_postgres_prefetch();
+  Init_rdo_postgres_replication();
 }
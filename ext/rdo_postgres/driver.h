@@ -5,8 +5,18 @@
  * See LICENSE file for details.
  */
 
+#ifndef RDO_POSTGRES_DRIVER_H
+#define RDO_POSTGRES_DRIVER_H
+
 #include <ruby.h>
 #include <libpq-fe.h>
+#include <sys/time.h>
+
+/** Number of deferred DEALLOCATEs that forces them to be sent */
+#define RDO_PG_DEALLOCATE_BATCH 16
+
+/** Seconds to wait for a cancelled query to end before dropping the connection */
+#define RDO_PG_CANCEL_GRACE 5
 
 /** Struct that RDO::Postgres::Driver wraps */
 typedef struct {
@@ -14,8 +24,114 @@ typedef struct {
   int      ref_count;
   int      is_open;
   int      stmt_count;
+  int      generation;
   int      encoding;
+  int      intern_limit;
+  VALUE    intern_columns;
+  int      cast_flags;
+  int      consume_results;
+  int      simple_query;
+  int      decode_threads;
+  double   query_timeout;
+  int      has_deadline;
+  struct timeval deadline;
+  int      in_transaction;
+  VALUE    type_map;
+  VALUE    explain_sampler;
+  char  ** dealloc_names;
+  int      dealloc_count;
+  int      dealloc_capacity;
 } RDOPostgresDriver;
 
+/**
+ * Queue a prepared statement name to be deallocated later.
+ *
+ * This is safe to call during GC. The driver takes ownership of stmt_name.
+ */
+void rdo_postgres_driver_defer_deallocate(RDOPostgresDriver * driver, char * stmt_name);
+
+/**
+ * Send any queued DEALLOCATEs in a single round trip.
+ *
+ * Unless force is non-zero, nothing is sent until RDO_PG_DEALLOCATE_BATCH
+ * names are queued. If one fails, the names after it stay queued.
+ */
+void rdo_postgres_driver_flush_deallocations(RDOPostgresDriver * driver, int force);
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+/**
+ * Queue all pending DEALLOCATEs onto a connection in pipeline mode.
+ *
+ * Returns the number of commands sent, each of which produces one result
+ * followed by a sync.
+ */
+int rdo_postgres_driver_pipeline_deallocations(RDOPostgresDriver * driver);
+#endif
+
+/**
+ * Wait for the connection socket to become readable, without holding the GVL.
+ *
+ * Returns 1 when readable, or 0 if timeout (NULL for no limit) elapses first.
+ */
+int rdo_postgres_driver_wait_readable(RDOPostgresDriver * driver, struct timeval * timeout);
+
+/**
+ * Start the clock for a query, if the driver has a query_timeout.
+ *
+ * Called once per public entry point, so that the timeout covers every round
+ * trip the call makes. Also notes whether a transaction block is open, so a
+ * connection lost during the call is not silently reopened outside it.
+ */
+void rdo_postgres_driver_start_deadline(RDOPostgresDriver * driver);
+
+/**
+ * Return the next result of a query sent with PQsend*(), like PQgetResult().
+ *
+ * The GVL is released while waiting. If the deadline passes first, the query
+ * is cancelled, its results are drained and RDO::Postgres::TimeoutError is
+ * raised. If the server does not respond to the cancel within
+ * RDO_PG_CANCEL_GRACE seconds, the connection is shut down instead.
+ */
+PGresult * rdo_postgres_driver_get_result(RDOPostgresDriver * driver);
+
+/**
+ * Return the result of a query sent with PQsend*(), like PQexec().
+ *
+ * Pass the return value of the PQsend*() call as sent. Reads every result,
+ * returning the first error, or the last result if there was no error. If
+ * the wait is interrupted (e.g. by Thread#raise), the query is abandoned.
+ */
+PGresult * rdo_postgres_driver_exec_result(RDOPostgresDriver * driver, int sent);
+
+/**
+ * Cancel a query left running by an interrupted call, and read its results.
+ *
+ * Safe to call from an ensure block, and does nothing if no query is running.
+ * If the server does not respond to the cancel within RDO_PG_CANCEL_GRACE
+ * seconds, the socket is shut down, and the connection is reopened by the
+ * next prepare, unless a transaction block was open.
+ */
+void rdo_postgres_driver_abandon(RDOPostgresDriver * driver);
+
+/**
+ * The built-in type to decode values of type as, using the driver's type_map.
+ *
+ * Domains resolve to their base type, enums to text, and arrays of those to
+ * the matching built-in array type. Other types are returned unchanged.
+ */
+Oid rdo_postgres_driver_resolve_type(RDOPostgresDriver * driver, Oid type);
+
+/**
+ * The decoder in the driver's type_map for types with no built-in equivalent.
+ *
+ * This is :hstore, or an Array of [name, decoder] pairs for a composite type,
+ * as passed to rdo_postgres_cast_decoded_value(). Returns Qnil for any other
+ * type. The type_map holds the fields of every composite when it is loaded,
+ * so this never needs a query.
+ */
+VALUE rdo_postgres_driver_type_decoder(RDOPostgresDriver * driver, Oid type);
+
 /** Initializer called during extension init */
 void Init_rdo_postgres_driver(void);
+
+#endif
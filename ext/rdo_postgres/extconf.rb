@@ -35,4 +35,13 @@ unless have_build_env
   exit(1)
 end
 
+# libpq >= 14
+have_func("PQenterPipelineMode", "libpq-fe.h")
+
+# libpq >= 12
+have_func("PQresultMemorySize", "libpq-fe.h")
+
+# ruby >= 2.4
+have_func("rb_gc_adjust_memory_usage", "ruby.h")
+
 create_makefile("rdo_postgres/rdo_postgres")
@@ -0,0 +1,355 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include "largeobject.h"
+#include "driver.h"
+#include "macros.h"
+#include <libpq/libpq-fs.h>
+#include <string.h>
+
+/** Bytes read at a time when reading to the end of a large object */
+#define RDO_PG_LO_CHUNK 65536
+
+/** Struct wrapped by RDO::Postgres::LargeObject */
+typedef struct {
+  VALUE               driver_obj;
+  RDOPostgresDriver * driver;
+  int                 generation;
+  Oid                 oid;
+  int                 fd;
+} RDOPostgresLargeObject;
+
+/** class RDO::Postgres::LargeObject */
+static VALUE rdo_postgres_cLargeObject;
+
+/** Keep the driver alive while the large object is */
+static void rdo_postgres_large_object_mark(RDOPostgresLargeObject * lo) {
+  rb_gc_mark(lo->driver_obj);
+}
+
+/** Release the struct during GC (the descriptor ends with the transaction) */
+static void rdo_postgres_large_object_free(RDOPostgresLargeObject * lo) {
+  free(lo);
+}
+
+/** Fetch the driver struct, raising if the connection is not open */
+static RDOPostgresDriver * rdo_postgres_large_object_driver(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open)) {
+    RDO_ERROR("Unable to use large object: connection is not open");
+  }
+
+  return driver;
+}
+
+/** Fetch the large object, raising if it was closed or its connection reset */
+static RDOPostgresLargeObject * rdo_postgres_large_object_get(VALUE self) {
+  RDOPostgresLargeObject * lo;
+  Data_Get_Struct(self, RDOPostgresLargeObject, lo);
+
+  if (lo->fd < 0) {
+    RDO_ERROR("Large object %u is closed", lo->oid);
+  }
+
+  if (!(lo->driver->is_open) || lo->driver->generation != lo->generation) {
+    RDO_ERROR("Large object %u belongs to a closed connection", lo->oid);
+  }
+
+  return lo;
+}
+
+/** Raise with the connection error message for a failed lo_* call */
+static void rdo_postgres_large_object_fail(RDOPostgresDriver * driver,
+    const char * what, Oid oid) {
+  RDO_ERROR("Failed to %s large object %u: %s",
+      what, oid, PQerrorMessage(driver->conn_ptr));
+}
+
+/** Convert a mode String ("r", "w" or "rw") to INV_READ/INV_WRITE flags */
+static int rdo_postgres_large_object_mode(VALUE mode) {
+  if (NIL_P(mode)) {
+    return INV_READ;
+  }
+
+  Check_Type(mode, T_STRING);
+
+  const char * s = StringValueCStr(mode);
+
+  if (strcmp(s, "r") == 0) {
+    return INV_READ;
+  } else if (strcmp(s, "w") == 0) {
+    return INV_WRITE;
+  } else if (strcmp(s, "rw") == 0 || strcmp(s, "r+") == 0 || strcmp(s, "w+") == 0) {
+    return INV_READ | INV_WRITE;
+  }
+
+  rb_raise(rb_eArgError, "Invalid large object mode: %s", s);
+}
+
+/** Create a new, empty large object and return its Oid */
+static VALUE rdo_postgres_driver_lo_create(VALUE self) {
+  RDOPostgresDriver * driver = rdo_postgres_large_object_driver(self);
+  Oid                 oid    = lo_create(driver->conn_ptr, InvalidOid);
+
+  if (oid == InvalidOid) {
+    rdo_postgres_large_object_fail(driver, "create", oid);
+  }
+
+  return UINT2NUM(oid);
+}
+
+/**
+ * Open the large object with the given Oid.
+ *
+ * This must be done inside a transaction, and the LargeObject returned can
+ * only be used until that transaction ends.
+ */
+static VALUE rdo_postgres_driver_lo_open(int argc, VALUE * args, VALUE self) {
+  VALUE oid;
+  VALUE mode;
+
+  rb_scan_args(argc, args, "11", &oid, &mode);
+
+  RDOPostgresDriver * driver = rdo_postgres_large_object_driver(self);
+
+  if (PQtransactionStatus(driver->conn_ptr) != PQTRANS_INTRANS) {
+    RDO_ERROR("Large objects can only be opened inside a transaction");
+  }
+
+  int fd = lo_open(driver->conn_ptr, NUM2UINT(oid),
+      rdo_postgres_large_object_mode(mode));
+
+  if (fd < 0) {
+    rdo_postgres_large_object_fail(driver, "open", NUM2UINT(oid));
+  }
+
+  RDOPostgresLargeObject * lo = malloc(sizeof(RDOPostgresLargeObject));
+  lo->driver_obj = self;
+  lo->driver     = driver;
+  lo->generation = driver->generation;
+  lo->oid        = NUM2UINT(oid);
+  lo->fd         = fd;
+
+  return Data_Wrap_Struct(rdo_postgres_cLargeObject,
+      rdo_postgres_large_object_mark, rdo_postgres_large_object_free, lo);
+}
+
+/** Delete the large object with the given Oid */
+static VALUE rdo_postgres_driver_lo_unlink(VALUE self, VALUE oid) {
+  RDOPostgresDriver * driver = rdo_postgres_large_object_driver(self);
+
+  if (lo_unlink(driver->conn_ptr, NUM2UINT(oid)) < 0) {
+    rdo_postgres_large_object_fail(driver, "unlink", NUM2UINT(oid));
+  }
+
+  return Qtrue;
+}
+
+/** Read up to len bytes into buf, returning the number read */
+static int rdo_postgres_large_object_read_into(RDOPostgresLargeObject * lo,
+    VALUE buf, long offset, long len) {
+
+  rb_str_resize(buf, offset + len);
+
+  int n = lo_read(lo->driver->conn_ptr, lo->fd, RSTRING_PTR(buf) + offset, len);
+
+  if (n < 0) {
+    rdo_postgres_large_object_fail(lo->driver, "read", lo->oid);
+  }
+
+  rb_str_set_len(buf, offset + n);
+
+  return n;
+}
+
+/**
+ * Read like IO#read.
+ *
+ * With no length, read to the end and return a String (empty at the end).
+ * With a length, return up to that many bytes, or nil at the end. If outbuf
+ * is given, the bytes are read into it.
+ */
+static VALUE rdo_postgres_large_object_read(int argc, VALUE * args, VALUE self) {
+  VALUE length;
+  VALUE outbuf;
+
+  rb_scan_args(argc, args, "02", &length, &outbuf);
+
+  RDOPostgresLargeObject * lo = rdo_postgres_large_object_get(self);
+
+  if (NIL_P(outbuf)) {
+    outbuf = rb_str_new(NULL, 0);
+  } else {
+    StringValue(outbuf);
+    rb_str_modify(outbuf);
+    rb_str_set_len(outbuf, 0);
+  }
+
+  rb_enc_associate_index(outbuf, rb_ascii8bit_encindex());
+
+  if (NIL_P(length)) {
+    while (rdo_postgres_large_object_read_into(lo, outbuf,
+          RSTRING_LEN(outbuf), RDO_PG_LO_CHUNK) > 0);
+    return outbuf;
+  }
+
+  long len = NUM2LONG(length);
+
+  if (len < 0) {
+    rb_raise(rb_eArgError, "negative length %ld given", len);
+  } else if (len == 0) {
+    return outbuf;
+  }
+
+  if (rdo_postgres_large_object_read_into(lo, outbuf, 0, len) == 0) {
+    return Qnil;
+  }
+
+  return outbuf;
+}
+
+/** Write str at the current position, returning the number of bytes written */
+static VALUE rdo_postgres_large_object_write(VALUE self, VALUE str) {
+  RDOPostgresLargeObject * lo = rdo_postgres_large_object_get(self);
+
+  str = RDO_OBJ_TO_S(str);
+
+  const char * ptr     = RSTRING_PTR(str);
+  long         len     = RSTRING_LEN(str);
+  long         written = 0;
+
+  while (written < len) {
+    long chunk = len - written > RDO_PG_LO_CHUNK ? RDO_PG_LO_CHUNK : len - written;
+    int  n     = lo_write(lo->driver->conn_ptr, lo->fd, ptr + written, chunk);
+
+    if (n < 0) {
+      rdo_postgres_large_object_fail(lo->driver, "write", lo->oid);
+    }
+
+    written += n;
+  }
+
+  return LONG2NUM(written);
+}
+
+/** Move to offset, relative to whence (IO::SEEK_SET, SEEK_CUR or SEEK_END) */
+static VALUE rdo_postgres_large_object_seek(int argc, VALUE * args, VALUE self) {
+  VALUE offset;
+  VALUE whence;
+
+  rb_scan_args(argc, args, "11", &offset, &whence);
+
+  RDOPostgresLargeObject * lo = rdo_postgres_large_object_get(self);
+
+  pg_int64 pos = lo_lseek64(lo->driver->conn_ptr, lo->fd, NUM2LL(offset),
+      NIL_P(whence) ? SEEK_SET : NUM2INT(whence));
+
+  if (pos < 0) {
+    rdo_postgres_large_object_fail(lo->driver, "seek", lo->oid);
+  }
+
+  return INT2FIX(0);
+}
+
+/** Return the current position */
+static VALUE rdo_postgres_large_object_tell(VALUE self) {
+  RDOPostgresLargeObject * lo = rdo_postgres_large_object_get(self);
+
+  pg_int64 pos = lo_tell64(lo->driver->conn_ptr, lo->fd);
+
+  if (pos < 0) {
+    rdo_postgres_large_object_fail(lo->driver, "tell", lo->oid);
+  }
+
+  return LL2NUM(pos);
+}
+
+/** Truncate (or extend with zeros) to len bytes */
+static VALUE rdo_postgres_large_object_truncate(VALUE self, VALUE len) {
+  RDOPostgresLargeObject * lo = rdo_postgres_large_object_get(self);
+
+  if (lo_truncate64(lo->driver->conn_ptr, lo->fd, NUM2LL(len)) < 0) {
+    rdo_postgres_large_object_fail(lo->driver, "truncate", lo->oid);
+  }
+
+  return INT2FIX(0);
+}
+
+/** Return the Oid of the large object */
+static VALUE rdo_postgres_large_object_oid(VALUE self) {
+  RDOPostgresLargeObject * lo;
+  Data_Get_Struct(self, RDOPostgresLargeObject, lo);
+  return UINT2NUM(lo->oid);
+}
+
+/** Close the descriptor; closing more than once has no effect */
+static VALUE rdo_postgres_large_object_close(VALUE self) {
+  RDOPostgresLargeObject * lo;
+  Data_Get_Struct(self, RDOPostgresLargeObject, lo);
+
+  if (lo->fd < 0) {
+    return Qnil;
+  }
+
+  if (lo->driver->is_open && lo->driver->generation == lo->generation
+      && PQtransactionStatus(lo->driver->conn_ptr) == PQTRANS_INTRANS) {
+    lo_close(lo->driver->conn_ptr, lo->fd);
+  }
+
+  lo->fd = -1;
+
+  return Qnil;
+}
+
+/** Predicate test if the large object has been closed */
+static VALUE rdo_postgres_large_object_closed_p(VALUE self) {
+  RDOPostgresLargeObject * lo;
+  Data_Get_Struct(self, RDOPostgresLargeObject, lo);
+  return lo->fd < 0 ? Qtrue : Qfalse;
+}
+
+void Init_rdo_postgres_large_objects(void) {
+  VALUE mPostgres = rb_path2class("RDO::Postgres");
+  VALUE cDriver   = rb_path2class("RDO::Postgres::Driver");
+
+  rdo_postgres_cLargeObject = rb_define_class_under(mPostgres,
+      "LargeObject", rb_cObject);
+
+  rb_undef_alloc_func(rdo_postgres_cLargeObject);
+
+  rb_define_method(cDriver, "lo_create", rdo_postgres_driver_lo_create, 0);
+  rb_define_method(cDriver, "lo_open", rdo_postgres_driver_lo_open, -1);
+  rb_define_method(cDriver, "lo_unlink", rdo_postgres_driver_lo_unlink, 1);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "read", rdo_postgres_large_object_read, -1);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "write", rdo_postgres_large_object_write, 1);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "seek", rdo_postgres_large_object_seek, -1);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "tell", rdo_postgres_large_object_tell, 0);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "truncate", rdo_postgres_large_object_truncate, 1);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "oid", rdo_postgres_large_object_oid, 0);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "close", rdo_postgres_large_object_close, 0);
+
+  rb_define_method(rdo_postgres_cLargeObject,
+      "closed?", rdo_postgres_large_object_closed_p, 0);
+
+  rb_define_alias(rdo_postgres_cLargeObject, "pos", "tell");
+}
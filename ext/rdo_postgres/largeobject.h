@@ -0,0 +1,11 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include <ruby.h>
+
+/** Initializer for RDO::Postgres::LargeObject and the Driver lo_* methods */
+void Init_rdo_postgres_large_objects(void);
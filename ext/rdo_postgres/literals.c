@@ -0,0 +1,214 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include "literals.h"
+#include "params.h"
+#include "arrays.h"
+#include "macros.h"
+#include <ruby/encoding.h>
+#include <string.h>
+#include <libpq-fe.h>
+
+/**
+ * Client encodings with multibyte characters containing ASCII bytes.
+ *
+ * Escaping these needs to be encoding-aware, so is left to libpq.
+ */
+static const char * rdo_postgres_literal_unsafe_encodings[] = {
+  "SJIS", "SHIFT_JIS_2004", "BIG5", "GBK", "UHC", "GB18030", "JOHAB", NULL
+};
+
+/** Predicate test if the connection's escaping needs PQescapeStringConn() */
+static int rdo_postgres_literal_unsafe_encoding_p(PGconn * conn) {
+  const char  * name = pg_encoding_to_char(PQclientEncoding(conn));
+  const char ** unsafe;
+
+  for (unsafe = rdo_postgres_literal_unsafe_encodings; *unsafe != NULL; ++unsafe) {
+    if (strcmp(name, *unsafe) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+/** Predicate test if backslashes are literal in '' strings */
+static int rdo_postgres_literal_std_strings_p(PGconn * conn) {
+  const char * setting = PQparameterStatus(conn, "standard_conforming_strings");
+  return setting != NULL && strcmp(setting, "on") == 0;
+}
+
+/** Append the escaped bytes of str (without quotes) to buf */
+static void rdo_postgres_literal_cat_escaped(RDOPostgresDriver * driver,
+    VALUE buf, VALUE str) {
+
+  const char * src = RSTRING_PTR(str);
+  long         len = RSTRING_LEN(str);
+  long         offset;
+  size_t       written;
+
+  if (memchr(src, '\0', len) != NULL) {
+    rb_raise(rb_eArgError, "String contains a NUL byte, which cannot be quoted");
+  }
+
+  offset = RSTRING_LEN(buf);
+  rb_str_modify_expand(buf, len * 2 + 1);
+
+  if (rdo_postgres_literal_unsafe_encoding_p(driver->conn_ptr)) {
+    int error = 0;
+    written = PQescapeStringConn(driver->conn_ptr, RSTRING_PTR(buf) + offset,
+        src, len, &error);
+
+    if (error) {
+      RDO_ERROR("Unable to quote string: %s", PQerrorMessage(driver->conn_ptr));
+    }
+  } else {
+    written = rdo_postgres_params_escape_literal(RSTRING_PTR(buf) + offset,
+        src, len, rdo_postgres_literal_std_strings_p(driver->conn_ptr));
+  }
+
+  rb_str_set_len(buf, offset + written);
+}
+
+/** Append the bytes of str to buf as a hex bytea literal */
+static void rdo_postgres_literal_cat_bytea(RDOPostgresDriver * driver,
+    VALUE buf, VALUE str) {
+
+  static const char hex[] = "0123456789abcdef";
+
+  const unsigned char * src = (const unsigned char *) RSTRING_PTR(str);
+  long                  len = RSTRING_LEN(str);
+  long                  offset;
+  char                * dst;
+  long                  i;
+
+  if (rdo_postgres_literal_std_strings_p(driver->conn_ptr)) {
+    rb_str_cat(buf, "'\\x", 3);
+  } else {
+    rb_str_cat(buf, "E'\\\\x", 5);
+  }
+
+  offset = RSTRING_LEN(buf);
+  rb_str_modify_expand(buf, len * 2 + 1);
+  dst = RSTRING_PTR(buf) + offset;
+
+  for (i = 0; i < len; ++i) {
+    *(dst++) = hex[src[i] >> 4];
+    *(dst++) = hex[src[i] & 0x0F];
+  }
+
+  rb_str_set_len(buf, offset + len * 2);
+  rb_str_cat(buf, "'", 1);
+}
+
+/**
+ * Predicate test if a binary String can be quoted as text.
+ *
+ * Binary encoding is common for Strings read from sockets or files, so those
+ * that are ASCII, or valid in the connection encoding, are sent as text.
+ */
+static int rdo_postgres_literal_text_p(RDOPostgresDriver * driver, VALUE str) {
+  if (rb_enc_str_asciionly_p(str)) {
+    return 1;
+  }
+
+  if (driver->encoding < 0 || driver->encoding == rb_ascii8bit_encindex()) {
+    return 0;
+  }
+
+  VALUE text = rb_str_dup(str);
+  rb_enc_associate_index(text, driver->encoding);
+
+  return rb_enc_str_coderange(text) != ENC_CODERANGE_BROKEN;
+}
+
+/** Append value to buf as an SQL literal */
+static void rdo_postgres_literal_cat_value(RDOPostgresDriver * driver,
+    VALUE buf, VALUE value) {
+
+  switch (TYPE(value)) {
+    case T_NIL:
+      rb_str_cat(buf, "NULL", 4);
+      return;
+
+    case T_ARRAY:
+      {
+        VALUE encoded = rdo_postgres_array_encode_text(value);
+        value = NIL_P(encoded)
+          ? RDO_OBJ_TO_S(rb_funcall(rb_path2class("RDO::Postgres::Array::Text"),
+                rb_intern("new"), 1, value))
+          : encoded;
+      }
+      break;
+
+    case T_STRING:
+      if (rb_obj_is_kind_of(value, rb_path2class("RDO::Postgres::Bytea"))) {
+        rdo_postgres_literal_cat_bytea(driver, buf, value);
+        return;
+      }
+
+      if (ENCODING_GET(value) == rb_ascii8bit_encindex()
+          && !rdo_postgres_literal_text_p(driver, value)) {
+        rb_raise(rb_eArgError,
+            "Binary String is not valid text in the connection encoding; "
+            "wrap it in RDO::Postgres::Bytea to send it as bytea");
+      }
+      break;
+
+    default:
+      value = RDO_OBJ_TO_S(value);
+  }
+
+  rb_str_cat(buf, "'", 1);
+  rdo_postgres_literal_cat_escaped(driver, buf, value);
+  rb_str_cat(buf, "'", 1);
+}
+
+VALUE rdo_postgres_literal_escape(RDOPostgresDriver * driver, VALUE str) {
+  VALUE buf = rb_str_buf_new(RSTRING_LEN(str) + 2);
+  rdo_postgres_literal_cat_escaped(driver, buf, str);
+  rb_enc_associate(buf, rb_enc_get(str));
+  return buf;
+}
+
+VALUE rdo_postgres_literal_interpolate(RDOPostgresDriver * driver, VALUE sql,
+    int argc, VALUE * args) {
+
+  Check_Type(sql, T_STRING);
+
+  const char       * ptr = RSTRING_PTR(sql);
+  VALUE              buf = rb_str_buf_new(RSTRING_LEN(sql) + argc * 16);
+  int                n   = 0;
+  int                stop;
+  size_t             start;
+  size_t             length;
+  RDOPostgresScanner scanner;
+
+  rdo_postgres_params_scanner_init(&scanner, ptr, RSTRING_LEN(sql));
+
+  do {
+    stop = rdo_postgres_params_scan(&scanner, &start, &length);
+    rb_str_cat(buf, ptr + start, length);
+
+    if (stop == RDO_PG_SCAN_MARKER) {
+      if (n < argc) {
+        rdo_postgres_literal_cat_value(driver, buf, args[n]);
+      }
+      ++n;
+    } else if (stop == RDO_PG_SCAN_ESCAPED) {
+      rb_str_cat(buf, "?", 1);
+    }
+  } while (stop != RDO_PG_SCAN_END);
+
+  if (n != argc) {
+    rb_raise(rb_eArgError,
+        "Bind parameter count mismatch: wanted %i, got %i", n, argc);
+  }
+
+  rb_enc_associate(buf, rb_enc_get(sql));
+
+  return buf;
+}
@@ -0,0 +1,28 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include <ruby.h>
+#include "driver.h"
+
+/**
+ * Escape str for use inside a '' quoted string literal.
+ *
+ * Raises an ArgumentError if str contains a NUL byte, which no text value can.
+ */
+VALUE rdo_postgres_literal_escape(RDOPostgresDriver * driver, VALUE str);
+
+/**
+ * Replace each '?' marker in sql with args, as SQL literals.
+ *
+ * Values are sent as quoted literals of unknown type, so the server infers
+ * their types just as it does for untyped bind parameters. nil is sent as
+ * NULL, and RDO::Postgres::Bytea values as hex bytea literals. Other binary
+ * Strings are sent as text if they are valid in the connection encoding, or
+ * raise ArgumentError.
+ */
+VALUE rdo_postgres_literal_interpolate(RDOPostgresDriver * driver, VALUE sql,
+    int argc, VALUE * args);
@@ -66,7 +66,7 @@
  */
 #define RDO_STRING(s, len, enc) \
   (rb_enc_associate_index(rb_str_new(s, len), \
-                          enc > 0 ? enc : rb_enc_find_index("binary")))
+                          enc > 0 ? enc : rb_ascii8bit_encindex()))
 
 /**
  * Convert a C string to a ruby String, assuming possible NULL bytes.
@@ -81,7 +81,7 @@
  *   a Ruby String
  */
 #define RDO_BINARY_STRING(s, len) \
-  (RDO_STRING(s, len, rb_enc_find_index("binary")))
+  (RDO_STRING(s, len, rb_ascii8bit_encindex()))
 
 /**
  * Convert a C string to a Fixnum.
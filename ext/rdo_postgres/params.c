@@ -10,106 +10,143 @@
 #include <string.h>
 #include <math.h>
 
-/** Get the strlen of the marker (e.g. $2) based on its index */
-#define RDO_PG_MARKER_LEN(n) (n > 0 ? (int) floor(log10(n)) + 2 : 2)
+void rdo_postgres_params_scanner_init(RDOPostgresScanner * scanner,
+    const char * sql, size_t len) {
+
+  scanner->sql     = sql;
+  scanner->len     = len;
+  scanner->pos     = 0;
+  scanner->instr   = 0;
+  scanner->inident = 0;
+  scanner->inslcmt = 0;
+  scanner->inmlcmt = 0;
+}
 
 /**
- * Replace e.g. "SELECT ? WHERE ?" with "SELECT $1 WHERE $2".
+ * Find the next '?' in e.g. "SELECT ? WHERE ?".
  *
  * Handles string literals and comments.
  *
  * This function is deliberately not broken apart, since it needs to be extremely fast.
  */
-char * rdo_postgres_params_inject_markers(char * stmt) {
-  int    len     = strlen(stmt);
-  char * buf     = malloc(sizeof(char) * len ? (len * (floor(log10(len)) + 2)) : 0);
-  char * s       = stmt;
-  char * b       = buf;
-  int    n       = 0;
-  int    instr   = 0;
-  int    inident = 0;
-  int    inslcmt = 0;
-  int    inmlcmt = 0;
-
-  for (; *s; ++s, ++b) {
-    switch (*s) {
+int rdo_postgres_params_scan(RDOPostgresScanner * scanner,
+    size_t * start, size_t * length) {
+
+  const char * sql = scanner->sql;
+  size_t       len = scanner->len;
+  size_t       i   = scanner->pos;
+
+  *start = i;
+
+  for (; i < len; ++i) {
+    switch (sql[i]) {
       case '/':
-        if (!instr && !inident && !inslcmt && *(s + 1) == '*') {
-          ++inmlcmt;
-          *b = *s;
-          *(++b) = *(++s);
-        } else {
-          *b = *s;
+        if (!scanner->instr && !scanner->inident && !scanner->inslcmt
+            && i + 1 < len && sql[i + 1] == '*') {
+          ++scanner->inmlcmt;
+          ++i;
         }
         break;
 
       case '*':
-        if (inmlcmt && *(s + 1) == '/') {
-          --inmlcmt;
-          *b = *s;
-          *(++b) = *(++s);
-        } else {
-          *b = *s;
+        if (scanner->inmlcmt && i + 1 < len && sql[i + 1] == '/') {
+          --scanner->inmlcmt;
+          ++i;
         }
         break;
 
       case '-':
-        if (!instr && !inident && !inmlcmt && *(s + 1) == '-') {
-          inslcmt = 1;
-          *b = *s;
-          *(++b) = *(++s);
-        } else {
-          *b = *s;
+        if (!scanner->instr && !scanner->inident && !scanner->inmlcmt
+            && i + 1 < len && sql[i + 1] == '-') {
+          scanner->inslcmt = 1;
+          ++i;
         }
         break;
 
       case '\n':
       case '\r':
-        inslcmt = 0;
-        *b = *s;
+        scanner->inslcmt = 0;
         break;
 
       case '\'':
-        if (!inident && !inmlcmt && !inslcmt) {
-          instr = !instr;
-          *b = *s;
-        } else {
-          *b = *s;
-        }
+        if (!scanner->inident && !scanner->inmlcmt && !scanner->inslcmt)
+          scanner->instr = !scanner->instr;
         break;
 
       case '\\':
-        if (!instr && !inident && !inmlcmt && !inslcmt && *(s + 1) == '?')
-          ++s;
-
-        *b = *s;
+        if (!scanner->instr && !scanner->inident && !scanner->inmlcmt
+            && !scanner->inslcmt && i + 1 < len && sql[i + 1] == '?') {
+          *length      = i - *start;
+          scanner->pos = i + 2;
+          return RDO_PG_SCAN_ESCAPED;
+        }
         break;
 
       case '"':
-        if (!instr && !inmlcmt && !inslcmt) {
-          inident = !inident;
-          *b = *s;
-        } else {
-          *b = *s;
-        }
+        if (!scanner->instr && !scanner->inmlcmt && !scanner->inslcmt)
+          scanner->inident = !scanner->inident;
         break;
 
       case '?':
-        if (!instr && !inident && !inmlcmt && !inslcmt) {
-          sprintf(b, "$%i", ++n);
-          b += RDO_PG_MARKER_LEN(n) - 1;
-        } else {
-          *b = *s;
+        if (!scanner->instr && !scanner->inident
+            && !scanner->inmlcmt && !scanner->inslcmt) {
+          *length      = i - *start;
+          scanner->pos = i + 1;
+          return RDO_PG_SCAN_MARKER;
         }
         break;
-
-      default:
-        *b = *s;
-        break;
     }
   }
 
+  *length      = i - *start;
+  scanner->pos = i;
+
+  return RDO_PG_SCAN_END;
+}
+
+/** Replace e.g. "SELECT ? WHERE ?" with "SELECT $1 WHERE $2" */
+char * rdo_postgres_params_inject_markers(char * stmt) {
+  size_t             len = strlen(stmt);
+  char             * buf = malloc(sizeof(char) * (len ? (len * (floor(log10(len)) + 2)) : 0) + 1);
+  char             * b   = buf;
+  int                n   = 0;
+  int                stop;
+  size_t             start;
+  size_t             length;
+  RDOPostgresScanner scanner;
+
+  rdo_postgres_params_scanner_init(&scanner, stmt, len);
+
+  do {
+    stop = rdo_postgres_params_scan(&scanner, &start, &length);
+
+    memcpy(b, stmt + start, length);
+    b += length;
+
+    if (stop == RDO_PG_SCAN_MARKER) {
+      b += sprintf(b, "$%i", ++n);
+    } else if (stop == RDO_PG_SCAN_ESCAPED) {
+      *(b++) = '?';
+    }
+  } while (stop != RDO_PG_SCAN_END);
+
   *b = '\0';
 
   return buf;
 }
+
+size_t rdo_postgres_params_escape_literal(char * dst, const char * src,
+    size_t len, int std_strings) {
+
+  char       * d   = dst;
+  const char * end = src + len;
+
+  for (; src < end; ++src) {
+    if (*src == '\'' || (*src == '\\' && !std_strings)) {
+      *(d++) = *src;
+    }
+    *(d++) = *src;
+  }
+
+  return d - dst;
+}
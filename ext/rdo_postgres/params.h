@@ -5,11 +5,65 @@
  * See LICENSE file for details.
  */
 
+#ifndef RDO_POSTGRES_PARAMS_H
+#define RDO_POSTGRES_PARAMS_H
+
 #include <stdio.h>
 
+/** Returned by rdo_postgres_params_scan() at the end of the statement */
+#define RDO_PG_SCAN_END     0
+
+/** Returned by rdo_postgres_params_scan() when it stops at a '?' marker */
+#define RDO_PG_SCAN_MARKER  1
+
+/** Returned by rdo_postgres_params_scan() when it stops at an escaped '\?' */
+#define RDO_PG_SCAN_ESCAPED 2
+
+/**
+ * State for finding '?' markers in a statement.
+ *
+ * String literals, quoted identifiers and comments are skipped.
+ */
+typedef struct {
+  const char * sql;
+  size_t       len;
+  size_t       pos;
+  int          instr;
+  int          inident;
+  int          inslcmt;
+  int          inmlcmt;
+} RDOPostgresScanner;
+
+/** Start scanning len bytes of sql */
+void rdo_postgres_params_scanner_init(RDOPostgresScanner * scanner,
+    const char * sql, size_t len);
+
+/**
+ * Advance to the next marker, or the end of the statement.
+ *
+ * *start and *length are set to the text since the previous stop, which is
+ * copied unchanged. The marker itself is not included. For an escaped '\?',
+ * neither character is included, and the caller writes a literal '?'.
+ */
+int rdo_postgres_params_scan(RDOPostgresScanner * scanner,
+    size_t * start, size_t * length);
+
 /**
  * Make a copy of the string sql, replacing '?' markers with numbered $1, $2 etc.
  *
  * Memory must be released with free() once the new string is no longer in use.
  */
 char * rdo_postgres_params_inject_markers(char * sql);
+
+/**
+ * Write the len bytes of src to dst, escaped for a '' quoted string literal.
+ *
+ * Quotes are doubled, and backslashes too unless std_strings is set (as for
+ * standard_conforming_strings). dst needs room for 2 * len bytes. Returns the
+ * number of bytes written. Only safe for client encodings where ASCII bytes
+ * never appear within multibyte characters.
+ */
+size_t rdo_postgres_params_escape_literal(char * dst, const char * src,
+    size_t len, int std_strings);
+
+#endif
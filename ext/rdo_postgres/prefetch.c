@@ -0,0 +1,183 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include "prefetch.h"
+#include "driver.h"
+#include "statements.h"
+#include "tuples.h"
+#include "macros.h"
+#include <string.h>
+
+/*
+ * Queries are sent without waiting for their results, so the server can work
+ * on the next one while Ruby processes the last. Where libpq supports
+ * pipelining, any number may be in flight; otherwise one.
+ */
+
+/** Fetch the driver struct, raising if the connection is not open */
+static RDOPostgresDriver * rdo_postgres_prefetch_driver(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open)) {
+    RDO_ERROR("Unable to execute statement: connection is not open");
+  }
+
+  return driver;
+}
+
+/**
+ * Send sql without waiting for its result.
+ *
+ * Returns false if another query cannot be sent until a result is received.
+ */
+static VALUE rdo_postgres_driver_prefetch_send(VALUE self, VALUE sql) {
+  RDOPostgresDriver * driver = rdo_postgres_prefetch_driver(self);
+  PGconn            * conn   = driver->conn_ptr;
+  int                 sent;
+
+  Check_Type(sql, T_STRING);
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+  if (PQpipelineStatus(conn) == PQ_PIPELINE_OFF && !PQenterPipelineMode(conn)) {
+    RDO_ERROR("Failed to enter pipeline mode: %s", PQerrorMessage(conn));
+  }
+
+  sent = PQsendQueryParams(conn, StringValueCStr(sql), 0, NULL, NULL, NULL, NULL, 0)
+    && PQsendFlushRequest(conn)
+    && PQflush(conn) == 0;
+#else
+  if (PQtransactionStatus(conn) == PQTRANS_ACTIVE) {
+    return Qfalse;
+  }
+
+  sent = PQsendQuery(conn, StringValueCStr(sql));
+#endif
+
+  if (!sent) {
+    RDO_ERROR("Failed to execute statement: %s", PQerrorMessage(conn));
+  }
+
+  return Qtrue;
+}
+
+/**
+ * Wait for the result of the oldest query sent with prefetch_send.
+ *
+ * Returns an Array of the Result and the bytes libpq held for it.
+ */
+static VALUE rdo_postgres_driver_prefetch_receive(VALUE self) {
+  RDOPostgresDriver * driver = rdo_postgres_prefetch_driver(self);
+  PGresult          * res;
+  PGresult          * extra;
+  size_t              memsize;
+
+  rdo_postgres_driver_start_deadline(driver);
+
+  if ((res = rdo_postgres_driver_get_result(driver)) == NULL) {
+    RDO_ERROR("Failed to execute statement: no query in flight");
+  }
+
+  // the NULL that ends each query's results
+  while ((extra = rdo_postgres_driver_get_result(driver)) != NULL) {
+    PQclear(extra);
+  }
+
+  switch (PQresultStatus(res)) {
+    case PGRES_BAD_RESPONSE:
+    case PGRES_FATAL_ERROR:
+#ifdef HAVE_PQENTERPIPELINEMODE
+    case PGRES_PIPELINE_ABORTED:
+#endif
+      {
+        char msg[sizeof(char) * (strlen(PQresultErrorMessage(res)) + 1)];
+        strcpy(msg, PQresultErrorMessage(res));
+        PQclear(res);
+        RDO_ERROR("Failed to execute statement: %s", msg);
+      }
+
+    default:
+      memsize = rdo_postgres_result_memsize(res);
+      return rb_assoc_new(rdo_postgres_statements_result_new(driver, res),
+          SIZET2NUM(memsize));
+  }
+}
+
+/**
+ * Read whatever has arrived on the socket into libpq, without blocking.
+ *
+ * Called while rows are processed, so the server is not left waiting on a
+ * full socket buffer.
+ */
+static VALUE rdo_postgres_driver_prefetch_poll(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (driver->is_open) {
+    PQconsumeInput(driver->conn_ptr);
+  }
+
+  return Qnil;
+}
+
+/**
+ * Discard the results of any queries still in flight.
+ *
+ * Used from ensure blocks, so the wait is not subject to the query timeout.
+ */
+static VALUE rdo_postgres_driver_prefetch_finish(VALUE self) {
+  RDOPostgresDriver * driver;
+  PGresult          * res;
+
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open)) {
+    return Qnil;
+  }
+
+  PGconn * conn = driver->conn_ptr;
+
+  driver->has_deadline = 0;
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+  if (PQpipelineStatus(conn) == PQ_PIPELINE_OFF) {
+    return Qnil;
+  }
+
+  PQpipelineSync(conn);
+  PQflush(conn);
+
+  while (!PQexitPipelineMode(conn) && PQstatus(conn) != CONNECTION_BAD) {
+    while ((res = rdo_postgres_driver_get_result(driver)) != NULL) {
+      PQclear(res);
+    }
+  }
+#else
+  while (PQstatus(conn) != CONNECTION_BAD
+      && (res = rdo_postgres_driver_get_result(driver)) != NULL) {
+    PQclear(res);
+  }
+#endif
+
+  return Qnil;
+}
+
+void Init_rdo_postgres_prefetch(void) {
+  VALUE cDriver = rb_path2class("RDO::Postgres::Driver");
+
+  rb_define_private_method(cDriver,
+      "prefetch_send", rdo_postgres_driver_prefetch_send, 1);
+
+  rb_define_private_method(cDriver,
+      "prefetch_receive", rdo_postgres_driver_prefetch_receive, 0);
+
+  rb_define_private_method(cDriver,
+      "prefetch_poll", rdo_postgres_driver_prefetch_poll, 0);
+
+  rb_define_private_method(cDriver,
+      "prefetch_finish", rdo_postgres_driver_prefetch_finish, 0);
+}
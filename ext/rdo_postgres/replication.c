@@ -0,0 +1,985 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include "replication.h"
+#include "driver.h"
+#include "casts.h"
+#include "macros.h"
+#include "types.h"
+#include <ruby/io.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+/*
+ * Logical replication runs START_REPLICATION on a connection opened with
+ * replication=database, after which the server streams CopyData messages:
+ * XLogData ('w') carrying the output plugin's data, and keepalives ('k').
+ * Standby status updates ('r') are sent back to confirm progress.
+ *
+ * pgoutput messages are decoded straight from the copy buffer, and
+ * test_decoding's text lines are parsed, into Hashes describing each change.
+ * Values are cast with the same casts as query results.
+ */
+
+/** Seconds between the Unix epoch and the PostgreSQL epoch (2000-01-01) */
+#define RDO_PG_EPOCH_OFFSET 946684800LL
+
+/** Position in a message being decoded */
+typedef struct {
+  char * p;
+  char * end;
+} RDOPostgresReader;
+
+/** A type name printed by test_decoding, and its Oid */
+typedef struct {
+  const char * name;
+  Oid          type;
+} RDOPostgresTypeName;
+
+/** Types test_decoding values are cast as; anything else is returned as text */
+static const RDOPostgresTypeName rdo_postgres_replication_type_names[] = {
+  { "integer",                     RDO_PG_INT4OID },
+  { "bigint",                      RDO_PG_INT8OID },
+  { "smallint",                    RDO_PG_INT2OID },
+  { "real",                        RDO_PG_FLOAT4OID },
+  { "double precision",            RDO_PG_FLOAT8OID },
+  { "numeric",                     RDO_PG_NUMERICOID },
+  { "boolean",                     RDO_PG_BOOLOID },
+  { "bytea",                       RDO_PG_BYTEAOID },
+  { "date",                        RDO_PG_DATEOID },
+  { "timestamp without time zone", RDO_PG_TIMESTAMPOID },
+  { "timestamp with time zone",    RDO_PG_TIMESTAMPTZOID },
+  { "interval",                    RDO_PG_INTERVALOID },
+  { "json",                        RDO_PG_JSONOID },
+  { "jsonb",                       RDO_PG_JSONBOID },
+  { "inet",                        RDO_PG_INETOID },
+  { "cidr",                        RDO_PG_CIDROID },
+  { "money",                       RDO_PG_MONEYOID },
+  { "integer[]",                   RDO_PG_INT4ARRAYOID },
+  { "bigint[]",                    RDO_PG_INT8ARRAYOID },
+  { "text[]",                      RDO_PG_TEXTARRAYOID },
+  { NULL,                          0 }
+};
+
+/** Fetch the driver struct, raising if the connection is not open */
+static RDOPostgresDriver * rdo_postgres_replication_driver(VALUE self) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open)) {
+    RDO_ERROR("Unable to stream changes: connection is not open");
+  }
+
+  return driver;
+}
+
+/** Raise unless n more bytes can be read */
+static void rdo_postgres_reader_need(RDOPostgresReader * r, long n) {
+  if (r->end - r->p < n) {
+    RDO_ERROR("Malformed replication message: expected %ld more bytes", n);
+  }
+}
+
+static int rdo_postgres_reader_byte(RDOPostgresReader * r) {
+  rdo_postgres_reader_need(r, 1);
+  return (unsigned char) *(r->p++);
+}
+
+static int16_t rdo_postgres_reader_int16(RDOPostgresReader * r) {
+  rdo_postgres_reader_need(r, 2);
+  uint16_t n = ((uint16_t) (unsigned char) r->p[0] << 8)
+    | (uint16_t) (unsigned char) r->p[1];
+  r->p += 2;
+  return (int16_t) n;
+}
+
+static int32_t rdo_postgres_reader_int32(RDOPostgresReader * r) {
+  rdo_postgres_reader_need(r, 4);
+  uint32_t n = 0;
+  int      i = 0;
+  for (; i < 4; ++i)
+    n = (n << 8) | (unsigned char) r->p[i];
+  r->p += 4;
+  return (int32_t) n;
+}
+
+static int64_t rdo_postgres_reader_int64(RDOPostgresReader * r) {
+  rdo_postgres_reader_need(r, 8);
+  uint64_t n = 0;
+  int      i = 0;
+  for (; i < 8; ++i)
+    n = (n << 8) | (unsigned char) r->p[i];
+  r->p += 8;
+  return (int64_t) n;
+}
+
+/** Read a NUL-terminated string, returning a pointer into the message */
+static char * rdo_postgres_reader_string(RDOPostgresReader * r) {
+  char * s   = r->p;
+  char * nul = memchr(r->p, '\0', r->end - r->p);
+
+  if (nul == NULL) {
+    RDO_ERROR("Malformed replication message: unterminated string");
+  }
+
+  r->p = nul + 1;
+
+  return s;
+}
+
+/** Convert microseconds since 2000-01-01 to a Time */
+static VALUE rdo_postgres_replication_time(int64_t micros) {
+  return rb_time_nano_new(micros / 1000000 + RDO_PG_EPOCH_OFFSET,
+      (micros % 1000000) * 1000);
+}
+
+/** The current time in microseconds since 2000-01-01 */
+static int64_t rdo_postgres_replication_now(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return ((int64_t) now.tv_sec - RDO_PG_EPOCH_OFFSET) * 1000000 + now.tv_usec;
+}
+
+#define RDO_PG_SYM(name) ID2SYM(rb_intern(name))
+
+/** A new event Hash of the given type */
+static VALUE rdo_postgres_replication_event(const char * type, int64_t lsn) {
+  VALUE event = rb_hash_new();
+  rb_hash_aset(event, RDO_PG_SYM("type"), RDO_PG_SYM(type));
+  rb_hash_aset(event, RDO_PG_SYM("lsn"), LL2NUM(lsn));
+  return event;
+}
+
+/** Add the :schema and :table of a relation to event */
+static void rdo_postgres_replication_set_relation(VALUE event, VALUE relation) {
+  rb_hash_aset(event, RDO_PG_SYM("schema"), rb_ary_entry(relation, 0));
+  rb_hash_aset(event, RDO_PG_SYM("table"),  rb_ary_entry(relation, 1));
+}
+
+/** Look up a relation described by an earlier Relation message */
+static VALUE rdo_postgres_replication_relation(VALUE relations, int32_t relid) {
+  VALUE relation = rb_hash_lookup2(relations, LONG2NUM(relid), Qnil);
+
+  if (NIL_P(relation)) {
+    RDO_ERROR("Replication message for unknown relation %d", (int) relid);
+  }
+
+  return relation;
+}
+
+/**
+ * Store a Relation message as [schema, table, columns].
+ *
+ * Each column is [name, type, decoder], with the type resolved through the
+ * driver's type_map.
+ */
+static void rdo_postgres_replication_pgoutput_relation(RDOPostgresDriver * driver,
+    RDOPostgresReader * r, VALUE relations) {
+
+  int32_t relid  = rdo_postgres_reader_int32(r);
+  char  * schema = rdo_postgres_reader_string(r);
+  char  * table  = rdo_postgres_reader_string(r);
+  VALUE   cols;
+  int     ncols, i;
+
+  rdo_postgres_reader_byte(r); // replica identity setting
+
+  ncols = rdo_postgres_reader_int16(r);
+  cols  = rb_ary_new2(ncols);
+
+  for (i = 0; i < ncols; ++i) {
+    rdo_postgres_reader_byte(r); // flags (1 = part of the key)
+
+    char * name = rdo_postgres_reader_string(r);
+    Oid    type = (Oid) rdo_postgres_reader_int32(r);
+
+    rdo_postgres_reader_int32(r); // typmod
+
+    rb_ary_push(cols, rb_ary_new3(3,
+          ID2SYM(rb_intern(name)),
+          UINT2NUM(rdo_postgres_driver_resolve_type(driver, type)),
+          rdo_postgres_driver_type_decoder(driver, type)));
+  }
+
+  rb_hash_aset(relations, LONG2NUM(relid), rb_ary_new3(3,
+        RDO_STRING(schema, strlen(schema), driver->encoding),
+        RDO_STRING(table, strlen(table), driver->encoding),
+        cols));
+}
+
+/** Cast one value of a column, copying it to buf to NUL-terminate it */
+static VALUE rdo_postgres_replication_cast(RDOPostgresDriver * driver,
+    VALUE column, char * value, long len, char * buf) {
+
+  VALUE decoder = rb_ary_entry(column, 2);
+
+  memcpy(buf, value, len);
+  buf[len] = '\0';
+
+  if (!NIL_P(decoder)) {
+    return rdo_postgres_cast_decoded_value(buf, len, decoder,
+        driver->encoding, driver->cast_flags);
+  }
+
+  return rdo_postgres_cast_raw_value(buf, len, NUM2UINT(rb_ary_entry(column, 1)),
+      driver->encoding, driver->cast_flags);
+}
+
+/**
+ * Read a TupleData section into a Hash of column => value.
+ *
+ * Unchanged TOASTed values are not sent, so their columns are left out.
+ */
+static VALUE rdo_postgres_replication_pgoutput_tuple(RDOPostgresDriver * driver,
+    RDOPostgresReader * r, VALUE relation, char * buf) {
+
+  VALUE cols  = rb_ary_entry(relation, 2);
+  VALUE tuple = rb_hash_new();
+  int   ncols = rdo_postgres_reader_int16(r);
+  int   i;
+
+  for (i = 0; i < ncols; ++i) {
+    VALUE   column = rb_ary_entry(cols, i);
+    VALUE   name   = NIL_P(column) ? INT2NUM(i) : rb_ary_entry(column, 0);
+    int     kind   = rdo_postgres_reader_byte(r);
+    int32_t len;
+
+    switch (kind) {
+      case 'n':
+        rb_hash_aset(tuple, name, Qnil);
+        break;
+
+      case 'u':
+        break;
+
+      case 't':
+      case 'b':
+        len = rdo_postgres_reader_int32(r);
+        rdo_postgres_reader_need(r, len);
+
+        rb_hash_aset(tuple, name, (kind == 't' && !NIL_P(column))
+            ? rdo_postgres_replication_cast(driver, column, r->p, len, buf)
+            : RDO_BINARY_STRING(r->p, len));
+
+        r->p += len;
+        break;
+
+      default:
+        RDO_ERROR("Malformed replication message: unknown tuple data '%c'", kind);
+    }
+  }
+
+  return tuple;
+}
+
+/**
+ * Decode a pgoutput message into an event Hash.
+ *
+ * Returns Qnil for messages that only describe the stream (relations, types
+ * and origins).
+ */
+static VALUE rdo_postgres_replication_decode_pgoutput(RDOPostgresDriver * driver,
+    char * data, long len, int64_t lsn, VALUE relations) {
+
+  RDOPostgresReader r     = { data, data + len };
+  VALUE             tmp   = rb_str_buf_new(len + 1);
+  char            * buf   = RSTRING_PTR(tmp);
+  VALUE             event = Qnil;
+  VALUE             relation;
+  int               kind  = rdo_postgres_reader_byte(&r);
+
+  switch (kind) {
+    case 'B':
+      event = rdo_postgres_replication_event("begin", lsn);
+      rb_hash_aset(event, RDO_PG_SYM("final_lsn"), LL2NUM(rdo_postgres_reader_int64(&r)));
+      rb_hash_aset(event, RDO_PG_SYM("commit_time"),
+          rdo_postgres_replication_time(rdo_postgres_reader_int64(&r)));
+      rb_hash_aset(event, RDO_PG_SYM("xid"), UINT2NUM((uint32_t) rdo_postgres_reader_int32(&r)));
+      break;
+
+    case 'C':
+      event = rdo_postgres_replication_event("commit", lsn);
+      rdo_postgres_reader_byte(&r); // flags
+      rb_hash_aset(event, RDO_PG_SYM("commit_lsn"), LL2NUM(rdo_postgres_reader_int64(&r)));
+      rb_hash_aset(event, RDO_PG_SYM("end_lsn"), LL2NUM(rdo_postgres_reader_int64(&r)));
+      rb_hash_aset(event, RDO_PG_SYM("commit_time"),
+          rdo_postgres_replication_time(rdo_postgres_reader_int64(&r)));
+      break;
+
+    case 'R':
+      rdo_postgres_replication_pgoutput_relation(driver, &r, relations);
+      break;
+
+    case 'I':
+      relation = rdo_postgres_replication_relation(relations, rdo_postgres_reader_int32(&r));
+      rdo_postgres_reader_byte(&r); // 'N'
+      event = rdo_postgres_replication_event("insert", lsn);
+      rdo_postgres_replication_set_relation(event, relation);
+      rb_hash_aset(event, RDO_PG_SYM("new"),
+          rdo_postgres_replication_pgoutput_tuple(driver, &r, relation, buf));
+      break;
+
+    case 'U':
+      relation = rdo_postgres_replication_relation(relations, rdo_postgres_reader_int32(&r));
+      event    = rdo_postgres_replication_event("update", lsn);
+      rdo_postgres_replication_set_relation(event, relation);
+
+      kind = rdo_postgres_reader_byte(&r);
+      if (kind == 'K' || kind == 'O') {
+        rb_hash_aset(event, RDO_PG_SYM("old"),
+            rdo_postgres_replication_pgoutput_tuple(driver, &r, relation, buf));
+        rdo_postgres_reader_byte(&r); // 'N'
+      } else {
+        rb_hash_aset(event, RDO_PG_SYM("old"), Qnil);
+      }
+
+      rb_hash_aset(event, RDO_PG_SYM("new"),
+          rdo_postgres_replication_pgoutput_tuple(driver, &r, relation, buf));
+      break;
+
+    case 'D':
+      relation = rdo_postgres_replication_relation(relations, rdo_postgres_reader_int32(&r));
+      rdo_postgres_reader_byte(&r); // 'K' or 'O'
+      event = rdo_postgres_replication_event("delete", lsn);
+      rdo_postgres_replication_set_relation(event, relation);
+      rb_hash_aset(event, RDO_PG_SYM("old"),
+          rdo_postgres_replication_pgoutput_tuple(driver, &r, relation, buf));
+      break;
+
+    case 'T':
+      {
+        int32_t n       = rdo_postgres_reader_int32(&r);
+        int     options = rdo_postgres_reader_byte(&r);
+        VALUE   tables  = rb_ary_new2(n);
+
+        for (; n > 0; --n) {
+          relation = rdo_postgres_replication_relation(relations,
+              rdo_postgres_reader_int32(&r));
+          rb_ary_push(tables, rb_ary_new3(2,
+                rb_ary_entry(relation, 0), rb_ary_entry(relation, 1)));
+        }
+
+        event = rdo_postgres_replication_event("truncate", lsn);
+        rb_hash_aset(event, RDO_PG_SYM("tables"), tables);
+        rb_hash_aset(event, RDO_PG_SYM("cascade"), (options & 1) ? Qtrue : Qfalse);
+        rb_hash_aset(event, RDO_PG_SYM("restart_identity"), (options & 2) ? Qtrue : Qfalse);
+      }
+      break;
+
+    case 'M':
+      {
+        rdo_postgres_reader_byte(&r); // flags
+        rdo_postgres_reader_int64(&r); // lsn of the message
+
+        char  * prefix = rdo_postgres_reader_string(&r);
+        int32_t n      = rdo_postgres_reader_int32(&r);
+
+        rdo_postgres_reader_need(&r, n);
+
+        event = rdo_postgres_replication_event("message", lsn);
+        rb_hash_aset(event, RDO_PG_SYM("prefix"),
+            RDO_STRING(prefix, strlen(prefix), driver->encoding));
+        rb_hash_aset(event, RDO_PG_SYM("content"), RDO_BINARY_STRING(r.p, n));
+      }
+      break;
+
+    case 'Y': // type
+    case 'O': // origin
+      break;
+
+    default:
+      RDO_ERROR("Unsupported pgoutput message '%c'", kind);
+  }
+
+  RB_GC_GUARD(tmp);
+
+  return event;
+}
+
+/** Skip the spaces at *s */
+static void rdo_postgres_replication_skip_spaces(char ** s, char * end) {
+  while (*s < end && **s == ' ')
+    ++(*s);
+}
+
+/** Predicate test if the text at s starts with word */
+static int rdo_postgres_replication_starts_with(char * s, char * end, const char * word) {
+  size_t n = strlen(word);
+  return (size_t) (end - s) >= n && strncmp(s, word, n) == 0;
+}
+
+/**
+ * Read a possibly double-quoted identifier from test_decoding output into
+ * buf, stopping at the first unquoted character in delims.
+ */
+static long rdo_postgres_replication_read_ident(char ** s, char * end,
+    const char * delims, char * buf) {
+
+  char * b = buf;
+
+  while (*s < end && (**s == '"' || strchr(delims, **s) == NULL)) {
+    if (**s == '"') {
+      for (++(*s); *s < end; ++(*s)) {
+        if (**s == '"') {
+          if (*s + 1 < end && *(*s + 1) == '"') {
+            ++(*s);
+          } else {
+            break;
+          }
+        }
+        *(b++) = **s;
+      }
+      if (*s < end)
+        ++(*s);
+    } else {
+      *(b++) = *((*s)++);
+    }
+  }
+
+  *b = '\0';
+
+  return b - buf;
+}
+
+/** The Oid of a type name printed by test_decoding, without any typmod */
+static Oid rdo_postgres_replication_type_oid(char * name, long len) {
+  char   stripped[len + 1];
+  char * d = stripped;
+  long   i = 0;
+  int    depth = 0;
+
+  for (; i < len; ++i) {
+    if (name[i] == '(')
+      ++depth;
+    else if (name[i] == ')')
+      --depth;
+    else if (depth == 0)
+      *(d++) = name[i];
+  }
+
+  *d = '\0';
+
+  const RDOPostgresTypeName * t = rdo_postgres_replication_type_names;
+
+  for (; t->name != NULL; ++t) {
+    if (strcmp(t->name, stripped) == 0)
+      return t->type;
+  }
+
+  if (strncmp(stripped, "character", 9) == 0 || strcmp(stripped, "text") == 0)
+    return RDO_PG_TEXTOID;
+
+  return 0;
+}
+
+/**
+ * Read "name[type]:value" pairs into tuple until the end of the line or a
+ * keyword (e.g. "new-tuple:").
+ */
+static void rdo_postgres_replication_test_tuple(RDOPostgresDriver * driver,
+    char ** s, char * end, VALUE tuple, char * buf) {
+
+  for (;;) {
+    rdo_postgres_replication_skip_spaces(s, end);
+
+    if (*s >= end || rdo_postgres_replication_starts_with(*s, end, "new-tuple:"))
+      return;
+
+    if (rdo_postgres_replication_starts_with(*s, end, "(no-tuple-data)")) {
+      *s += 15;
+      continue;
+    }
+
+    long  nlen = rdo_postgres_replication_read_ident(s, end, "[", buf);
+    VALUE name = ID2SYM(rb_intern2(buf, nlen));
+
+    if (*s >= end)
+      RDO_ERROR("Malformed test_decoding output: expected a type");
+
+    char * type = ++(*s);
+
+    while (*s + 1 < end && !(**s == ']' && *(*s + 1) == ':'))
+      ++(*s);
+
+    Oid oid = rdo_postgres_replication_type_oid(type, *s - type);
+
+    *s += 2;
+
+    if (rdo_postgres_replication_starts_with(*s, end, "unchanged-toast-datum")) {
+      *s += 21;
+      continue;
+    }
+
+    if (rdo_postgres_replication_starts_with(*s, end, "null")
+        && (*s + 4 == end || *(*s + 4) == ' ')) {
+      *s += 4;
+      rb_hash_aset(tuple, name, Qnil);
+      continue;
+    }
+
+    char * b = buf;
+
+    if (*s < end && **s == '\'') {
+      for (++(*s); *s < end; ++(*s)) {
+        if (**s == '\'') {
+          if (*s + 1 < end && *(*s + 1) == '\'') {
+            ++(*s);
+          } else {
+            ++(*s);
+            break;
+          }
+        }
+        *(b++) = **s;
+      }
+    } else {
+      while (*s < end && **s != ' ')
+        *(b++) = *((*s)++);
+    }
+
+    *b = '\0';
+
+    rb_hash_aset(tuple, name, oid == 0
+        ? RDO_STRING(buf, b - buf, driver->encoding)
+        : rdo_postgres_cast_raw_value(buf, b - buf, oid,
+            driver->encoding, driver->cast_flags));
+  }
+}
+
+/**
+ * Decode a line of test_decoding output into an event Hash.
+ *
+ * e.g. "table public.users: UPDATE: id[integer]:1 name[text]:'bob'"
+ */
+static VALUE rdo_postgres_replication_decode_test(RDOPostgresDriver * driver,
+    char * data, long len, int64_t lsn) {
+
+  char  * s     = data;
+  char  * end   = data + len;
+  VALUE   tmp   = rb_str_buf_new(len + 1);
+  char  * buf   = RSTRING_PTR(tmp);
+  VALUE   event = Qnil;
+
+  if (rdo_postgres_replication_starts_with(s, end, "BEGIN")
+      || rdo_postgres_replication_starts_with(s, end, "COMMIT")) {
+    int begin = *s == 'B';
+
+    event = rdo_postgres_replication_event(begin ? "begin" : "commit", lsn);
+    s    += begin ? 5 : 6;
+    rdo_postgres_replication_skip_spaces(&s, end);
+
+    if (s < end) {
+      long long xid;
+      memcpy(buf, s, end - s);
+      buf[end - s] = '\0';
+      if (sscanf(buf, "%lld", &xid) == 1)
+        rb_hash_aset(event, RDO_PG_SYM("xid"), LL2NUM(xid));
+    }
+  } else if (rdo_postgres_replication_starts_with(s, end, "table ")) {
+    s += 6;
+
+    long  n      = rdo_postgres_replication_read_ident(&s, end, ".:", buf);
+    VALUE schema = RDO_STRING(buf, n, driver->encoding);
+    VALUE table;
+
+    if (s < end && *s == '.') {
+      ++s;
+      n     = rdo_postgres_replication_read_ident(&s, end, ":", buf);
+      table = RDO_STRING(buf, n, driver->encoding);
+    } else {
+      table  = schema;
+      schema = Qnil;
+    }
+
+    s += 2; // ": "
+
+    if (rdo_postgres_replication_starts_with(s, end, "INSERT:")) {
+      event = rdo_postgres_replication_event("insert", lsn);
+      s += 7;
+      rb_hash_aset(event, RDO_PG_SYM("new"), rb_hash_new());
+      rdo_postgres_replication_test_tuple(driver, &s, end,
+          rb_hash_aref(event, RDO_PG_SYM("new")), buf);
+    } else if (rdo_postgres_replication_starts_with(s, end, "UPDATE:")) {
+      VALUE tuple = rb_hash_new();
+
+      event = rdo_postgres_replication_event("update", lsn);
+      s += 7;
+      rdo_postgres_replication_skip_spaces(&s, end);
+
+      if (rdo_postgres_replication_starts_with(s, end, "old-key:")) {
+        s += 8;
+        rdo_postgres_replication_test_tuple(driver, &s, end, tuple, buf);
+        rb_hash_aset(event, RDO_PG_SYM("old"), tuple);
+        tuple = rb_hash_new();
+        s += 10; // "new-tuple:"
+      } else {
+        rb_hash_aset(event, RDO_PG_SYM("old"), Qnil);
+      }
+
+      rdo_postgres_replication_test_tuple(driver, &s, end, tuple, buf);
+      rb_hash_aset(event, RDO_PG_SYM("new"), tuple);
+    } else if (rdo_postgres_replication_starts_with(s, end, "DELETE:")) {
+      event = rdo_postgres_replication_event("delete", lsn);
+      s += 7;
+      rb_hash_aset(event, RDO_PG_SYM("old"), rb_hash_new());
+      rdo_postgres_replication_test_tuple(driver, &s, end,
+          rb_hash_aref(event, RDO_PG_SYM("old")), buf);
+    } else if (rdo_postgres_replication_starts_with(s, end, "TRUNCATE:")) {
+      event = rdo_postgres_replication_event("truncate", lsn);
+      rb_hash_aset(event, RDO_PG_SYM("tables"),
+          rb_ary_new3(1, rb_ary_new3(2, schema, table)));
+      return event;
+    } else {
+      return Qnil;
+    }
+
+    rb_hash_aset(event, RDO_PG_SYM("schema"), schema);
+    rb_hash_aset(event, RDO_PG_SYM("table"), table);
+  } else if (rdo_postgres_replication_starts_with(s, end, "message:")) {
+    event = rdo_postgres_replication_event("message", lsn);
+    rb_hash_aset(event, RDO_PG_SYM("content"), RDO_STRING(s, len, driver->encoding));
+  }
+
+  RB_GC_GUARD(tmp);
+
+  return event;
+}
+
+/** Raise with the error message in res, freeing it */
+static void rdo_postgres_replication_raise(PGresult * res, const char * what) {
+  char msg[sizeof(char) * (strlen(PQresultErrorMessage(res)) + 1)];
+  strcpy(msg, PQresultErrorMessage(res));
+  PQclear(res);
+  RDO_ERROR("%s: %s", what, msg);
+}
+
+/** Decode the payload of an XLogData message, called under rb_protect() */
+static VALUE rdo_postgres_replication_decode(VALUE arg) {
+  VALUE             * args   = (VALUE *) arg;
+  RDOPostgresDriver * driver = (RDOPostgresDriver *) args[0];
+  char              * data   = (char *) args[1];
+  long                len    = (long) args[2];
+  int64_t             lsn    = *((int64_t *) args[3]);
+
+  if (len == 0) {
+    return Qnil;
+  }
+
+  if (args[5]) {
+    return rdo_postgres_replication_decode_pgoutput(driver, data, len, lsn, args[4]);
+  }
+
+  return rdo_postgres_replication_decode_test(driver, data, len, lsn);
+}
+
+/**
+ * Read the results that follow the end of the stream.
+ *
+ * Once the server has ended the stream, libpq waits for the client to end
+ * its side too. Returns the first error, which the caller must free, or NULL.
+ */
+static PGresult * rdo_postgres_replication_finish(RDOPostgresDriver * driver) {
+  PGconn   * conn   = driver->conn_ptr;
+  PGresult * failed = NULL;
+  PGresult * res;
+
+  while (PQstatus(conn) != CONNECTION_BAD
+      && (res = rdo_postgres_driver_get_result(driver)) != NULL) {
+    ExecStatusType status = PQresultStatus(res);
+
+    if (status == PGRES_COPY_IN && PQputCopyEnd(conn, NULL) == 1) {
+      PQflush(conn);
+    }
+
+    if (failed == NULL && status == PGRES_FATAL_ERROR) {
+      failed = res;
+    } else {
+      PQclear(res);
+    }
+  }
+
+  return failed;
+}
+
+/**
+ * Send START_REPLICATION (or any command starting a COPY BOTH stream).
+ *
+ * The wait is not subject to the query timeout, since the stream runs for as
+ * long as the caller reads it.
+ */
+static VALUE rdo_postgres_driver_replication_start(VALUE self, VALUE sql) {
+  RDOPostgresDriver * driver = rdo_postgres_replication_driver(self);
+  PGresult          * res;
+
+  Check_Type(sql, T_STRING);
+
+  driver->has_deadline = 0;
+
+  if (!PQsendQuery(driver->conn_ptr, StringValueCStr(sql))) {
+    RDO_ERROR("Failed to start replication: %s", PQerrorMessage(driver->conn_ptr));
+  }
+
+  if ((res = rdo_postgres_driver_get_result(driver)) == NULL) {
+    RDO_ERROR("Failed to start replication: no result");
+  }
+
+  if (PQresultStatus(res) != PGRES_COPY_BOTH) {
+    PGresult * extra;
+    while ((extra = rdo_postgres_driver_get_result(driver)) != NULL)
+      PQclear(extra);
+    rdo_postgres_replication_raise(res, "Failed to start replication");
+  }
+
+  PQclear(res);
+
+  return Qtrue;
+}
+
+/**
+ * Read the next message from the stream, waiting up to timeout seconds.
+ *
+ * A timeout of 0 still returns a message that has already arrived.
+ *
+ * Returns [:data, wal_start, wal_end, event] for XLogData, where event is nil
+ * if the message only describes the stream; [:keepalive, wal_end,
+ * reply_requested] for keepalives; false on timeout; nil when the server
+ * ends the stream.
+ */
+static VALUE rdo_postgres_driver_replication_read(VALUE self, VALUE timeout_secs,
+    VALUE plugin, VALUE relations) {
+
+  RDOPostgresDriver * driver = rdo_postgres_replication_driver(self);
+  PGconn            * conn   = driver->conn_ptr;
+  struct timeval      deadline;
+  struct timeval      now;
+  struct timeval      remaining;
+  struct timeval    * timeout = NULL;
+  char              * buf;
+  int                 len;
+  int                 polled   = 0;
+  int                 pgoutput = SYM2ID(plugin) == rb_intern("pgoutput");
+
+  Check_Type(relations, T_HASH);
+
+  if (!NIL_P(timeout_secs)) {
+    gettimeofday(&now, NULL);
+    remaining = rb_time_interval(timeout_secs);
+    timeradd(&now, &remaining, &deadline);
+    timeout = &remaining;
+  }
+
+  for (;;) {
+    len = PQgetCopyData(conn, &buf, 1);
+
+    if (len > 0)
+      break;
+
+    if (len == -1) {
+      PGresult * failed = rdo_postgres_replication_finish(driver);
+
+      if (failed != NULL)
+        rdo_postgres_replication_raise(failed, "Replication stream failed");
+
+      return Qnil;
+    }
+
+    if (len == -2) {
+      RDO_ERROR("Replication stream failed: %s", PQerrorMessage(conn));
+    }
+
+    if (timeout != NULL) {
+      gettimeofday(&now, NULL);
+      if (timercmp(&now, &deadline, <)) {
+        timersub(&deadline, &now, &remaining);
+      } else if (polled) {
+        return Qfalse;
+      } else {
+        // with no time left, still read what has already arrived, once
+        timerclear(&remaining);
+        polled = 1;
+      }
+    }
+
+    rdo_postgres_driver_wait_readable(driver, timeout);
+
+    if (!PQconsumeInput(conn)) {
+      RDO_ERROR("Failed to read from connection: %s", PQerrorMessage(conn));
+    }
+  }
+
+  RDOPostgresReader r = { buf, buf + len };
+  VALUE             message;
+  int               state;
+
+  // buf must be freed whatever happens while decoding
+  switch (buf[0]) {
+    case 'w':
+      {
+        r.p++;
+
+        int64_t start = 0;
+        int64_t end   = 0;
+
+        if (len >= 25) {
+          start = rdo_postgres_reader_int64(&r);
+          end   = rdo_postgres_reader_int64(&r);
+          rdo_postgres_reader_int64(&r); // send time
+        }
+
+        VALUE args[] = {
+          (VALUE) driver, (VALUE) r.p, (VALUE) (r.end - r.p),
+          (VALUE) &start, relations, (VALUE) pgoutput
+        };
+
+        message = rb_ary_new3(4, RDO_PG_SYM("data"), LL2NUM(start), LL2NUM(end), Qnil);
+
+        VALUE event = rb_protect(rdo_postgres_replication_decode, (VALUE) args, &state);
+
+        if (state) {
+          PQfreemem(buf);
+          rb_jump_tag(state);
+        }
+
+        rb_ary_store(message, 3, event);
+      }
+      break;
+
+    case 'k':
+      r.p++;
+      if (len < 18) {
+        PQfreemem(buf);
+        RDO_ERROR("Malformed replication keepalive");
+      }
+      {
+        int64_t end = rdo_postgres_reader_int64(&r);
+        rdo_postgres_reader_int64(&r); // send time
+        message = rb_ary_new3(3, RDO_PG_SYM("keepalive"), LL2NUM(end),
+            rdo_postgres_reader_byte(&r) ? Qtrue : Qfalse);
+      }
+      break;
+
+    default:
+      state = buf[0];
+      PQfreemem(buf);
+      RDO_ERROR("Unexpected replication message '%c'", state);
+  }
+
+  PQfreemem(buf);
+
+  return message;
+}
+
+/** Write a message to the stream and flush it */
+static void rdo_postgres_replication_put(RDOPostgresDriver * driver,
+    char * msg, int len) {
+
+  PGconn * conn = driver->conn_ptr;
+  int      flushed;
+
+  if (PQputCopyData(conn, msg, len) != 1) {
+    RDO_ERROR("Failed to send to replication stream: %s", PQerrorMessage(conn));
+  }
+
+  while ((flushed = PQflush(conn)) == 1) {
+    rb_wait_for_single_fd(PQsocket(conn), RB_WAITFD_OUT, NULL);
+  }
+
+  if (flushed < 0) {
+    RDO_ERROR("Failed to send to replication stream: %s", PQerrorMessage(conn));
+  }
+}
+
+/** Append n as 8 big-endian bytes */
+static char * rdo_postgres_replication_put_int64(char * p, int64_t n) {
+  int i = 7;
+  for (; i >= 0; --i, n >>= 8)
+    p[i] = (char) (n & 0xFF);
+  return p + 8;
+}
+
+/**
+ * Send a standby status update.
+ *
+ * The server may discard WAL up to flushed, so only pass positions whose
+ * changes have been fully processed.
+ */
+static VALUE rdo_postgres_driver_replication_status(VALUE self, VALUE written,
+    VALUE flushed, VALUE applied, VALUE reply) {
+
+  RDOPostgresDriver * driver = rdo_postgres_replication_driver(self);
+  char                msg[34];
+  char              * p = msg;
+
+  *(p++) = 'r';
+  p = rdo_postgres_replication_put_int64(p, NUM2LL(written));
+  p = rdo_postgres_replication_put_int64(p, NUM2LL(flushed));
+  p = rdo_postgres_replication_put_int64(p, NUM2LL(applied));
+  p = rdo_postgres_replication_put_int64(p, rdo_postgres_replication_now());
+  *(p++) = RTEST(reply) ? 1 : 0;
+
+  rdo_postgres_replication_put(driver, msg, sizeof(msg));
+
+  return Qtrue;
+}
+
+/**
+ * End the stream, discarding anything the server sends before it stops.
+ *
+ * The connection can then be used for commands again.
+ */
+static VALUE rdo_postgres_driver_replication_stop(VALUE self) {
+  RDOPostgresDriver * driver;
+  PGresult          * res;
+  char              * buf;
+  int                 len;
+
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  if (!(driver->is_open) || PQstatus(driver->conn_ptr) == CONNECTION_BAD) {
+    return Qnil;
+  }
+
+  PGconn * conn = driver->conn_ptr;
+
+  driver->has_deadline = 0;
+
+  if (PQputCopyEnd(conn, NULL) == 1) {
+    PQflush(conn);
+  }
+
+  while ((len = PQgetCopyData(conn, &buf, 1)) >= 0) {
+    if (len > 0) {
+      PQfreemem(buf);
+    } else {
+      rdo_postgres_driver_wait_readable(driver, NULL);
+      if (!PQconsumeInput(conn))
+        break;
+    }
+  }
+
+  if ((res = rdo_postgres_replication_finish(driver)) != NULL) {
+    PQclear(res);
+  }
+
+  return Qnil;
+}
+
+void Init_rdo_postgres_replication(void) {
+  VALUE cDriver = rb_path2class("RDO::Postgres::Driver");
+
+  rb_define_private_method(cDriver,
+      "replication_start", rdo_postgres_driver_replication_start, 1);
+
+  rb_define_private_method(cDriver,
+      "replication_read", rdo_postgres_driver_replication_read, 3);
+
+  rb_define_private_method(cDriver,
+      "replication_status", rdo_postgres_driver_replication_status, 4);
+
+  rb_define_private_method(cDriver,
+      "replication_stop", rdo_postgres_driver_replication_stop, 0);
+}
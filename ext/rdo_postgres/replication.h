@@ -0,0 +1,11 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include <ruby.h>
+
+/** Initializer for the Driver methods used to stream changes (see ReplicationStream) */
+void Init_rdo_postgres_replication(void);
@@ -0,0 +1,223 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#include "spool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/** Open an anonymous temp file in $TMPDIR (or /tmp), removed once closed */
+static FILE * rdo_postgres_spool_tmpfile(void) {
+  const char * dir = getenv("TMPDIR");
+  char         path[4096];
+  FILE       * file;
+  int          fd;
+
+  if (dir == NULL || *dir == '\0') {
+    dir = "/tmp";
+  }
+
+  if (snprintf(path, sizeof(path), "%s/rdo_pg_spool_XXXXXX", dir) >= (int) sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+
+  if ((fd = mkstemp(path)) < 0) {
+    return NULL;
+  }
+
+  unlink(path);
+
+  if ((file = fdopen(fd, "w+")) == NULL) {
+    close(fd);
+  }
+
+  return file;
+}
+
+/** Move the bytes held so far into a temp file, which receives all later writes */
+static int rdo_postgres_spool_stream_spill(RDOPostgresSpoolStream * stream) {
+  if ((stream->file = rdo_postgres_spool_tmpfile()) == NULL) {
+    return 0;
+  }
+
+  if (stream->size > 0
+      && fwrite(stream->data, 1, stream->size, stream->file) != stream->size) {
+    return 0;
+  }
+
+  free(stream->data);
+  stream->data     = NULL;
+  stream->capacity = 0;
+
+  return 1;
+}
+
+/** Append n bytes to the stream, spilling it first if it would pass its limit */
+static int rdo_postgres_spool_stream_write(RDOPostgresSpoolStream * stream,
+    const void * bytes, size_t n) {
+
+  if (stream->file == NULL && stream->size + n > stream->limit
+      && !rdo_postgres_spool_stream_spill(stream)) {
+    return 0;
+  }
+
+  if (stream->file != NULL) {
+    if (fwrite(bytes, 1, n, stream->file) != n) {
+      return 0;
+    }
+  } else {
+    if (stream->size + n > stream->capacity) {
+      size_t capacity = stream->capacity ? stream->capacity : 4096;
+      char * data;
+
+      while (capacity < stream->size + n)
+        capacity *= 2;
+
+      if ((data = realloc(stream->data, capacity)) == NULL) {
+        errno = ENOMEM;
+        return 0;
+      }
+
+      stream->data     = data;
+      stream->capacity = capacity;
+    }
+
+    memcpy(stream->data + stream->size, bytes, n);
+  }
+
+  stream->size += n;
+
+  return 1;
+}
+
+/** Map a spilled stream so it can be read like one held in memory */
+static int rdo_postgres_spool_stream_finish(RDOPostgresSpoolStream * stream) {
+  void * map;
+
+  if (stream->file == NULL || stream->mapped) {
+    return 1;
+  }
+
+  if (fflush(stream->file) != 0) {
+    return 0;
+  }
+
+  map = mmap(NULL, stream->size, PROT_READ, MAP_SHARED, fileno(stream->file), 0);
+
+  if (map == MAP_FAILED) {
+    return 0;
+  }
+
+  stream->data   = map;
+  stream->mapped = 1;
+
+  return 1;
+}
+
+/** Release a stream's memory, mapping and temp file */
+static void rdo_postgres_spool_stream_free(RDOPostgresSpoolStream * stream) {
+  if (stream->mapped) {
+    munmap(stream->data, stream->size);
+  } else {
+    free(stream->data);
+  }
+
+  if (stream->file != NULL) {
+    fclose(stream->file);
+  }
+}
+
+RDOPostgresSpool * rdo_postgres_spool_new(size_t limit) {
+  RDOPostgresSpool * spool = calloc(1, sizeof(RDOPostgresSpool));
+
+  if (spool != NULL) {
+    spool->rows.limit    = limit;
+    spool->offsets.limit = limit;
+  }
+
+  return spool;
+}
+
+int rdo_postgres_spool_append(RDOPostgresSpool * spool, PGresult * res, int row) {
+  uint64_t offset  = spool->rows.size;
+  int      nfields = PQnfields(res);
+  int      j       = 0;
+
+  for (; j < nfields; ++j) {
+    int32_t length = PQgetisnull(res, row, j) ? -1 : PQgetlength(res, row, j);
+
+    if (!rdo_postgres_spool_stream_write(&spool->rows, &length, sizeof(length))) {
+      return 0;
+    }
+
+    // values are kept NUL-terminated, as the casts expect
+    if (length >= 0
+        && !rdo_postgres_spool_stream_write(&spool->rows,
+          PQgetvalue(res, row, j), length + 1)) {
+      return 0;
+    }
+  }
+
+  if (!rdo_postgres_spool_stream_write(&spool->offsets, &offset, sizeof(offset))) {
+    return 0;
+  }
+
+  spool->ntuples++;
+
+  return 1;
+}
+
+int rdo_postgres_spool_finish(RDOPostgresSpool * spool) {
+  return rdo_postgres_spool_stream_finish(&spool->rows)
+    && rdo_postgres_spool_stream_finish(&spool->offsets);
+}
+
+char * rdo_postgres_spool_row(RDOPostgresSpool * spool, long i) {
+  uint64_t offset;
+  memcpy(&offset, spool->offsets.data + i * sizeof(uint64_t), sizeof(uint64_t));
+  return spool->rows.data + offset;
+}
+
+char * rdo_postgres_spool_value(char ** cursor, int * length) {
+  int32_t len;
+  char  * value;
+
+  memcpy(&len, *cursor, sizeof(len));
+  *cursor += sizeof(len);
+
+  if (len < 0) {
+    *length = 0;
+    return NULL;
+  }
+
+  value    = *cursor;
+  *cursor += len + 1;
+  *length  = len;
+
+  return value;
+}
+
+size_t rdo_postgres_spool_memsize(RDOPostgresSpool * spool) {
+  return (spool->rows.mapped ? 0 : spool->rows.capacity)
+    + (spool->offsets.mapped ? 0 : spool->offsets.capacity);
+}
+
+int rdo_postgres_spool_spilled_p(RDOPostgresSpool * spool) {
+  return spool->rows.file != NULL || spool->offsets.file != NULL;
+}
+
+void rdo_postgres_spool_free(RDOPostgresSpool * spool) {
+  if (spool == NULL)
+    return;
+
+  rdo_postgres_spool_stream_free(&spool->rows);
+  rdo_postgres_spool_stream_free(&spool->offsets);
+  free(spool);
+}
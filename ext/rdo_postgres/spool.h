@@ -0,0 +1,66 @@
+/*
+ * RDO Postgres Driver.
+ * Copyright © 2012 Chris Corbyn.
+ *
+ * See LICENSE file for details.
+ */
+
+#ifndef RDO_POSTGRES_SPOOL_H
+#define RDO_POSTGRES_SPOOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libpq-fe.h>
+
+/** Bytes that grow in memory up to a limit, then continue in a temp file */
+typedef struct {
+  FILE   * file;
+  char   * data;
+  size_t   size;
+  size_t   capacity;
+  size_t   limit;
+  int      mapped;
+} RDOPostgresSpoolStream;
+
+/**
+ * Rows of a result, stored compactly for repeated and random access.
+ *
+ * Each row is stored as, for each column, an int32 length (-1 for NULL)
+ * followed by that many bytes and a NUL. A second stream holds the uint64
+ * offset of each row. Once finished, spilled streams are memory-mapped.
+ */
+typedef struct {
+  RDOPostgresSpoolStream rows;
+  RDOPostgresSpoolStream offsets;
+  long                   ntuples;
+} RDOPostgresSpool;
+
+/** Allocate a spool keeping up to limit bytes of each stream in memory */
+RDOPostgresSpool * rdo_postgres_spool_new(size_t limit);
+
+/** Append row of res. Returns 0 and sets errno on failure. */
+int rdo_postgres_spool_append(RDOPostgresSpool * spool, PGresult * res, int row);
+
+/** Map any spilled streams for reading. Returns 0 and sets errno on failure. */
+int rdo_postgres_spool_finish(RDOPostgresSpool * spool);
+
+/** The stored bytes of row i, for reading with rdo_postgres_spool_value() */
+char * rdo_postgres_spool_row(RDOPostgresSpool * spool, long i);
+
+/**
+ * Read the next value of a row and advance the cursor past it.
+ *
+ * Returns a NUL-terminated pointer to the value, or NULL if it is NULL.
+ */
+char * rdo_postgres_spool_value(char ** cursor, int * length);
+
+/** Bytes held in memory, which excludes spilled and mapped data */
+size_t rdo_postgres_spool_memsize(RDOPostgresSpool * spool);
+
+/** Predicate test if any of the spool was written to a temp file */
+int rdo_postgres_spool_spilled_p(RDOPostgresSpool * spool);
+
+/** Unmap, close and free everything */
+void rdo_postgres_spool_free(RDOPostgresSpool * spool);
+
+#endif
@@ -9,11 +9,14 @@
 #include "driver.h"
 #include "params.h"
 #include "tuples.h"
+#include "arrays.h"
 #include "macros.h"
 #include <stdlib.h>
 #include <libpq-fe.h>
 #include "types.h"
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 
 /** I don't like magic numbers */
 #define RDO_PG_NO_OIDS 0
@@ -21,6 +24,9 @@
 #define RDO_PG_TEXT_INPUT NULL
 #define RDO_PG_TEXT_OUTPUT 0
 
+/** Number of parameter sets sent in one pipeline before reading results */
+#define RDO_PG_PIPELINE_BATCH 256
+
 /** Wrap a Ruby Array with a RDO::Postgres::Array */
 #define RDO_PG_WRAP_ARRAY(clsname, a) \
   (rb_funcall(rb_path2class("RDO::Postgres::Array::" clsname), \
@@ -33,32 +39,104 @@ static VALUE rdo_postgres_cStatementExecutor;
 typedef struct {
   char              * stmt_name;
   char              * cmd;
+  int                 generation;
+  int                 prepared;
+  int                 deferred;
   int                 nparams;
   Oid               * param_types;
+  int                 nfields;
+  char             ** field_names;
+  Oid               * field_types;
+  int               * field_formats;
   RDOPostgresDriver * driver;
   VALUE               driver_obj;
 } RDOPostgresStatementExecutor;
 
+/** Type of the bind parameter at index i, or 0 if not yet described */
+#define RDO_PG_PARAM_TYPE(executor, i) \
+  ((executor)->param_types == NULL ? 0 : (executor)->param_types[i])
+
 /** Claim ownership of driver during GC */
 static void rdo_postgres_statement_executor_mark(RDOPostgresStatementExecutor * executor) {
   rb_gc_mark(executor->driver_obj);
 }
 
-/** Free memory associated with the StatementExecutor during GC */
+/** Release the memory holding the result of PQdescribePrepared() */
+static void rdo_postgres_statement_executor_free_description(
+    RDOPostgresStatementExecutor * executor) {
+
+  int i = 0;
+  for (; i < executor->nfields; ++i)
+    free(executor->field_names[i]);
+
+  free(executor->param_types);
+  free(executor->field_names);
+  free(executor->field_types);
+  free(executor->field_formats);
+
+  executor->nparams       = 0;
+  executor->param_types   = NULL;
+  executor->nfields       = 0;
+  executor->field_names   = NULL;
+  executor->field_types   = NULL;
+  executor->field_formats = NULL;
+}
+
+/**
+ * Free memory associated with the StatementExecutor during GC.
+ *
+ * The prepared statement is not deallocated here, since that would block GC
+ * on a round trip and could interleave with a query already in progress.
+ * Instead the name is queued on the driver and sent with a later prepare.
+ */
 static void rdo_postgres_statement_executor_free(RDOPostgresStatementExecutor * executor) {
-  if (executor->driver->is_open) {
-    char dealloc_cmd[strlen(executor->stmt_name) + 12];
-    sprintf(dealloc_cmd, "DEALLOCATE %s", executor->stmt_name);
-    PQclear(PQexec(executor->driver->conn_ptr, dealloc_cmd));
+  if (executor->prepared
+      && executor->driver->is_open
+      && executor->generation == executor->driver->generation) {
+    rdo_postgres_driver_defer_deallocate(executor->driver, executor->stmt_name);
+  } else {
+    free(executor->stmt_name);
   }
 
   executor->driver->ref_count--;
-  free(executor->stmt_name);
+  rdo_postgres_statement_executor_free_description(executor);
   free(executor->cmd);
-  free(executor->param_types);
   free(executor);
 }
 
+/**
+ * Raise unless the statement can run on the driver's current connection.
+ *
+ * A statement prepared on a connection that has since been closed or
+ * reopened no longer exists under its name there, so it must be prepared
+ * again. One that was never prepared simply moves to the new connection.
+ */
+static void rdo_postgres_statement_executor_check_open(
+    RDOPostgresStatementExecutor * executor) {
+
+  if (!(executor->driver->is_open)) {
+    RDO_ERROR("Unable to execute statement: connection is not open");
+  }
+
+  if (executor->generation != executor->driver->generation) {
+    if (executor->prepared) {
+      RDO_ERROR("Unable to execute statement: it was prepared on a connection "
+          "that has since been closed");
+    }
+
+    executor->generation = executor->driver->generation;
+  }
+}
+
+/** Predicate test if the statement was prepared on a connection since closed */
+static VALUE rdo_postgres_statement_executor_stale_p(VALUE self) {
+  RDOPostgresStatementExecutor * executor;
+  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+
+  return executor->prepared
+    && executor->generation != executor->driver->generation ? Qtrue : Qfalse;
+}
+
 /** Extract information about the result into a ruby Hash */
 static VALUE rdo_postgres_result_info_new(PGresult * res) {
   VALUE info = rb_hash_new();
@@ -71,61 +149,254 @@ static VALUE rdo_postgres_result_info_new(PGresult * res) {
   return info;
 }
 
-/** Actually issue the PQprepare() command */
-static void rdo_postgres_statement_executor_prepare(VALUE self) {
-  RDOPostgresStatementExecutor * executor;
-  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+/** Raise an RDO::Exception if res is an error, clearing it first */
+static void rdo_postgres_statement_executor_check_result(PGresult * res,
+    const char * what) {
 
-  if (!(executor->driver->is_open)) {
-    RDO_ERROR("Unable to prepare statement: connection is not open");
+  ExecStatusType status = PQresultStatus(res);
+
+  if (status == PGRES_BAD_RESPONSE || status == PGRES_FATAL_ERROR) {
+    char msg[sizeof(char) * (strlen(PQresultErrorMessage(res)) + 1)];
+    strcpy(msg, PQresultErrorMessage(res));
+    PQclear(res);
+    RDO_ERROR("Failed to %s: %s", what, msg);
   }
+}
 
-  char           * cmd = rdo_postgres_params_inject_markers(executor->cmd);
-  PGresult       * res;
-  ExecStatusType   status;
+/** Keep the parameter and result column info from PQdescribePrepared() */
+static void rdo_postgres_statement_executor_describe(
+    RDOPostgresStatementExecutor * executor, PGresult * res) {
 
-  res = PQprepare(
-      executor->driver->conn_ptr,
-      executor->stmt_name,
-      cmd,
-      RDO_PG_NO_OIDS,
-      RDO_PG_INFER_TYPES);
+  int i;
+
+  rdo_postgres_statement_executor_free_description(executor);
+
+  executor->nparams     = PQnparams(res);
+  executor->param_types = malloc(sizeof(Oid) * executor->nparams);
+
+  for (i = 0; i < executor->nparams; ++i) {
+    executor->param_types[i] = PQparamtype(res, i);
+  }
+
+  executor->nfields       = PQnfields(res);
+  executor->field_names   = malloc(sizeof(char *) * executor->nfields);
+  executor->field_types   = malloc(sizeof(Oid) * executor->nfields);
+  executor->field_formats = malloc(sizeof(int) * executor->nfields);
+
+  for (i = 0; i < executor->nfields; ++i) {
+    executor->field_names[i]   = strdup(PQfname(res, i));
+    executor->field_types[i]   = PQftype(res, i);
+    executor->field_formats[i] = PQfformat(res, i);
+  }
+
+  executor->prepared = 1;
+}
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+
+/**
+ * Read anything left in the pipeline and return the connection to normal mode.
+ *
+ * Called from ensure blocks. If the call was interrupted (e.g. by Thread#raise)
+ * rather than failing on an error from the server, the query still running is
+ * cancelled first, so that draining does not wait for it to finish.
+ */
+static void rdo_postgres_statement_executor_pipeline_drain(RDOPostgresDriver * driver,
+    int synced) {
+
+  PGconn   * conn  = driver->conn_ptr;
+  VALUE      error = rb_errinfo();
+  PGresult * res;
+
+  if (!synced) {
+    PQpipelineSync(conn);
+  }
+
+  if (!NIL_P(error) && !rb_obj_is_kind_of(error, rb_path2class("RDO::Exception"))) {
+    rdo_postgres_driver_abandon(driver);
+  }
+
+  while (!PQexitPipelineMode(conn) && PQstatus(conn) != CONNECTION_BAD) {
+    while ((res = PQgetResult(conn)) != NULL) {
+      PQclear(res);
+    }
+  }
+}
+
+/** Return the next result in the pipeline, consuming the NULL that follows it */
+static PGresult * rdo_postgres_statement_executor_pipeline_result(
+    RDOPostgresDriver * driver) {
+
+  PGresult * res = rdo_postgres_driver_get_result(driver);
+
+  if (res != NULL && PQresultStatus(res) != PGRES_PIPELINE_SYNC) {
+    PQclear(rdo_postgres_driver_get_result(driver));
+  }
+
+  return res;
+}
+
+/** State for a pipelined prepare, describe and optional first execution */
+typedef struct {
+  RDOPostgresStatementExecutor * executor;
+  int                            argc;
+  char                        ** values;
+  size_t                       * lengths;
+  PGresult                     * result;
+  int                            synced;
+} RDOPostgresPrepareFlight;
+
+/**
+ * Send any queued DEALLOCATEs, PQsendPrepare(), PQsendDescribePrepared() and
+ * (if values is not NULL) PQsendQueryPrepared() together, then read the results.
+ *
+ * The DEALLOCATEs are synced separately so that they cannot abort the prepare.
+ * The result of the execution, if any, is left in flight->result. Each result
+ * is checked as it is read, so nothing is left allocated if one fails or the
+ * query times out; the ensure block drains the rest.
+ */
+static VALUE rdo_postgres_statement_executor_prepare_flight(VALUE arg) {
+  RDOPostgresPrepareFlight     * flight   = (RDOPostgresPrepareFlight *) arg;
+  RDOPostgresStatementExecutor * executor = flight->executor;
+  PGconn                       * conn     = executor->driver->conn_ptr;
+  PGresult                     * res;
+  int                            ndeallocs;
+  int                            i;
+
+  ndeallocs = rdo_postgres_driver_pipeline_deallocations(executor->driver);
+
+  char * cmd = rdo_postgres_params_inject_markers(executor->cmd);
+
+  PQsendPrepare(conn, executor->stmt_name, cmd, RDO_PG_NO_OIDS, RDO_PG_INFER_TYPES);
+  PQsendDescribePrepared(conn, executor->stmt_name);
 
   free(cmd);
 
-  status = PQresultStatus(res);
+  if (flight->values != NULL) {
+    PQsendQueryPrepared(
+        conn,
+        executor->stmt_name,
+        flight->argc,
+        (const char **) flight->values,
+        (const int *) flight->lengths,
+        RDO_PG_TEXT_INPUT,
+        RDO_PG_TEXT_OUTPUT);
+  }
 
-  if (status != PGRES_BAD_RESPONSE && status != PGRES_FATAL_ERROR) {
-    PQclear(res);
-  } else {
-    char msg[sizeof(char) * (strlen(PQresultErrorMessage(res)) + 1)];
-    strcpy(msg, PQresultErrorMessage(res));
-    PQclear(res);
-    RDO_ERROR("Failed to prepare statement: %s", msg);
+  PQpipelineSync(conn);
+  flight->synced = 1;
+
+  for (i = 0; i < ndeallocs; ++i) {
+    PQclear(rdo_postgres_statement_executor_pipeline_result(executor->driver));
+    PQclear(rdo_postgres_statement_executor_pipeline_result(executor->driver)); // sync
   }
 
-  res = PQdescribePrepared(executor->driver->conn_ptr, executor->stmt_name);
+  res = rdo_postgres_statement_executor_pipeline_result(executor->driver);
+  rdo_postgres_statement_executor_check_result(res, "prepare statement");
+  PQclear(res);
 
-  if (status != PGRES_COMMAND_OK) {
-    char msg[sizeof(char) * (strlen(PQresultErrorMessage(res)) + 1)];
-    strcpy(msg, PQresultErrorMessage(res));
-    PQclear(res);
-    RDO_ERROR("Failed to prepare statement: %s", msg);
+  res = rdo_postgres_statement_executor_pipeline_result(executor->driver);
+  rdo_postgres_statement_executor_check_result(res, "prepare statement");
+  rdo_postgres_statement_executor_describe(executor, res);
+  PQclear(res);
+
+  if (flight->values != NULL) {
+    flight->result = rdo_postgres_statement_executor_pipeline_result(executor->driver);
   }
 
-  executor->nparams     = PQnparams(res);
-  executor->param_types = malloc(sizeof(Oid) * executor->nparams);
+  return Qnil;
+}
 
-  int i = 0;
-  for (; i < executor->nparams; ++i) {
-    executor->param_types[i] = PQparamtype(res, i);
+/** Ensure block for prepare_flight(), leaving the connection out of pipeline mode */
+static VALUE rdo_postgres_statement_executor_prepare_flight_ensure(VALUE arg) {
+  RDOPostgresPrepareFlight * flight = (RDOPostgresPrepareFlight *) arg;
+  rdo_postgres_statement_executor_pipeline_drain(
+      flight->executor->driver, flight->synced);
+  return Qnil;
+}
+
+/**
+ * Prepare, describe and optionally execute in a single round trip.
+ *
+ * Returns the result of the execution, or NULL if values is NULL.
+ */
+static PGresult * rdo_postgres_statement_executor_pipeline_prepare(
+    RDOPostgresStatementExecutor * executor,
+    int argc, char ** values, size_t * lengths) {
+
+  RDOPostgresPrepareFlight flight = {
+    .executor = executor,
+    .argc     = argc,
+    .values   = values,
+    .lengths  = lengths,
+    .result   = NULL,
+    .synced   = 0
+  };
+
+  if (!PQenterPipelineMode(executor->driver->conn_ptr)) {
+    RDO_ERROR("Failed to enter pipeline mode: %s",
+        PQerrorMessage(executor->driver->conn_ptr));
   }
 
+  rb_ensure(
+      rdo_postgres_statement_executor_prepare_flight, (VALUE) &flight,
+      rdo_postgres_statement_executor_prepare_flight_ensure, (VALUE) &flight);
+
+  return flight.result;
+}
+
+#endif
+
+/**
+ * Actually issue the PQprepare() command, and describe the statement.
+ *
+ * With libpq >= 14 both are pipelined into a single round trip.
+ */
+static void rdo_postgres_statement_executor_prepare(
+    RDOPostgresStatementExecutor * executor) {
+
+  if (!(executor->driver->is_open)) {
+    RDO_ERROR("Unable to prepare statement: connection is not open");
+  }
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+  rdo_postgres_statement_executor_pipeline_prepare(executor, 0, NULL, NULL);
+#else
+  rdo_postgres_driver_flush_deallocations(executor->driver, 0);
+
+  char     * cmd = rdo_postgres_params_inject_markers(executor->cmd);
+  PGresult * res;
+
+  res = rdo_postgres_driver_exec_result(executor->driver,
+      PQsendPrepare(
+        executor->driver->conn_ptr,
+        executor->stmt_name,
+        cmd,
+        RDO_PG_NO_OIDS,
+        RDO_PG_INFER_TYPES));
+
+  free(cmd);
+
+  rdo_postgres_statement_executor_check_result(res, "prepare statement");
   PQclear(res);
+
+  res = rdo_postgres_driver_exec_result(executor->driver,
+      PQsendDescribePrepared(executor->driver->conn_ptr, executor->stmt_name));
+
+  rdo_postgres_statement_executor_check_result(res, "prepare statement");
+  rdo_postgres_statement_executor_describe(executor, res);
+  PQclear(res);
+#endif
 }
 
-/** Factory method to return a new StatementExecutor */
-VALUE rdo_postgres_statement_executor_new(VALUE driver, VALUE cmd, VALUE name) {
+/**
+ * Factory method to return a new StatementExecutor.
+ *
+ * If deferred is non-zero, nothing is sent to the server until the first
+ * execution, so that prepare, describe and execute can share a round trip.
+ */
+VALUE rdo_postgres_statement_executor_new(VALUE driver, VALUE cmd, VALUE name,
+    int deferred) {
   Check_Type(cmd,  T_STRING);
   Check_Type(name, T_STRING);
 
@@ -136,8 +407,15 @@ VALUE rdo_postgres_statement_executor_new(VALUE driver, VALUE cmd, VALUE name) {
   executor->driver_obj  = driver;
   executor->stmt_name   = strdup(RSTRING_PTR(name));
   executor->cmd         = strdup(RSTRING_PTR(cmd));
-  executor->nparams     = 0;
-  executor->param_types = NULL;
+  executor->generation    = executor->driver->generation;
+  executor->prepared      = 0;
+  executor->deferred      = deferred;
+  executor->nparams       = 0;
+  executor->param_types   = NULL;
+  executor->nfields       = 0;
+  executor->field_names   = NULL;
+  executor->field_types   = NULL;
+  executor->field_formats = NULL;
   executor->driver->ref_count++;
 
   VALUE self = Data_Wrap_Struct(rdo_postgres_cStatementExecutor,
@@ -152,7 +430,14 @@ VALUE rdo_postgres_statement_executor_new(VALUE driver, VALUE cmd, VALUE name) {
 
 /** Initialize the StatementExecutor with the given driver and command */
 static VALUE rdo_postgres_statement_executor_initialize(VALUE self, VALUE driver) {
-  rdo_postgres_statement_executor_prepare(self);
+  RDOPostgresStatementExecutor * executor;
+  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+
+  if (!executor->deferred) {
+    rdo_postgres_driver_start_deadline(executor->driver);
+    rdo_postgres_statement_executor_prepare(executor);
+  }
+
   return self;
 }
 
@@ -163,26 +448,94 @@ static VALUE rdo_postgres_statement_executor_command(VALUE self) {
   return rb_str_new2(executor->cmd);
 }
 
-/** Execute with PQexecPrepared() and return a Result */
-static VALUE rdo_postgres_statement_executor_execute(int argc, VALUE * args,
-    VALUE self) {
-
+/** Describe the result columns as an Array of Hashes with :name, :type and :format */
+static VALUE rdo_postgres_statement_executor_columns(VALUE self) {
   RDOPostgresStatementExecutor * executor;
   Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
 
-  if (!(executor->driver->is_open)) {
-    RDO_ERROR("Unable to execute statement: connection is not open");
+  if (!executor->prepared) {
+    rdo_postgres_driver_start_deadline(executor->driver);
+    rdo_postgres_statement_executor_prepare(executor);
+  }
+
+  VALUE columns = rb_ary_new2(executor->nfields);
+  int   i       = 0;
+
+  for (; i < executor->nfields; ++i) {
+    VALUE col = rb_hash_new();
+    rb_hash_aset(col, ID2SYM(rb_intern("name")),
+        ID2SYM(rb_intern(executor->field_names[i])));
+    rb_hash_aset(col, ID2SYM(rb_intern("type")),
+        UINT2NUM(executor->field_types[i]));
+    rb_hash_aset(col, ID2SYM(rb_intern("format")),
+        ID2SYM(rb_intern(executor->field_formats[i] ? "binary" : "text")));
+    rb_ary_push(columns, col);
   }
 
+  return columns;
+}
+
+/** Raise an ArgumentError unless argc matches the described parameter count */
+static void rdo_postgres_statement_executor_check_argc(
+    RDOPostgresStatementExecutor * executor, int argc) {
+
   if (argc != executor->nparams) {
     rb_raise(rb_eArgError,
         "Bind parameter count mismatch: wanted %i, got %i",
         executor->nparams, argc);
   }
+}
 
-  char * values[argc];
-  size_t lengths[argc];
-  int    i;
+#ifdef HAVE_PQENTERPIPELINEMODE
+
+/**
+ * Predicate test if args encode the same way whatever their parameter types.
+ *
+ * Arrays and bytea values depend on the parameter types, so need the statement
+ * to be described before they can be encoded. Binary Strings, and Strings not
+ * valid in their encoding, are likely bytea values. Non-String values are
+ * replaced with their #to_s as they are checked.
+ */
+static int rdo_postgres_statement_executor_untyped_params_p(int argc, VALUE * args) {
+  int i = 0;
+
+  for (; i < argc; ++i) {
+    switch (TYPE(args[i])) {
+      case T_NIL:
+        break;
+
+      case T_ARRAY:
+        return 0;
+
+      default:
+        if (TYPE(args[i]) != T_STRING) {
+          args[i] = RDO_OBJ_TO_S(args[i]);
+        }
+
+        if (ENCODING_GET(args[i]) == rb_ascii8bit_encindex()
+            || rb_enc_str_coderange(args[i]) == ENC_CODERANGE_BROKEN
+            || memchr(RSTRING_PTR(args[i]), '\\', RSTRING_LEN(args[i])) != NULL
+            || memchr(RSTRING_PTR(args[i]), '\0', RSTRING_LEN(args[i])) != NULL) {
+          return 0;
+        }
+    }
+  }
+
+  return 1;
+}
+
+#endif
+
+/**
+ * Convert bind parameters to the strings sent to the server.
+ *
+ * If the statement has not been described yet, all values are sent as text.
+ */
+static void rdo_postgres_statement_executor_encode_params(
+    RDOPostgresStatementExecutor * executor,
+    int argc, VALUE * args, char ** values, size_t * lengths) {
+
+  int i;
 
   for (i = 0; i < argc; ++i) {
     if (TYPE(args[i]) == T_NIL) {
@@ -190,10 +543,11 @@ static VALUE rdo_postgres_statement_executor_execute(int argc, VALUE * args,
       lengths[i] = 0;
     } else {
       if (TYPE(args[i]) == T_ARRAY) {
-        if (executor->param_types[i] == RDO_PG_BYTEAARRAYOID) {
+        if (RDO_PG_PARAM_TYPE(executor, i) == RDO_PG_BYTEAARRAYOID) {
           args[i] = RDO_PG_WRAP_ARRAY("Bytea", args[i]);
         } else {
-          args[i] = RDO_PG_WRAP_ARRAY("Text", args[i]);
+          VALUE encoded = rdo_postgres_array_encode_text(args[i]);
+          args[i] = NIL_P(encoded) ? RDO_PG_WRAP_ARRAY("Text", args[i]) : encoded;
         }
       }
 
@@ -201,7 +555,7 @@ static VALUE rdo_postgres_statement_executor_execute(int argc, VALUE * args,
         args[i] = RDO_OBJ_TO_S(args[i]);
       }
 
-      if (executor->param_types[i] == RDO_PG_BYTEAOID) {
+      if (RDO_PG_PARAM_TYPE(executor, i) == RDO_PG_BYTEAOID) {
         values[i] = (char *) PQescapeByteaConn(executor->driver->conn_ptr,
             (unsigned char *) RSTRING_PTR(args[i]),
             RSTRING_LEN(args[i]),
@@ -212,8 +566,83 @@ static VALUE rdo_postgres_statement_executor_execute(int argc, VALUE * args,
       }
     }
   }
+}
+
+/** Release any memory allocated by encode_params() */
+static void rdo_postgres_statement_executor_free_params(
+    RDOPostgresStatementExecutor * executor, int argc, char ** values) {
+
+  int i;
+
+  for (i = 0; i < argc; ++i) {
+    if (RDO_PG_PARAM_TYPE(executor, i) == RDO_PG_BYTEAOID) {
+      PQfreemem(values[i]);
+    }
+  }
+}
+
+VALUE rdo_postgres_statements_result_new(RDOPostgresDriver * driver, PGresult * res) {
+  // read before the tuple list, which frees res when results are consumed
+  VALUE info   = rdo_postgres_result_info_new(res);
+  VALUE tuples = rdo_postgres_tuple_list_new(res, driver);
+
+  return rb_funcall(rb_path2class("RDO::Postgres::Result"), rb_intern("new"), 2,
+      tuples, info);
+}
+
+/** Wrap a successful PGresult in an RDO::Postgres::Result */
+static VALUE rdo_postgres_statement_executor_result(
+    RDOPostgresStatementExecutor * executor, PGresult * res) {
+
+  return rdo_postgres_statements_result_new(executor->driver, res);
+}
+
+/** Execute the prepared statement and return a Result */
+static VALUE rdo_postgres_statement_executor_execute_statement(int argc, VALUE * args,
+    VALUE self) {
+
+  RDOPostgresStatementExecutor * executor;
+  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+
+  rdo_postgres_statement_executor_check_open(executor);
+
+  rdo_postgres_driver_start_deadline(executor->driver);
+
+  char     * values[argc];
+  size_t     lengths[argc];
+  PGresult * res;
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+  if (!executor->prepared
+      && rdo_postgres_statement_executor_untyped_params_p(argc, args)) {
+    rdo_postgres_statement_executor_encode_params(executor,
+        argc, args, values, lengths);
 
-  PGresult * res = PQexecPrepared(
+    res = rdo_postgres_statement_executor_pipeline_prepare(executor,
+        argc, values, lengths);
+
+    if (PQresultStatus(res) != PGRES_TUPLES_OK
+        && PQresultStatus(res) != PGRES_COMMAND_OK
+        && argc != executor->nparams) {
+      PQclear(res);
+      rdo_postgres_statement_executor_check_argc(executor, argc);
+    }
+
+    rdo_postgres_statement_executor_check_result(res, "execute statement");
+
+    return rdo_postgres_statement_executor_result(executor, res);
+  }
+#endif
+
+  if (!executor->prepared) {
+    rdo_postgres_statement_executor_prepare(executor);
+  }
+
+  rdo_postgres_statement_executor_check_argc(executor, argc);
+  rdo_postgres_statement_executor_encode_params(executor,
+      argc, args, values, lengths);
+
+  int sent = PQsendQueryPrepared(
       executor->driver->conn_ptr,
       executor->stmt_name,
       argc,
@@ -222,21 +651,621 @@ static VALUE rdo_postgres_statement_executor_execute(int argc, VALUE * args,
       RDO_PG_TEXT_INPUT,
       RDO_PG_TEXT_OUTPUT);
 
-  for (i = 0; i < argc; ++i) {
-    if (executor->param_types[i] == RDO_PG_BYTEAOID) {
-      PQfreemem(values[i]);
+  rdo_postgres_statement_executor_free_params(executor, argc, values);
+
+  res = rdo_postgres_driver_exec_result(executor->driver, sent);
+  rdo_postgres_statement_executor_check_result(res, "execute statement");
+
+  return rdo_postgres_statement_executor_result(executor, res);
+}
+
+/** State shared between the spooling loop and its ensure block */
+typedef struct {
+  RDOPostgresStatementExecutor * executor;
+  VALUE                          list;
+  PGresult                     * last;
+  int                            done;
+} RDOPostgresSpooling;
+
+/**
+ * Read single-row mode results into a spooled TupleList until the final one.
+ *
+ * The final result (with no rows) is kept in spooling->last for its info.
+ */
+static VALUE rdo_postgres_statement_executor_spool_rows(VALUE arg) {
+  RDOPostgresSpooling * spooling = (RDOPostgresSpooling *) arg;
+  RDOPostgresDriver   * driver   = spooling->executor->driver;
+  PGresult            * res;
+
+  while ((res = rdo_postgres_driver_get_result(driver)) != NULL) {
+    switch (PQresultStatus(res)) {
+      case PGRES_SINGLE_TUPLE:
+        rdo_postgres_tuple_list_spool(spooling->list, res, driver);
+        PQclear(res);
+        break;
+
+      default:
+        if (spooling->last != NULL && PQresultStatus(spooling->last) == PGRES_FATAL_ERROR) {
+          PQclear(res);
+        } else {
+          PQclear(spooling->last);
+          spooling->last = res;
+
+          // describes the columns, even if there were no rows
+          if (PQresultStatus(res) == PGRES_TUPLES_OK) {
+            rdo_postgres_tuple_list_spool(spooling->list, res, driver);
+          }
+        }
     }
   }
 
-  ExecStatusType status = PQresultStatus(res);
+  spooling->done = 1;
 
-  if (status == PGRES_BAD_RESPONSE || status == PGRES_FATAL_ERROR) {
+  return Qnil;
+}
+
+/**
+ * Ensure block for spool_rows(), ending whatever is left of the query.
+ *
+ * If spooling stopped early, the query is cancelled first, so that the rest
+ * of its rows are not streamed just to be thrown away.
+ */
+static VALUE rdo_postgres_statement_executor_spool_rows_ensure(VALUE arg) {
+  RDOPostgresSpooling * spooling = (RDOPostgresSpooling *) arg;
+  PGconn              * conn     = spooling->executor->driver->conn_ptr;
+  PGresult            * res;
+
+  if (!spooling->done) {
+    PQclear(spooling->last);
+    spooling->last = NULL;
+
+    rdo_postgres_driver_abandon(spooling->executor->driver);
+
+    while (PQstatus(conn) != CONNECTION_BAD && (res = PQgetResult(conn)) != NULL) {
+      PQclear(res);
+    }
+  }
+
+  return Qnil;
+}
+
+/**
+ * Execute the prepared statement, spooling rows as they arrive.
+ *
+ * Rows are streamed in single-row mode and copied into a compact buffer,
+ * which moves to a memory-mapped temp file once it passes limit bytes. The
+ * returned Result can be iterated more than once and indexed with [].
+ */
+static VALUE rdo_postgres_statement_executor_execute_spooled(int argc,
+    VALUE * args, VALUE self) {
+
+  RDOPostgresStatementExecutor * executor;
+  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+
+  if (argc < 1) {
+    rb_raise(rb_eArgError, "wrong number of arguments (0 for 1+)");
+  }
+
+  long limit = NUM2LONG(args[0]);
+
+  if (limit < 0) {
+    rb_raise(rb_eArgError, "Spool limit must not be negative");
+  }
+
+  argc -= 1;
+  args += 1;
+
+  rdo_postgres_statement_executor_check_open(executor);
+
+  rdo_postgres_driver_start_deadline(executor->driver);
+
+  if (!executor->prepared) {
+    rdo_postgres_statement_executor_prepare(executor);
+  }
+
+  rdo_postgres_statement_executor_check_argc(executor, argc);
+
+  char   * values[argc];
+  size_t   lengths[argc];
+
+  RDOPostgresSpooling spooling = {
+    .executor = executor,
+    .list     = rdo_postgres_tuple_list_new_spooled(executor->driver, (size_t) limit),
+    .last     = NULL,
+    .done     = 0
+  };
+
+  rdo_postgres_statement_executor_encode_params(executor,
+      argc, args, values, lengths);
+
+  int sent = PQsendQueryPrepared(
+      executor->driver->conn_ptr,
+      executor->stmt_name,
+      argc,
+      (const char **) values,
+      (const int *) lengths,
+      RDO_PG_TEXT_INPUT,
+      RDO_PG_TEXT_OUTPUT);
+
+  rdo_postgres_statement_executor_free_params(executor, argc, values);
+
+  if (!sent) {
+    RDO_ERROR("Failed to execute statement: %s",
+        PQerrorMessage(executor->driver->conn_ptr));
+  }
+
+  PQsetSingleRowMode(executor->driver->conn_ptr);
+
+  rb_ensure(
+      rdo_postgres_statement_executor_spool_rows, (VALUE) &spooling,
+      rdo_postgres_statement_executor_spool_rows_ensure, (VALUE) &spooling);
+
+  if (spooling.last == NULL) {
+    RDO_ERROR("Failed to execute statement: %s",
+        PQerrorMessage(executor->driver->conn_ptr));
+  }
+
+  rdo_postgres_statement_executor_check_result(spooling.last, "execute statement");
+  rdo_postgres_tuple_list_spool_finish(spooling.list);
+
+  VALUE info = rdo_postgres_result_info_new(spooling.last);
+  rb_hash_aset(info, ID2SYM(rb_intern("count")), rb_funcall(spooling.list, rb_intern("size"), 0));
+  PQclear(spooling.last);
+
+  return rb_funcall(rb_path2class("RDO::Postgres::Result"), rb_intern("new"), 2,
+      spooling.list, info);
+}
+
+/**
+ * Execute the prepared statement and return a Result.
+ *
+ * With an explain sampler set on the driver, the sampler is told how long
+ * the execution took once it returns, so it can choose to capture the plan.
+ */
+static VALUE rdo_postgres_statement_executor_execute(int argc, VALUE * args,
+    VALUE self) {
+
+  RDOPostgresStatementExecutor * executor;
+  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+
+  VALUE sampler = executor->driver->explain_sampler;
+
+  if (NIL_P(sampler)) {
+    return rdo_postgres_statement_executor_execute_statement(argc, args, self);
+  }
+
+  // monotonic, so a clock adjustment cannot make a statement look slow
+  struct timespec started;
+  struct timespec finished;
+  VALUE           result;
+  VALUE           params = rb_ary_new4(argc, args);
+
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  result = rdo_postgres_statement_executor_execute_statement(argc, args, self);
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+
+  rb_funcall(sampler, rb_intern("record"), 3,
+      rb_str_new2(executor->cmd),
+      params,
+      DBL2NUM((finished.tv_sec - started.tv_sec)
+        + (finished.tv_nsec - started.tv_nsec) / 1e9));
+
+  return result;
+}
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+
+/** State shared between the pipeline body and its ensure block */
+typedef struct {
+  RDOPostgresStatementExecutor * executor;
+  VALUE                          param_sets;
+  long                           offset;
+  long                           count;
+  VALUE                          results;
+  int                            synced;
+} RDOPostgresPipeline;
+
+/**
+ * Send the param_sets in [offset, offset + count) in a single pipeline.
+ *
+ * Results are pushed onto results. If any set fails, the remaining sets in
+ * the pipeline are aborted by the server and an error is raised once the
+ * pipeline has been drained.
+ */
+static VALUE rdo_postgres_statement_executor_pipeline(VALUE arg) {
+  RDOPostgresPipeline          * pipeline = (RDOPostgresPipeline *) arg;
+  RDOPostgresStatementExecutor * executor = pipeline->executor;
+  PGconn                       * conn     = executor->driver->conn_ptr;
+  PGresult                     * res;
+  PGresult                     * error    = NULL;
+  long                           failed   = -1;
+  long                           i;
+
+  for (i = pipeline->offset; i < pipeline->offset + pipeline->count; ++i) {
+    VALUE  params = rb_ary_entry(pipeline->param_sets, i);
+    int    argc   = (int) RARRAY_LEN(params);
+    VALUE  args[argc];
+    char * values[argc];
+    size_t lengths[argc];
+    int    sent;
+
+    MEMCPY(args, RARRAY_PTR(params), VALUE, argc);
+
+    rdo_postgres_statement_executor_encode_params(executor,
+        argc, args, values, lengths);
+
+    sent = PQsendQueryPrepared(
+        conn,
+        executor->stmt_name,
+        argc,
+        (const char **) values,
+        (const int *) lengths,
+        RDO_PG_TEXT_INPUT,
+        RDO_PG_TEXT_OUTPUT);
+
+    rdo_postgres_statement_executor_free_params(executor, argc, values);
+
+    if (!sent) {
+      RDO_ERROR("Failed to execute statement: %s", PQerrorMessage(conn));
+    }
+  }
+
+  PQpipelineSync(conn);
+  pipeline->synced = 1;
+
+  for (i = pipeline->offset; i < pipeline->offset + pipeline->count; ++i) {
+    res = rdo_postgres_driver_get_result(executor->driver);
+
+    switch (PQresultStatus(res)) {
+      case PGRES_BAD_RESPONSE:
+      case PGRES_FATAL_ERROR:
+        error  = res;
+        failed = i;
+        break;
+
+      case PGRES_PIPELINE_ABORTED:
+        PQclear(res);
+        break;
+
+      default:
+        if (error == NULL) {
+          rb_ary_push(pipeline->results,
+              rdo_postgres_statement_executor_result(executor, res));
+        } else {
+          PQclear(res);
+        }
+    }
+
+    PQclear(rdo_postgres_driver_get_result(executor->driver)); // NULL separator
+  }
+
+  if (error != NULL) {
+    char msg[sizeof(char) * (strlen(PQresultErrorMessage(error)) + 1)];
+    strcpy(msg, PQresultErrorMessage(error));
+    PQclear(error);
+    RDO_ERROR("Failed to execute statement (parameter set %li): %s", failed, msg);
+  }
+
+  return Qnil;
+}
+
+/** Ensure block for pipeline(), leaving the connection out of pipeline mode */
+static VALUE rdo_postgres_statement_executor_pipeline_ensure(VALUE arg) {
+  RDOPostgresPipeline * pipeline = (RDOPostgresPipeline *) arg;
+  rdo_postgres_statement_executor_pipeline_drain(
+      pipeline->executor->driver, pipeline->synced);
+  return Qnil;
+}
+
+#endif
+
+/** State for one execute_many() call */
+typedef struct {
+  VALUE                          self;
+  RDOPostgresStatementExecutor * executor;
+  VALUE                          param_sets;
+  VALUE                          results;
+  int                            transaction;
+  int                            done;
+} RDOPostgresBatch;
+
+/** Execute every parameter set of a batch, appending to its results */
+static VALUE rdo_postgres_statement_executor_execute_sets(VALUE arg) {
+  RDOPostgresBatch * batch = (RDOPostgresBatch *) arg;
+  long               nsets = RARRAY_LEN(batch->param_sets);
+  long               i;
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+  for (i = 0; i < nsets; i += RDO_PG_PIPELINE_BATCH) {
+    RDOPostgresPipeline pipeline = {
+      .executor   = batch->executor,
+      .param_sets = batch->param_sets,
+      .offset     = i,
+      .count      = (nsets - i) < RDO_PG_PIPELINE_BATCH ? (nsets - i) : RDO_PG_PIPELINE_BATCH,
+      .results    = batch->results,
+      .synced     = 0
+    };
+
+    if (!PQenterPipelineMode(batch->executor->driver->conn_ptr)) {
+      RDO_ERROR("Failed to enter pipeline mode: %s",
+          PQerrorMessage(batch->executor->driver->conn_ptr));
+    }
+
+    rb_ensure(
+        rdo_postgres_statement_executor_pipeline, (VALUE) &pipeline,
+        rdo_postgres_statement_executor_pipeline_ensure, (VALUE) &pipeline);
+  }
+#else
+  for (i = 0; i < nsets; ++i) {
+    VALUE params = rb_ary_dup(rb_ary_entry(batch->param_sets, i));
+    rb_ary_push(batch->results,
+        rdo_postgres_statement_executor_execute_statement(
+          (int) RARRAY_LEN(params), RARRAY_PTR(params), batch->self));
+  }
+#endif
+
+  batch->done = 1;
+  return Qnil;
+}
+
+/** Roll back the transaction opened for execute_many(), returning the result */
+static VALUE rdo_postgres_statement_executor_rollback(VALUE arg) {
+  RDOPostgresDriver * driver = (RDOPostgresDriver *) arg;
+  return (VALUE) rdo_postgres_driver_exec_result(driver,
+      PQsendQuery(driver->conn_ptr, "ROLLBACK"));
+}
+
+/**
+ * Ensure block for execute_sets(), ending the transaction opened for it.
+ *
+ * This commits if every set succeeded, and otherwise rolls back, so that a
+ * failure part way through does not leave the earlier sets applied.
+ */
+static VALUE rdo_postgres_statement_executor_execute_sets_ensure(VALUE arg) {
+  RDOPostgresBatch  * batch  = (RDOPostgresBatch *) arg;
+  RDOPostgresDriver * driver = batch->executor->driver;
+  PGresult          * res;
+
+  if (!batch->transaction || PQstatus(driver->conn_ptr) == CONNECTION_BAD) {
+    return Qnil;
+  }
+
+  if (batch->done) {
+    res = rdo_postgres_driver_exec_result(driver,
+        PQsendQuery(driver->conn_ptr, "COMMIT"));
+    rdo_postgres_statement_executor_check_result(res, "commit transaction");
+  } else {
+    int state = 0;
+
+    // keep the original error, even if the rollback fails or times out
+    res = (PGresult *) rb_protect(
+        rdo_postgres_statement_executor_rollback, (VALUE) driver, &state);
+
+    if (state) {
+      rb_set_errinfo(Qnil);
+      return Qnil;
+    }
+  }
+
+  PQclear(res);
+  return Qnil;
+}
+
+/**
+ * Execute once for each Array of bind parameters in param_sets.
+ *
+ * Where libpq supports pipelining, the sets are sent back-to-back without
+ * waiting for each result. Returns an Array of RDO::Result, one per set.
+ *
+ * Unless a transaction is already open, the sets run in one of their own, so
+ * if any set fails none of them are applied. Inside a transaction, a failure
+ * aborts it as usual.
+ */
+static VALUE rdo_postgres_statement_executor_execute_many(VALUE self,
+    VALUE param_sets) {
+
+  Check_Type(param_sets, T_ARRAY);
+
+  RDOPostgresStatementExecutor * executor;
+  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+
+  rdo_postgres_statement_executor_check_open(executor);
+
+  VALUE results = rb_ary_new2(RARRAY_LEN(param_sets));
+  long  nsets   = RARRAY_LEN(param_sets);
+  long  i;
+
+  rdo_postgres_driver_start_deadline(executor->driver);
+
+  if (!executor->prepared) {
+    rdo_postgres_statement_executor_prepare(executor);
+  }
+
+  for (i = 0; i < nsets; ++i) {
+    VALUE params = rb_ary_entry(param_sets, i);
+    Check_Type(params, T_ARRAY);
+
+    if (RARRAY_LEN(params) != executor->nparams) {
+      rb_raise(rb_eArgError,
+          "Bind parameter count mismatch in set %li: wanted %i, got %li",
+          i, executor->nparams, RARRAY_LEN(params));
+    }
+  }
+
+  RDOPostgresBatch batch = {
+    .self        = self,
+    .executor    = executor,
+    .param_sets  = param_sets,
+    .results     = results,
+    .transaction = PQtransactionStatus(executor->driver->conn_ptr) == PQTRANS_IDLE,
+    .done        = 0
+  };
+
+  if (batch.transaction) {
+    PGresult * res = rdo_postgres_driver_exec_result(executor->driver,
+        PQsendQuery(executor->driver->conn_ptr, "BEGIN"));
+    rdo_postgres_statement_executor_check_result(res, "begin transaction");
     PQclear(res);
-    RDO_ERROR("Failed to execute statement: %s", PQresultErrorMessage(res));
   }
 
-  return RDO_RESULT(rdo_postgres_tuple_list_new(res, executor->driver->encoding),
-      rdo_postgres_result_info_new(res));
+  rb_ensure(
+      rdo_postgres_statement_executor_execute_sets, (VALUE) &batch,
+      rdo_postgres_statement_executor_execute_sets_ensure, (VALUE) &batch);
+
+  return results;
+}
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+
+/** State for preparing several statements in one pipeline */
+typedef struct {
+  RDOPostgresDriver * driver;
+  VALUE               executors;
+  long                offset;
+  long                count;
+  int                 synced;
+} RDOPostgresWarmup;
+
+/**
+ * Prepare and describe the executors in [offset, offset + count) in a single
+ * pipeline.
+ *
+ * Each statement is synced separately, so one that fails to prepare does not
+ * abort the others. Its slot in executors is set to nil.
+ */
+static VALUE rdo_postgres_statement_executor_warm_flight(VALUE arg) {
+  RDOPostgresWarmup * warmup = (RDOPostgresWarmup *) arg;
+  PGconn            * conn   = warmup->driver->conn_ptr;
+  PGresult          * res;
+  int                 ndeallocs;
+  long                i;
+
+  ndeallocs = rdo_postgres_driver_pipeline_deallocations(warmup->driver);
+
+  for (i = warmup->offset; i < warmup->offset + warmup->count; ++i) {
+    RDOPostgresStatementExecutor * executor;
+    Data_Get_Struct(rb_ary_entry(warmup->executors, i),
+        RDOPostgresStatementExecutor, executor);
+
+    char * cmd = rdo_postgres_params_inject_markers(executor->cmd);
+
+    PQsendPrepare(conn, executor->stmt_name, cmd, RDO_PG_NO_OIDS, RDO_PG_INFER_TYPES);
+    PQsendDescribePrepared(conn, executor->stmt_name);
+    PQpipelineSync(conn);
+
+    free(cmd);
+  }
+
+  warmup->synced = 1;
+
+  for (i = 0; i < ndeallocs; ++i) {
+    PQclear(rdo_postgres_statement_executor_pipeline_result(warmup->driver));
+    PQclear(rdo_postgres_statement_executor_pipeline_result(warmup->driver)); // sync
+  }
+
+  for (i = warmup->offset; i < warmup->offset + warmup->count; ++i) {
+    RDOPostgresStatementExecutor * executor;
+    Data_Get_Struct(rb_ary_entry(warmup->executors, i),
+        RDOPostgresStatementExecutor, executor);
+
+    res = rdo_postgres_statement_executor_pipeline_result(warmup->driver);
+    int ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    PQclear(res);
+
+    res = rdo_postgres_statement_executor_pipeline_result(warmup->driver);
+    if (ok && PQresultStatus(res) == PGRES_COMMAND_OK) {
+      rdo_postgres_statement_executor_describe(executor, res);
+    } else {
+      rb_ary_store(warmup->executors, i, Qnil);
+    }
+    PQclear(res);
+
+    PQclear(rdo_postgres_statement_executor_pipeline_result(warmup->driver)); // sync
+  }
+
+  return Qnil;
+}
+
+/** Ensure block for warm_flight(), leaving the connection out of pipeline mode */
+static VALUE rdo_postgres_statement_executor_warm_flight_ensure(VALUE arg) {
+  RDOPostgresWarmup * warmup = (RDOPostgresWarmup *) arg;
+  rdo_postgres_statement_executor_pipeline_drain(warmup->driver, warmup->synced);
+  return Qnil;
+}
+
+#else
+
+/** Prepare one executor, for use with rb_rescue2() */
+static VALUE rdo_postgres_statement_executor_warm_one(VALUE self) {
+  RDOPostgresStatementExecutor * executor;
+  Data_Get_Struct(self, RDOPostgresStatementExecutor, executor);
+  rdo_postgres_statement_executor_prepare(executor);
+  return self;
+}
+
+/** Rescue block for warm_one(), giving nil in place of the executor */
+static VALUE rdo_postgres_statement_executor_warm_failed(VALUE self, VALUE error) {
+  return Qnil;
+}
+
+#endif
+
+/**
+ * Prepare each of the statements in cmds ahead of its first execution.
+ *
+ * Where libpq supports pipelining, every statement is prepared and described
+ * in a single round trip. Returns an Array with a StatementExecutor for each
+ * statement, or nil for those that failed to prepare.
+ */
+static VALUE rdo_postgres_driver_prepare_all(VALUE self, VALUE cmds) {
+  RDOPostgresDriver * driver;
+  Data_Get_Struct(self, RDOPostgresDriver, driver);
+
+  Check_Type(cmds, T_ARRAY);
+
+  if (!(driver->is_open)) {
+    RDO_ERROR("Unable to prepare statement: connection is not open");
+  }
+
+  long  ncmds     = RARRAY_LEN(cmds);
+  VALUE executors = rb_ary_new2(ncmds);
+  long  i;
+
+  for (i = 0; i < ncmds; ++i) {
+    rb_ary_push(executors,
+        rb_funcall(self, rb_intern("prepare"), 2, rb_ary_entry(cmds, i), Qtrue));
+  }
+
+  rdo_postgres_driver_start_deadline(driver);
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+  for (i = 0; i < ncmds; i += RDO_PG_PIPELINE_BATCH) {
+    RDOPostgresWarmup warmup = {
+      .driver    = driver,
+      .executors = executors,
+      .offset    = i,
+      .count     = (ncmds - i) < RDO_PG_PIPELINE_BATCH ? (ncmds - i) : RDO_PG_PIPELINE_BATCH,
+      .synced    = 0
+    };
+
+    if (!PQenterPipelineMode(driver->conn_ptr)) {
+      RDO_ERROR("Failed to enter pipeline mode: %s", PQerrorMessage(driver->conn_ptr));
+    }
+
+    rb_ensure(
+        rdo_postgres_statement_executor_warm_flight, (VALUE) &warmup,
+        rdo_postgres_statement_executor_warm_flight_ensure, (VALUE) &warmup);
+  }
+#else
+  for (i = 0; i < ncmds; ++i) {
+    rb_ary_store(executors, i, rb_rescue2(
+          rdo_postgres_statement_executor_warm_one, rb_ary_entry(executors, i),
+          rdo_postgres_statement_executor_warm_failed, Qnil,
+          rb_path2class("RDO::Exception"), (VALUE) 0));
+  }
+#endif
+
+  return executors;
 }
 
 /** Statements framework initializer, called during extension init */
@@ -252,8 +1281,23 @@ void Init_rdo_postgres_statements(void) {
   rb_define_method(rdo_postgres_cStatementExecutor,
       "command", rdo_postgres_statement_executor_command, 0);
 
+  rb_define_method(rdo_postgres_cStatementExecutor,
+      "columns", rdo_postgres_statement_executor_columns, 0);
+
   rb_define_method(rdo_postgres_cStatementExecutor,
       "execute", rdo_postgres_statement_executor_execute, -1);
 
+  rb_define_method(rdo_postgres_cStatementExecutor,
+      "stale?", rdo_postgres_statement_executor_stale_p, 0);
+
+  rb_define_method(rdo_postgres_cStatementExecutor,
+      "execute_many", rdo_postgres_statement_executor_execute_many, 1);
+
+  rb_define_method(rdo_postgres_cStatementExecutor,
+      "execute_spooled", rdo_postgres_statement_executor_execute_spooled, -1);
+
+  rb_define_private_method(rb_path2class("RDO::Postgres::Driver"),
+      "prepare_all", rdo_postgres_driver_prepare_all, 1);
+
   Init_rdo_postgres_tuples();
 }
@@ -7,9 +7,18 @@
 
 #include <stdio.h>
 #include <ruby.h>
+#include "driver.h"
 
-/** Factory to create a new StatementExecutor */
-VALUE rdo_postgres_statement_executor_new(VALUE driver, VALUE cmd, VALUE name);
+/**
+ * Factory to create a new StatementExecutor.
+ *
+ * If deferred is non-zero, preparation waits until the first execution.
+ */
+VALUE rdo_postgres_statement_executor_new(VALUE driver, VALUE cmd, VALUE name,
+    int deferred);
+
+/** Wrap a successful PGresult in an RDO::Postgres::Result, taking ownership */
+VALUE rdo_postgres_statements_result_new(RDOPostgresDriver * driver, PGresult * res);
 
 /** Initializer for the statements framework */
 void Init_rdo_postgres_statements(void);
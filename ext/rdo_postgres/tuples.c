@@ -7,37 +7,782 @@
 
 #include "tuples.h"
 #include "casts.h"
+#include "arrow.h"
+#include "spool.h"
+#include "macros.h"
+#include "types.h"
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <ruby/thread.h>
+
+/** Results with fewer rows than this are never decoded in parallel */
+#define RDO_PG_PARALLEL_DECODE_MIN_ROWS 10000
+
+/** Upper limit on the number of decode workers per result */
+#define RDO_PG_MAX_DECODE_THREADS 64
+
+/** Upper limit on the distinct values interned per column */
+#define RDO_PG_MAX_INTERN_LIMIT (1 << 20)
+
+/** Number of slots an intern table starts with, a power of two */
+#define RDO_PG_INTERN_MIN_CAPACITY 8
+
+/** Predicate test if column j is cast with a decoder from the type map */
+#define RDO_PG_DECODER_P(list, j) \
+  (!NIL_P((list)->decoders) && !NIL_P(rb_ary_entry((list)->decoders, j)))
+
+/** Kinds of column the decode workers can parse */
+#define RDO_PG_DECODE_NONE  0
+#define RDO_PG_DECODE_INT   1
+#define RDO_PG_DECODE_FLOAT 2
+#define RDO_PG_DECODE_BOOL  3
+
+/** Table of frozen Strings shared by all cells of one text column */
+typedef struct {
+  int             limit;
+  int             size;
+  int             capacity;
+  unsigned long * hashes;
+  VALUE         * strings;
+} RDOPostgresInternTable;
+
+/** Values of one column parsed by the decode workers */
+typedef struct {
+  int       kind;
+  int64_t * ints;
+  double  * floats;
+} RDOPostgresDecodedColumn;
 
 /** Wrapper for the TupleList class */
 typedef struct {
-  PGresult * res;
-  int        encoding;
+  PGresult                 * res;
+  int                        encoding;
+  int                        cast_flags;
+  int                        nfields;
+  Oid                      * types;
+  ID                       * keys;
+  VALUE                      decoders;
+  RDOPostgresInternTable  ** interns;
+  size_t                     memsize;
+  VALUE                      rows;
+  int                        decode_threads;
+  int                        decode_tried;
+  RDOPostgresDecodedColumn * decoded;
+  void                     * decode_buffer;
+  RDOPostgresSpool         * spool;
+  PGresult                 * desc;
 } RDOPostgresTupleList;
 
+/** The share of rows [from, to) parsed by one decode worker */
+typedef struct {
+  RDOPostgresTupleList * list;
+  int                    from;
+  int                    to;
+} RDOPostgresDecodeTask;
+
 /** class RDO::Postgres::TupleList */
 static VALUE rdo_postgres_cTupleList;
 
-/** Used to free the struct wrapped by TupleList during GC */
-static void rdo_postgres_tuple_list_free(RDOPostgresTupleList * list) {
+/** FNV-1a hash of the raw bytes in a value */
+static unsigned long rdo_postgres_intern_hash(char * s, int len) {
+  unsigned long h = 2166136261UL;
+  int           i = 0;
+
+  for (; i < len; ++i) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619UL;
+  }
+
+  return h;
+}
+
+/**
+ * Allocate an empty intern table for up to limit distinct values.
+ *
+ * The table starts small and grows as values are added, so a short result
+ * costs little whatever the limit. The limit is capped at
+ * RDO_PG_MAX_INTERN_LIMIT, so that the capacity cannot overflow.
+ */
+static RDOPostgresInternTable * rdo_postgres_intern_table_new(int limit) {
+  RDOPostgresInternTable * table = malloc(sizeof(RDOPostgresInternTable));
+
+  if (table == NULL)
+    rb_memerror();
+
+  if (limit > RDO_PG_MAX_INTERN_LIMIT)
+    limit = RDO_PG_MAX_INTERN_LIMIT;
+
+  table->limit    = limit;
+  table->size     = 0;
+  table->capacity = RDO_PG_INTERN_MIN_CAPACITY;
+  table->hashes   = calloc(table->capacity, sizeof(unsigned long));
+  table->strings  = malloc(sizeof(VALUE) * table->capacity);
+
+  if (table->hashes == NULL || table->strings == NULL) {
+    free(table->hashes);
+    free(table->strings);
+    free(table);
+    rb_memerror();
+  }
+
+  int i = 0;
+  for (; i < table->capacity; ++i)
+    table->strings[i] = Qundef;
+
+  return table;
+}
+
+/** Double the capacity of an intern table, keeping the Strings in it */
+static void rdo_postgres_intern_table_grow(RDOPostgresInternTable * table) {
+  int             capacity = table->capacity * 2;
+  int             mask     = capacity - 1;
+  unsigned long * hashes   = calloc(capacity, sizeof(unsigned long));
+  VALUE         * strings  = malloc(sizeof(VALUE) * capacity);
+  int             i;
+  int             j;
+
+  if (hashes == NULL || strings == NULL) {
+    free(hashes);
+    free(strings);
+    rb_memerror();
+  }
+
+  for (i = 0; i < capacity; ++i)
+    strings[i] = Qundef;
+
+  for (i = 0; i < table->capacity; ++i) {
+    if (table->strings[i] == Qundef)
+      continue;
+
+    for (j = table->hashes[i] & mask; strings[j] != Qundef; j = (j + 1) & mask);
+
+    hashes[j]  = table->hashes[i];
+    strings[j] = table->strings[i];
+  }
+
+  free(table->hashes);
+  free(table->strings);
+
+  table->capacity = capacity;
+  table->hashes   = hashes;
+  table->strings  = strings;
+}
+
+/** Release the memory held by an intern table (the Strings belong to the GC) */
+static void rdo_postgres_intern_table_free(RDOPostgresInternTable * table) {
+  free(table->hashes);
+  free(table->strings);
+  free(table);
+}
+
+/**
+ * Return the frozen String for this value, adding it to the table if needed.
+ *
+ * Once the column has produced more than limit distinct values it is
+ * considered high-cardinality and new Strings are allocated as normal.
+ */
+static VALUE rdo_postgres_intern_string(RDOPostgresInternTable * table,
+    char * s, int len, int enc) {
+
+  unsigned long h    = rdo_postgres_intern_hash(s, len);
+  int           mask = table->capacity - 1;
+  int           i    = h & mask;
+  VALUE         str;
+
+  for (; table->strings[i] != Qundef; i = (i + 1) & mask) {
+    str = table->strings[i];
+    if (table->hashes[i] == h
+        && RSTRING_LEN(str) == len
+        && memcmp(RSTRING_PTR(str), s, len) == 0) {
+      return str;
+    }
+  }
+
+  str = RDO_STRING(s, len, enc);
+
+  if (table->size < table->limit) {
+    // kept at most half full, so probes stay short
+    if ((table->size + 1) * 2 > table->capacity) {
+      rdo_postgres_intern_table_grow(table);
+      mask = table->capacity - 1;
+      for (i = h & mask; table->strings[i] != Qundef; i = (i + 1) & mask);
+    }
+
+    rb_obj_freeze(str);
+    table->hashes[i]  = h;
+    table->strings[i] = str;
+    table->size++;
+  }
+
+  return str;
+}
+
+/** Predicate test if the column type is one the String cache applies to */
+static int rdo_postgres_intern_type_p(Oid type) {
+  switch (type) {
+    case RDO_PG_TEXTOID:
+    case RDO_PG_CHAROID:
+    case RDO_PG_VARCHAROID:
+    case RDO_PG_BPCHAROID:
+      return 1;
+
+    default:
+      return 0;
+  }
+}
+
+/** Predicate test if interning was requested for the named column */
+static int rdo_postgres_intern_column_p(VALUE columns, char * name) {
+  if (NIL_P(columns)) {
+    return 1;
+  }
+
+  long i = 0;
+  for (; i < RARRAY_LEN(columns); ++i) {
+    VALUE col = rb_ary_entry(columns, i);
+    if (TYPE(col) == T_STRING && strcmp(RSTRING_PTR(col), name) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/** Keep hold of the consumed rows and interned Strings during GC */
+static void rdo_postgres_tuple_list_mark(void * ptr) {
+  RDOPostgresTupleList * list = ptr;
+
+  rb_gc_mark(list->rows);
+  rb_gc_mark(list->decoders);
+
+  if (list->interns == NULL)
+    return;
+
+  int i, j;
+  for (i = 0; i < list->nfields; ++i) {
+    if (list->interns[i] == NULL)
+      continue;
+
+    for (j = 0; j < list->interns[i]->capacity; ++j) {
+      if (list->interns[i]->strings[j] != Qundef)
+        rb_gc_mark(list->interns[i]->strings[j]);
+    }
+  }
+}
+
+/** Memory held by libpq for a result, which the GC cannot see */
+size_t rdo_postgres_result_memsize(PGresult * res) {
+#ifdef HAVE_PQRESULTMEMORYSIZE
+  return PQresultMemorySize(res);
+#else
+  size_t size    = 0;
+  int    ntuples = PQntuples(res);
+  int    nfields = PQnfields(res);
+  int    i, j;
+
+  for (i = 0; i < ntuples; ++i) {
+    for (j = 0; j < nfields; ++j) {
+      size += PQgetlength(res, i, j) + 1 + sizeof(char *) + sizeof(int);
+    }
+  }
+
+  return size;
+#endif
+}
+
+/** Tell the GC that malloc'd memory it cannot see was allocated or freed */
+static void rdo_postgres_adjust_memory_usage(ssize_t diff) {
+#ifdef HAVE_RB_GC_ADJUST_MEMORY_USAGE
+  rb_gc_adjust_memory_usage(diff);
+#endif
+}
+
+/** Free the PGresult as soon as it is no longer needed */
+static void rdo_postgres_tuple_list_clear(RDOPostgresTupleList * list) {
+  if (list->res == NULL)
+    return;
+
   PQclear(list->res);
-  free(list);
+  list->res = NULL;
+
+  rdo_postgres_adjust_memory_usage(-(ssize_t) list->memsize);
+  list->memsize = 0;
+}
+
+/** Release the intern tables, which are not needed once all rows are decoded */
+static void rdo_postgres_tuple_list_free_interns(RDOPostgresTupleList * list) {
+  if (list->interns == NULL)
+    return;
+
+  int i = 0;
+  for (; i < list->nfields; ++i) {
+    if (list->interns[i] != NULL)
+      rdo_postgres_intern_table_free(list->interns[i]);
+  }
+
+  free(list->interns);
+  list->interns = NULL;
+}
+
+/** Release the buffers written by the decode workers */
+static void rdo_postgres_tuple_list_free_decoded(RDOPostgresTupleList * list) {
+  if (list->decoded == NULL)
+    return;
+
+  free(list->decode_buffer);
+  free(list->decoded);
+  list->decoded       = NULL;
+  list->decode_buffer = NULL;
+}
+
+/** Used to free the struct wrapped by TupleList during GC */
+static void rdo_postgres_tuple_list_free(void * ptr) {
+  RDOPostgresTupleList * list = ptr;
+
+  rdo_postgres_tuple_list_free_interns(list);
+  rdo_postgres_tuple_list_free_decoded(list);
+  rdo_postgres_tuple_list_clear(list);
+
+  if (list->spool != NULL) {
+    rdo_postgres_adjust_memory_usage(-(ssize_t) list->memsize);
+    rdo_postgres_spool_free(list->spool);
+  }
+
+  PQclear(list->desc);
+  free(list->types);
+  free(list->keys);
+  xfree(list);
+}
+
+/** Report the size of the TupleList, including the PGresult, to ObjectSpace */
+static size_t rdo_postgres_tuple_list_memsize(const void * ptr) {
+  const RDOPostgresTupleList * list = ptr;
+  size_t size = sizeof(RDOPostgresTupleList) + list->memsize;
+
+  if (list->decoded != NULL && list->res != NULL) {
+    int i = 0;
+    for (; i < list->nfields; ++i) {
+      if (list->decoded[i].kind != RDO_PG_DECODE_NONE)
+        size += sizeof(int64_t) * PQntuples(list->res);
+    }
+  }
+
+  return size;
+}
+
+static const rb_data_type_t rdo_postgres_tuple_list_type = {
+  "RDO::Postgres::TupleList",
+  {
+    rdo_postgres_tuple_list_mark,
+    rdo_postgres_tuple_list_free,
+    rdo_postgres_tuple_list_memsize,
+  },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/** The kind of parsing a decode worker can do for a column type */
+static int rdo_postgres_decode_kind(Oid type) {
+  switch (type) {
+    case RDO_PG_INT2OID:
+    case RDO_PG_INT4OID:
+    case RDO_PG_INT8OID:
+      return RDO_PG_DECODE_INT;
+
+    case RDO_PG_FLOAT4OID:
+    case RDO_PG_FLOAT8OID:
+      return RDO_PG_DECODE_FLOAT;
+
+    case RDO_PG_BOOLOID:
+      return RDO_PG_DECODE_BOOL;
+
+    default:
+      return RDO_PG_DECODE_NONE;
+  }
+}
+
+/** Parse the task's rows of every decodable column (runs without the GVL) */
+static void * rdo_postgres_decode_worker(void * ptr) {
+  RDOPostgresDecodeTask * task = ptr;
+  RDOPostgresTupleList  * list = task->list;
+  int                     i, j;
+  char                  * value;
+
+  for (j = 0; j < list->nfields; ++j) {
+    RDOPostgresDecodedColumn * col = &list->decoded[j];
+
+    for (i = task->from; i < task->to; ++i) {
+      if (PQgetisnull(list->res, i, j))
+        continue;
+
+      value = PQgetvalue(list->res, i, j);
+
+      switch (col->kind) {
+        case RDO_PG_DECODE_INT:
+          col->ints[i] = strtoll(value, NULL, 10);
+          break;
+
+        case RDO_PG_DECODE_FLOAT:
+          col->floats[i] = strtod(value, NULL);
+          break;
+
+        case RDO_PG_DECODE_BOOL:
+          col->ints[i] = value[0] == 't';
+          break;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/** Split the rows across decode_threads workers and wait for them all */
+static void * rdo_postgres_decode_parallel(void * ptr) {
+  RDOPostgresTupleList  * list     = ptr;
+  int                     ntuples  = PQntuples(list->res);
+  int                     nthreads = list->decode_threads;
+  int                     per      = (ntuples + nthreads - 1) / nthreads;
+  pthread_t               threads[nthreads];
+  int                     started[nthreads];
+  RDOPostgresDecodeTask   tasks[nthreads];
+  int                     t;
+
+  for (t = 0; t < nthreads; ++t) {
+    tasks[t].list = list;
+    tasks[t].from = t * per < ntuples ? t * per : ntuples;
+    tasks[t].to   = tasks[t].from + per < ntuples ? tasks[t].from + per : ntuples;
+
+    started[t] = pthread_create(&threads[t], NULL,
+        rdo_postgres_decode_worker, &tasks[t]) == 0;
+
+    if (!started[t])
+      rdo_postgres_decode_worker(&tasks[t]);
+  }
+
+  for (t = 0; t < nthreads; ++t) {
+    if (started[t])
+      pthread_join(threads[t], NULL);
+  }
+
+  return NULL;
+}
+
+/**
+ * Parse integer, float and boolean columns in parallel, if enabled.
+ *
+ * Only building the Ruby objects is left for the Ruby thread. This runs at
+ * most once per TupleList: the parsed values of every column share a single
+ * buffer, which is kept for later iterations, and a result with nothing to
+ * parse is not looked at again.
+ */
+static void rdo_postgres_tuple_list_decode(RDOPostgresTupleList * list) {
+  int ntuples = PQntuples(list->res);
+  int found   = 0;
+  int j;
+
+  if (list->decode_tried)
+    return;
+
+  list->decode_tried = 1;
+
+  if (list->decode_threads < 2 || ntuples < RDO_PG_PARALLEL_DECODE_MIN_ROWS)
+    return;
+
+  for (j = 0; j < list->nfields; ++j) {
+    if (rdo_postgres_decode_kind(list->types[j]) != RDO_PG_DECODE_NONE)
+      ++found;
+  }
+
+  if (!found)
+    return;
+
+  list->decoded       = calloc(list->nfields, sizeof(RDOPostgresDecodedColumn));
+  list->decode_buffer = malloc(sizeof(int64_t) * ntuples * found);
+
+  if (list->decoded == NULL || list->decode_buffer == NULL) {
+    rdo_postgres_tuple_list_free_decoded(list);
+    return;
+  }
+
+  char * next = list->decode_buffer;
+
+  for (j = 0; j < list->nfields; ++j) {
+    RDOPostgresDecodedColumn * col = &list->decoded[j];
+
+    col->kind = rdo_postgres_decode_kind(list->types[j]);
+
+    if (col->kind == RDO_PG_DECODE_FLOAT) {
+      col->floats = (double *) next;
+      next += sizeof(int64_t) * ntuples;
+    } else if (col->kind != RDO_PG_DECODE_NONE) {
+      col->ints = (int64_t *) next;
+      next += sizeof(int64_t) * ntuples;
+    }
+  }
+
+  rb_thread_call_without_gvl(rdo_postgres_decode_parallel, list, NULL, NULL);
+}
+
+/** The Ruby value for a cell parsed by the decode workers */
+static VALUE rdo_postgres_tuple_list_decoded_value(RDOPostgresDecodedColumn * col,
+    int i) {
+
+  switch (col->kind) {
+    case RDO_PG_DECODE_INT:
+      return LL2NUM(col->ints[i]);
+
+    case RDO_PG_DECODE_FLOAT:
+      return DBL2NUM(col->floats[i]);
+
+    default:
+      return col->ints[i] ? Qtrue : Qfalse;
+  }
+}
+
+/** Build the Hash for row i of the result */
+static VALUE rdo_postgres_tuple_list_row(RDOPostgresTupleList * list, int i) {
+  VALUE hash = rb_hash_new();
+  int   j    = 0;
+
+  for (; j < list->nfields; ++j) {
+    VALUE value;
+
+    if (list->decoded != NULL
+        && list->decoded[j].kind != RDO_PG_DECODE_NONE
+        && !PQgetisnull(list->res, i, j)) {
+      value = rdo_postgres_tuple_list_decoded_value(&list->decoded[j], i);
+    } else if (list->interns != NULL
+        && list->interns[j] != NULL
+        && !PQgetisnull(list->res, i, j)) {
+      value = rdo_postgres_intern_string(list->interns[j],
+          PQgetvalue(list->res, i, j),
+          PQgetlength(list->res, i, j),
+          list->encoding);
+    } else if (RDO_PG_DECODER_P(list, j) && !PQgetisnull(list->res, i, j)) {
+      value = rdo_postgres_cast_decoded_value(PQgetvalue(list->res, i, j),
+          PQgetlength(list->res, i, j),
+          rb_ary_entry(list->decoders, j),
+          list->encoding, list->cast_flags);
+    } else {
+      value = rdo_postgres_cast_typed_value(list->res, i, j, list->types[j],
+          list->encoding, list->cast_flags);
+    }
+
+    rb_hash_aset(hash, ID2SYM(list->keys[j]), value);
+  }
+
+  return hash;
+}
+
+/** Build the Hash for row i of a spooled result */
+static VALUE rdo_postgres_tuple_list_spool_row(RDOPostgresTupleList * list, long i) {
+  VALUE  hash   = rb_hash_new();
+  char * cursor = rdo_postgres_spool_row(list->spool, i);
+  int    j      = 0;
+
+  for (; j < list->nfields; ++j) {
+    VALUE  value;
+    int    length;
+    char * s = rdo_postgres_spool_value(&cursor, &length);
+
+    if (s == NULL) {
+      value = Qnil;
+    } else if (list->interns != NULL && list->interns[j] != NULL) {
+      value = rdo_postgres_intern_string(list->interns[j], s, length, list->encoding);
+    } else if (RDO_PG_DECODER_P(list, j)) {
+      value = rdo_postgres_cast_decoded_value(s, length,
+          rb_ary_entry(list->decoders, j), list->encoding, list->cast_flags);
+    } else {
+      value = rdo_postgres_cast_raw_value(s, length, list->types[j],
+          list->encoding, list->cast_flags);
+    }
+
+    rb_hash_aset(hash, ID2SYM(list->keys[j]), value);
+  }
+
+  return hash;
+}
+
+/** Number of rows, however they are held */
+static long rdo_postgres_tuple_list_size(RDOPostgresTupleList * list) {
+  if (!NIL_P(list->rows)) {
+    return RARRAY_LEN(list->rows);
+  } else if (list->spool != NULL) {
+    return list->spool->ntuples;
+  } else {
+    return PQntuples(list->res);
+  }
+}
+
+/**
+ * Decode every row into an Array of Hashes and free the PGresult.
+ *
+ * This avoids holding the libpq and Ruby copies of a large result at once.
+ */
+static void rdo_postgres_tuple_list_consume(RDOPostgresTupleList * list) {
+  int   ntuples = PQntuples(list->res);
+  int   i       = 0;
+  VALUE rows    = rb_ary_new2(ntuples);
+
+  list->rows = rows;
+
+  rdo_postgres_tuple_list_decode(list);
+
+  for (; i < ntuples; ++i) {
+    rb_ary_push(rows, rdo_postgres_tuple_list_row(list, i));
+  }
+
+  rdo_postgres_tuple_list_free_interns(list);
+  rdo_postgres_tuple_list_free_decoded(list);
+  rdo_postgres_tuple_list_clear(list);
+}
+
+/** Allocate a TupleList with the driver's settings, but no columns yet */
+static VALUE rdo_postgres_tuple_list_alloc(RDOPostgresDriver * driver,
+    RDOPostgresTupleList ** ptr) {
+
+  RDOPostgresTupleList * list;
+  VALUE obj = TypedData_Make_Struct(rdo_postgres_cTupleList,
+      RDOPostgresTupleList, &rdo_postgres_tuple_list_type, list);
+
+  list->res        = NULL;
+  list->encoding   = driver->encoding;
+  list->cast_flags = driver->cast_flags;
+  list->nfields    = 0;
+  list->types      = NULL;
+  list->keys       = NULL;
+  list->decoders   = Qnil;
+  list->interns    = NULL;
+  list->rows       = Qnil;
+  list->decoded    = NULL;
+  list->memsize    = 0;
+
+  list->decode_tried  = 0;
+  list->decode_buffer = NULL;
+  list->spool      = NULL;
+  list->desc       = NULL;
+
+  list->decode_threads = driver->decode_threads < RDO_PG_MAX_DECODE_THREADS
+    ? driver->decode_threads : RDO_PG_MAX_DECODE_THREADS;
+
+  *ptr = list;
+
+  return obj;
+}
+
+/** Resolve the column types of res and set up any intern tables */
+static void rdo_postgres_tuple_list_init_columns(RDOPostgresTupleList * list,
+    PGresult * res, RDOPostgresDriver * driver) {
+
+  int i = 0;
+
+  list->nfields = PQnfields(res);
+  list->types   = malloc(sizeof(Oid) * (list->nfields + 1));
+  list->keys    = malloc(sizeof(ID) * (list->nfields + 1));
+
+  for (; i < list->nfields; ++i) {
+    VALUE decoder = rdo_postgres_driver_type_decoder(driver, PQftype(res, i));
+
+    list->keys[i] = rb_intern(PQfname(res, i));
+
+    list->types[i] = rdo_postgres_driver_resolve_type(driver, PQftype(res, i));
+
+    if (!NIL_P(decoder)) {
+      if (NIL_P(list->decoders))
+        list->decoders = rb_ary_new2(list->nfields);
+      rb_ary_store(list->decoders, i, decoder);
+    }
+  }
+
+  if (driver->intern_limit > 0) {
+    for (i = 0; i < list->nfields; ++i) {
+      if (!rdo_postgres_intern_type_p(list->types[i])
+          || !rdo_postgres_intern_column_p(driver->intern_columns, PQfname(res, i)))
+        continue;
+
+      if (list->interns == NULL) {
+        list->interns = calloc(list->nfields, sizeof(RDOPostgresInternTable *));
+
+        if (list->interns == NULL)
+          rb_memerror();
+      }
+
+      list->interns[i] = rdo_postgres_intern_table_new(driver->intern_limit);
+    }
+  }
 }
 
 /** Factory to return a new instance of TupleList for a result */
-VALUE rdo_postgres_tuple_list_new(PGresult * res, int encoding) {
-  RDOPostgresTupleList * list = malloc(sizeof(RDOPostgresTupleList));
-  list->res      = res;
-  list->encoding = encoding;
+VALUE rdo_postgres_tuple_list_new(PGresult * res, RDOPostgresDriver * driver) {
+  RDOPostgresTupleList * list;
+  VALUE obj = rdo_postgres_tuple_list_alloc(driver, &list);
+
+  list->res     = res;
+  list->memsize = rdo_postgres_result_memsize(res);
 
-  VALUE obj = Data_Wrap_Struct(rdo_postgres_cTupleList, 0,
-      rdo_postgres_tuple_list_free, list);
+  rdo_postgres_adjust_memory_usage((ssize_t) list->memsize);
+  rdo_postgres_tuple_list_init_columns(list, res, driver);
+
+  if (driver->consume_results) {
+    rdo_postgres_tuple_list_consume(list);
+  }
 
   rb_obj_call_init(obj, 0, NULL);
 
   return obj;
 }
 
+/** Factory to return an empty TupleList that rows are spooled into */
+VALUE rdo_postgres_tuple_list_new_spooled(RDOPostgresDriver * driver, size_t limit) {
+  RDOPostgresTupleList * list;
+  VALUE obj = rdo_postgres_tuple_list_alloc(driver, &list);
+
+  if ((list->spool = rdo_postgres_spool_new(limit)) == NULL) {
+    rb_raise(rb_eNoMemError, "Failed to allocate a result spool");
+  }
+
+  rb_obj_call_init(obj, 0, NULL);
+
+  return obj;
+}
+
+/** Add the rows of a single-row mode (or final) result to a spooled TupleList */
+void rdo_postgres_tuple_list_spool(VALUE self, PGresult * res,
+    RDOPostgresDriver * driver) {
+
+  RDOPostgresTupleList * list;
+  TypedData_Get_Struct(self, RDOPostgresTupleList,
+      &rdo_postgres_tuple_list_type, list);
+
+  int i = 0;
+
+  if (list->desc == NULL) {
+    list->desc = PQcopyResult(res, PG_COPYRES_ATTRS);
+    rdo_postgres_tuple_list_init_columns(list, res, driver);
+  }
+
+  for (; i < PQntuples(res); ++i) {
+    if (!rdo_postgres_spool_append(list->spool, res, i)) {
+      rb_sys_fail("Failed to spool result row");
+    }
+  }
+}
+
+/** Make the spooled rows readable, once the last row has been added */
+void rdo_postgres_tuple_list_spool_finish(VALUE self) {
+  RDOPostgresTupleList * list;
+  TypedData_Get_Struct(self, RDOPostgresTupleList,
+      &rdo_postgres_tuple_list_type, list);
+
+  if (!rdo_postgres_spool_finish(list->spool)) {
+    rb_sys_fail("Failed to map spooled result");
+  }
+
+  list->memsize = rdo_postgres_spool_memsize(list->spool);
+  rdo_postgres_adjust_memory_usage((ssize_t) list->memsize);
+}
+
 /** Allow iteration over all tuples, yielding Hashes into a block */
 static VALUE rdo_postgres_tuple_list_each(VALUE self) {
   if (!rb_block_given_p()) {
@@ -45,28 +790,147 @@ static VALUE rdo_postgres_tuple_list_each(VALUE self) {
   }
 
   RDOPostgresTupleList * list;
-  Data_Get_Struct(self, RDOPostgresTupleList, list);
+  TypedData_Get_Struct(self, RDOPostgresTupleList,
+      &rdo_postgres_tuple_list_type, list);
+
+  if (!NIL_P(list->rows)) {
+    long i = 0;
+    for (; i < RARRAY_LEN(list->rows); ++i) {
+      rb_yield(rb_ary_entry(list->rows, i));
+    }
+    return self;
+  }
+
+  if (list->spool != NULL) {
+    long i = 0;
+    for (; i < list->spool->ntuples; ++i) {
+      rb_yield(rdo_postgres_tuple_list_spool_row(list, i));
+    }
+    return self;
+  }
 
   int i     = 0;
   int ntups = PQntuples(list->res);
 
+  rdo_postgres_tuple_list_decode(list);
+
   for (; i < ntups; ++i) {
-    VALUE hash  = rb_hash_new();
-    int j       = 0;
-    int nfields = PQnfields(list->res);
-
-    for (; j < nfields; ++j) {
-      rb_hash_aset(hash,
-          ID2SYM(rb_intern(PQfname(list->res, j))),
-          rdo_postgres_cast_value(list->res, i, j, list->encoding));
-    }
+    rb_yield(rdo_postgres_tuple_list_row(list, i));
+  }
+
+  return self;
+}
+
+/** Return row i as a Hash (negative indexes count from the end), or nil */
+static VALUE rdo_postgres_tuple_list_aref(VALUE self, VALUE index) {
+  RDOPostgresTupleList * list;
+  TypedData_Get_Struct(self, RDOPostgresTupleList,
+      &rdo_postgres_tuple_list_type, list);
+
+  long size = rdo_postgres_tuple_list_size(list);
+  long i    = NUM2LONG(index);
 
-    rb_yield(hash);
+  if (i < 0) {
+    i += size;
   }
 
+  if (i < 0 || i >= size) {
+    return Qnil;
+  } else if (!NIL_P(list->rows)) {
+    return rb_ary_entry(list->rows, i);
+  } else if (list->spool != NULL) {
+    return rdo_postgres_tuple_list_spool_row(list, i);
+  } else {
+    return rdo_postgres_tuple_list_row(list, (int) i);
+  }
+}
+
+/** Return the number of rows */
+static VALUE rdo_postgres_tuple_list_size_m(VALUE self) {
+  RDOPostgresTupleList * list;
+  TypedData_Get_Struct(self, RDOPostgresTupleList,
+      &rdo_postgres_tuple_list_type, list);
+  return LONG2NUM(rdo_postgres_tuple_list_size(list));
+}
+
+/** Predicate test if rows were written to a temp file */
+static VALUE rdo_postgres_tuple_list_spilled_p(VALUE self) {
+  RDOPostgresTupleList * list;
+  TypedData_Get_Struct(self, RDOPostgresTupleList,
+      &rdo_postgres_tuple_list_type, list);
+  return list->spool != NULL && rdo_postgres_spool_spilled_p(list->spool)
+    ? Qtrue : Qfalse;
+}
+
+/** Fetch the PGresult, raising if it was freed in consume mode */
+static PGresult * rdo_postgres_tuple_list_result(RDOPostgresTupleList * list) {
+  if (list->spool != NULL) {
+    RDO_ERROR("Spooled results cannot be exported");
+  }
+
+  if (list->res == NULL) {
+    RDO_ERROR("Result was consumed: disable consume_results to export it");
+  }
+
+  return list->res;
+}
+
+/**
+ * Yield the result as Arrow IPC stream chunks, without building row Hashes.
+ *
+ * The schema is yielded first, then one record batch per rows_per_batch rows,
+ * then the end-of-stream marker. The chunks concatenated form a valid stream.
+ */
+static VALUE rdo_postgres_tuple_list_each_arrow_ipc(int argc, VALUE * args, VALUE self) {
+  RETURN_ENUMERATOR(self, argc, args);
+
+  VALUE rows_per_batch;
+  rb_scan_args(argc, args, "01", &rows_per_batch);
+
+  RDOPostgresTupleList * list;
+  TypedData_Get_Struct(self, RDOPostgresTupleList,
+      &rdo_postgres_tuple_list_type, list);
+
+  PGresult * res   = rdo_postgres_tuple_list_result(list);
+  int        utf8  = list->encoding == rb_utf8_encindex();
+  int        ntups = PQntuples(res);
+  int        batch = NIL_P(rows_per_batch)
+    ? RDO_PG_ARROW_BATCH_ROWS : NUM2INT(rows_per_batch);
+  int        from  = 0;
+
+  if (batch < 1) {
+    rb_raise(rb_eArgError, "rows_per_batch must be positive");
+  }
+
+  rb_yield(rdo_postgres_arrow_schema(res, utf8));
+
+  for (; from < ntups; from += batch) {
+    rb_yield(rdo_postgres_arrow_record_batch(res, utf8,
+          from, ntups - from < batch ? ntups : from + batch));
+  }
+
+  rb_yield(rdo_postgres_arrow_end_of_stream());
+
   return self;
 }
 
+/** Collect the result in the Arrow IPC stream format */
+static VALUE rdo_postgres_tuple_list_to_arrow_ipc(int argc, VALUE * args, VALUE self) {
+  VALUE stream = rb_str_buf_new(0);
+  VALUE chunks = rb_funcall2(self, rb_intern("each_arrow_ipc"), argc, args);
+  long  i      = 0;
+
+  chunks = rb_funcall(chunks, rb_intern("to_a"), 0);
+
+  for (; i < RARRAY_LEN(chunks); ++i) {
+    rb_str_buf_append(stream, rb_ary_entry(chunks, i));
+  }
+
+  rb_enc_associate_index(stream, rb_ascii8bit_encindex());
+
+  return stream;
+}
+
 /**
  * Invoked during driver initialization to set up the TupleList.
  */
@@ -76,9 +940,26 @@ void Init_rdo_postgres_tuples(void) {
   rdo_postgres_cTupleList = rb_define_class_under(mPostgres,
       "TupleList", rb_cObject);
 
+  rb_undef_alloc_func(rdo_postgres_cTupleList);
+
   rb_define_method(rdo_postgres_cTupleList,
       "each", rdo_postgres_tuple_list_each, 0);
 
+  rb_define_method(rdo_postgres_cTupleList,
+      "[]", rdo_postgres_tuple_list_aref, 1);
+
+  rb_define_method(rdo_postgres_cTupleList,
+      "size", rdo_postgres_tuple_list_size_m, 0);
+
+  rb_define_method(rdo_postgres_cTupleList,
+      "spilled?", rdo_postgres_tuple_list_spilled_p, 0);
+
+  rb_define_method(rdo_postgres_cTupleList,
+      "each_arrow_ipc", rdo_postgres_tuple_list_each_arrow_ipc, -1);
+
+  rb_define_method(rdo_postgres_cTupleList,
+      "to_arrow_ipc", rdo_postgres_tuple_list_to_arrow_ipc, -1);
+
   rb_include_module(rdo_postgres_cTupleList, rb_mEnumerable);
 
   Init_rdo_postgres_casts();
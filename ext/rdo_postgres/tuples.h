@@ -8,11 +8,31 @@
 #include <stdio.h>
 #include <ruby.h>
 #include <libpq-fe.h>
+#include "driver.h"
 
 /**
  * Create a new RDO::Postgres::TupleList.
+ *
+ * The encoding, cast flags and string interning settings are copied from the
+ * driver.
+ */
+VALUE rdo_postgres_tuple_list_new(PGresult * res, RDOPostgresDriver * driver);
+
+/**
+ * Create an empty RDO::Postgres::TupleList that rows are spooled into.
+ *
+ * Up to limit bytes are kept in memory, then rows spill to a temp file.
  */
-VALUE rdo_postgres_tuple_list_new(PGresult * res, int encoding);
+VALUE rdo_postgres_tuple_list_new_spooled(RDOPostgresDriver * driver, size_t limit);
+
+/** Add every row of res (from single-row mode) to a spooled TupleList */
+void rdo_postgres_tuple_list_spool(VALUE list, PGresult * res, RDOPostgresDriver * driver);
+
+/** Finish a spooled TupleList once all rows are added, so it can be read */
+void rdo_postgres_tuple_list_spool_finish(VALUE list);
+
+/** Memory held by libpq for a result, which the GC cannot see */
+size_t rdo_postgres_result_memsize(PGresult * res);
 
 /**
  * Called during driver initialization to define needed tuple classes.
@@ -72,3 +72,56 @@
 // timestamp[]/timestamptz[]
 #define RDO_PG_TIMESTAMPARRAYOID   1115
 #define RDO_PG_TIMESTAMPTZARRAYOID 1185
+
+// uuid
+#define RDO_PG_UUIDOID 2950
+
+// json/jsonb
+#define RDO_PG_JSONOID  114
+#define RDO_PG_JSONBOID 3802
+
+// interval
+#define RDO_PG_INTERVALOID 1186
+
+// time/timetz
+#define RDO_PG_TIMEOID   1083
+#define RDO_PG_TIMETZOID 1266
+
+// inet/cidr
+#define RDO_PG_INETOID 869
+#define RDO_PG_CIDROID 650
+
+// money
+#define RDO_PG_MONEYOID 790
+
+// uuid[]
+#define RDO_PG_UUIDARRAYOID 2951
+
+// json[]/jsonb[]
+#define RDO_PG_JSONARRAYOID  199
+#define RDO_PG_JSONBARRAYOID 3807
+
+// interval[]
+#define RDO_PG_INTERVALARRAYOID 1187
+
+// time[]/timetz[]
+#define RDO_PG_TIMEARRAYOID   1183
+#define RDO_PG_TIMETZARRAYOID 1270
+
+// inet[]/cidr[]
+#define RDO_PG_INETARRAYOID 1041
+#define RDO_PG_CIDRARRAYOID 651
+
+// money[]
+#define RDO_PG_MONEYARRAYOID 791
+
+// record (anonymous composites)
+#define RDO_PG_RECORDOID 2249
+
+// ranges
+#define RDO_PG_INT4RANGEOID 3904
+#define RDO_PG_INT8RANGEOID 3926
+#define RDO_PG_NUMRANGEOID  3906
+#define RDO_PG_DATERANGEOID 3912
+#define RDO_PG_TSRANGEOID   3908
+#define RDO_PG_TSTZRANGEOID 3910
@@ -8,7 +8,24 @@
 require "rdo"
 
 require "rdo/postgres/version"
+require "rdo/postgres/sql"
+require "rdo/postgres/type_map"
+require "rdo/postgres/query_cache"
+require "rdo/postgres/coalescer"
+require "rdo/postgres/explain_sampler"
 require "rdo/postgres/driver"
+require "rdo/postgres/simple_statement"
+require "rdo/postgres/result"
+require "rdo/postgres/bytea"
+require "rdo/postgres/bytea_reader"
+require "rdo/postgres/bulk_insert"
+require "rdo/postgres/cursor"
+require "rdo/postgres/replication_stream"
+require "rdo/postgres/routing_driver"
+require "rdo/postgres/sharding_driver"
+require "rdo/postgres/interval"
+require "rdo/postgres/range"
+require "rdo/postgres/inet"
 
 require "rdo/postgres/array"
 require "rdo/postgres/array/text"
@@ -20,6 +37,10 @@ require "rdo/postgres/array/bytea"
 require "rdo/postgres/array/date"
 require "rdo/postgres/array/timestamp"
 require "rdo/postgres/array/timestamp_tz"
+require "rdo/postgres/array/interval"
+require "rdo/postgres/array/inet"
+require "rdo/postgres/array/cidr"
+require "rdo/postgres/array/money"
 
 # c extension
 require "rdo_postgres/rdo_postgres"
@@ -28,3 +49,13 @@ require "rdo_postgres/rdo_postgres"
 %w[postgres postgresql pgsql psql].each do |name|
   RDO::Connection.register_driver(name, RDO::Postgres::Driver)
 end
+
+# Read/write splitting across a primary and replicas
+%w[postgres+routing postgresql+routing].each do |name|
+  RDO::Connection.register_driver(name, RDO::Postgres::RoutingDriver)
+end
+
+# Key-based sharding across several databases
+%w[postgres+sharding postgresql+sharding].each do |name|
+  RDO::Connection.register_driver(name, RDO::Postgres::ShardingDriver)
+end
@@ -0,0 +1,23 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "ipaddr"
+
+module RDO
+  module Postgres
+    # Ruby handling for cidr[] types in PostgreSQL.
+    class Array::Cidr < Array
+      def parse_value(s)
+        # defined in ext/rdo_postgres/arrays.c
+      end
+
+      def format_value(v)
+        IPAddr === v ? "#{v}/#{v.prefix}" : v.to_s
+      end
+    end
+  end
+end
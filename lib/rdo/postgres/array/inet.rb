@@ -0,0 +1,27 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "ipaddr"
+
+module RDO
+  module Postgres
+    # Ruby handling for inet[] types in PostgreSQL.
+    class Array::Inet < Array
+      def parse_value(s)
+        # defined in ext/rdo_postgres/arrays.c
+      end
+
+      def format_value(v)
+        case v
+        when Inet   then v.to_s
+        when IPAddr then "#{v}/#{v.prefix}"
+        else v.to_s
+        end
+      end
+    end
+  end
+end
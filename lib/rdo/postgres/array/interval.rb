@@ -0,0 +1,17 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Ruby handling for interval[] type in PostgreSQL.
+    class Array::Interval < Array
+      def parse_value(s)
+        # defined in ext/rdo_postgres/arrays.c
+      end
+    end
+  end
+end
@@ -0,0 +1,23 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "bigdecimal"
+
+module RDO
+  module Postgres
+    # Ruby handling for money[] type in PostgreSQL.
+    class Array::Money < Array
+      def parse_value(s)
+        # defined in ext/rdo_postgres/arrays.c
+      end
+
+      def format_value(v)
+        BigDecimal === v ? v.to_s("F") : v.to_s
+      end
+    end
+  end
+end
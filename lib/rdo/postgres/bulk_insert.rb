@@ -0,0 +1,197 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Multi-row INSERT used by Driver#insert_many.
+    #
+    # With the :values strategy, rows are sent as INSERT ... VALUES with one
+    # tuple of bind parameters per row. Batches are split into statements of
+    # a few fixed sizes (powers of SHAPE_BASE that fit within MAX_PARAMS), so
+    # only a handful of statements are ever prepared for a table, and repeats
+    # of the same size are pipelined.
+    #
+    # With the :unnest strategy, each column is sent as a single array
+    # parameter and expanded on the server with unnest(), so one prepared
+    # statement handles any number of rows. Array-typed columns cannot be
+    # inserted this way.
+    class BulkInsert
+      # Most bind parameters a single statement can have.
+      MAX_PARAMS = 65535
+
+      # Statement row counts are powers of this number.
+      SHAPE_BASE = 8
+
+      # Rows sent in each statement with the :unnest strategy.
+      UNNEST_BATCH_ROWS = 10_000
+
+      # Initialize an insert into table.
+      #
+      # @param [RDO::Postgres::Driver] driver
+      #   the driver to execute with
+      #
+      # @param [String, Symbol] table
+      #   the table name, optionally schema-qualified
+      #
+      # @param [Array] columns
+      #   the names of the columns values are given for
+      #
+      # @param [Hash] options
+      #   :on_conflict and :strategy, as for Driver#insert_many
+      def initialize(driver, table, columns, options = {})
+        raise ArgumentError, "At least one column is required" if columns.empty?
+
+        @driver      = driver
+        @table       = table.to_s
+        @columns     = columns.map(&:to_s)
+        @on_conflict = conflict_clause(options[:on_conflict])
+        @strategy    = (options[:strategy] || :values).to_sym
+
+        unless [:values, :unnest].include?(@strategy)
+          raise ArgumentError, "Unknown insert strategy #{@strategy.inspect}"
+        end
+      end
+
+      # Insert rows, each an Array of values in column order.
+      #
+      # @param [Array<Array>] rows
+      #   the rows to insert
+      #
+      # @return [Fixnum]
+      #   the number of rows affected
+      def run(rows)
+        rows.each_with_index do |row, i|
+          unless row.size == @columns.size
+            raise ArgumentError,
+              "Row #{i} has #{row.size} values for #{@columns.size} columns"
+          end
+        end
+
+        return 0 if rows.empty?
+
+        results =
+          if @strategy == :unnest
+            run_unnest(rows)
+          else
+            run_values(rows)
+          end
+
+        results.inject(0) { |sum, result| sum + result.affected_rows.to_i }
+      end
+
+      # The INSERT ... VALUES statement for size rows.
+      def values_sql(size)
+        width  = @columns.size
+        tuples = Array.new(size) do |r|
+          "(" + Array.new(width) { |c| "$#{r * width + c + 1}" }.join(", ") + ")"
+        end
+
+        "#{insert_prefix} VALUES #{tuples.join(", ")}#{@on_conflict}"
+      end
+
+      # The INSERT ... SELECT FROM unnest() statement.
+      def unnest_sql
+        types = column_types.each_with_index.map { |type, i| "$#{i + 1}::#{type}[]" }
+        "#{insert_prefix} SELECT * FROM unnest(#{types.join(", ")})#{@on_conflict}"
+      end
+
+      private
+
+      def run_values(rows)
+        batches(rows.size).flat_map do |size, offsets|
+          @driver.prepare_cached(values_sql(size)).execute_many(
+            offsets.map { |offset| rows[offset, size].flatten(1) }
+          )
+        end
+      end
+
+      def run_unnest(rows)
+        @driver.prepare_cached(unnest_sql).execute_many(
+          rows.each_slice(UNNEST_BATCH_ROWS).map(&:transpose)
+        )
+      end
+
+      # Statement sizes, largest first.
+      def shapes
+        max   = MAX_PARAMS / @columns.size
+        sizes = [1]
+        sizes << sizes.last * SHAPE_BASE while sizes.last * SHAPE_BASE <= max
+        sizes.reverse
+      end
+
+      # Split count rows into [size, [offset, ...]] pairs, one per shape used.
+      def batches(count)
+        offset = 0
+
+        shapes.map { |size|
+          n       = (count - offset) / size
+          offsets = Array.new(n) { |i| offset + i * size }
+          offset += n * size
+          [size, offsets]
+        }.reject { |size, offsets| offsets.empty? }
+      end
+
+      def insert_prefix
+        "INSERT INTO #{quote_table(@table)} (#{@columns.map { |c| quote_ident(c) }.join(", ")})"
+      end
+
+      def column_types
+        types = @driver.column_types(@table)
+
+        @columns.map do |column|
+          type = types.fetch(column) do
+            raise ArgumentError, "Unknown column #{column} in #{@table}"
+          end
+
+          if type.end_with?("[]")
+            raise ArgumentError,
+              "Column #{column} is an array, which the :unnest strategy cannot insert"
+          end
+
+          type
+        end
+      end
+
+      # The :on_conflict option may be :nothing, a String following
+      # "ON CONFLICT", or a Hash with :target and :update column lists.
+      def conflict_clause(spec)
+        case spec
+        when nil
+          nil
+        when :nothing, :ignore
+          " ON CONFLICT DO NOTHING"
+        when String
+          " ON CONFLICT #{spec}"
+        when Hash
+          target  = Array(spec[:target]).map(&:to_s)
+          updates = Array(spec.fetch(:update) { @columns - target }).map(&:to_s)
+
+          columns = (" (#{target.map { |c| quote_ident(c) }.join(", ")})" unless target.empty?)
+
+          if updates.empty?
+            " ON CONFLICT#{columns} DO NOTHING"
+          else
+            raise ArgumentError, "on_conflict needs a :target to update" if target.empty?
+
+            " ON CONFLICT#{columns} DO UPDATE SET " +
+              updates.map { |c| "#{quote_ident(c)} = EXCLUDED.#{quote_ident(c)}" }.join(", ")
+          end
+        else
+          raise ArgumentError, "Invalid on_conflict option #{spec.inspect}"
+        end
+      end
+
+      def quote_table(name)
+        name.split(".").map { |part| quote_ident(part) }.join(".")
+      end
+
+      def quote_ident(name)
+        %Q{"#{name.to_s.gsub('"', '""')}"}
+      end
+    end
+  end
+end
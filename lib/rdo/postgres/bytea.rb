@@ -0,0 +1,26 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # A String of binary data, quoted as a bytea literal.
+    #
+    # In simple query mode and Driver#execute_script, bind parameters are
+    # quoted into the SQL as text, which cannot hold arbitrary bytes. Wrap
+    # binary data in a Bytea to send it as a hex bytea literal instead.
+    #
+    # @example
+    #   driver.execute_script("INSERT INTO files (data) VALUES (?)",
+    #     RDO::Postgres::Bytea.new(File.binread(path)))
+    class Bytea < String
+      def initialize(data = "")
+        super
+        force_encoding(Encoding::BINARY)
+      end
+    end
+  end
+end
@@ -0,0 +1,154 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Reads a single bytea value in chunks, using substring() on the server.
+    #
+    # Only one chunk is held in memory at a time, however large the value.
+    # The query is run again for each chunk, so it should be run inside a
+    # REPEATABLE READ transaction if the value may change between reads.
+    #
+    # Values stored with STORAGE EXTERNAL (uncompressed) can be sliced
+    # without reading the whole value from the TOAST table.
+    class ByteaReader
+      # Bytes fetched in each round trip, unless specified.
+      DEFAULT_CHUNK_SIZE = 1024 * 1024
+
+      attr_reader :chunk_size, :pos
+
+      # Initialize a reader for the value selected by sql.
+      #
+      # @param [RDO::Postgres::Driver] driver
+      #   the driver to execute with
+      #
+      # @param [String] sql
+      #   a query selecting a single bytea column from a single row
+      #
+      # @param [Array] args
+      #   bind parameters for sql
+      #
+      # @param [Fixnum] chunk_size
+      #   the number of bytes to fetch in each round trip
+      def initialize(driver, sql, args = [], chunk_size = DEFAULT_CHUNK_SIZE)
+        raise ArgumentError, "chunk_size must be positive" unless chunk_size > 0
+
+        @driver     = driver
+        @sql        = sql
+        @args       = args
+        @chunk_size = chunk_size
+        @pos        = 0
+      end
+
+      # The length of the value in bytes (0 if there is no value).
+      def size
+        @size ||= begin
+          row = @driver.prepare_cached(
+            "SELECT octet_length(rdo_bytea.v) AS size FROM (#{@sql}) AS rdo_bytea(v)"
+          ).execute(*@args).first
+          (row && row[:size]) || 0
+        end
+      end
+
+      alias_method :length, :size
+
+      # Read like IO#read.
+      #
+      # With no length, the rest of the value is read, in chunks.
+      #
+      # @param [Fixnum] length
+      #   the maximum number of bytes to read, or nil for all
+      #
+      # @param [String] outbuf
+      #   an optional String to read into
+      #
+      # @return [String]
+      #   the bytes read, or nil at the end if length was given
+      def read(length = nil, outbuf = nil)
+        outbuf = outbuf ? outbuf.replace("") : String.new
+        outbuf.force_encoding(Encoding::BINARY)
+
+        if length.nil?
+          each_chunk { |chunk| outbuf << chunk }
+          return outbuf
+        end
+
+        raise ArgumentError, "negative length #{length} given" if length < 0
+        return outbuf if length == 0
+        return nil if eof?
+
+        while outbuf.bytesize < length && !eof?
+          outbuf << fetch([length - outbuf.bytesize, @chunk_size].min)
+        end
+
+        outbuf
+      end
+
+      # Yield each remaining chunk of the value.
+      #
+      # @return [Enumerator]
+      #   if no block is given
+      def each_chunk
+        return enum_for(:each_chunk) unless block_given?
+
+        yield fetch(@chunk_size) until eof?
+        self
+      end
+
+      # Move to an absolute byte offset.
+      def seek(offset)
+        raise ArgumentError, "negative offset #{offset} given" if offset < 0
+        @pos = offset
+        0
+      end
+
+      alias_method :pos=, :seek
+
+      # Move back to the start of the value.
+      def rewind
+        seek(0)
+      end
+
+      # Predicate test if the whole value has been read.
+      def eof?
+        @pos >= size
+      end
+
+      # For the IO-like API; there is nothing to release.
+      def close
+        nil
+      end
+
+      private
+
+      # Fetch up to length bytes from the current position and advance.
+      def fetch(length)
+        row   = @driver.prepare_cached(chunk_sql).execute(*@args, @pos + 1, length).first
+        chunk = (row && row[:chunk]) || ""
+        @pos += chunk.bytesize
+        @size = @pos if chunk.empty?
+        chunk
+      end
+
+      # The range parameters follow the inner query, so either marker style works.
+      def chunk_sql
+        @chunk_sql ||= begin
+          from, len =
+            if @sql =~ /\$\d/
+              ["$#{@args.size + 1}", "$#{@args.size + 2}"]
+            else
+              %w[? ?]
+            end
+
+          "SELECT substring(rdo_bytea.v FROM rdo_range.f FOR rdo_range.n) AS chunk " \
+          "FROM (#{@sql}) AS rdo_bytea(v) " \
+          "CROSS JOIN (SELECT #{from}::int4, #{len}::int4) AS rdo_range(f, n)"
+        end
+      end
+    end
+  end
+end
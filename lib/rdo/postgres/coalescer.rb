@@ -0,0 +1,170 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "thread"
+
+module RDO
+  module Postgres
+    # Shares the result of a read-only query with identical concurrent queries.
+    #
+    # The first caller for a statement and its bind values runs it, and any
+    # caller arriving with the same statement and values before it finishes
+    # waits for it instead of querying the server. Each caller gets its own
+    # RDO::Result, holding the same frozen values.
+    #
+    # Results are only shared between connections with the same Coalescer.
+    # Driver gives each database, user and set of session settings its own,
+    # since those can change what a query returns.
+    #
+    # A caller only joins a query that started after its own last write (see
+    # #mark), so it always sees what it wrote. Callers inside a transaction
+    # must not use the Coalescer at all, since their snapshot differs from
+    # the one the shared query runs in; Driver checks for this.
+    #
+    # If the first caller fails, whoever was waiting runs the query itself,
+    # so an error on one connection (e.g. a cancelled query) is not passed to
+    # the others.
+    class Coalescer
+      # A query in progress, and the callers waiting on it.
+      Flight = Struct.new(:done, :rows, :info, :waiters, :started)
+
+      @coalescers = {}
+      @mutex      = Mutex.new
+
+      class << self
+        # The Coalescer shared by connections with key.
+        #
+        # @param [Object] key
+        #   identifies the database and session, e.g. [host, port, dbname, user]
+        #
+        # @return [RDO::Postgres::Coalescer]
+        def for(key)
+          @mutex.synchronize { @coalescers[key] ||= new }
+        end
+
+        # Forget every Coalescer.
+        def clear
+          @mutex.synchronize { @coalescers.clear }
+        end
+      end
+
+      # Number of callers that were given another caller's result.
+      attr_reader :shared
+
+      def initialize
+        @flights = {}
+        @mutex   = Mutex.new
+        @done    = ConditionVariable.new
+        @shared  = 0
+        @clock   = 0
+      end
+
+      # Record a write, returning a marker to pass to #run as :after.
+      #
+      # Queries started before the marker was taken are not joined by a
+      # caller passing it.
+      #
+      # @return [Integer]
+      def mark
+        @mutex.synchronize { @clock += 1 }
+      end
+
+      # Number of distinct queries in progress.
+      def size
+        @mutex.synchronize { @flights.size }
+      end
+
+      # Return the result of stmt and args, yielding to run it if it is not
+      # already running.
+      #
+      # @param [String] stmt
+      #   a read-only statement
+      #
+      # @param [Array] args
+      #   the bind parameters
+      #
+      # @param [Integer] after
+      #   the caller's last #mark; only queries started since are joined
+      #
+      # @param [Float] timeout
+      #   seconds to wait for another caller's query, or nil for no limit
+      #
+      # @return [RDO::Result]
+      #   a result for this caller
+      #
+      # @raise [RDO::Postgres::TimeoutError]
+      #   if the query being waited on runs for longer than timeout
+      def run(stmt, args, after: 0, timeout: nil)
+        key = [stmt, args.map{|v| v.nil? ? nil : v.to_s}]
+
+        flight, leader = @mutex.synchronize do
+          if (flight = @flights[key]) && flight.started > after
+            flight.waiters += 1
+            [flight, false]
+          else
+            [@flights[key] = Flight.new(false, nil, nil, 0, @clock += 1), true]
+          end
+        end
+
+        return lead(key, flight) { yield } if leader
+
+        @mutex.synchronize do
+          wait(flight, timeout)
+          @shared += 1 if flight.rows
+        end
+
+        flight.rows ? result_for(flight) : yield
+      end
+
+      private
+
+      def lead(key, flight)
+        result = yield
+
+        flight.rows = result.map do |tuple|
+          tuple.each_value{|v| v.freeze if v.kind_of?(String)}
+          tuple.freeze
+        end
+
+        flight.info = result.info.dup.freeze
+
+        result_for(flight)
+      ensure
+        @mutex.synchronize do
+          @flights.delete(key) if @flights[key].equal?(flight)
+          flight.done = true
+          @done.broadcast if flight.waiters > 0
+        end
+      end
+
+      # Called holding @mutex.
+      def wait(flight, timeout)
+        unless timeout
+          @done.wait(@mutex) until flight.done
+          return
+        end
+
+        deadline = Process.clock_gettime(Process::CLOCK_MONOTONIC) + timeout
+
+        until flight.done
+          remaining = deadline - Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+          if remaining <= 0
+            flight.waiters -= 1
+            raise TimeoutError, "Timed out after #{timeout}s waiting for an identical query"
+          end
+
+          @done.wait(@mutex, remaining)
+        end
+      end
+
+      def result_for(flight)
+        RDO::Result.new(flight.rows.map(&:dup), flight.info.dup)
+      end
+    end
+  end
+end
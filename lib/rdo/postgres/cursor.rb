@@ -0,0 +1,133 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Iterates a large result in batches through a server-side cursor.
+    #
+    # Reading is double-buffered: the FETCH for the next batch is sent before
+    # the current batch is yielded, so the server produces it while Ruby
+    # works. With pipelining (libpq >= 14), up to :prefetch FETCHes are kept
+    # in flight, as long as their estimated size stays within :max_bytes.
+    #
+    # The cursor lives in a transaction, which is opened around the
+    # iteration if one is not already in progress.
+    class Cursor
+      include Enumerable
+
+      # Rows in each FETCH.
+      DEFAULT_BATCH_SIZE = 1000
+
+      # FETCHes kept in flight while a batch is processed.
+      DEFAULT_PREFETCH = 1
+
+      # Estimated bytes of prefetched batches held at once.
+      DEFAULT_MAX_BYTES = 64 * 1024 * 1024
+
+      # Rows yielded by #each between reads from the socket.
+      POLL_ROWS = 256
+
+      # Initialize a cursor over a query.
+      #
+      # @param [RDO::Postgres::Driver] driver
+      #   the driver to execute with
+      #
+      # @param [String] sql
+      #   the query, which may have '?' markers
+      #
+      # @param [Array] args
+      #   bind parameters, quoted into the DECLARE
+      #
+      # @param [Hash] options
+      #   :batch_size, :prefetch and :max_bytes
+      def initialize(driver, sql, args = [], options = {})
+        @driver     = driver
+        @sql        = sql
+        @args       = args
+        @batch_size = Integer(options[:batch_size] || DEFAULT_BATCH_SIZE)
+        @prefetch   = Integer(options[:prefetch]   || DEFAULT_PREFETCH)
+        @max_bytes  = Integer(options[:max_bytes]  || DEFAULT_MAX_BYTES)
+
+        raise ArgumentError, "batch_size must be positive" unless @batch_size > 0
+        raise ArgumentError, "prefetch must be positive" unless @prefetch > 0
+      end
+
+      # Yield each batch of rows as an RDO::Result.
+      #
+      # @return [Enumerator]
+      #   if no block is given
+      def each_batch
+        return enum_for(:each_batch) unless block_given?
+
+        @driver.send(:within_transaction) do
+          name = @driver.send(:next_cursor_name)
+          @driver.execute_script("DECLARE #{name} NO SCROLL CURSOR FOR #{@sql}", *@args)
+
+          begin
+            read(name) { |batch| yield batch }
+          ensure
+            @driver.execute_script("CLOSE #{name}") rescue nil
+          end
+        end
+
+        self
+      end
+
+      # Yield each row as a Hash.
+      #
+      # Between rows, anything that has arrived for the next batch is read
+      # from the socket, so the server is never blocked on a full buffer.
+      #
+      # @return [Enumerator]
+      #   if no block is given
+      def each
+        return enum_for(:each) unless block_given?
+
+        each_batch do |batch|
+          batch.each_with_index do |row, i|
+            @driver.send(:prefetch_poll) if (i % POLL_ROWS).zero?
+            yield row
+          end
+        end
+      end
+
+      private
+
+      def read(name)
+        fetch     = "FETCH FORWARD #{@batch_size} FROM #{name}"
+        in_flight = 0
+        largest   = 0
+        done      = false
+
+        # Send FETCHes until :prefetch are in flight, or the next would take
+        # the estimate past :max_bytes. One is always allowed.
+        fill = lambda do
+          while in_flight < @prefetch && (in_flight.zero? || (in_flight + 1) * largest <= @max_bytes)
+            break unless @driver.send(:prefetch_send, fetch)
+            in_flight += 1
+          end
+        end
+
+        begin
+          fill.call
+
+          until done
+            batch, bytes = @driver.send(:prefetch_receive)
+            in_flight -= 1
+            largest    = bytes if bytes > largest
+            done       = batch.count < @batch_size
+
+            fill.call unless done
+            yield batch unless batch.count.zero?
+          end
+        ensure
+          @driver.send(:prefetch_finish)
+        end
+      end
+    end
+  end
+end
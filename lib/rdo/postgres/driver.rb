@@ -7,14 +7,42 @@
 
 module RDO
   module Postgres
+    # Raised when a query runs past its timeout and is cancelled.
+    class TimeoutError < RDO::Exception; end
+
     # Driver for the Postgres server.
     #
     # All default behaviour is overloaded.
     class Driver < RDO::Driver
       # most implementation defined by C extension
 
+      # Number of distinct values kept per column when interning Strings.
+      DEFAULT_INTERN_LIMIT = 1024
+
+      # Number of statements kept by #prepare_cached.
+      STATEMENT_CACHE_SIZE = 64
+
+      # Bytes of rows #execute_spooled keeps in memory before using a temp file.
+      DEFAULT_SPOOL_LIMIT = 64 * 1024 * 1024
+
       # Internally this driver uses prepared statements.
       #
+      # With the :simple_query option, bind parameters are instead quoted into
+      # the statement on the client, and it is sent with the simple query
+      # protocol (see #execute_script). This works behind poolers that cannot
+      # keep prepared statements, such as PgBouncer in transaction mode, and
+      # #prepare then returns a SimpleStatement.
+      #
+      # With the :query_cache option, read-only statements outside of a
+      # transaction are answered from the QueryCache where possible.
+      #
+      # With the :coalesce option, a read-only statement outside of a
+      # transaction that is identical (including bind values) to one already
+      # running on another connection waits for and shares its result, rather
+      # than being sent to the server (see Coalescer). Only queries started
+      # after this connection's last write through #execute (including
+      # COMMIT) are shared, and the wait is limited by query_timeout.
+      #
       # @param [String] stmt
       #   the statement to execute
       #
@@ -24,45 +52,745 @@ module RDO
       # @return [RDO::Result]
       #   a result containing any tuples and query info
       def execute(stmt, *args)
-        prepare(stmt).execute(*args)
+        if (@query_cache || @coalescer) && !in_transaction? && Sql.read_only?(stmt)
+          execute_read(stmt, args)
+        else
+          execute_statement(stmt, args).tap do
+            Sql.written_tables(stmt).each{|t| @query_cache.invalidate(t)} if @query_cache
+            @last_write = @coalescer.mark if @coalescer
+          end
+        end
+      end
+
+      # Execute one or more statements in a single round trip.
+      #
+      # Bind parameters are quoted into the SQL on the client, and it is sent
+      # with the simple query protocol, so no statement is prepared. Values
+      # are quoted as literals of unknown type, which the server resolves
+      # like untyped bind parameters. Wrap binary data in a Bytea to send it
+      # as bytea.
+      #
+      # @param [String] sql
+      #   statements separated by semicolons
+      #
+      # @param [Object...] *args
+      #   bind parameters for the '?' markers, across all statements
+      #
+      # @return [RDO::Result]
+      #   the result of the last statement
+      def execute_script(sql, *args)
+        simple_execute(sql, *args)
+      end
+
+      # Iterate the rows of a query in batches, through a server-side cursor.
+      #
+      # The next batch is requested before the current one is yielded, so
+      # network and processing overlap. Defaults for the batch size, number
+      # of batches read ahead and their memory cap come from the
+      # :cursor_batch_size, :cursor_prefetch and :cursor_max_bytes options;
+      # use Cursor.new to choose them per query.
+      #
+      # @param [String] stmt
+      #   the query, which may have '?' markers
+      #
+      # @param [Object...] *args
+      #   bind parameters, quoted into the DECLARE on the client
+      #
+      # @return [RDO::Postgres::Cursor]
+      #   an Enumerable of rows, with #each_batch
+      def cursor(stmt, *args)
+        Cursor.new(self, stmt, args,
+          batch_size: options[:cursor_batch_size],
+          prefetch:   options[:cursor_prefetch],
+          max_bytes:  options[:cursor_max_bytes])
+      end
+
+      # Stream changes from a logical replication slot.
+      #
+      # The connection must be opened with the :replication option, and is
+      # used only for the stream while it is read.
+      #
+      # @param [String] slot
+      #   the name of the replication slot
+      #
+      # @param [Hash] stream_options
+      #   see ReplicationStream#initialize
+      #
+      # @return [RDO::Postgres::ReplicationStream]
+      #   an Enumerable of change events
+      def replication_stream(slot, stream_options = {})
+        ReplicationStream.new(self, slot, stream_options)
+      end
+
+      # Predicate test if the connection was opened for replication.
+      def replication?
+        ![nil, false, "false"].include?(options[:replication])
+      end
+
+      # Predicate test if #execute uses the simple query protocol.
+      #
+      # Replication connections only accept simple queries.
+      def simple_query?
+        replication? || [true, "true"].include?(options[:simple_query])
+      end
+
+      # The QueryCache used by #execute, or nil if it is disabled.
+      attr_reader :query_cache
+
+      # The Coalescer used by #execute, or nil if it is disabled.
+      attr_reader :coalescer
+
+      # Run the block with a different query_timeout.
+      #
+      # Each query made in the block is cancelled, raising
+      # RDO::Postgres::TimeoutError, if it runs for longer than seconds.
+      #
+      # @param [Numeric] seconds
+      #   the timeout for each query, or nil for no limit
+      #
+      # @return [Object]
+      #   the return value of the block
+      def with_timeout(seconds)
+        previous = query_timeout
+        self.query_timeout = seconds
+
+        begin
+          yield
+        ensure
+          self.query_timeout = previous
+        end
+      end
+
+      # Execute the same statement once for each set of bind parameters.
+      #
+      # The statement is prepared once, and where libpq supports pipelining,
+      # all parameter sets are sent without waiting on each result.
+      #
+      # @param [String] stmt
+      #   the statement to execute
+      #
+      # @param [Array<Array>] param_sets
+      #   an Array of bind parameter lists
+      #
+      # @return [Array<RDO::Result>]
+      #   one result per parameter set
+      def execute_many(stmt, param_sets)
+        prepare(stmt).execute_many(param_sets)
+      end
+
+      # Execute a statement whose result may be too large to hold in memory.
+      #
+      # Rows are streamed from the server one at a time and copied into a
+      # compact buffer. Past the :spool_limit option (in bytes), the buffer
+      # moves to an unlinked temp file in $TMPDIR, which is memory-mapped once
+      # the query completes. Unlike the lazy iteration of #execute with
+      # :consume_results off, the result can be iterated any number of times
+      # and rows can be read by index. Arrow export is not supported, nor is
+      # simple query mode.
+      #
+      # @param [String] stmt
+      #   the statement to execute
+      #
+      # @param [Object...] *args
+      #   bind parameters to execute with
+      #
+      # @return [RDO::Result]
+      #   a result, whose rows are decoded each time they are read
+      def execute_spooled(stmt, *args)
+        prepare(stmt, true).execute_spooled(spool_limit, *args)
+      end
+
+      # The ExplainSampler set by #explain_to, or nil.
+      attr_reader :explain_sampler
+
+      # Capture query plans for slow or randomly sampled statements.
+      #
+      # After each StatementExecutor#execute taking at least threshold
+      # seconds, or for 1 in every sample executions, EXPLAIN (FORMAT JSON)
+      # is run with the same bind parameters on a background thread, and the
+      # plan is passed to sink. The defaults come from the :explain_threshold
+      # and :explain_sample options.
+      #
+      # @example
+      #   driver.explain_to(threshold: 0.5) { |event| logger.info(event) }
+      #
+      # @param [#call] sink
+      #   receives a Hash per plan (see ExplainSampler), or nil to stop; the
+      #   block is used if not given
+      #
+      # @param [Numeric] threshold
+      #   seconds after which a statement's plan is captured
+      #
+      # @param [Fixnum] sample
+      #   capture the plan of 1 in every sample statements
+      #
+      # @return [RDO::Postgres::ExplainSampler]
+      #   the sampler, or nil if stopped
+      def explain_to(sink = nil, threshold: nil, sample: nil, &block)
+        sink ||= block
+        @explain_sampler.stop if @explain_sampler
+
+        @explain_sampler = sink && ExplainSampler.new(options, sink,
+          threshold: threshold || options[:explain_threshold],
+          sample:    sample || options[:explain_sample])
+
+        self.explain_sampler = @explain_sampler
+      end
+
+      # Subscribe to NOTIFY messages on a channel.
+      #
+      # Notifications are read with #wait_for_notify or #notifications.
+      #
+      # @param [String] channel
+      #   the name of the channel
+      #
+      # @return [RDO::Result]
+      #   the result of the LISTEN command
+      def listen(channel)
+        execute("LISTEN #{quote_ident(channel)}")
+      end
+
+      # Stop receiving NOTIFY messages on a channel.
+      #
+      # @param [String] channel
+      #   the name of the channel, or nil for all channels
+      #
+      # @return [RDO::Result]
+      #   the result of the UNLISTEN command
+      def unlisten(channel = nil)
+        if channel.nil?
+          execute("UNLISTEN *").tap { listen_for_invalidations }
+        else
+          execute("UNLISTEN #{quote_ident(channel)}")
+        end
+      end
+
+      # Return all notifications received so far, without blocking.
+      #
+      # @return [Array<Hash>]
+      #   Hashes with :channel, :payload and :pid
+      def notifications
+        drain_notifications
+        @notification_backlog.slice!(0, @notification_backlog.size)
+      end
+
+      # Block until a notification arrives, without holding the GVL.
+      #
+      # @param [Numeric] timeout
+      #   seconds to wait, or nil to wait forever
+      #
+      # @return [Hash]
+      #   a Hash with :channel, :payload and :pid, or nil on timeout
+      def wait_for_notify(timeout = nil)
+        deadline = timeout && Process.clock_gettime(Process::CLOCK_MONOTONIC) + timeout
+
+        loop do
+          drain_notifications
+          return @notification_backlog.shift unless @notification_backlog.empty?
+
+          remaining = deadline && deadline - Process.clock_gettime(Process::CLOCK_MONOTONIC)
+          return nil if remaining && remaining < 0
+
+          notify = wait_for_notification(remaining)
+          return nil if notify.nil?
+
+          @notification_backlog << notify unless invalidation?(notify)
+        end
+      end
+
+      # Open a large object as an IO-like RDO::Postgres::LargeObject.
+      #
+      # With a block, the object is closed when the block returns, and if
+      # no transaction is in progress, one is opened around the block.
+      # Without a block, the caller must already be in a transaction.
+      #
+      # @param [Fixnum] oid
+      #   the Oid of the large object, e.g. from #lo_create
+      #
+      # @param [String] mode
+      #   "r", "w" or "rw"
+      #
+      # @return [Object]
+      #   the LargeObject, or the return value of the block
+      def large_object(oid, mode = "r")
+        return lo_open(oid, mode) unless block_given?
+
+        within_transaction do
+          lo = lo_open(oid, mode)
+
+          begin
+            yield lo
+          ensure
+            lo.close
+          end
+        end
+      end
+
+      # Insert many rows with as few statements and round trips as possible.
+      #
+      # Useful where COPY cannot be used, e.g. for upserts. Unless already in
+      # a transaction, the rows are inserted in one.
+      #
+      # @param [String, Symbol] table
+      #   the table to insert into
+      #
+      # @param [Array] columns
+      #   the column names
+      #
+      # @param [Array<Array>] rows
+      #   the values for each row, in column order
+      #
+      # @param [Hash] options
+      #   :on_conflict may be :nothing, a String following "ON CONFLICT", or
+      #   a Hash with :target and :update column lists. :strategy may be
+      #   :values (the default) or :unnest.
+      #
+      # @return [Fixnum]
+      #   the number of rows affected
+      def insert_many(table, columns, rows, options = {})
+        insert = BulkInsert.new(self, table, columns, options)
+        return 0 if rows.empty?
+
+        within_transaction { insert.run(rows) }
+      end
+
+      # Prepare a statement, reusing the one prepared last time for stmt.
+      #
+      # The last STATEMENT_CACHE_SIZE statements are kept until the
+      # connection is reopened.
+      #
+      # @param [String] stmt
+      #   the statement to prepare
+      #
+      # @return [RDO::Postgres::StatementExecutor]
+      #   the prepared statement
+      def prepare_cached(stmt)
+        if (executor = @statement_cache.delete(stmt))
+          return @statement_cache[stmt] = executor
+        end
+
+        cache_statement(stmt, prepare(stmt))
+      end
+
+      # Prepare statements ahead of their first execution.
+      #
+      # Every statement is prepared and described in a single round trip
+      # (with libpq >= 14), and kept by #prepare_cached, so #execute and
+      # #prepare_cached later run them without preparing again. Statements
+      # that fail to prepare, e.g. because a table no longer exists, are
+      # skipped. Does nothing in simple query mode.
+      #
+      # Called when the connection is opened, with the statements listed by
+      # the :warmup option.
+      #
+      # @param [Array<String>] stmts
+      #   the statements to prepare, up to STATEMENT_CACHE_SIZE
+      #
+      # @return [Fixnum]
+      #   the number of statements prepared
+      def warm(stmts)
+        return 0 if simple_query?
+
+        stmts = stmts.uniq.reject { |stmt| @statement_cache.key?(stmt) }.first(STATEMENT_CACHE_SIZE)
+
+        prepare_all(stmts).zip(stmts).count do |executor, stmt|
+          cache_statement(stmt, executor) if executor
+        end
+      end
+
+      # The column names and types of a table, as a Hash.
+      #
+      # Types are as given by format_type(), e.g. "character varying(20)".
+      # Results are cached until the connection is reopened.
+      #
+      # @param [String] table
+      #   the table name, optionally schema-qualified
+      #
+      # @return [Hash]
+      #   a Hash of column name => type
+      def column_types(table)
+        @column_types[table.to_s] ||= Hash[
+          execute(
+            "SELECT a.attname AS name, format_type(a.atttypid, a.atttypmod) AS type " \
+            "FROM pg_attribute a " \
+            "WHERE a.attrelid = ?::regclass AND a.attnum > 0 AND NOT a.attisdropped",
+            table.to_s.split(".").map { |part| quote_ident(part) }.join(".")
+          ).map { |row| [row[:name], row[:type]] }
+        ]
+      end
+
+      # Read pg_type again, e.g. after creating a domain or enum, or altering
+      # a composite type.
+      #
+      # The new map is shared with other connections to the same database,
+      # though they only pick it up when they are next opened.
+      def reload_types
+        self.type_map = TypeMap.for(self, type_map_key, true) if type_map?
+        true
+      end
+
+      # Read a bytea value in chunks, rather than all at once.
+      #
+      # @param [String] sql
+      #   a query selecting one bytea column from one row
+      #
+      # @param [Object...] *args
+      #   bind parameters for the query
+      #
+      # @return [RDO::Postgres::ByteaReader]
+      #   an IO-like reader, fetching ByteaReader::DEFAULT_CHUNK_SIZE at a time
+      def read_bytea(sql, *args)
+        ByteaReader.new(self, sql, args)
       end
 
       private
 
-      # Passed to PQconnectdb().
+      def quote_ident(name)
+        %Q{"#{name.to_s.gsub('"', '""')}"}
+      end
+
+      def next_cursor_name
+        "rdo_cursor_#{@cursor_count += 1}"
+      end
+
+      # A read-only statement, answered from the QueryCache or shared with
+      # identical statements on other connections where enabled.
+      def execute_read(stmt, args)
+        run = lambda do
+          if @coalescer && !in_transaction?
+            @coalescer.run(stmt, args, after: @last_write, timeout: query_timeout) do
+              execute_statement(stmt, args)
+            end
+          else
+            execute_statement(stmt, args)
+          end
+        end
+
+        if @query_cache
+          # reading invalidations first is only a non-blocking read of the socket
+          drain_notifications
+          @query_cache.fetch(stmt, args) { run.call }
+        else
+          run.call
+        end
+      end
+
+      def execute_statement(stmt, args)
+        if simple_query?
+          simple_execute(stmt, *args)
+        elsif @statement_cache.key?(stmt)
+          prepare_cached(stmt).execute(*args)
+        else
+          prepare(stmt, true).execute(*args)
+        end
+      end
+
+      # Keep executor for stmt, evicting the least recently used statement.
+      def cache_statement(stmt, executor)
+        @statement_cache.delete(@statement_cache.first[0]) if @statement_cache.size >= STATEMENT_CACHE_SIZE
+        @statement_cache[stmt] = executor
+      end
+
+      # The statements listed by the :warmup option.
+      #
+      # This is an Array of statements, or the path to a file with one
+      # statement per line. Blank lines and lines starting with "--" are
+      # ignored.
+      def warmup_statements
+        case (warmup = options[:warmup])
+        when nil, false, ""
+          []
+        when ::Array
+          warmup
+        else
+          File.readlines(warmup.to_s).map(&:strip).reject { |l| l.empty? || l.start_with?("--") }
+        end
+      end
+
+      # Run the block in a transaction, unless one is already in progress.
+      #
+      # The transaction is committed when the block returns or breaks (e.g.
+      # Enumerable#first on a Cursor), and rolled back if it raises.
+      def within_transaction
+        return yield if in_transaction?
+
+        execute("BEGIN")
+        raised = false
+
+        begin
+          yield
+        rescue ::Exception
+          raised = true
+          raise
+        ensure
+          if raised
+            execute("ROLLBACK") if open? rescue nil
+          else
+            execute("COMMIT")
+          end
+        end
+      end
+
+      # Passed to PQconnectStart().
       #
       # e.g. "host=localhost user=bob password=secret dbname=bobs_db"
+      #
+      # The time zone (the system's by default), client encoding and any
+      # :settings are sent in the startup packet, so opening the connection
+      # needs no extra queries. Poolers that reject the "options" parameter
+      # (e.g. pgbouncer) can set :startup_settings to false, to have them
+      # sent with SET in one round trip once connected instead.
       def connect_db_string
-        {
-          host:            options[:host],
-          port:            options[:port],
-          dbname:          options[:database],
-          user:            options[:user],
-          password:        options[:password],
-          connect_timeout: options[:connect_timeout]
-        }.reject{|k,v| v.nil?}.map{|pair| pair.join("=")}.join(" ")
+        params = {
+          host:                 options[:host],
+          port:                 options[:port],
+          dbname:               options[:database],
+          user:                 options[:user],
+          password:             options[:password],
+          connect_timeout:      options[:connect_timeout],
+          target_session_attrs: options[:target_session_attrs],
+          replication:          (replication_mode if replication?)
+        }
+
+        if startup_settings?
+          params[:client_encoding] = encoding
+          params[:options]         = startup_options
+        end
+
+        params.reject{|k,v| v.nil?}.map{|k,v| "#{k}=#{conninfo_value(v)}"}.join(" ")
+      end
+
+      # Read by the C extension when the connection is opened.
+      #
+      # Seconds to wait for the connection to be made, or nil to wait forever.
+      def connect_timeout
+        if (timeout = options[:connect_timeout]) && Float(timeout) > 0
+          Float(timeout)
+        end
+      end
+
+      # Read by the C extension when the connection is opened.
+      #
+      # Seconds a query may run before it is cancelled, or 0 for no limit.
+      def default_query_timeout
+        Float(options.fetch(:query_timeout, 0))
+      end
+
+      def spool_limit
+        Integer(options.fetch(:spool_limit, DEFAULT_SPOOL_LIMIT))
       end
 
       def after_open
-        set_time_zone
-        set_encoding
+        @notification_backlog = []
+        @statement_cache      = {}
+        @column_types         = {}
+        @cursor_count         = 0
+        @view_tables          = {}
+        @query_cache = (QueryCache.new(query_cache_options) if query_cache?)
+        @coalescer   = (Coalescer.for(coalescer_key) if coalesce?)
+        @last_write  = 0
+
+        unless startup_settings?
+          sets = runtime_settings.map{|name, value| "SET #{quote_ident(name)} TO '#{quote(value)}'"}
+          sets << "SET NAMES '#{quote(encoding)}'"
+          execute_script(sets.join("; "))
+        end
+
+        listen_for_invalidations
+        self.type_map = (TypeMap.for(self, type_map_key) if type_map?)
+        warm(warmup_statements)
+      end
+
+      # Domains, enums and extension types are decoded using their base
+      # types, unless the :type_map option is false.
+      def type_map?
+        ![false, "false"].include?(options[:type_map])
+      end
+
+      # Connections with the same key share a TypeMap, since Oids are only
+      # unique within one database.
+      def type_map_key
+        [options[:host], options[:port], options[:database]]
+      end
+
+      # "database" for logical replication, unless :replication gives a mode.
+      def replication_mode
+        [true, "true"].include?(options[:replication]) ? "database" : options[:replication]
+      end
+
+      def query_cache?
+        [true, "true"].include?(options[:query_cache])
+      end
+
+      def coalesce?
+        [true, "true"].include?(options[:coalesce])
+      end
+
+      # Only connections that would see the same result for a query share a
+      # Coalescer.
+      def coalescer_key
+        [
+          options[:host], options[:port], options[:database], options[:user],
+          encoding, runtime_settings.sort
+        ]
       end
 
-      def set_time_zone
-        if options[:time_zone]
-          execute("SET TIME ZONE '#{quote(options[:time_zone])}'")
+      def query_cache_options
+        {
+          ttl:       options[:query_cache_ttl],
+          max_bytes: options[:query_cache_size],
+          channel:   options[:query_cache_channel],
+          views:     method(:with_view_tables)
+        }.reject{|k,v| v.nil?}
+      end
+
+      # Add the tables behind any views in tables, which are looked up once.
+      def with_view_tables(tables)
+        unknown = tables - @view_tables.keys
+
+        unless unknown.empty?
+          begin
+            rows = execute_statement(QueryCache::VIEWS_QUERY, [unknown])
+            unknown.each{|t| @view_tables[t] = []}
+            rows.each{|r| @view_tables[r[:view]] << r[:table_name]}
+          rescue RDO::Exception
+            # tagged with the names alone; looked up again next time
+          end
+        end
+
+        (tables + tables.flat_map{|t| @view_tables.fetch(t, [])}).uniq
+      end
+
+      def listen_for_invalidations
+        execute("LISTEN #{quote_ident(@query_cache.channel)}") if @query_cache
+      end
+
+      # Move pending notifications into the backlog, applying invalidations.
+      def drain_notifications
+        read_notifications.each do |notify|
+          @notification_backlog << notify unless invalidation?(notify)
+        end
+      end
+
+      # Apply notify to the cache if it is an invalidation message.
+      def invalidation?(notify)
+        return false unless @query_cache && notify[:channel] == @query_cache.channel
+
+        if notify[:payload].empty?
+          @query_cache.clear
         else
-          execute("SET TIME ZONE interval '#{quote(RDO::Util.system_time_zone)}' hour to minute")
+          @query_cache.invalidate(notify[:payload])
         end
+
+        true
       end
 
-      def set_encoding
-        execute("SET NAMES '#{quote(encoding)}'")
+      def startup_settings?
+        ![false, "false"].include?(options[:startup_settings])
+      end
+
+      # Session settings sent when connecting, including TimeZone.
+      #
+      # The :settings option may be a Hash, or a String like "a=1,b=2".
+      def runtime_settings
+        settings = case given = options[:settings]
+                   when nil    then {}
+                   when String then Hash[given.split(",").map{|s| s.split("=", 2).map(&:strip)}]
+                   else Hash[given.map{|k,v| [k.to_s, v.to_s]}]
+                   end
+        settings["TimeZone"] = time_zone unless settings.key?("TimeZone")
+        settings
+      end
+
+      # With no :time_zone, the system UTC offset is used.
+      #
+      # A numeric offset in TimeZone is POSIX style, with positive values west
+      # of Greenwich, so the sign is flipped.
+      def time_zone
+        options.fetch(:time_zone) do
+          offset = RDO::Util.system_time_zone
+          case offset[0]
+          when "+" then "-" + offset[1..-1]
+          when "-" then "+" + offset[1..-1]
+          else offset
+          end
+        end
+      end
+
+      # The "options" startup parameter, e.g. "-c TimeZone=UTC".
+      #
+      # Spaces and backslashes in values are escaped with a backslash.
+      def startup_options
+        runtime_settings.map do |name, value|
+          "-c #{name}=#{value.gsub(/[\\ ]/){|c| "\\#{c}"}}"
+        end.join(" ")
+      end
+
+      # Single-quote conninfo values containing spaces, quotes or backslashes.
+      def conninfo_value(value)
+        value = value.to_s
+        if value.empty? || value =~ /[\s'\\]/
+          "'#{value.gsub(/['\\]/){|c| "\\#{c}"}}'"
+        else
+          value
+        end
       end
 
       def encoding
         options.fetch(:encoding, "utf-8")
       end
+
+      # Read by the C extension when the connection is opened.
+      #
+      # The :intern_strings option may be true, or the maximum number of
+      # distinct values to share per column before it falls back to allocating
+      # a new String for each value. Returns 0 when interning is disabled.
+      def intern_strings_limit
+        case setting = options[:intern_strings]
+        when nil, false, "false", "0" then 0
+        when true, "true"             then DEFAULT_INTERN_LIMIT
+        else Integer(setting)
+        end
+      end
+
+      # Read by the C extension when the connection is opened.
+      #
+      # With the :parse_json option, json and jsonb values are returned as
+      # Hashes and Arrays, rather than as Strings.
+      def parse_json?
+        if [true, "true"].include?(options[:parse_json])
+          require "json"
+          true
+        end
+      end
+
+      # Read by the C extension when the connection is opened.
+      #
+      # With the :consume_results option, all rows are decoded as soon as a
+      # query returns and the libpq copy of the result is freed immediately.
+      def consume_results?
+        [true, "true"].include?(options[:consume_results])
+      end
+
+      # Read by the C extension when the connection is opened.
+      #
+      # With the :decode_threads option, integer, float and boolean columns
+      # of large results are parsed by that many native threads, without the
+      # GVL. Returns 0 when disabled.
+      def decode_threads
+        Integer(options.fetch(:decode_threads, 0))
+      end
+
+      # Column names that interning is restricted to, or nil for all text columns.
+      #
+      # The :intern_columns option may be an Array or a comma-separated String.
+      def intern_strings_columns
+        case columns = options[:intern_columns]
+        when nil    then nil
+        when String then columns.split(",").map(&:strip)
+        else columns.map(&:to_s)
+        end
+      end
     end
   end
 end
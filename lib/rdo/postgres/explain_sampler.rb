@@ -0,0 +1,163 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "thread"
+require "digest/md5"
+require "json"
+
+module RDO
+  module Postgres
+    # Captures query plans for slow or randomly sampled statements.
+    #
+    # The C extension calls #record after each StatementExecutor#execute.
+    # Statements that ran for at least :threshold seconds, or 1 in every
+    # :sample, are queued, and a background thread runs EXPLAIN (FORMAT JSON)
+    # for them with the same bind parameters. The caller never waits on this.
+    #
+    # A driver connection cannot be used by two threads at once, so the plans
+    # are read on a second connection opened with the same options, once the
+    # first statement is queued. Each driver with a sampler therefore uses an
+    # extra server connection. Objects only visible to the original session
+    # (e.g. temp tables) fail to explain, and the error is passed to the sink
+    # instead of a plan.
+    #
+    # Driver#close stops the thread and closes the connection; both start
+    # again with the next statement queued.
+    class ExplainSampler
+      # Statements waiting to be explained; any more are dropped.
+      QUEUE_SIZE = 64
+
+      # Only these statements can be explained.
+      EXPLAINABLE = /\A(?:\s+|--[^\n]*\n?|\/\*.*?\*\/)*(?:SELECT|INSERT|UPDATE|DELETE|WITH|VALUES|TABLE)\b/im
+
+      # Statements dropped because the queue was full.
+      attr_reader :dropped
+
+      # Initialize a sampler for a driver.
+      #
+      # @param [Hash] driver_options
+      #   options to open the connection plans are read on
+      #
+      # @param [#call] sink
+      #   called with a Hash of :fingerprint, :sql, :params, :duration,
+      #   :reason (:slow or :sampled) and :plan, or :error if it failed
+      #
+      # @param [Hash] options
+      #   :threshold (seconds) and :sample (explain 1 in N statements)
+      def initialize(driver_options, sink, options = {})
+        @driver_options = driver_options.merge(query_cache: false)
+        @sink      = sink
+        @threshold = options[:threshold] && Float(options[:threshold])
+        @sample    = Integer(options[:sample] || 0)
+        @queue     = Queue.new
+        @mutex     = Mutex.new
+        @random    = Random.new
+        @dropped   = 0
+        @worker    = nil
+      end
+
+      # Called with the time taken by each execution.
+      #
+      # @param [String] sql
+      #   the statement that was executed
+      #
+      # @param [Array] params
+      #   its bind parameters
+      #
+      # @param [Float] duration
+      #   seconds taken
+      def record(sql, params, duration)
+        return unless (reason = reason_for(duration)) && sql =~ EXPLAINABLE
+
+        if @queue.size >= QUEUE_SIZE
+          @dropped += 1
+        else
+          start
+          @queue << [sql, params, duration, reason]
+        end
+      end
+
+      # A stable identifier for statements differing only in literal values,
+      # whitespace and case.
+      #
+      # @param [String] sql
+      #   the statement
+      #
+      # @return [String]
+      #   a hex digest
+      def fingerprint(sql)
+        Digest::MD5.hexdigest(
+          sql.gsub(/'(?:[^']|'')*'/, "?").
+            gsub(/\b\d+(?:\.\d+)?\b/, "?").
+            gsub(/\$\d+/, "?").
+            gsub(/\s+/, " ").
+            strip.downcase
+        )
+      end
+
+      # Stop the background thread and close its connection.
+      #
+      # Statements still queued are not explained. Called by Driver#close.
+      def stop
+        worker = @mutex.synchronize { @worker.tap { @worker = nil } }
+        return unless worker
+
+        @queue.clear
+        @queue << :stop
+        worker.join
+      end
+
+      private
+
+      def reason_for(duration)
+        if @threshold && duration >= @threshold
+          :slow
+        elsif @sample > 0 && @random.rand(@sample).zero?
+          :sampled
+        end
+      end
+
+      def start
+        @mutex.synchronize do
+          @worker ||= Thread.new { run }
+        end
+      end
+
+      def run
+        driver = nil
+
+        while (job = @queue.pop) != :stop
+          driver = explain(driver, *job)
+        end
+      ensure
+        driver.close if driver rescue nil
+      end
+
+      # Returns the driver, which is opened on first use.
+      def explain(driver, sql, params, duration, reason)
+        event = {
+          fingerprint: fingerprint(sql),
+          sql:         sql,
+          params:      params,
+          duration:    duration,
+          reason:      reason
+        }
+
+        begin
+          driver ||= Driver.new(@driver_options).tap(&:open)
+          plan = driver.prepare("EXPLAIN (FORMAT JSON) #{sql}").execute(*params).first_value
+          event[:plan] = plan.is_a?(String) ? JSON.parse(plan) : plan
+        rescue StandardError => e
+          event[:error] = e
+        end
+
+        @sink.call(event) rescue nil
+        driver
+      end
+    end
+  end
+end
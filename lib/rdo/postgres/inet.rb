@@ -0,0 +1,62 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "ipaddr"
+
+module RDO
+  module Postgres
+    # A PostgreSQL inet value.
+    #
+    # Unlike IPAddr, which applies the netmask, an inet keeps its host address
+    # alongside the prefix length, so it compares as the host, and #to_s gives
+    # back what PostgreSQL stored.
+    #
+    # @example
+    #   inet = RDO::Postgres::Inet.new("192.168.0.5/24")
+    #   inet.to_s    # => "192.168.0.5/24"
+    #   inet.prefix  # => 24
+    #   inet.network # => #<IPAddr: IPv4:192.168.0.0/255.255.255.0>
+    class Inet < IPAddr
+      def initialize(addr = "::", family = Socket::AF_UNSPEC)
+        host, prefix = addr.split("/", 2) if addr.kind_of?(String)
+        super(host || addr, family)
+        @prefix = prefix ? Integer(prefix) : max_prefix
+      end
+
+      # @return [Fixnum]
+      #   the prefix length of the network the host is on
+      def prefix
+        @prefix
+      end
+
+      # @return [IPAddr]
+      #   the network the host is on
+      def network
+        IPAddr.new(to_i, family).mask(prefix)
+      end
+
+      # Format the address as PostgreSQL does, with the prefix unless it
+      # covers the whole address.
+      #
+      # @return [String]
+      #   an inet string PostgreSQL can parse
+      def to_s
+        prefix == max_prefix ? super : "#{super}/#{prefix}"
+      end
+
+      def inspect
+        "#<#{self.class}: #{self}>"
+      end
+
+      private
+
+      def max_prefix
+        ipv4? ? 32 : 128
+      end
+    end
+  end
+end
@@ -0,0 +1,30 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # A PostgreSQL interval.
+    #
+    # Months, days and microseconds are kept separately, as PostgreSQL does,
+    # since the length of a month or a day is not fixed.
+    #
+    # @example
+    #   RDO::Postgres::Interval.new(14, 3, 14706000000)
+    #   # => 1 year 2 mons 3 days 04:05:06
+    class Interval < Struct.new(:months, :days, :microseconds)
+      # Format the interval for use as a bind parameter.
+      #
+      # @return [String]
+      #   an interval string PostgreSQL can parse
+      def to_s
+        secs, usecs = microseconds.abs.divmod(1_000_000)
+        sign        = microseconds < 0 ? "-" : ""
+        "#{months} mons #{days} days #{sign}#{secs}.#{"%06d" % usecs} secs"
+      end
+    end
+  end
+end
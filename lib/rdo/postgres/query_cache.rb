@@ -0,0 +1,186 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # In-process cache of read-only query results.
+    #
+    # Entries are keyed by the statement and its bind values as sent to the
+    # server, and expire after a TTL. The least recently used entries are
+    # evicted once the estimated size of all entries passes a cap.
+    #
+    # Only statements that read from a table and call no volatile functions
+    # (see Sql.cacheable?) are cached.
+    #
+    # Each entry is tagged with the tables its statement reads from, and the
+    # tables behind any views among them. A NOTIFY on the cache channel, with
+    # a table name as its payload, drops every entry tagged with that table.
+    # An empty payload clears the cache.
+    class QueryCache
+      # Default seconds an entry stays valid.
+      DEFAULT_TTL = 60
+
+      # Default cap on the estimated size of all entries, in bytes.
+      DEFAULT_MAX_BYTES = 16 * 1024 * 1024
+
+      # Default channel for invalidation messages.
+      DEFAULT_CHANNEL = "rdo_query_cache"
+
+      # Rough size of each Ruby object kept in an entry.
+      SLOT_SIZE = 40
+
+      # The tables behind each of a list of views, including through other views.
+      VIEWS_QUERY = <<-SQL.gsub(/\s+/, " ").strip
+        WITH RECURSIVE deps(view, rel) AS (
+          SELECT c.relname::text, c.oid FROM pg_class c
+          WHERE c.relkind = 'v' AND c.relname = ANY(?::text[])
+          UNION
+          SELECT deps.view, d.refobjid FROM deps
+          JOIN pg_rewrite r ON r.ev_class = deps.rel
+          JOIN pg_depend d ON d.objid = r.oid
+            AND d.classid = 'pg_rewrite'::regclass
+            AND d.refclassid = 'pg_class'::regclass
+            AND d.refobjid <> r.ev_class
+        )
+        SELECT DISTINCT deps.view, c.relname::text AS table_name
+        FROM deps JOIN pg_class c ON c.oid = deps.rel
+        WHERE c.relkind <> 'v'
+      SQL
+
+      # A cached result: column names, rows of values and the result info.
+      Entry = Struct.new(:columns, :rows, :info, :tables, :bytes, :expires_at)
+
+      attr_reader :ttl, :max_bytes, :channel, :bytes
+
+      # Initialize an empty cache.
+      #
+      # @param [Hash] options
+      #   :ttl, :max_bytes, :channel, and :views, called with the names of
+      #   the tables a statement reads to return them with the tables behind
+      #   any views among them
+      def initialize(options = {})
+        @ttl       = Float(options.fetch(:ttl, DEFAULT_TTL))
+        @max_bytes = Integer(options.fetch(:max_bytes, DEFAULT_MAX_BYTES))
+        @channel   = options.fetch(:channel, DEFAULT_CHANNEL).to_s
+        @views     = options[:views]
+        @entries   = {}
+        @bytes     = 0
+      end
+
+      # Number of entries in the cache.
+      def size
+        @entries.size
+      end
+
+      # Return the cached result for stmt and args, or yield to fetch it.
+      #
+      # The result is only stored if stmt is cacheable.
+      #
+      # @param [String] stmt
+      #   a read-only statement
+      #
+      # @param [Array] args
+      #   the bind parameters
+      #
+      # @return [RDO::Result]
+      #   a result built from the cached rows
+      def fetch(stmt, args)
+        key = [stmt, args.map{|v| v.nil? ? nil : v.to_s}]
+
+        if (entry = @entries.delete(key)) && entry.expires_at > now
+          @entries[key] = entry
+        else
+          remove(key, entry) if entry
+          return yield unless Sql.cacheable?(stmt)
+
+          entry = store(key, stmt, yield)
+        end
+
+        result_for(entry)
+      end
+
+      # Drop all entries reading from table.
+      #
+      # @param [String] table
+      #   the table name, without schema
+      def invalidate(table)
+        @entries.each do |key, entry|
+          remove(key, entry) if entry.tables.include?(table)
+        end
+      end
+
+      # Drop every entry.
+      def clear
+        @entries.clear
+        @bytes = 0
+      end
+
+      private
+
+      def store(key, stmt, result)
+        columns = nil
+        rows    = result.map do |tuple|
+          columns ||= tuple.keys
+          tuple.values.each{|v| v.freeze if v.kind_of?(String)}
+        end
+
+        tables = Sql.read_tables(stmt)
+        tables = @views.call(tables) if @views
+
+        entry = Entry.new(
+          columns,
+          rows,
+          result.info.dup.freeze,
+          tables,
+          estimate(key, rows),
+          now + ttl
+        )
+
+        return entry if entry.bytes > max_bytes
+
+        @entries[key] = entry
+        @bytes += entry.bytes
+        evict
+        entry
+      end
+
+      def remove(key, entry)
+        @entries.delete(key)
+        @bytes -= entry.bytes
+      end
+
+      def evict
+        while @bytes > max_bytes && (oldest = @entries.first)
+          remove(*oldest)
+        end
+      end
+
+      def result_for(entry)
+        RDO::Result.new(
+          entry.rows.map{|values| Hash[entry.columns.zip(values)]},
+          entry.info.dup
+        )
+      end
+
+      def estimate(key, rows)
+        bytes = SLOT_SIZE + key[0].bytesize + key[1].size * SLOT_SIZE
+        rows.each do |values|
+          bytes += SLOT_SIZE
+          values.each do |v|
+            bytes += SLOT_SIZE
+            bytes += v.bytesize if v.kind_of?(String)
+          end
+        end
+        bytes
+      end
+
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+    end
+  end
+end
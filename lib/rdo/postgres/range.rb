@@ -0,0 +1,137 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # A PostgreSQL range, such as an int4range or tstzrange.
+    #
+    # This is a Ruby Range that can also exclude its first value, as
+    # PostgreSQL ranges can, and can be empty. Infinite bounds are nil. Ranges
+    # of integers and dates are always returned in the canonical [a,b) form,
+    # so compare equal to Ruby's a...b.
+    #
+    # @example
+    #   RDO::Postgres::Range.new(1.5, 2.5, false, true)
+    #   # => (1.5,2.5]
+    class Range < ::Range
+      # The empty range.
+      #
+      # @return [RDO::Postgres::Range]
+      #   a range containing no values
+      def self.empty
+        new(nil, nil, true, true, true)
+      end
+
+      # Initialize a range.
+      #
+      # @param [Object] first
+      #   the lower bound, or nil if there is none
+      #
+      # @param [Object] last
+      #   the upper bound, or nil if there is none
+      #
+      # @param [Boolean] exclude_end
+      #   true if last is not in the range
+      #
+      # @param [Boolean] exclude_begin
+      #   true if first is not in the range
+      def initialize(first, last, exclude_end = false, exclude_begin = false, empty = false)
+        @exclude_begin = exclude_begin
+        @empty         = empty
+        super(first, last, exclude_end)
+      end
+
+      # Predicate test if the lower bound is not in the range.
+      #
+      # @return [Boolean]
+      def exclude_begin?
+        @exclude_begin
+      end
+
+      # Predicate test if this is the empty range.
+      #
+      # @return [Boolean]
+      def empty?
+        @empty
+      end
+
+      # Predicate test if value is within the range.
+      #
+      # @return [Boolean]
+      def cover?(value)
+        return false if empty?
+        return false if exclude_begin? && !self.begin.nil? && value == self.begin
+        super
+      end
+
+      alias_method :include?, :cover?
+      alias_method :member?,  :cover?
+      alias_method :===,      :cover?
+
+      # Yield each value in the range.
+      def each(&block)
+        return enum_for(:each) unless block
+        return self if empty?
+
+        first = true
+        super do |value|
+          yield value unless first && exclude_begin?
+          first = false
+        end
+      end
+
+      # Compare with another range, including the exclusion of the lower bound.
+      #
+      # @return [Boolean]
+      def ==(other)
+        return false unless other.is_a?(::Range)
+
+        bounds = other.is_a?(Range) ? [other.exclude_begin?, other.empty?] : [false, false]
+        bounds == [exclude_begin?, empty?] && super
+      end
+
+      alias_method :eql?, :==
+
+      # Ranges that are == have the same hash.
+      def hash
+        [super, exclude_begin?, empty?].hash
+      end
+
+      # Format the range for use as a bind parameter.
+      #
+      # @return [String]
+      #   a range string PostgreSQL can parse
+      def to_s
+        return "empty" if empty?
+
+        [
+          (self.begin.nil? || exclude_begin?) ? "(" : "[",
+          format_bound(self.begin),
+          ",",
+          format_bound(self.end),
+          (self.end.nil? || exclude_end?) ? ")" : "]"
+        ].join
+      end
+
+      # The range, in PostgreSQL's notation.
+      def inspect
+        empty? ? "empty" : to_s
+      end
+
+      private
+
+      def format_bound(value)
+        return "" if value.nil?
+
+        str = value.is_a?(BigDecimal) ? value.to_s("F") : value.to_s
+        return str unless str.empty? || str =~ /[\s"\\,()\[\]]/
+
+        %Q{"#{str.gsub(/["\\]/) { |c| "\\#{c}" }}"}
+      end
+    end
+  end
+end
@@ -0,0 +1,256 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Streams changes from a logical replication slot.
+    #
+    # Each change is yielded as a Hash with a :type (:begin, :commit,
+    # :insert, :update, :delete, :truncate or :message) and its :lsn. Row
+    # changes have a :schema, :table and :new and/or :old row, whose values
+    # are cast like query results. Columns holding unchanged TOASTed values
+    # are not sent by the server, so they are missing from :new.
+    #
+    # The server keeps WAL until it is told changes have been processed. By
+    # default each transaction is acknowledged once its :commit has been
+    # yielded, and acknowledgements are sent to the server in batches of
+    # :ack_batch, or every :status_interval seconds. With :auto_ack false,
+    # call #ack once changes are durably handled elsewhere.
+    #
+    # @example
+    #   db = RDO.connect("postgres://localhost/app?replication=true")
+    #   stream = db.driver.replication_stream("app_slot", publications: ["app"])
+    #   stream.each { |change| p change }
+    class ReplicationStream
+      include Enumerable
+
+      # Seconds between standby status updates sent to the server.
+      DEFAULT_STATUS_INTERVAL = 10
+
+      # Acknowledged transactions between standby status updates.
+      DEFAULT_ACK_BATCH = 100
+
+      # Output plugins whose messages are decoded.
+      PLUGINS = [:pgoutput, :test_decoding]
+
+      # The name of the replication slot.
+      attr_reader :slot
+
+      # The output plugin, :pgoutput or :test_decoding.
+      attr_reader :plugin
+
+      # The furthest position received from the server.
+      attr_reader :received_lsn
+
+      # The furthest position acknowledged as processed.
+      attr_reader :flushed_lsn
+
+      # Initialize a stream over a slot.
+      #
+      # @param [RDO::Postgres::Driver] driver
+      #   a driver opened with the :replication option
+      #
+      # @param [String] slot
+      #   the name of the replication slot
+      #
+      # @param [Hash] options
+      #   :plugin, :publications (required for pgoutput), :messages,
+      #   :plugin_options, :start_lsn, :status_interval, :ack_batch and
+      #   :auto_ack
+      def initialize(driver, slot, options = {})
+        @driver          = driver
+        @slot            = slot.to_s
+        @plugin          = (options[:plugin] || :pgoutput).to_sym
+        @publications    = Array(options[:publications]).map(&:to_s)
+        @messages        = options[:messages]
+        @plugin_options  = options[:plugin_options] || {}
+        @status_interval = Float(options[:status_interval] || DEFAULT_STATUS_INTERVAL)
+        @ack_batch       = Integer(options[:ack_batch] || DEFAULT_ACK_BATCH)
+        @auto_ack        = options.fetch(:auto_ack, true)
+        @received_lsn    = @flushed_lsn = self.class.parse_lsn(options[:start_lsn] || 0)
+
+        unless PLUGINS.include?(@plugin)
+          raise ArgumentError, "plugin must be one of #{PLUGINS.join(", ")}"
+        end
+
+        if @plugin == :pgoutput && @publications.empty?
+          raise ArgumentError, "publications are required for pgoutput"
+        end
+
+        raise ArgumentError, "status_interval must be positive" unless @status_interval > 0
+        raise ArgumentError, "ack_batch must be positive" unless @ack_batch > 0
+      end
+
+      class << self
+        # Convert an LSN such as "16/B374D848" to an Integer.
+        #
+        # @param [String, Integer] lsn
+        #
+        # @return [Integer]
+        def parse_lsn(lsn)
+          return Integer(lsn) unless lsn.kind_of?(String)
+
+          high, low = lsn.split("/", 2)
+          raise ArgumentError, "invalid LSN #{lsn.inspect}" if low.nil?
+
+          (Integer(high, 16) << 32) | Integer(low, 16)
+        end
+
+        # Format an Integer LSN as PostgreSQL does.
+        #
+        # @param [Integer] lsn
+        #
+        # @return [String]
+        def format_lsn(lsn)
+          "%X/%X" % [lsn >> 32, lsn & 0xFFFFFFFF]
+        end
+      end
+
+      # Create the slot with this stream's output plugin.
+      #
+      # @param [Boolean] temporary
+      #   true if the slot is dropped when the connection closes
+      #
+      # @return [String]
+      #   the LSN from which changes are available
+      def create_slot(temporary: false)
+        @driver.execute_script([
+          "CREATE_REPLICATION_SLOT #{quote_ident(@slot)}",
+          ("TEMPORARY" if temporary),
+          "LOGICAL #{@plugin} NOEXPORT_SNAPSHOT"
+        ].compact.join(" ")).first[:consistent_point]
+      end
+
+      # Drop the slot, releasing the WAL it holds.
+      def drop_slot
+        @driver.execute_script("DROP_REPLICATION_SLOT #{quote_ident(@slot)}")
+        nil
+      end
+
+      # Yield each change until the server ends the stream or #stop is called.
+      #
+      # The connection is used for the stream while it is read. When the
+      # block returns or raises, acknowledgements are sent and the stream is
+      # ended, so the connection can be used for commands again.
+      #
+      # @return [Enumerator]
+      #   if no block is given
+      def each
+        return enum_for(:each) unless block_given?
+
+        relations       = {}
+        @pending        = 0
+        @stopping       = false
+        @in_transaction = false
+        @status_due     = now + @status_interval
+
+        @driver.send(:replication_start, start_command)
+
+        begin
+          until @stopping
+            # the deadline may pass between the status check and here
+            message = @driver.send(:replication_read, [@status_due - now, 0].max, @plugin, relations)
+
+            break if message.nil?
+
+            case message && message.first
+            when :data
+              _, start, finish, change = message
+              @received_lsn = [@received_lsn, start, finish].max
+
+              if change
+                @in_transaction = true if change[:type] == :begin
+                yield change
+                commit(change) if change[:type] == :commit
+              end
+            when :keepalive
+              _, wal_end, reply = message
+              @received_lsn = [@received_lsn, wal_end].max
+
+              # with every transaction yielded acknowledged, the server can
+              # discard WAL up to where it has sent, e.g. other databases' WAL
+              @flushed_lsn = @received_lsn if @auto_ack && !@in_transaction
+
+              # answer without asking for a reply, which would only be
+              # another keepalive
+              send_status if reply
+            end
+
+            send_status if now >= @status_due
+          end
+        ensure
+          begin
+            send_status if @driver.open?
+          rescue RDO::Exception
+          end
+          @driver.send(:replication_stop)
+        end
+
+        self
+      end
+
+      # Acknowledge changes up to lsn as processed.
+      #
+      # The server may discard WAL up to this point, and on reconnecting the
+      # stream resumes after it.
+      #
+      # @param [Integer, String] lsn
+      #   e.g. the :end_lsn of a :commit
+      def ack(lsn)
+        lsn = self.class.parse_lsn(lsn)
+        return if lsn <= @flushed_lsn
+
+        @flushed_lsn = lsn
+        @pending    += 1
+
+        send_status if @pending >= @ack_batch
+      end
+
+      # End #each after the change being processed.
+      def stop
+        @stopping = true
+      end
+
+      private
+
+      def start_command
+        options = @plugin_options.map { |k, v| [k.to_s, v.to_s] }
+
+        if @plugin == :pgoutput
+          options.unshift(["proto_version", "1"], ["publication_names",
+            @publications.map { |p| quote_ident(p) }.join(",")])
+          options << ["messages", "true"] if @messages
+        end
+
+        [
+          "START_REPLICATION SLOT #{quote_ident(@slot)}",
+          "LOGICAL #{self.class.format_lsn(@flushed_lsn)}",
+          ("(#{options.map { |k, v| "#{quote_ident(k)} '#{@driver.quote(v)}'" }.join(", ")})" if options.any?)
+        ].compact.join(" ")
+      end
+
+      def commit(change)
+        @in_transaction = false
+        ack(change[:end_lsn] || change[:lsn]) if @auto_ack
+      end
+
+      def send_status(reply = false)
+        @driver.send(:replication_status, @received_lsn, @flushed_lsn, @flushed_lsn, reply)
+        @pending    = 0
+        @status_due = now + @status_interval
+      end
+
+      def quote_ident(name)
+        @driver.send(:quote_ident, name)
+      end
+
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+    end
+  end
+end
@@ -0,0 +1,64 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Result returned by the driver, with export to columnar formats.
+    class Result < RDO::Result
+      def initialize(tuples, info = {})
+        super
+        @tuple_list = tuples
+      end
+
+      # Read the row at index, without decoding any others.
+      #
+      # @param [Fixnum] index
+      #   the row number, negative to count back from the last row
+      #
+      # @return [Hash]
+      #   the row, or nil if there is no such row
+      def [](index)
+        @tuple_list[index]
+      end
+
+      # Predicate test if the rows were spilled to a temp file.
+      #
+      # Only results from Driver#execute_spooled are ever spilled.
+      def spilled?
+        @tuple_list.spilled?
+      end
+
+      # Export the result in the Arrow IPC stream format.
+      #
+      # Values are written straight from the libpq result, without creating
+      # Ruby objects for each cell.
+      #
+      # @param [Fixnum] rows_per_batch
+      #   the number of rows in each record batch
+      #
+      # @return [String]
+      #   a binary String holding the complete stream
+      def to_arrow_ipc(rows_per_batch = nil)
+        @tuple_list.to_arrow_ipc(rows_per_batch)
+      end
+
+      # Yield the Arrow IPC stream as binary String chunks.
+      #
+      # The schema comes first, then one chunk per record batch, then the
+      # end-of-stream marker. Useful for writing a large result to an IO.
+      #
+      # @param [Fixnum] rows_per_batch
+      #   the number of rows in each record batch
+      #
+      # @return [Enumerator]
+      #   if no block is given
+      def each_arrow_ipc(rows_per_batch = nil, &block)
+        @tuple_list.each_arrow_ipc(rows_per_batch, &block)
+      end
+    end
+  end
+end
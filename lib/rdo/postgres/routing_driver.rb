@@ -0,0 +1,355 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "thread"
+
+module RDO
+  module Postgres
+    # Driver that splits reads and writes across a primary and its replicas.
+    #
+    # The URI host is the primary, and the :replicas option lists the replica
+    # hosts, e.g.
+    #
+    #   postgres+routing://db1/app?replicas=db2:5432,db3:5432
+    #
+    # Read-only statements go to a replica, chosen with :balance, which is
+    # either "round_robin" (the default) or "least_outstanding". Everything
+    # else goes to the primary. Reads are also sent to the primary while it is
+    # inside a transaction, and for :sticky_window seconds (default 1) after a
+    # write, so that a client always sees its own writes.
+    #
+    # A replica connection is checked out by one thread at a time, since a
+    # connection cannot run two queries at once. Reads from other threads go
+    # to another replica, or wait (up to query_timeout) for one to be free.
+    #
+    # Every connection is given the full host list. The primary connection
+    # uses target_session_attrs=read-write, so it follows a promotion, and each
+    # replica connection prefers a standby, starting with its own host.
+    class RoutingDriver < RDO::Driver
+      # Seconds that reads stay on the primary after a write.
+      DEFAULT_STICKY_WINDOW = 1.0
+
+      attr_reader :primary, :replicas
+
+      def initialize(options = {})
+        super
+
+        hosts     = [[options[:host], options[:port]]] + replica_hosts
+        @primary  = Driver.new(host_options(hosts, "read-write"))
+        @replicas = replica_hosts.each_index.map do |i|
+          Driver.new(host_options(hosts[1..-1].rotate(i) + hosts[0, 1], "prefer-standby"))
+        end
+
+        @mutex        = Mutex.new
+        @checked_in   = ConditionVariable.new
+        @held         = {}
+        @idle_since   = Hash[@replicas.map{|r| [r, 0]}]
+        @next_replica = 0
+        @stuck_until  = nil
+        @available    = []
+      end
+
+      # Open the primary and any replicas that can be reached.
+      #
+      # Replicas that fail to connect are left out until the next #open.
+      def open
+        @primary.open
+        @available = @replicas.select do |replica|
+          begin
+            replica.open
+          rescue RDO::Exception
+            false
+          end
+        end
+        true
+      end
+
+      def open?
+        @primary.open?
+      end
+
+      def close
+        ([@primary] + @replicas).each(&:close)
+        @mutex.synchronize do
+          @available = []
+          @checked_in.broadcast
+        end
+        true
+      end
+
+      def quote(value)
+        @primary.quote(value)
+      end
+
+      # Execute on a replica if stmt is read-only and nothing pins it to the
+      # primary, otherwise on the primary.
+      #
+      # @param [String] stmt
+      #   the statement to execute
+      #
+      # @param [Object...] *args
+      #   bind parameters to execute with
+      #
+      # @return [RDO::Result]
+      #   a result containing any tuples and query info
+      def execute(stmt, *args)
+        route(stmt) { |driver| driver.execute(stmt, *args) }
+      end
+
+      # Prepare a statement which is routed each time it is executed.
+      #
+      # @param [String] stmt
+      #   the statement to prepare
+      #
+      # @return [StatementExecutor]
+      #   an executor that prepares stmt on each driver it is sent to
+      def prepare(stmt)
+        StatementExecutor.new(self, stmt)
+      end
+
+      # Always executed on the primary.
+      def execute_many(stmt, param_sets)
+        on_primary(stmt) { @primary.execute_many(stmt, param_sets) }
+      end
+
+      def listen(channel)
+        @primary.listen(channel)
+      end
+
+      def unlisten(channel = nil)
+        @primary.unlisten(channel)
+      end
+
+      def notifications
+        @primary.notifications
+      end
+
+      def wait_for_notify(timeout = nil)
+        @primary.wait_for_notify(timeout)
+      end
+
+      def query_timeout
+        @primary.query_timeout
+      end
+
+      # Applies to the primary and every replica.
+      def query_timeout=(seconds)
+        ([@primary] + @replicas).each { |driver| driver.query_timeout = seconds }
+      end
+
+      def with_timeout(seconds)
+        previous = query_timeout
+        self.query_timeout = seconds
+
+        begin
+          yield
+        ensure
+          self.query_timeout = previous
+        end
+      end
+
+      # Always executed on the primary.
+      def insert_many(table, columns, rows, options = {})
+        on_primary("INSERT") { @primary.insert_many(table, columns, rows, options) }
+      end
+
+      def prepare_cached(stmt)
+        @primary.prepare_cached(stmt)
+      end
+
+      def column_types(table)
+        @primary.column_types(table)
+      end
+
+      def reload_types
+        ([@primary] + @available).each(&:reload_types)
+        true
+      end
+
+      # Large objects are always used on the primary.
+      def large_object(oid, mode = "r", &block)
+        @primary.large_object(oid, mode, &block)
+      end
+
+      def read_bytea(sql, *args)
+        @primary.read_bytea(sql, *args)
+      end
+
+      # Plans are sampled from the primary and every replica.
+      def explain_to(sink = nil, threshold: nil, sample: nil, &block)
+        sink ||= block
+        ([@primary] + @replicas).map do |driver|
+          driver.explain_to(sink, threshold: threshold, sample: sample)
+        end.first
+      end
+
+      # Cursors are opened on the primary, since they need a transaction.
+      def cursor(stmt, *args)
+        @primary.cursor(stmt, *args)
+      end
+
+      def execute_script(sql, *args)
+        route(sql) { |driver| driver.execute_script(sql, *args) }
+      end
+
+      def execute_spooled(stmt, *args)
+        route(stmt) { |driver| driver.execute_spooled(stmt, *args) }
+      end
+
+      # Predicate test if stmt can be sent to a replica, ignoring pinning.
+      #
+      # @param [String] stmt
+      #   the statement to check
+      #
+      # @return [Boolean]
+      #   true if stmt looks read-only
+      def read_only?(stmt)
+        Sql.read_only?(stmt)
+      end
+
+      # Yields the driver that stmt should run on.
+      #
+      # Used by the statements returned from #prepare.
+      def route(stmt)
+        if read_only?(stmt) && !pinned?
+          replica = checkout_replica
+          begin
+            yield replica
+          ensure
+            checkin_replica(replica)
+          end
+        else
+          on_primary(stmt) { yield @primary }
+        end
+      end
+
+      private
+
+      # Writes keep reads on the primary for the sticky window.
+      def on_primary(stmt)
+        yield
+      ensure
+        @stuck_until = now + sticky_window unless read_only?(stmt)
+      end
+
+      def pinned?
+        @available.empty? ||
+          @primary.in_transaction? ||
+          (@stuck_until && now < @stuck_until)
+      end
+
+      # Take a replica for the current thread, which keeps it until checkin.
+      #
+      # A thread that already holds one (e.g. in a nested call) is given the
+      # same replica again.
+      def checkout_replica
+        @mutex.synchronize do
+          if (held = @held[Thread.current])
+            held[1] += 1
+            return held[0]
+          end
+
+          timeout  = query_timeout
+          deadline = now + timeout if timeout
+
+          until (replica = free_replica)
+            raise RDO::Exception, "No replicas are open" if @available.empty?
+
+            if deadline
+              remaining = deadline - now
+              raise TimeoutError, "Timed out after #{timeout}s waiting for a replica" if remaining <= 0
+              @checked_in.wait(@mutex, remaining)
+            else
+              @checked_in.wait(@mutex)
+            end
+          end
+
+          @held[Thread.current] = [replica, 1]
+          replica
+        end
+      end
+
+      def checkin_replica(replica)
+        @mutex.synchronize do
+          held = @held[Thread.current]
+          next unless (held[1] -= 1).zero?
+
+          @held.delete(Thread.current)
+          @idle_since[replica] = now
+          @checked_in.signal
+        end
+      end
+
+      # The next replica not held by any thread, or nil if all are busy.
+      #
+      # Called holding @mutex. With least_outstanding, the one idle longest.
+      def free_replica
+        busy       = @held.values.map(&:first)
+        candidates = @available.rotate(@next_replica) - busy
+        return nil if candidates.empty?
+
+        @next_replica = (@next_replica + 1) % @available.size
+
+        if balance == "least_outstanding"
+          candidates.min_by{|r| @idle_since[r]}
+        else
+          candidates.first
+        end
+      end
+
+      def balance
+        options.fetch(:balance, "round_robin").to_s
+      end
+
+      def sticky_window
+        Float(options.fetch(:sticky_window, DEFAULT_STICKY_WINDOW))
+      end
+
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+
+      # The :replicas option may be an Array or a comma-separated String of
+      # "host" or "host:port".
+      def replica_hosts
+        @replica_hosts ||= begin
+          list = options[:replicas] || []
+          list = list.split(",") if list.kind_of?(String)
+          list.map{|h| h.to_s.strip.split(":", 2)}.reject{|h, _| h.empty?}
+        end
+      end
+
+      def host_options(hosts, target_session_attrs)
+        options.reject{|k, _| [:replicas, :balance, :sticky_window].include?(k)}.merge(
+          host:                 hosts.map{|h, _| h || "localhost"}.join(","),
+          port:                 hosts.map{|_, p| p || options[:port] || 5432}.join(","),
+          target_session_attrs: target_session_attrs
+        )
+      end
+
+      # Prepares the statement lazily on each driver it is routed to, and
+      # again after that driver reconnects.
+      class StatementExecutor
+        attr_reader :command
+
+        def initialize(router, command)
+          @router    = router
+          @command   = command
+          @executors = {}
+        end
+
+        def execute(*args)
+          @router.route(@command) do |driver|
+            executor = @executors[driver]
+            executor = @executors[driver] = driver.prepare(@command) if executor.nil? || executor.stale?
+            executor.execute(*args)
+          end
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,538 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "thread"
+require "digest/md5"
+
+module RDO
+  module Postgres
+    # Driver that spreads data across several databases by a shard key.
+    #
+    # The :shards option lists each shard as "host[:port][/database]", with
+    # the URI host, port and database as defaults, e.g.
+    #
+    #   postgres+sharding://db1/app?shards=db1/app_0,db2/app_1,db3/app_2
+    #
+    # #shard maps a key to the Driver for its shard, using the :strategy,
+    # which is "hash" (the default; see ConsistentHash) or "range" (see
+    # RangeTable). Any object with #shard_for(key), returning a shard index,
+    # may also be given as the :strategy.
+    #
+    # Reads without a key are run on every shard at once: #execute
+    # concatenates the results, and #merge streams rows sorted across shards.
+    # Writes must name a shard with #execute_on, or use #fan_out to run on
+    # every shard deliberately.
+    class ShardingDriver < RDO::Driver
+      # Points each shard is given on the hash ring.
+      DEFAULT_VIRTUAL_NODES = 128
+
+      attr_reader :shards, :strategy
+
+      def initialize(options = {})
+        super
+
+        @specs = shard_specs
+        raise ArgumentError, "at least one shard is required" if @specs.empty?
+
+        @shards   = @specs.map { |spec| Driver.new(shard_options(spec)) }
+        @strategy = build_strategy
+      end
+
+      # Open every shard.
+      def open
+        @shards.each(&:open)
+        true
+      end
+
+      def open?
+        @shards.all?(&:open?)
+      end
+
+      def close
+        @shards.each(&:close)
+        true
+      end
+
+      def quote(value)
+        @shards.first.quote(value)
+      end
+
+      # The Driver for the shard holding key.
+      #
+      # @param [Object] key
+      #   the shard key, e.g. a tenant id
+      #
+      # @return [RDO::Postgres::Driver]
+      def shard(key)
+        index = @strategy.shard_for(key)
+
+        unless index.kind_of?(Integer) && index >= 0 && index < @shards.size
+          raise RDO::Exception, "Shard strategy returned #{index.inspect} for key #{key.inspect}"
+        end
+
+        @shards[index]
+      end
+
+      # Execute stmt on the shard holding key.
+      #
+      # @param [Object] key
+      #   the shard key
+      #
+      # @param [String] stmt
+      #   the statement to execute
+      #
+      # @param [Object...] *args
+      #   bind parameters to execute with
+      #
+      # @return [RDO::Result]
+      def execute_on(key, stmt, *args)
+        shard(key).execute(stmt, *args)
+      end
+
+      # Execute stmt on every shard concurrently.
+      #
+      # @return [Array<RDO::Result>]
+      #   the result from each shard, in shard order
+      def fan_out(stmt, *args)
+        each_shard_concurrently { |driver| driver.execute(stmt, *args) }
+      end
+
+      # Execute stmt on every shard concurrently, combining the results.
+      #
+      # Rows are in shard order, and counts are summed. Use #merge for rows in
+      # a sorted order. Only reads are allowed, since a write without a key is
+      # almost always a mistake; see #execute_on and #fan_out.
+      #
+      # @param [String] stmt
+      #   the statement to execute
+      #
+      # @param [Object...] *args
+      #   bind parameters to execute with
+      #
+      # @return [RDO::Result]
+      #   a result containing the tuples from every shard
+      def execute(stmt, *args)
+        check_read_only(stmt)
+        combine(fan_out(stmt, *args))
+      end
+
+      # Prepare a statement which is executed on every shard.
+      #
+      # As with #execute, only reads are allowed.
+      #
+      # @param [String] stmt
+      #   the statement to prepare
+      #
+      # @return [StatementExecutor]
+      #   an executor that prepares stmt on each shard
+      def prepare(stmt)
+        StatementExecutor.new(self, stmt)
+      end
+
+      # Yield the rows of stmt from every shard, in order.
+      #
+      # stmt must return rows sorted by order on each shard. Each shard
+      # streams its rows through a Cursor on a thread of its own, while the
+      # streams are merged as they arrive, so the full result is never held
+      # in memory. NULLs sort last, or first if descending, as they do in
+      # PostgreSQL.
+      #
+      # Don't use the shards from the block, since they are busy with the
+      # cursors until the merge finishes.
+      #
+      # @example
+      #   db.driver.merge({created_at: :desc, id: :asc},
+      #     "SELECT * FROM events ORDER BY created_at DESC, id")
+      #
+      # @param [Symbol, Array, Hash] order
+      #   the sort columns, e.g. :id, [:name, :id] or {name: :desc}
+      #
+      # @param [String] stmt
+      #   the query, sorted by the same columns
+      #
+      # @param [Object...] *args
+      #   bind parameters, quoted into the query on the client
+      #
+      # @return [Enumerator]
+      #   if no block is given
+      def merge(order, stmt, *args)
+        return enum_for(:merge, order, stmt, *args) unless block_given?
+
+        merger  = Merger.new(order)
+        streams = @shards.map do |driver|
+          Stream.new(driver, stmt, args, options[:cursor_batch_size])
+        end
+
+        begin
+          streams.each_with_index { |s, i| merger.push(s.next_row, i) unless s.done? }
+
+          until merger.empty?
+            row, i = merger.pop
+            yield row
+            merger.push(streams[i].next_row, i) unless streams[i].done?
+          end
+        ensure
+          streams.each(&:close)
+        end
+
+        self
+      end
+
+      # Run schema changes on every shard, e.g. in migrations.
+      def execute_script(sql, *args)
+        each_shard_concurrently { |driver| driver.execute_script(sql, *args) }.last
+      end
+
+      def query_timeout
+        @shards.first.query_timeout
+      end
+
+      # Applies to every shard.
+      def query_timeout=(seconds)
+        @shards.each { |driver| driver.query_timeout = seconds }
+      end
+
+      def with_timeout(seconds)
+        previous = query_timeout
+        self.query_timeout = seconds
+
+        begin
+          yield
+        ensure
+          self.query_timeout = previous
+        end
+      end
+
+      def reload_types
+        @shards.each(&:reload_types)
+        true
+      end
+
+      # Yield each shard on a thread of its own, returning the block's values
+      # in shard order.
+      #
+      # Every thread is waited for before the first error is raised.
+      def each_shard_concurrently
+        threads = @shards.map do |driver|
+          Thread.new do
+            Thread.current.report_on_exception = false
+            yield driver
+          end
+        end
+
+        threads.each { |t| t.join rescue nil }
+        threads.map(&:value)
+      end
+
+      private
+
+      # Raise unless stmt may run on every shard without a key.
+      def check_read_only(stmt)
+        return if Sql.read_only?(stmt)
+
+        raise RDO::Exception,
+          "Refusing to run a write on every shard; use execute_on with a shard key, " \
+          "or fan_out to run it on every shard: #{stmt}"
+      end
+
+      # One result with the rows of every result, and the sum of their counts.
+      def combine(results)
+        info = results.first.info.dup
+
+        [:count, :affected_rows].each do |key|
+          info[key] = results.inject(0) { |sum, r| sum + r.info[key].to_i } if info.key?(key)
+        end
+
+        RDO::Result.new(results.flat_map(&:to_a), info)
+      end
+
+      # The :shards option may be an Array or a comma-separated String of
+      # "host[:port][/database]".
+      def shard_specs
+        list = options[:shards] || []
+        list = list.split(",") if list.kind_of?(String)
+
+        list.map(&:to_s).map(&:strip).reject(&:empty?).map do |spec|
+          address, database = spec.split("/", 2)
+          host, port        = address.split(":", 2)
+
+          {
+            host:     (host.nil? || host.empty?) ? options[:host] : host,
+            port:     port || options[:port],
+            database: database || options[:database]
+          }
+        end
+      end
+
+      def shard_options(spec)
+        options.reject { |k, _| [:shards, :strategy, :ranges, :virtual_nodes].include?(k) }.merge(spec)
+      end
+
+      def build_strategy
+        strategy = options.fetch(:strategy, "hash")
+        return strategy if strategy.respond_to?(:shard_for)
+
+        case strategy.to_s
+        when "hash"
+          names = @specs.map { |spec| spec.values_at(:host, :port, :database).join(":") }
+          ConsistentHash.new(names, Integer(options.fetch(:virtual_nodes, DEFAULT_VIRTUAL_NODES)))
+        when "range"
+          RangeTable.new(options[:ranges], @shards.size)
+        else
+          raise ArgumentError, "Unknown shard strategy #{strategy.inspect}"
+        end
+      end
+
+      # Maps keys to shards on a hash ring.
+      #
+      # Each shard is placed at several points on the ring, by hashing its
+      # name, and a key belongs to the first shard point at or after the hash
+      # of the key. Adding a shard only moves the keys between its points and
+      # the ones before them, about 1/N of all keys.
+      class ConsistentHash
+        # @param [Array<String>] names
+        #   a name for each shard, e.g. its host and database
+        #
+        # @param [Fixnum] virtual_nodes
+        #   the points each shard is given on the ring
+        def initialize(names, virtual_nodes = DEFAULT_VIRTUAL_NODES)
+          raise ArgumentError, "virtual_nodes must be positive" unless virtual_nodes > 0
+
+          ring = names.each_with_index.flat_map do |name, i|
+            (0...virtual_nodes).map { |v| [point("#{name}##{v}"), i] }
+          end.sort
+
+          @points  = ring.map(&:first)
+          @indexes = ring.map(&:last)
+        end
+
+        # @return [Fixnum]
+        #   the index of the shard holding key
+        def shard_for(key)
+          position = point(key.to_s)
+          @indexes[@points.bsearch_index { |p| p >= position } || 0]
+        end
+
+        private
+
+        def point(str)
+          Digest::MD5.digest(str).unpack("N").first
+        end
+      end
+
+      # Maps keys to shards by ranges of key values.
+      #
+      # The :ranges option gives the first key of each shard after the first,
+      # in order, e.g. "1000,5000" for three shards: keys below 1000, from
+      # 1000 up to 5000, and from 5000.
+      class RangeTable
+        # @param [Array, String] bounds
+        #   the first key of each shard after the first
+        #
+        # @param [Fixnum] count
+        #   the number of shards
+        def initialize(bounds, count)
+          bounds = bounds.split(",") if bounds.kind_of?(String)
+          bounds = Array(bounds).map { |b| b.kind_of?(String) ? b.strip : b }
+
+          if bounds.all? { |b| b.kind_of?(String) && b =~ /\A-?\d+\z/ }
+            bounds = bounds.map { |b| Integer(b) }
+          end
+
+          unless bounds.size == count - 1
+            raise ArgumentError, "ranges must give #{count - 1} bounds for #{count} shards"
+          end
+
+          unless bounds.each_cons(2).all? { |a, b| a < b }
+            raise ArgumentError, "ranges must be in ascending order"
+          end
+
+          @bounds  = bounds
+          @integer = bounds.all? { |b| b.kind_of?(Integer) }
+        end
+
+        # @return [Fixnum]
+        #   the index of the shard holding key
+        def shard_for(key)
+          key = Integer(key) if @integer && key.kind_of?(String)
+          @bounds.bsearch_index { |b| b > key } || @bounds.size
+        end
+      end
+
+      # Reads a query on one shard through a Cursor, on a thread of its own.
+      #
+      # Batches are handed over through a small queue, so the cursor reads
+      # ahead while earlier rows are merged, without running far ahead.
+      class Stream
+        # Batches held in the queue.
+        QUEUE_SIZE = 2
+
+        def initialize(driver, stmt, args, batch_size)
+          @queue   = SizedQueue.new(QUEUE_SIZE)
+          @rows    = []
+          @done    = false
+          @closing = false
+          @thread  = Thread.new do
+            begin
+              Cursor.new(driver, stmt, args, batch_size: batch_size).each_batch do |batch|
+                break if @closing
+                @queue << batch.to_a
+              end
+              @queue << :done
+            rescue ::Exception => e
+              @queue << e
+            end
+          end
+        end
+
+        # Predicate test if every row has been read, waiting for the next
+        # batch if needed.
+        def done?
+          fill
+          @rows.empty?
+        end
+
+        # The next row, or nil once every row has been read.
+        def next_row
+          fill
+          @rows.shift
+        end
+
+        # Stop reading, waiting for the cursor to be closed.
+        def close
+          @closing = true
+          @queue.clear until @thread.join(0.01)
+        end
+
+        private
+
+        def fill
+          while @rows.empty? && !@done
+            case (batch = @queue.pop)
+            when :done       then @done = true
+            when ::Exception then @done = true; raise batch
+            else                  @rows = batch
+            end
+          end
+        end
+      end
+
+      # A binary heap of rows from each stream, smallest first.
+      #
+      # Ties are broken by the stream index, so rows from the first shard
+      # come first.
+      class Merger
+        def initialize(order)
+          @keys = order_keys(order)
+          @heap = []
+        end
+
+        def empty?
+          @heap.empty?
+        end
+
+        # Add a row read from stream i.
+        def push(row, i)
+          @heap << [row, i]
+          sift_up(@heap.size - 1)
+        end
+
+        # Remove and return the smallest [row, i].
+        def pop
+          top  = @heap.first
+          last = @heap.pop
+
+          unless @heap.empty?
+            @heap[0] = last
+            sift_down(0)
+          end
+
+          top
+        end
+
+        private
+
+        def order_keys(order)
+          pairs = case order
+                  when Hash  then order.to_a
+                  else            Array(order).map { |k| k.kind_of?(::Array) ? k : [k, :asc] }
+                  end
+
+          pairs.map do |column, direction|
+            [column.to_sym, direction.to_s.downcase == "desc" ? -1 : 1]
+          end
+        end
+
+        def less?(a, b)
+          @keys.each do |column, direction|
+            x, y = a[0][column], b[0][column]
+            next if x == y
+
+            cmp = if x.nil? then 1
+                  elsif y.nil? then -1
+                  else x <=> y
+                  end
+
+            return cmp * direction < 0
+          end
+
+          a[1] < b[1]
+        end
+
+        def sift_up(i)
+          while i > 0
+            parent = (i - 1) / 2
+            break unless less?(@heap[i], @heap[parent])
+            @heap[i], @heap[parent] = @heap[parent], @heap[i]
+            i = parent
+          end
+        end
+
+        def sift_down(i)
+          loop do
+            smallest = i
+            [2 * i + 1, 2 * i + 2].each do |child|
+              smallest = child if child < @heap.size && less?(@heap[child], @heap[smallest])
+            end
+            break if smallest == i
+            @heap[i], @heap[smallest] = @heap[smallest], @heap[i]
+            i = smallest
+          end
+        end
+      end
+
+      # Prepares the statement on each shard, and executes it on all of them.
+      #
+      # A shard that reconnects has the statement prepared again.
+      class StatementExecutor
+        attr_reader :command
+
+        def initialize(router, command)
+          @router    = router
+          @command   = command
+          @executors = {}
+          @mutex     = Mutex.new
+        end
+
+        def execute(*args)
+          @router.send(:check_read_only, @command)
+
+          results = @router.each_shard_concurrently do |driver|
+            executor = @mutex.synchronize do
+              cached = @executors[driver]
+              cached = @executors[driver] = driver.prepare(@command, true) if cached.nil? || cached.stale?
+              cached
+            end
+            executor.execute(*args)
+          end
+
+          @router.send(:combine, results)
+        end
+      end
+    end
+  end
+end
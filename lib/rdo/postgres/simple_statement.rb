@@ -0,0 +1,57 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Stands in for a StatementExecutor in simple query mode.
+    #
+    # Nothing is prepared on the server: each execution quotes the bind
+    # parameters into the statement and sends it with the simple query
+    # protocol, as Driver#execute does in that mode.
+    class SimpleStatement
+      attr_reader :command
+
+      # Initialize a statement for a driver in simple query mode.
+      #
+      # @param [RDO::Postgres::Driver] driver
+      #   the driver to execute with
+      #
+      # @param [String] command
+      #   the statement, which may have '?' markers
+      def initialize(driver, command)
+        @driver  = driver
+        @command = command
+      end
+
+      # @return [RDO::Result]
+      def execute(*args)
+        @driver.send(:simple_execute, @command, *args)
+      end
+
+      # @return [Array<RDO::Result>]
+      #   one result per parameter set, each in its own round trip
+      def execute_many(param_sets)
+        param_sets.map { |args| execute(*args) }
+      end
+
+      # Nothing is prepared, so the statement survives a reconnect.
+      def stale?
+        false
+      end
+
+      # Column descriptions need a prepared statement.
+      def columns
+        raise RDO::Exception, "Statement columns are not available in simple query mode"
+      end
+
+      # Spooling streams rows through the extended protocol.
+      def execute_spooled(limit, *args)
+        raise RDO::Exception, "execute_spooled is not supported in simple query mode"
+      end
+    end
+  end
+end
@@ -0,0 +1,97 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+module RDO
+  module Postgres
+    # Lightweight inspection of SQL text, used for routing and caching.
+    #
+    # These are conservative heuristics, not a parser: anything that is not
+    # clearly a plain read is treated as a write.
+    module Sql
+      # Statements that may be read-only.
+      READ_ONLY = /\A(?:SELECT|SHOW|VALUES|TABLE|WITH|EXPLAIN)\b/i
+
+      # Anything that makes an otherwise read-only statement need the primary.
+      WRITES = /\b(?:INSERT|UPDATE|DELETE|MERGE|INTO|FOR\s+(?:NO\s+KEY\s+)?UPDATE|FOR\s+(?:KEY\s+)?SHARE|ANALYZE|nextval|setval|pg_advisory\w*|lo_\w+)\b/i
+
+      # Functions whose result can change between identical queries.
+      VOLATILE = /\b(?:now|random|setseed|nextval|currval|lastval|setval|clock_timestamp|statement_timestamp|transaction_timestamp|timeofday|gen_random_uuid|uuid_generate_\w+|txid_current\w*|pg_current_\w+|pg_sleep\w*|pg_try_advisory\w*|current_(?:date|time|timestamp)|local(?:time|timestamp))\b/i
+
+      # Leading comments, which are skipped when classifying a statement.
+      LEADING_COMMENTS = /\A(?:\s+|--[^\n]*\n?|\/\*.*?\*\/)*/m
+
+      # A leading /* primary */ comment marks a statement as a write.
+      PRIMARY_HINT = /\A\s*\/\*\s*primary\s*\*\//i
+
+      # A table name, optionally schema-qualified and quoted.
+      TABLE_NAME = /((?:"[^"]+"|\w+)(?:\s*\.\s*(?:"[^"]+"|\w+))?)/
+
+      # Tables a statement reads from.
+      READ_TABLES = /\b(?:FROM|JOIN)\s+(?:ONLY\s+)?#{TABLE_NAME}/i
+
+      # Tables a statement writes to.
+      WRITE_TABLES = /\b(?:INSERT\s+INTO|UPDATE(?:\s+ONLY)?|DELETE\s+FROM(?:\s+ONLY)?|TRUNCATE(?:\s+TABLE)?(?:\s+ONLY)?|MERGE\s+INTO)\s+#{TABLE_NAME}/i
+
+      module_function
+
+      # Predicate test if stmt only reads.
+      #
+      # @param [String] stmt
+      #   the statement to check
+      #
+      # @return [Boolean]
+      #   true if stmt looks read-only
+      def read_only?(stmt)
+        return false if stmt =~ PRIMARY_HINT
+
+        body = stmt.sub(LEADING_COMMENTS, "")
+        !!(body =~ READ_ONLY && body !~ WRITES)
+      end
+
+      # Predicate test if the result of stmt can be reused for identical queries.
+      #
+      # @param [String] stmt
+      #   the statement to check
+      #
+      # @return [Boolean]
+      #   true if stmt is read-only, reads from a table and calls no volatile
+      #   functions
+      def cacheable?(stmt)
+        read_only?(stmt) && stmt !~ VOLATILE && !read_tables(stmt).empty?
+      end
+
+      # Names of the tables stmt reads from, without schema or quotes.
+      #
+      # @param [String] stmt
+      #   the statement to inspect
+      #
+      # @return [Array<String>]
+      #   lower-cased table names
+      def read_tables(stmt)
+        table_names(stmt, READ_TABLES)
+      end
+
+      # Names of the tables stmt writes to, without schema or quotes.
+      #
+      # @param [String] stmt
+      #   the statement to inspect
+      #
+      # @return [Array<String>]
+      #   lower-cased table names
+      def written_tables(stmt)
+        table_names(stmt, WRITE_TABLES)
+      end
+
+      def table_names(stmt, pattern)
+        stmt.scan(pattern).map do |(name)|
+          name = name.split(".").last.strip
+          name.start_with?('"') ? name[1..-2] : name.downcase
+        end.uniq
+      end
+    end
+  end
+end
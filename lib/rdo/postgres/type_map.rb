@@ -0,0 +1,169 @@
+##
+# RDO PostgreSQL driver.
+# Copyright © 2012 Chris Corbyn.
+#
+# See LICENSE file for details.
+##
+
+require "thread"
+
+module RDO
+  module Postgres
+    # Maps types with no built-in decoder to a built-in type to decode as.
+    #
+    # Domains map to their base type, enums and string-like extension types
+    # (such as citext) to text, and arrays of any of these to the array type
+    # of what their element maps to. The map is read from pg_type once per
+    # database, and shared by every connection to it in the process.
+    #
+    # Composite types and hstore map to a decoder instead: an Array of
+    # [name, decoder] pairs for the fields of a composite, and :hstore.
+    #
+    # The fields of every composite (including the row type of each table)
+    # are read along with pg_type, so that decoding never needs a query of
+    # its own, which a busy connection could not send.
+    module TypeMap
+      # text
+      TEXT_OID = 25
+
+      # Oids below this are built in.
+      FIRST_NORMAL_OID = 16384
+
+      # Extension types decoded as text, by name.
+      TEXT_TYPE_NAMES = %w[hstore citext ltree lquery ltxtquery]
+
+      # Composite types in these schemas (the system catalogs) are not loaded.
+      SYSTEM_SCHEMAS = "SELECT oid FROM pg_namespace " \
+        "WHERE nspname IN ('pg_catalog', 'information_schema', 'pg_toast')"
+
+      # Every column of pg_type needed to resolve a type.
+      QUERY = <<-SQL.gsub(/\s+/, " ").strip
+        SELECT oid::int8 AS oid, typname::text AS name, typtype AS kind,
+               typcategory AS category, typbasetype::int8 AS base,
+               typelem::int8 AS elem, typarray::int8 AS array_type,
+               typrelid::int8 AS relid
+        FROM pg_type
+        WHERE typtype IN ('b', 'd', 'e')
+           OR (typtype = 'c' AND typnamespace NOT IN (#{SYSTEM_SCHEMAS}))
+      SQL
+
+      # The fields of every composite type in QUERY, in order.
+      FIELDS_QUERY = <<-SQL.gsub(/\s+/, " ").strip
+        SELECT a.attrelid::int8 AS relid, a.attname::text AS name,
+               a.atttypid::int8 AS type
+        FROM pg_attribute a
+        JOIN pg_type t ON t.typrelid = a.attrelid
+        WHERE t.typtype = 'c' AND t.typnamespace NOT IN (#{SYSTEM_SCHEMAS})
+          AND a.attnum > 0 AND NOT a.attisdropped
+        ORDER BY a.attrelid, a.attnum
+      SQL
+
+      @maps  = {}
+      @mutex = Mutex.new
+
+      class << self
+        # The map for the database driver is connected to, loading it if needed.
+        #
+        # @param [RDO::Postgres::Driver] driver
+        #   an open driver
+        #
+        # @param [Object] key
+        #   identifies the database, e.g. [host, port, dbname]
+        #
+        # @param [Boolean] reload
+        #   true to read pg_type again, e.g. after CREATE DOMAIN
+        #
+        # @return [Hash]
+        #   a frozen Hash of Oid => built-in Oid or decoder
+        def for(driver, key, reload = false)
+          @mutex.synchronize { @maps.delete(key) } if reload
+          map = @mutex.synchronize { @maps[key] }
+          return map if map
+
+          rows   = driver.execute_script(QUERY).to_a
+          fields = driver.execute_script(FIELDS_QUERY).to_a
+
+          @mutex.synchronize { @maps[key] ||= build(rows, fields).freeze }
+        end
+
+        # Forget every loaded map.
+        def clear
+          @mutex.synchronize { @maps.clear }
+        end
+
+        # Resolve each row of pg_type, keeping those that map elsewhere.
+        #
+        # @param [Array<Hash>] rows
+        #   rows from QUERY
+        #
+        # @param [Array<Hash>] fields
+        #   rows from FIELDS_QUERY
+        #
+        # @return [Hash]
+        #   a Hash of Oid => built-in Oid or decoder
+        def build(rows, fields = [])
+          types   = Hash[rows.map { |row| [row[:oid], row] }]
+          columns = fields.group_by { |field| field[:relid] }
+          columns.default = []
+          memo    = {}
+          map     = {}
+
+          types.each_key do |oid|
+            decoder  = decoder_for(types, columns, memo, oid)
+            map[oid] = decoder unless decoder == oid
+          end
+
+          map
+        end
+
+        private
+
+        def decoder_for(types, columns, memo, oid, depth = 0)
+          return memo[oid] if memo.key?(oid)
+
+          row = types[oid]
+          return oid if row.nil? || depth > 32
+
+          memo[oid] =
+            if row[:kind] == "d"
+              decoder_for(types, columns, memo, row[:base], depth + 1)
+            elsif row[:kind] == "c"
+              columns[row[:relid]].map { |field|
+                [
+                  field[:name].to_sym,
+                  decoder_for(types, columns, memo, field[:type], depth + 1)
+                ].freeze
+              }.freeze
+            elsif row[:name] == "hstore" && row[:oid] >= FIRST_NORMAL_OID
+              :hstore
+            else
+              resolve(types, oid)
+            end
+        end
+
+        def resolve(types, oid, depth = 0)
+          row = types[oid]
+          return oid if row.nil? || depth > 32
+
+          if row[:kind] == "d"
+            resolve(types, row[:base], depth + 1)
+          elsif row[:kind] == "e" || text_like?(row)
+            TEXT_OID
+          elsif row[:category] == "A" && row[:elem] > 0
+            elem = resolve(types, row[:elem], depth + 1)
+            return oid if elem == row[:elem]
+            array = types[elem] && types[elem][:array_type]
+            array && array > 0 ? array : oid
+          else
+            oid
+          end
+        end
+
+        def text_like?(row)
+          row[:oid] >= FIRST_NORMAL_OID &&
+            (row[:category] == "S" || TEXT_TYPE_NAMES.include?(row[:name]))
+        end
+      end
+    end
+  end
+end
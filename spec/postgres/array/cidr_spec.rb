@@ -0,0 +1,35 @@
+require "spec_helper"
+
+describe RDO::Postgres::Array::Cidr do
+  it "is a kind of ::Array" do
+    RDO::Postgres::Array::Cidr.new.should be_a_kind_of(::Array)
+  end
+
+  describe "#to_s" do
+    context "with an array of IPAddrs" do
+      let(:arr) { RDO::Postgres::Array::Cidr[IPAddr.new("10.0.0.0/8"), IPAddr.new("::1")] }
+
+      it "includes the prefix length" do
+        arr.to_s.should == '{10.0.0.0/8,::1/128}'
+      end
+    end
+  end
+
+  describe ".parse" do
+    let(:str) { '{}' }
+    let(:arr) { RDO::Postgres::Array::Cidr.parse(str) }
+
+    it "returns a RDO::Postgres::Array::Cidr" do
+      arr.should be_a_kind_of(RDO::Postgres::Array::Cidr)
+    end
+
+    context "with an array of networks" do
+      let(:str) { '{10.0.0.0/8,NULL}' }
+
+      it "returns an Array of IPAddrs" do
+        arr.to_a.should == [IPAddr.new("10.0.0.0/8"), nil]
+        arr.to_a.first.prefix.should == 8
+      end
+    end
+  end
+end
@@ -0,0 +1,60 @@
+require "spec_helper"
+
+describe RDO::Postgres::Array::Inet do
+  it "is a kind of ::Array" do
+    RDO::Postgres::Array::Inet.new.should be_a_kind_of(::Array)
+  end
+
+  describe "#to_s" do
+    context "with an array of IPAddrs" do
+      let(:arr) { RDO::Postgres::Array::Inet[IPAddr.new("10.0.0.1"), IPAddr.new("10.0.0.0/8")] }
+
+      it "includes the prefix length" do
+        arr.to_s.should == '{10.0.0.1/32,10.0.0.0/8}'
+      end
+    end
+
+    context "with an inet that has a host part" do
+      let(:arr) { RDO::Postgres::Array::Inet[RDO::Postgres::Inet.new("192.168.0.5/24")] }
+
+      it "keeps the host address" do
+        arr.to_s.should == '{192.168.0.5/24}'
+      end
+    end
+
+    context "with an array containing nil" do
+      let(:arr) { RDO::Postgres::Array::Inet[nil, IPAddr.new("::1")] }
+
+      it "uses NULL" do
+        arr.to_s.should == '{NULL,::1/128}'
+      end
+    end
+  end
+
+  describe ".parse" do
+    let(:str) { '{}' }
+    let(:arr) { RDO::Postgres::Array::Inet.parse(str) }
+
+    it "returns a RDO::Postgres::Array::Inet" do
+      arr.should be_a_kind_of(RDO::Postgres::Array::Inet)
+    end
+
+    context "with an array of addresses" do
+      let(:str) { '{10.0.0.1,192.168.0.5/24}' }
+
+      it "returns an Array of RDO::Postgres::Inets" do
+        arr.to_a.should == [IPAddr.new("10.0.0.1"), IPAddr.new("192.168.0.5")]
+        arr.to_a.last.prefix.should == 24
+        arr.to_a.last.to_s.should == "192.168.0.5/24"
+      end
+    end
+
+    context "with an array containing NULL" do
+      let(:str) { '{NULL,::1}' }
+
+      it "uses nil as the value" do
+        arr.to_a.should == [nil, IPAddr.new("::1")]
+      end
+    end
+  end
+end
@@ -0,0 +1,58 @@
+require "spec_helper"
+
+describe RDO::Postgres::Array::Interval do
+  it "is a kind of ::Array" do
+    RDO::Postgres::Array::Interval.new.should be_a_kind_of(::Array)
+  end
+
+  describe "#to_s" do
+    context "with an array of Intervals" do
+      let(:arr) do
+        RDO::Postgres::Array::Interval[
+          RDO::Postgres::Interval.new(14, 3, 0),
+          RDO::Postgres::Interval.new(0, 0, -1_500_000)
+        ]
+      end
+
+      it "formats the intervals in quotes" do
+        arr.to_s.should == '{"14 mons 3 days 0.000000 secs","0 mons 0 days -1.500000 secs"}'
+      end
+    end
+
+    context "with an array containing nil" do
+      let(:arr) { RDO::Postgres::Array::Interval[nil, RDO::Postgres::Interval.new(0, 1, 0)] }
+
+      it "uses NULL" do
+        arr.to_s.should == '{NULL,"0 mons 1 days 0.000000 secs"}'
+      end
+    end
+  end
+
+  describe ".parse" do
+    let(:str) { '{}' }
+    let(:arr) { RDO::Postgres::Array::Interval.parse(str) }
+
+    it "returns a RDO::Postgres::Array::Interval" do
+      arr.should be_a_kind_of(RDO::Postgres::Array::Interval)
+    end
+
+    context "with an array of intervals" do
+      let(:str) { '{"1 year 2 mons","3 days 04:05:06.5"}' }
+
+      it "returns an Array of Intervals" do
+        arr.to_a.should == [
+          RDO::Postgres::Interval.new(14, 0, 0),
+          RDO::Postgres::Interval.new(0, 3, 14_706_500_000)
+        ]
+      end
+    end
+
+    context "with an array containing NULL" do
+      let(:str) { '{NULL,"1 day"}' }
+
+      it "uses nil as the value" do
+        arr.to_a.should == [nil, RDO::Postgres::Interval.new(0, 1, 0)]
+      end
+    end
+  end
+end
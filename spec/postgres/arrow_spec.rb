@@ -0,0 +1,158 @@
+require "spec_helper"
+
+describe RDO::Postgres::Result, "Arrow IPC export" do
+  let(:connection) { RDO.connect(connection_uri) }
+  let(:result) do
+    connection.execute(
+      "SELECT n AS id, 'v' || n AS name, n % 2 = 0 AS even " +
+      "FROM generate_series(1, 5) n"
+    )
+  end
+
+  let(:continuation) { "\xFF\xFF\xFF\xFF".force_encoding("binary") }
+  let(:end_of_stream) { continuation + "\x00\x00\x00\x00".force_encoding("binary") }
+
+  after(:each) { connection.close rescue nil }
+
+  # Just enough of a FlatBuffers reader to walk the Message and RecordBatch
+  # tables: returns the field position of a table, or nil when it is absent.
+  def fb_field(buf, table, index)
+    vtable = table - buf[table, 4].unpack("l<").first
+    return nil if 4 + index * 2 >= buf[vtable, 2].unpack("S<").first
+    offset = buf[vtable + 4 + index * 2, 2].unpack("S<").first
+    offset == 0 ? nil : table + offset
+  end
+
+  def fb_scalar(buf, table, index, format)
+    (pos = fb_field(buf, table, index)) && buf[pos..-1].unpack(format).first
+  end
+
+  def fb_table(buf, table, index)
+    pos = fb_field(buf, table, index)
+    pos + buf[pos, 4].unpack("L<").first
+  end
+
+  def fb_structs(buf, table, index)
+    pos    = fb_field(buf, table, index)
+    vector = pos + buf[pos, 4].unpack("L<").first
+    (0...buf[vector, 4].unpack("L<").first).map do |i|
+      buf[vector + 4 + i * 16, 16].unpack("q<q<")
+    end
+  end
+
+  # Each record batch as its row count, [length, null_count] per column and
+  # the bytes of every body buffer, in column order.
+  def record_batches(stream)
+    batches = []
+    pos     = 0
+
+    until (size = stream[pos + 4, 4].unpack("l<").first) == 0
+      meta      = stream[pos + 8, size]
+      message   = meta[0, 4].unpack("L<").first
+      body_size = fb_scalar(meta, message, 3, "q<") || 0
+      body      = stream[pos + 8 + size, body_size]
+
+      if fb_scalar(meta, message, 1, "C") == 3
+        batch = fb_table(meta, message, 2)
+        batches << {
+          :length  => fb_scalar(meta, batch, 0, "q<"),
+          :nodes   => fb_structs(meta, batch, 1),
+          :buffers => fb_structs(meta, batch, 2).map { |o, n| body[o, n] }
+        }
+      end
+
+      pos += 8 + size + body_size
+    end
+
+    batches
+  end
+
+  describe "#to_arrow_ipc" do
+    let(:stream) { result.to_arrow_ipc }
+
+    it "returns a binary String" do
+      stream.encoding.should == Encoding::BINARY
+    end
+
+    it "starts with an encapsulated message" do
+      stream[0, 4].should == continuation
+    end
+
+    it "ends with the end-of-stream marker" do
+      stream[-8, 8].should == end_of_stream
+    end
+
+    it "aligns every message to 8 bytes" do
+      (stream.bytesize % 8).should == 0
+    end
+
+    it "includes the column names in the schema" do
+      %w[id name even].each { |name| stream.should include(name) }
+    end
+  end
+
+  describe "record batch values" do
+    let(:result) do
+      connection.execute(
+        "SELECT n AS id, NULLIF(n, 2) AS maybe, DATE '2000-01-01' + n AS day, " +
+        "TIMESTAMPTZ '2000-01-02 03:04:05+10' + n * INTERVAL '1 hour' AS at, " +
+        "decode(repeat('ab', n), 'hex') AS raw FROM generate_series(1, 3) n"
+      )
+    end
+
+    let(:batch) { record_batches(result.to_arrow_ipc).first }
+    let(:buffers) { batch[:buffers] }
+
+    it "writes every row in a single batch by default" do
+      record_batches(result.to_arrow_ipc).size.should == 1
+      batch[:length].should == 3
+    end
+
+    it "writes the row and null count of each column" do
+      batch[:nodes].should == [[3, 0], [3, 1], [3, 0], [3, 0], [3, 0]]
+    end
+
+    it "sets the validity bit of each non-NULL value only" do
+      buffers[0].unpack("C").first.should == 0b111
+      buffers[2].unpack("C").first.should == 0b101
+    end
+
+    it "writes integers as little-endian values" do
+      buffers[1].unpack("l<3").should == [1, 2, 3]
+      buffers[3].unpack("l<3").values_at(0, 2).should == [1, 3]
+    end
+
+    it "writes dates as days since the epoch" do
+      buffers[5].unpack("l<3").should == [10958, 10959, 10960]
+    end
+
+    it "writes timestamptz values as UTC microseconds since the epoch" do
+      first = Time.utc(2000, 1, 1, 17, 4, 5).to_i
+      buffers[7].unpack("q<3").should == (1..3).map { |n| (first + n * 3600) * 1_000_000 }
+    end
+
+    it "writes bytea values as offsets into the unescaped bytes" do
+      buffers[9].unpack("l<4").should == [0, 1, 3, 6]
+      buffers[10][0, 6].should == ("\xAB" * 6).force_encoding("binary")
+    end
+
+    it "starts each batch's buffers at its own first row" do
+      second = record_batches(result.to_arrow_ipc(2)).last
+      second[:nodes].should == [[1, 0], [1, 0], [1, 0], [1, 0], [1, 0]]
+      second[:buffers][1].unpack("l<").should == [3]
+      second[:buffers][9].unpack("l<2").should == [0, 3]
+    end
+  end
+
+  describe "#each_arrow_ipc" do
+    it "yields the schema, one chunk per batch and the end-of-stream marker" do
+      chunks = result.each_arrow_ipc(2).to_a
+      chunks.size.should == 5
+      chunks.last.should == end_of_stream
+    end
+
+    it "concatenates to the same stream as #to_arrow_ipc" do
+      result.each_arrow_ipc(2).to_a.join.should == result.to_arrow_ipc(2)
+    end
+  end
+end
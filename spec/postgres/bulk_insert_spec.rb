@@ -0,0 +1,75 @@
+require "spec_helper"
+
+describe RDO::Postgres::Driver, "#insert_many" do
+  let(:connection) { RDO.connect(connection_uri) }
+  let(:driver)     { driver_for(connection) }
+  let(:rows)       { (1..1000).map { |i| [i, "name #{i}", i.even? ? nil : [i, i + 1]] } }
+
+  before(:each) do
+    connection.execute("DROP TABLE IF EXISTS rdo_bulk")
+    connection.execute("CREATE TABLE rdo_bulk (id integer PRIMARY KEY, name text, nums integer[])")
+  end
+
+  after(:each) do
+    connection.execute("DROP TABLE IF EXISTS rdo_bulk") rescue nil
+    connection.close rescue nil
+  end
+
+  it "inserts every row" do
+    driver.insert_many(:rdo_bulk, [:id, :name, :nums], rows).should == 1000
+    connection.execute("SELECT count(*) FROM rdo_bulk").first_value.should == 1000
+  end
+
+  it "keeps values and NULLs intact" do
+    driver.insert_many(:rdo_bulk, [:id, :name, :nums], rows)
+    connection.execute("SELECT * FROM rdo_bulk WHERE id IN (1, 2) ORDER BY id").to_a.should == [
+      {id: 1, name: "name 1", nums: [1, 2]},
+      {id: 2, name: "name 2", nums: nil}
+    ]
+  end
+
+  it "splits rows that exceed the bind parameter limit" do
+    many = (1..30_000).map { |i| [i, "n", nil] }
+    driver.insert_many(:rdo_bulk, [:id, :name, :nums], many).should == 30_000
+  end
+
+  it "rolls back every row when one fails" do
+    expect {
+      driver.insert_many(:rdo_bulk, [:id, :name], rows.map { |r| r[0, 2] } + [[1, "dup"]])
+    }.to raise_error(RDO::Exception)
+    connection.execute("SELECT count(*) FROM rdo_bulk").first_value.should == 0
+  end
+
+  it "raises an ArgumentError for rows of the wrong width" do
+    expect {
+      driver.insert_many(:rdo_bulk, [:id, :name], [[1]])
+    }.to raise_error(ArgumentError)
+  end
+
+  describe "with :on_conflict" do
+    before(:each) { driver.insert_many(:rdo_bulk, [:id, :name], [[1, "old"]]) }
+
+    it "supports :nothing" do
+      driver.insert_many(:rdo_bulk, [:id, :name], [[1, "new"], [2, "two"]], on_conflict: :nothing).should == 1
+      connection.execute("SELECT name FROM rdo_bulk WHERE id = 1").first_value.should == "old"
+    end
+
+    it "supports updating columns" do
+      driver.insert_many(:rdo_bulk, [:id, :name], [[1, "new"]], on_conflict: {target: [:id]})
+      connection.execute("SELECT name FROM rdo_bulk WHERE id = 1").first_value.should == "new"
+    end
+  end
+
+  describe "with strategy: :unnest" do
+    it "inserts every row with one statement" do
+      driver.insert_many(:rdo_bulk, [:id, :name], rows.map { |r| r[0, 2] }, strategy: :unnest).should == 1000
+      connection.execute("SELECT name FROM rdo_bulk WHERE id = 7").first_value.should == "name 7"
+    end
+
+    it "does not support array columns" do
+      expect {
+        driver.insert_many(:rdo_bulk, [:id, :nums], [[1, [1]]], strategy: :unnest)
+      }.to raise_error(ArgumentError)
+    end
+  end
+end
@@ -0,0 +1,120 @@
+require "spec_helper"
+
+describe RDO::Postgres::Coalescer do
+  let(:coalescer) { RDO::Postgres::Coalescer.new }
+  let(:sql)       { "SELECT * FROM users WHERE id = ?" }
+  let(:calls)     { Queue.new }
+
+  def run(stmt, *args, &block)
+    coalescer.run(stmt, args) do
+      calls << args
+      block ? block.call : RDO::Result.new([{id: 1, name: "bob"}], count: 1)
+    end
+  end
+
+  # Start n threads running stmt, with the first holding the query open.
+  def concurrently(n, stmt, *args)
+    gate    = Queue.new
+    leader  = Thread.new { run(stmt, *args) { gate.pop; RDO::Result.new([{id: 1, name: "bob"}], count: 1) } }
+    sleep 0.05 until coalescer.size == 1
+    others  = (n - 1).times.map { Thread.new { run(stmt, *args) } }
+    sleep 0.1
+    gate << :go
+    [leader, *others].map(&:value)
+  end
+
+  it "runs identical concurrent queries once" do
+    results = concurrently(5, sql, 1)
+    calls.size.should == 1
+    results.map(&:to_a).uniq.should == [[{id: 1, name: "bob"}]]
+    coalescer.shared.should == 4
+  end
+
+  it "gives each caller its own Result" do
+    a, b = concurrently(2, sql, 1)
+    a.first.should_not equal(b.first)
+    a.first[:name].should be_frozen
+  end
+
+  it "keys by the encoded bind values" do
+    leader = Thread.new { run(sql, 1) { sleep 0.2; RDO::Result.new([], {}) } }
+    sleep 0.05
+    run(sql, 2)
+    leader.join
+    calls.size.should == 2
+  end
+
+  it "does not share the result of a query that has finished" do
+    run(sql, 1)
+    run(sql, 1)
+    calls.size.should == 2
+  end
+
+  it "runs the query for waiting callers if the first one fails" do
+    gate     = Queue.new
+    leader   = Thread.new { run(sql, 1) { gate.pop; raise RDO::Exception, "cancelled" } }
+    sleep 0.05 until coalescer.size == 1
+    follower = Thread.new { run(sql, 1) }
+    sleep 0.1
+    gate << :go
+
+    expect { leader.join }.to raise_error(RDO::Exception)
+    follower.value.to_a.should == [{id: 1, name: "bob"}]
+    calls.size.should == 2
+  end
+
+  it "does not join a query started before the caller's last write" do
+    gate   = Queue.new
+    leader = Thread.new { run(sql, 1) { gate.pop; RDO::Result.new([], {}) } }
+    sleep 0.05 until coalescer.size == 1
+    write  = coalescer.mark
+
+    coalescer.run(sql, [1], after: write) { calls << [1]; RDO::Result.new([], {}) }
+    gate << :go
+    leader.join
+    calls.size.should == 2
+  end
+
+  it "raises TimeoutError if the query waited on runs too long" do
+    gate   = Queue.new
+    leader = Thread.new { run(sql, 1) { gate.pop; RDO::Result.new([], {}) } }
+    sleep 0.05 until coalescer.size == 1
+
+    expect {
+      coalescer.run(sql, [1], timeout: 0.1) { raise "should wait" }
+    }.to raise_error(RDO::Postgres::TimeoutError)
+
+    gate << :go
+    leader.join
+  end
+
+  context "with the coalesce option" do
+    let(:options)     { URI.parse(connection_uri).tap{|u| u.query = [u.query, "coalesce=true"].compact.join("&")}.to_s }
+    let(:connections) { 4.times.map { RDO.connect(options) } }
+
+    after(:each) { connections.each { |c| c.close rescue nil } }
+
+    it "shares a Coalescer between connections to the same database" do
+      connections.map { |c| driver_for(c).coalescer }.uniq.size.should == 1
+    end
+
+    it "answers identical concurrent queries with one execution" do
+      coalescer = driver_for(connections.first).coalescer
+      before    = coalescer.shared
+
+      connections.map { |c|
+        Thread.new { c.execute("SELECT pg_sleep(0.3), ?::int AS n", 7).first_value }
+      }.map(&:value)
+
+      (coalescer.shared - before).should == 3
+    end
+
+    it "does not coalesce inside a transaction" do
+      c = connections.first
+      c.execute("BEGIN")
+      driver_for(c).should_not_receive(:execute_read)
+      c.execute("SELECT 1")
+      c.execute("ROLLBACK")
+    end
+  end
+end
@@ -0,0 +1,68 @@
+require "spec_helper"
+
+describe RDO::Postgres::Cursor do
+  let(:connection) { RDO.connect(connection_uri) }
+  let(:driver)     { driver_for(connection) }
+  let(:sql)        { "SELECT i AS id FROM generate_series(1, ?) AS i ORDER BY i" }
+
+  after(:each) { connection.close rescue nil }
+
+  def cursor(count, options = {})
+    described_class.new(driver, sql, [count], options)
+  end
+
+  it "yields every row in order" do
+    cursor(2500, batch_size: 1000).map { |row| row[:id] }.should == (1..2500).to_a
+  end
+
+  it "yields batches of batch_size rows" do
+    cursor(2500, batch_size: 1000).each_batch.map(&:count).should == [1000, 1000, 500]
+  end
+
+  it "yields nothing for an empty result" do
+    cursor(0).to_a.should == []
+  end
+
+  it "reads ahead several batches" do
+    cursor(5000, batch_size: 100, prefetch: 4).count.should == 5000
+  end
+
+  it "still reads one batch ahead within a tiny memory cap" do
+    cursor(1000, batch_size: 100, prefetch: 4, max_bytes: 1).count.should == 1000
+  end
+
+  it "runs in a transaction, which is closed afterwards" do
+    cursor(10).each_batch { driver.in_transaction?.should == true }
+    driver.in_transaction?.should == false
+  end
+
+  it "closes the transaction when iteration stops early" do
+    driver.cursor(sql, 10).first(1).map { |row| row[:id] }.should == [1]
+    driver.in_transaction?.should == false
+  end
+
+  it "rolls back the transaction when the block raises" do
+    expect { cursor(10).each { raise "stop" } }.to raise_error(RuntimeError)
+    driver.in_transaction?.should == false
+  end
+
+  it "leaves the connection usable when the block raises" do
+    expect {
+      cursor(5000, batch_size: 100, prefetch: 4).each_batch { raise "stop" }
+    }.to raise_error(RuntimeError)
+    connection.execute("SELECT 1 AS one").first_value.should == 1
+  end
+
+  it "raises query errors" do
+    expect {
+      described_class.new(driver, "SELECT 1 / (i - 150) FROM generate_series(1, 300) AS i", [],
+        batch_size: 100).to_a
+    }.to raise_error(RDO::Exception)
+  end
+
+  describe "Driver#cursor" do
+    it "uses the driver's bind parameters" do
+      driver.cursor(sql, 3).map { |row| row[:id] }.should == [1, 2, 3]
+    end
+  end
+end
@@ -1,5 +1,7 @@
 require "spec_helper"
 require "uri"
+require "tempfile"
+require "timeout"
 
 describe RDO::Postgres::Driver do
   let(:options)    { connection_uri }
@@ -31,6 +33,55 @@ describe RDO::Postgres::Driver do
     end
   end
 
+  describe "session settings" do
+    let(:options) do
+      URI.parse(connection_uri).tap{|u| u.query = "time_zone=America/New_York&settings=statement_timeout=5s,application_name=rdo_spec"}.to_s
+    end
+
+    it "applies the time zone" do
+      connection.execute("SHOW TimeZone").first_value.should == "America/New_York"
+    end
+
+    it "applies the settings" do
+      connection.execute("SHOW statement_timeout").first_value.should == "5s"
+      connection.execute("SHOW application_name").first_value.should == "rdo_spec"
+    end
+
+    it "applies the encoding" do
+      connection.execute("SHOW client_encoding").first_value.should == "UTF8"
+    end
+
+    context "sent after connecting" do
+      let(:options) do
+        URI.parse(connection_uri).tap{|u| u.query = "startup_settings=false&settings=statement_timeout=5s"}.to_s
+      end
+
+      it "applies the settings" do
+        connection.execute("SHOW statement_timeout").first_value.should == "5s"
+      end
+    end
+
+    context "with the system time zone" do
+      it "uses the local UTC offset" do
+        connection.execute("SELECT to_char(now(), 'TZH:TZM')").first_value.should ==
+          Time.now.strftime("%:z")
+      end
+    end
+
+    context "with no settings given" do
+      let(:options) { connection_uri }
+
+      it "sends the system time zone in the options startup parameter" do
+        driver_for(connection).send(:connect_db_string).should =~ /\boptions='-c TimeZone=/
+      end
+
+      it "sets the time zone" do
+        connection.execute("SELECT to_char(now(), 'TZH:TZM')").first_value.should ==
+          Time.now.strftime("%:z")
+      end
+    end
+  end
+
   describe "#close" do
     it "closes the connection to the database" do
       connection.close
@@ -67,6 +118,16 @@ describe RDO::Postgres::Driver do
         connection.should be_open
       end
     end
+
+    context "with a connect_timeout" do
+      let(:options) { "postgres://10.255.255.1/rdo?connect_timeout=1" }
+
+      it "raises a RDO::Exception in time" do
+        started = Time.now
+        expect { connection }.to raise_error(RDO::Exception)
+        (Time.now - started).should < 3
+      end
+    end
   end
 
   describe "#execute" do
@@ -236,6 +297,90 @@ describe RDO::Postgres::Driver do
     end
   end
 
+  describe "#execute_many" do
+    before(:each) do
+      connection.execute("DROP SCHEMA IF EXISTS rdo_test CASCADE")
+      connection.execute("CREATE SCHEMA rdo_test")
+      connection.execute("SET search_path = rdo_test")
+      connection.execute("CREATE TABLE users (id serial primary key, name text unique)")
+    end
+
+    after(:each) do
+      connection.execute("DROP SCHEMA IF EXISTS rdo_test CASCADE")
+    end
+
+    let(:driver)  { driver_for(connection) }
+    let(:results) do
+      driver.execute_many(
+        "INSERT INTO users (name) VALUES (?) RETURNING id",
+        [["bob"], ["barry"], ["sarah"]]
+      )
+    end
+
+    it "returns one RDO::Result per parameter set" do
+      results.map(&:class).uniq.should == [RDO::Result]
+      results.map(&:first_value).should == [1, 2, 3]
+    end
+
+    it "provides the #affected_rows for each set" do
+      results.map(&:affected_rows).should == [1, 1, 1]
+    end
+
+    context "with more sets than fit in one pipeline" do
+      let(:results) do
+        driver.execute_many(
+          "INSERT INTO users (name) VALUES (?)",
+          (1..1000).map{|n| ["user #{n}"]}
+        )
+      end
+
+      it "executes every set" do
+        results.size.should == 1000
+        connection.execute("SELECT count(*) FROM users").first_value.should == 1000
+      end
+    end
+
+    context "with a failing set" do
+      let(:results) do
+        driver.execute_many(
+          "INSERT INTO users (name) VALUES (?)",
+          [["bob"], ["bob"], ["barry"]]
+        )
+      end
+
+      it "raises a RDO::Exception" do
+        expect { results }.to raise_error(RDO::Exception, /parameter set 1/)
+      end
+
+      it "leaves the connection usable" do
+        results rescue nil
+        connection.execute("SELECT 42").first_value.should == 42
+      end
+
+      it "applies none of the sets" do
+        results rescue nil
+        connection.execute("SELECT count(*) FROM users").first_value.should == 0
+      end
+
+      it "aborts an enclosing transaction without ending it" do
+        connection.execute("BEGIN")
+        results rescue nil
+        driver.should be_in_transaction
+        connection.execute("ROLLBACK")
+      end
+    end
+
+    context "with the wrong number of parameters" do
+      let(:results) do
+        driver.execute_many("INSERT INTO users (name) VALUES (?)", [["bob"], []])
+      end
+
+      it "raises an ArgumentError" do
+        expect { results }.to raise_error(ArgumentError)
+      end
+    end
+  end
+
   describe "string encoding" do
     context "with utf-8" do
       let(:options) { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8"}.to_s }
@@ -265,6 +410,360 @@ describe RDO::Postgres::Driver do
     end
   end
 
+  describe "string interning" do
+    let(:sql) { "SELECT s, 'x' || n AS t FROM unnest(array['a', 'b', 'a', 'a']) s, generate_series(1, 2) n" }
+    let(:rows) { connection.execute(sql).to_a }
+    let(:as)   { rows.map{|r| r[:s]}.select{|s| s == "a"} }
+
+    context "when disabled" do
+      it "allocates a new String per value" do
+        as.first.should_not be_frozen
+        as.first.should_not equal(as.last)
+      end
+    end
+
+    context "when enabled" do
+      let(:options) { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8&intern_strings=true"}.to_s }
+
+      it "returns the same frozen String for equal values" do
+        as.first.should be_frozen
+        as.first.should equal(as.last)
+      end
+
+      it "keeps the connection encoding" do
+        rows[0][:s].encoding.should == Encoding.find("utf-8")
+      end
+
+      it "shares values across more distinct values than the table starts with" do
+        values = connection.execute("SELECT (n % 100)::text AS v FROM generate_series(1, 1000) n").map{|r| r[:v]}
+        values.map(&:object_id).uniq.size.should == 100
+      end
+    end
+
+    context "with a limit" do
+      let(:options) { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8&intern_strings=1"}.to_s }
+
+      it "falls back to new Strings once the column exceeds the limit" do
+        rows.first[:s].should be_frozen
+        rows.map{|r| r[:s]}.reject{|s| s == rows.first[:s]}.map(&:frozen?).uniq.should == [false]
+      end
+    end
+
+    context "restricted to columns" do
+      let(:options) { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8&intern_strings=true&intern_columns=t"}.to_s }
+
+      it "only interns the named columns" do
+        rows[0][:s].should_not be_frozen
+        rows[0][:t].should be_frozen
+      end
+    end
+  end
+
+  describe "consuming results" do
+    let(:options) { URI.parse(connection_uri).tap{|u| u.query = "consume_results=true"}.to_s }
+    let(:result)  { connection.execute("SELECT n, 'x' || n AS s FROM generate_series(1, 3) n") }
+
+    it "decodes all rows" do
+      result.to_a.should == [
+        {n: 1, s: "x1"},
+        {n: 2, s: "x2"},
+        {n: 3, s: "x3"}
+      ]
+    end
+
+    it "can be iterated more than once" do
+      result.to_a.should == result.to_a
+    end
+
+    context "for a write returning a value" do
+      before(:each) do
+        connection.execute("DROP TABLE IF EXISTS consumed")
+        connection.execute("CREATE TABLE consumed (id serial primary key, name text)")
+      end
+
+      after(:each) { connection.execute("DROP TABLE IF EXISTS consumed") rescue nil }
+
+      let(:result) do
+        connection.execute("INSERT INTO consumed (name) VALUES ('a'), ('b') RETURNING id")
+      end
+
+      it "provides the query info" do
+        result.info[:count].should == 2
+      end
+
+      it "provides the number of #affected_rows" do
+        result.affected_rows.should == 2
+      end
+
+      it "provides the #insert_id" do
+        result.insert_id.should == 1
+      end
+    end
+  end
+
+  describe "parallel decoding" do
+    let(:options) { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8&decode_threads=4"}.to_s }
+    let(:sql) do
+      "SELECT n::int8 AS i, n * 1.5::float8 AS f, n % 2 = 0 AS b, " +
+        "CASE WHEN n % 3 = 0 THEN NULL ELSE n END AS m " +
+        "FROM generate_series(1, 20000) n"
+    end
+    let(:serial) { RDO.connect(connection_uri) }
+
+    after(:each) { serial.close rescue nil }
+
+    it "returns the same values as decoding on one thread" do
+      connection.execute(sql).to_a.should == serial.execute(sql).to_a
+    end
+  end
+
+  describe "query cache" do
+    let(:options)  { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8&query_cache=true"}.to_s }
+    let(:notifier) { RDO.connect(connection_uri) }
+    let(:sql)      { "SELECT count(*) FROM rdo_cached" }
+
+    before(:each) do
+      notifier.execute("DROP TABLE IF EXISTS rdo_cached CASCADE")
+      notifier.execute("CREATE TABLE rdo_cached (id integer)")
+    end
+
+    after(:each) do
+      notifier.execute("DROP TABLE IF EXISTS rdo_cached CASCADE") rescue nil
+      notifier.close rescue nil
+    end
+
+    it "answers repeated reads from the cache" do
+      connection.execute(sql).first_value.should == 0
+      notifier.execute("INSERT INTO rdo_cached VALUES (1)")
+      connection.execute(sql).first_value.should == 0
+    end
+
+    it "invalidates on a NOTIFY naming the table" do
+      connection.execute(sql)
+      notifier.execute("INSERT INTO rdo_cached VALUES (1)")
+      notifier.execute("NOTIFY rdo_query_cache, 'rdo_cached'")
+      sleep 0.1
+      connection.execute(sql).first_value.should == 1
+    end
+
+    it "misses on an entry that is being hit once it is invalidated" do
+      3.times { connection.execute(sql) }
+      notifier.execute("INSERT INTO rdo_cached VALUES (1)")
+      notifier.execute("NOTIFY rdo_query_cache, ''")
+      sleep 0.1
+      connection.execute(sql).first_value.should == 1
+    end
+
+    it "invalidates reads through a view on writes to its table" do
+      notifier.execute("CREATE VIEW rdo_cached_view AS SELECT * FROM rdo_cached")
+      connection.execute("SELECT count(*) FROM rdo_cached_view").first_value.should == 0
+      connection.execute("INSERT INTO rdo_cached VALUES (1)")
+      connection.execute("SELECT count(*) FROM rdo_cached_view").first_value.should == 1
+    end
+
+    it "does not cache bytea chunks" do
+      notifier.execute("INSERT INTO rdo_cached VALUES (1)")
+      driver_for(connection).read_bytea("SELECT decode('0102', 'hex') FROM rdo_cached").read.should == "\x01\x02".b
+      driver_for(connection).query_cache.size.should == 0
+    end
+
+    it "invalidates on writes through the same connection" do
+      connection.execute(sql)
+      connection.execute("INSERT INTO rdo_cached VALUES (1)")
+      connection.execute(sql).first_value.should == 1
+    end
+
+    it "does not return invalidations as notifications" do
+      notifier.execute("NOTIFY rdo_query_cache, 'rdo_cached'")
+      driver_for(connection).wait_for_notify(0.2).should be_nil
+    end
+  end
+
+  describe "statement warmup" do
+    let(:manifest) do
+      Tempfile.new("warmup").tap do |f|
+        f.write("-- hot statements\nSELECT ?::integer + 1 AS n\n\nSELECT * FROM no_such_table\n")
+        f.flush
+      end
+    end
+    let(:options)  { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8&warmup=#{manifest.path}"}.to_s }
+    let(:driver)   { driver_for(connection) }
+    let(:prepared) do
+      connection.execute("SELECT statement FROM pg_prepared_statements").map { |r| r[:statement] }
+    end
+
+    after(:each) { manifest.close! }
+
+    it "prepares the manifest's statements when connecting" do
+      connection.open
+      prepared.should include("SELECT $1::integer + 1 AS n")
+    end
+
+    it "skips statements that fail to prepare" do
+      driver.instance_variable_get(:@statement_cache).keys.should == ["SELECT ?::integer + 1 AS n"]
+    end
+
+    it "executes warmed statements without preparing them again" do
+      connection.execute("SELECT ?::integer + 1 AS n", 41).first_value.should == 42
+      prepared.grep(/\+ 1 AS n/).size.should == 1
+    end
+
+    describe "#warm" do
+      it "returns the number of statements prepared" do
+        driver.warm(["SELECT 1", "SELECT 2", "SELECT 1", "SELECT bad syntax from"]).should == 2
+      end
+    end
+  end
+
+  describe "query timeouts" do
+    let(:options) { URI.parse(connection_uri).tap{|u| u.query = "encoding=utf-8&query_timeout=0.2"}.to_s }
+    let(:driver)  { driver_for(connection) }
+
+    it "cancels a query that runs too long" do
+      expect {
+        connection.execute("SELECT pg_sleep(5)")
+      }.to raise_error(RDO::Postgres::TimeoutError)
+    end
+
+    it "leaves the connection usable" do
+      connection.execute("SELECT pg_sleep(5)") rescue nil
+      connection.execute("SELECT 42 AS n").first_value.should == 42
+    end
+
+    it "does not block other threads" do
+      ticks  = 0
+      ticker = Thread.new { 10.times { sleep 0.01; ticks += 1 } }
+      connection.execute("SELECT pg_sleep(5)") rescue nil
+      ticker.join
+      ticks.should == 10
+    end
+
+    describe "#with_timeout" do
+      it "applies a different timeout inside the block" do
+        driver.with_timeout(5) do
+          connection.execute("SELECT pg_sleep(0.3)").count.should == 1
+        end
+      end
+
+      it "restores the previous timeout" do
+        driver.with_timeout(nil) { }
+        driver.query_timeout.should == 0.2
+      end
+    end
+  end
+
+  describe "interrupted queries" do
+    let(:driver) { driver_for(connection) }
+
+    it "cancels the query and leaves the connection usable" do
+      started = Time.now
+      expect {
+        Timeout.timeout(0.2) { connection.execute("SELECT pg_sleep(5)") }
+      }.to raise_error(Timeout::Error)
+      connection.execute("SELECT 42 AS n").first_value.should == 42
+      (Time.now - started).should < 2
+    end
+
+    it "cancels a prepared statement interrupted by Thread#raise" do
+      stmt   = connection.prepare("SELECT pg_sleep(?)")
+      thread = Thread.new { stmt.execute(5) }
+      sleep 0.2
+      thread.raise(Interrupt)
+      expect { thread.join }.to raise_error(Interrupt)
+      driver.in_transaction?.should == false
+      connection.execute("SELECT 42 AS n").first_value.should == 42
+    end
+  end
+
+  describe "reconnecting" do
+    let(:driver) { driver_for(connection) }
+    let(:killer) { RDO.connect(options) }
+
+    after(:each) { killer.close rescue nil }
+
+    def lose_connection
+      pid = connection.execute("SELECT pg_backend_pid()").first_value
+      killer.execute("SELECT pg_terminate_backend(?)", pid)
+      connection.execute("SELECT 1") rescue nil
+    end
+
+    it "reopens a connection lost outside a transaction" do
+      lose_connection
+      connection.execute("SELECT 42 AS n").first_value.should == 42
+    end
+
+    it "raises instead of reopening a connection lost inside a transaction" do
+      connection.execute("BEGIN")
+      lose_connection
+      expect {
+        connection.execute("SELECT 42 AS n")
+      }.to raise_error(RDO::Exception, /inside a transaction/)
+    end
+
+    it "refuses statements prepared before the connection was reopened" do
+      stmt = connection.prepare("SELECT 42 AS n")
+      driver.close
+      driver.open
+      stmt.should be_stale
+      expect { stmt.execute }.to raise_error(RDO::Exception, /since been closed/)
+    end
+  end
+
+  describe "LISTEN/NOTIFY" do
+    let(:driver)   { driver_for(connection) }
+    let(:notifier) { RDO.connect(options) }
+
+    before(:each) { driver.listen("rdo_test") }
+    after(:each)  { notifier.close rescue nil }
+
+    describe "#wait_for_notify" do
+      it "returns the channel, payload and backend pid" do
+        pid = notifier.execute("SELECT pg_backend_pid()").first_value
+        notifier.execute("NOTIFY rdo_test, 'hello'")
+        driver.wait_for_notify(5).should == {channel: "rdo_test", payload: "hello", pid: pid}
+      end
+
+      it "returns nil on timeout" do
+        driver.wait_for_notify(0.1).should be_nil
+      end
+
+      it "wakes up when a notification arrives while waiting" do
+        Thread.new { sleep 0.2; notifier.execute("NOTIFY rdo_test, 'later'") }
+        driver.wait_for_notify(5)[:payload].should == "later"
+      end
+
+      it "does not block other threads" do
+        ticks  = 0
+        ticker = Thread.new { 10.times { sleep 0.02; ticks += 1 } }
+        driver.wait_for_notify(0.5)
+        ticker.join
+        ticks.should == 10
+      end
+    end
+
+    describe "#notifications" do
+      it "returns an empty Array when nothing is pending" do
+        driver.notifications.should == []
+      end
+
+      it "drains all pending notifications" do
+        notifier.execute("NOTIFY rdo_test, 'a'")
+        notifier.execute("NOTIFY rdo_test, 'b'")
+        sleep 0.1
+        driver.notifications.map{|n| n[:payload]}.should == ["a", "b"]
+        driver.notifications.should == []
+      end
+    end
+
+    describe "#unlisten" do
+      it "stops delivery on the channel" do
+        driver.unlisten("rdo_test")
+        notifier.execute("NOTIFY rdo_test, 'ignored'")
+        driver.wait_for_notify(0.2).should be_nil
+      end
+    end
+  end
+
   describe "#quote" do
     it "quotes a string literal for insertion into the SQL" do
       connection.quote("what's this?").should == "what''s this?"
@@ -281,5 +780,71 @@ describe RDO::Postgres::Driver do
       stmt.execute(4, 7).first_value.should == 11
       stmt.execute(5, 22).first_value.should == 27
     end
+
+    context "when statements are garbage collected" do
+      let(:prepared) do
+        connection.execute("SELECT count(*) FROM pg_prepared_statements").first_value
+      end
+
+      it "deallocates them in batches" do
+        200.times { connection.prepare("SELECT 1") }
+        GC.start
+        prepared.should < 100
+      end
+    end
+
+    context "after reconnecting" do
+      it "does not deallocate statements from the new connection" do
+        connection.prepare("SELECT 1")
+        connection.close && connection.open
+        stmt = connection.prepare("SELECT 42")
+        GC.start
+        20.times { connection.prepare("SELECT 1") }
+        stmt.execute.first_value.should == 42
+      end
+    end
+
+    context "when deferred" do
+      let(:driver) { driver_for(connection) }
+
+      it "prepares on the first execution" do
+        stmt = driver.prepare("SELECT ?::integer + ?", true)
+        stmt.execute(4, 7).first_value.should == 11
+        stmt.execute(5, 22).first_value.should == 27
+      end
+
+      it "encodes typed parameters once described" do
+        stmt = driver.prepare("SELECT ?::bytea AS b, ?::integer[] AS a", true)
+        row  = stmt.execute("\x00\x01", [1, 2]).first
+        row[:b].should == "\x00\x01"
+        row[:a].should == [1, 2]
+      end
+
+      it "encodes binary Strings as bytea on the first execution" do
+        connection.execute("CREATE TEMP TABLE salts (salt bytea)")
+        stmt = driver.prepare("INSERT INTO salts (salt) VALUES (?) RETURNING salt", true)
+        stmt.execute("\xff\xfe".b).first_value.should == "\xff\xfe".b
+      end
+
+      it "raises an RDO::Exception for a bad query" do
+        stmt = driver.prepare("SELECT * FROM bad_table", true)
+        expect { stmt.execute }.to raise_error(RDO::Exception)
+      end
+
+      it "raises an ArgumentError for the wrong number of parameters" do
+        stmt = driver.prepare("SELECT ?::integer", true)
+        expect { stmt.execute(1, 2) }.to raise_error(ArgumentError)
+      end
+    end
+
+    describe "#columns" do
+      it "describes the result columns" do
+        stmt = driver_for(connection).prepare("SELECT 1::integer AS a, 'x'::text AS b")
+        stmt.columns.should == [
+          {name: :a, type: 23, format: :text},
+          {name: :b, type: 25, format: :text}
+        ]
+      end
+    end
   end
 end
@@ -0,0 +1,80 @@
+require "spec_helper"
+
+describe RDO::Postgres::ExplainSampler do
+  let(:connection) { RDO.connect(connection_uri) }
+  let(:driver)     { driver_for(connection) }
+  let(:events)     { Queue.new }
+
+  after(:each) do
+    driver.explain_to(nil) rescue nil
+    connection.close rescue nil
+  end
+
+  context "with a threshold" do
+    before(:each) { driver.explain_to(events.method(:<<), threshold: 0.2) }
+
+    it "explains statements slower than the threshold" do
+      connection.execute("SELECT pg_sleep(0.3), ?::int AS n", 42)
+      event = events.pop
+      event[:reason].should == :slow
+      event[:sql].should == "SELECT pg_sleep(0.3), ?::int AS n"
+      event[:params].should == [42]
+      event[:duration].should >= 0.3
+      event[:plan].first.should have_key("Plan")
+    end
+
+    it "accepts a block as the sink" do
+      driver.explain_to(threshold: 0.2) { |event| events << event }
+      connection.execute("SELECT pg_sleep(0.3)")
+      events.pop[:reason].should == :slow
+    end
+
+    it "ignores faster statements" do
+      connection.execute("SELECT 1")
+      sleep 0.2
+      events.should be_empty
+    end
+  end
+
+  context "with a sample rate" do
+    before(:each) { driver.explain_to(events.method(:<<), sample: 1) }
+
+    it "explains sampled statements" do
+      connection.execute("SELECT 1 AS one")
+      events.pop[:reason].should == :sampled
+    end
+
+    it "skips statements that cannot be explained" do
+      connection.execute("SET search_path TO public")
+      connection.execute("SELECT 1 AS one")
+      events.pop[:sql].should == "SELECT 1 AS one"
+    end
+
+    it "stops its thread when the driver is closed" do
+      connection.execute("SELECT 1 AS one")
+      events.pop
+      threads = Thread.list.size
+      connection.close
+      Thread.list.size.should == threads - 1
+    end
+
+    it "passes errors to the sink" do
+      connection.execute("CREATE TEMP TABLE rdo_explain_tmp (id int)")
+      connection.execute("SELECT * FROM rdo_explain_tmp")
+      events.pop[:error].should be_a(RDO::Exception)
+    end
+  end
+
+  describe "#fingerprint" do
+    let(:sampler) { described_class.new({}, proc {}) }
+
+    it "ignores literals, whitespace and case" do
+      sampler.fingerprint("SELECT * FROM t WHERE id = 5 AND n = 'a'").should ==
+        sampler.fingerprint("select *\n  from t where id = 7 and n = 'it''s'")
+    end
+
+    it "distinguishes different statements" do
+      sampler.fingerprint("SELECT a FROM t").should_not == sampler.fingerprint("SELECT b FROM t")
+    end
+  end
+end
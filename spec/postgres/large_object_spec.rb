@@ -0,0 +1,89 @@
+require "spec_helper"
+require "stringio"
+
+describe RDO::Postgres::Driver, "streaming binary data" do
+  let(:connection) { RDO.connect(connection_uri) }
+  let(:driver)     { driver_for(connection) }
+  let(:data)       { (0..255).map(&:chr).join.force_encoding("binary") * 100 }
+
+  after(:each) { connection.close rescue nil }
+
+  describe "#large_object" do
+    let(:oid) { driver.lo_create }
+
+    after(:each) { driver.lo_unlink(oid) rescue nil }
+
+    it "writes and reads back the data" do
+      driver.large_object(oid, "w") { |lo| lo.write(data) }
+      driver.large_object(oid) { |lo| lo.read }.should == data
+    end
+
+    it "returns nil when reading at the end" do
+      driver.large_object(oid, "w") { |lo| lo.write("abc") }
+      driver.large_object(oid) { |lo| [lo.read(2), lo.read(2), lo.read(2)] }.should == ["ab", "c", nil]
+    end
+
+    it "supports seek and tell" do
+      driver.large_object(oid, "w") { |lo| lo.write(data) }
+      driver.large_object(oid) do |lo|
+        lo.seek(-10, IO::SEEK_END)
+        [lo.tell, lo.read(10)]
+      end.should == [data.bytesize - 10, data[-10, 10]]
+    end
+
+    it "supports truncate" do
+      driver.large_object(oid, "rw") do |lo|
+        lo.write(data)
+        lo.truncate(5)
+        lo.seek(0)
+        lo.read
+      end.should == data[0, 5]
+    end
+
+    it "works with IO.copy_stream" do
+      driver.large_object(oid, "w") { |lo| IO.copy_stream(StringIO.new(data), lo) }
+      out = StringIO.new("".force_encoding("binary"))
+      driver.large_object(oid) { |lo| IO.copy_stream(lo, out) }
+      out.string.should == data
+    end
+
+    it "closes the object after the block" do
+      driver.large_object(oid) { |lo| lo }.should be_closed
+    end
+
+    it "commits the transaction it opens" do
+      driver.large_object(oid, "w") { |lo| lo.write("abc") }
+      driver.should_not be_in_transaction
+    end
+
+    context "without a transaction" do
+      it "raises an RDO::Exception" do
+        expect { driver.lo_open(oid) }.to raise_error(RDO::Exception)
+      end
+    end
+  end
+
+  describe "#read_bytea" do
+    let(:reader) { driver.read_bytea("SELECT decode(?, 'hex')", data.unpack("H*").first) }
+
+    it "knows the size of the value" do
+      reader.size.should == data.bytesize
+    end
+
+    it "reads the whole value" do
+      reader.read.should == data
+    end
+
+    it "reads in chunks" do
+      reader = RDO::Postgres::ByteaReader.new(
+        driver, "SELECT decode($1, 'hex')", [data.unpack("H*").first], 1000
+      )
+      reader.each_chunk.map(&:bytesize).should == [1000] * 25 + [600]
+    end
+
+    it "returns nil when reading at the end" do
+      reader.read
+      reader.read(10).should be_nil
+    end
+  end
+end
@@ -0,0 +1,94 @@
+require "spec_helper"
+
+describe RDO::Postgres::QueryCache do
+  let(:cache)   { RDO::Postgres::QueryCache.new(options) }
+  let(:options) { {} }
+  let(:sql)     { "SELECT * FROM users JOIN public.roles ON true WHERE id = ?" }
+  let(:calls)   { [] }
+
+  def fetch(stmt, *args)
+    cache.fetch(stmt, args) do
+      calls << args
+      RDO::Result.new([{id: 1, name: "bob"}], count: 1)
+    end
+  end
+
+  it "returns the result on a miss" do
+    fetch(sql, 1).to_a.should == [{id: 1, name: "bob"}]
+  end
+
+  it "returns the cached result on a hit" do
+    fetch(sql, 1)
+    fetch(sql, 1).to_a.should == [{id: 1, name: "bob"}]
+    calls.size.should == 1
+  end
+
+  it "keys by the encoded bind values" do
+    fetch(sql, 1)
+    fetch(sql, "1")
+    fetch(sql, 2)
+    calls.size.should == 2
+  end
+
+  it "freezes cached Strings" do
+    fetch(sql, 1).first[:name].should be_frozen
+  end
+
+  it "does not cache statements reading no table" do
+    fetch("SELECT ?::int AS id", 1)
+    fetch("SELECT ?::int AS id", 1)
+    calls.size.should == 2
+  end
+
+  it "does not cache statements calling volatile functions" do
+    fetch("SELECT *, now() FROM users WHERE id = ?", 1)
+    fetch("SELECT * FROM users WHERE id = ? AND random() < 0.5", 1)
+    cache.size.should == 0
+  end
+
+  context "with a view resolver" do
+    let(:options) { {views: lambda { |tables| tables + ["accounts"] }} }
+
+    it "drops entries when a table behind a view changes" do
+      fetch(sql, 1)
+      cache.invalidate("accounts")
+      cache.size.should == 0
+    end
+  end
+
+  describe "#invalidate" do
+    it "drops entries reading from the table" do
+      fetch(sql, 1)
+      cache.invalidate("roles")
+      fetch(sql, 1)
+      calls.size.should == 2
+    end
+
+    it "keeps other entries" do
+      fetch(sql, 1)
+      cache.invalidate("accounts")
+      cache.size.should == 1
+    end
+  end
+
+  context "with a TTL" do
+    let(:options) { {ttl: 0.05} }
+
+    it "expires entries" do
+      fetch(sql, 1)
+      sleep 0.1
+      fetch(sql, 1)
+      calls.size.should == 2
+    end
+  end
+
+  context "with a memory cap" do
+    let(:options) { {max_bytes: 1024} }
+
+    it "evicts the least recently used entries" do
+      50.times { |i| fetch(sql, i) }
+      cache.bytes.should <= 1024
+      cache.size.should < 50
+    end
+  end
+end
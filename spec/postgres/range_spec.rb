@@ -0,0 +1,40 @@
+require "spec_helper"
+
+describe RDO::Postgres::Range do
+  describe "#to_s" do
+    it "formats inclusive and exclusive bounds" do
+      RDO::Postgres::Range.new(1, 5, true).to_s.should == "[1,5)"
+      RDO::Postgres::Range.new(1.5, 2.5, false, true).to_s.should == "(1.5,2.5]"
+    end
+
+    it "leaves infinite bounds empty" do
+      RDO::Postgres::Range.new(nil, 3).to_s.should == "(,3]"
+    end
+
+    it "quotes bounds containing special characters" do
+      RDO::Postgres::Range.new("a b", 'c"d', true).to_s.should == %q{["a b","c\"d")}
+    end
+
+    it "formats the empty range" do
+      RDO::Postgres::Range.empty.to_s.should == "empty"
+    end
+  end
+
+  describe "#==" do
+    it "compares the exclusion of the lower bound" do
+      RDO::Postgres::Range.new(1, 5, true).should == (1...5)
+      RDO::Postgres::Range.new(1, 5, true, true).should_not == (1...5)
+    end
+  end
+
+  context "used as a bind parameter" do
+    let(:connection) { RDO.connect(connection_uri) }
+    after(:each) { connection.close rescue nil }
+
+    it "is sent in range notation" do
+      connection.execute(
+        "SELECT ?::int4range @> 4 AS c", RDO::Postgres::Range.new(1, 5, true)
+      ).first_value.should be_true
+    end
+  end
+end
@@ -0,0 +1,127 @@
+require "spec_helper"
+
+# The server must run with wal_level = logical, and the test user must have
+# the REPLICATION attribute.
+describe RDO::Postgres::ReplicationStream do
+  let(:connection)  { RDO.connect(connection_uri) }
+  let(:replication) { RDO.connect(connection_uri + "&replication=true") }
+  let(:driver)      { driver_for(replication) }
+  let(:slot)        { "rdo_spec_#{Process.pid}" }
+
+  before(:each) do
+    connection.execute("DROP TABLE IF EXISTS replicated")
+    connection.execute("CREATE TABLE replicated (id integer PRIMARY KEY, name text, born date)")
+    connection.execute("ALTER TABLE replicated REPLICA IDENTITY FULL")
+  end
+
+  after(:each) do
+    replication.close rescue nil
+    connection.close rescue nil
+  end
+
+  # Changes up to and including the commit of the last transaction.
+  def changes(stream, commits = 1)
+    [].tap do |events|
+      stream.each do |event|
+        events << event
+        stream.stop if event[:type] == :commit && (commits -= 1).zero?
+      end
+    end
+  end
+
+  describe "with test_decoding" do
+    let(:stream) { driver.replication_stream(slot, plugin: :test_decoding) }
+
+    before(:each) { stream.create_slot(temporary: true) }
+
+    it "yields the changes of a transaction between begin and commit" do
+      connection.execute("INSERT INTO replicated VALUES (1, 'O''Brien', '2000-01-02')")
+      changes(stream).map { |e| e[:type] }.should == [:begin, :insert, :commit]
+    end
+
+    it "casts inserted values" do
+      connection.execute("INSERT INTO replicated VALUES (1, 'O''Brien', '2000-01-02')")
+      insert = changes(stream)[1]
+      insert[:table].should == "replicated"
+      insert[:new].should == { id: 1, name: "O'Brien", born: Date.new(2000, 1, 2) }
+    end
+
+    it "yields old and new rows of updates" do
+      connection.execute("INSERT INTO replicated VALUES (1, 'bob', NULL)")
+      connection.execute("UPDATE replicated SET id = 2")
+      update = changes(stream, 2)[4]
+      update[:type].should == :update
+      update[:old].should == { id: 1, name: "bob", born: nil }
+      update[:new].should == { id: 2, name: "bob", born: nil }
+    end
+
+    it "acknowledges each transaction once its commit is yielded" do
+      connection.execute("INSERT INTO replicated VALUES (1, 'bob', NULL)")
+      commit = changes(stream).last
+      stream.flushed_lsn.should == commit[:lsn]
+    end
+
+    it "leaves the connection usable afterwards" do
+      connection.execute("INSERT INTO replicated VALUES (1, 'bob', NULL)")
+      changes(stream)
+      driver.execute_script("IDENTIFY_SYSTEM").count.should == 1
+    end
+
+    it "keeps reading when a status update falls due just before a read" do
+      late  = driver.replication_stream(slot, plugin: :test_decoding, status_interval: 0.5)
+      clock = 0.0
+      late.define_singleton_method(:now) { clock += 1 }
+      connection.execute("INSERT INTO replicated VALUES (1, 'bob', NULL)")
+      changes(late).map { |e| e[:type] }.should == [:begin, :insert, :commit]
+    end
+  end
+
+  describe "with pgoutput" do
+    let(:stream) { driver.replication_stream(slot, publications: ["rdo_spec"], messages: true) }
+
+    before(:each) do
+      connection.execute("DROP PUBLICATION IF EXISTS rdo_spec")
+      connection.execute("CREATE PUBLICATION rdo_spec FOR TABLE replicated")
+      stream.create_slot(temporary: true)
+    end
+
+    it "decodes row changes" do
+      connection.execute("INSERT INTO replicated VALUES (1, 'bob', '2000-01-02')")
+      connection.execute("DELETE FROM replicated")
+      events = changes(stream, 2)
+      events.map { |e| e[:type] }.should == [:begin, :insert, :commit, :begin, :delete, :commit]
+      events[1].values_at(:schema, :table, :new).should ==
+        ["public", "replicated", { id: 1, name: "bob", born: Date.new(2000, 1, 2) }]
+      events[4][:old].should == { id: 1, name: "bob", born: Date.new(2000, 1, 2) }
+    end
+
+    it "decodes logical messages" do
+      connection.execute("SELECT pg_logical_emit_message(false, 'rdo', 'hello')")
+      connection.execute("INSERT INTO replicated VALUES (1, 'bob', NULL)")
+      message = changes(stream).find { |e| e[:type] == :message }
+      message.values_at(:prefix, :content).should == ["rdo", "hello"]
+    end
+
+    it "acknowledges the end of each commit" do
+      connection.execute("INSERT INTO replicated VALUES (1, 'bob', NULL)")
+      commit = changes(stream).last
+      stream.flushed_lsn.should == commit[:end_lsn]
+    end
+  end
+
+  describe ".parse_lsn" do
+    it "converts the text form to an Integer" do
+      described_class.parse_lsn("16/B374D848").should == 0x16B374D848
+    end
+  end
+
+  describe ".format_lsn" do
+    it "formats an Integer as PostgreSQL does" do
+      described_class.format_lsn(0x16B374D848).should == "16/B374D848"
+    end
+  end
+
+  it "requires publications for pgoutput" do
+    expect { described_class.new(driver, slot) }.to raise_error(ArgumentError)
+  end
+end
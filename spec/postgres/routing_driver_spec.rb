@@ -0,0 +1,144 @@
+require "spec_helper"
+require "uri"
+
+# Set REPLICAS to "host:port,..." to run against real streaming replicas.
+# By default the primary is also listed as each replica, which still gives
+# every replica a connection of its own.
+describe RDO::Postgres::RoutingDriver do
+  let(:uri)      { URI.parse(connection_uri) }
+  let(:replicas) { ENV["REPLICAS"] || "#{uri.host}:#{uri.port || 5432},#{uri.host}:#{uri.port || 5432}" }
+  let(:query)    { "replicas=#{replicas}&#{extra}&#{uri.query}" }
+  let(:extra)    { "sticky_window=0" }
+  let(:options)  { uri.dup.tap{|u| u.scheme = "postgres+routing"; u.query = query}.to_s }
+
+  let(:connection)   { RDO.connect(options) }
+  let(:router)       { driver_for(connection) }
+  let(:primary_pid)  { router.primary.execute("SELECT pg_backend_pid()").first_value }
+  let(:replica_pids) { router.replicas.map{|r| r.execute("SELECT pg_backend_pid()").first_value} }
+
+  def backend
+    connection.execute("SELECT pg_backend_pid()").first_value
+  end
+
+  after(:each) { connection.close rescue nil }
+
+  describe "#read_only?" do
+    it "accepts a SELECT" do
+      router.read_only?("SELECT * FROM users").should be_true
+    end
+
+    it "skips leading comments" do
+      router.read_only?("-- users\n/* all */ SELECT * FROM users").should be_true
+    end
+
+    it "rejects an INSERT" do
+      router.read_only?("INSERT INTO users (name) VALUES ('bob')").should be_false
+    end
+
+    it "rejects a SELECT ... FOR UPDATE" do
+      router.read_only?("SELECT * FROM users FOR UPDATE").should be_false
+    end
+
+    it "rejects a CTE that writes" do
+      router.read_only?("WITH d AS (DELETE FROM users RETURNING *) SELECT * FROM d").should be_false
+    end
+
+    it "rejects a /* primary */ hint" do
+      router.read_only?("/* primary */ SELECT * FROM users").should be_false
+    end
+  end
+
+  describe "#execute" do
+    it "sends reads to the replicas" do
+      replica_pids.should include(backend)
+    end
+
+    it "round robins across the replicas" do
+      4.times.map { backend }.uniq.sort.should == replica_pids.sort
+    end
+
+    it "sends writes to the primary" do
+      connection.execute("CREATE TEMP TABLE routed (id integer)")
+      router.primary.execute("SELECT count(*) FROM routed").first_value.should == 0
+    end
+
+    context "inside a transaction" do
+      it "sends reads to the primary" do
+        connection.execute("BEGIN")
+        backend.should == primary_pid
+        connection.execute("COMMIT")
+      end
+    end
+
+    context "after a write" do
+      let(:extra) { "sticky_window=60" }
+
+      it "sends reads to the primary within the window" do
+        connection.execute("SET application_name = 'rdo_spec'")
+        backend.should == primary_pid
+      end
+    end
+
+    context "balancing by least outstanding" do
+      let(:extra) { "sticky_window=0&balance=least_outstanding" }
+
+      it "uses every replica" do
+        4.times.map { backend }.uniq.sort.should == replica_pids.sort
+      end
+    end
+  end
+
+  describe "from several threads" do
+    it "never runs two reads on one replica at once" do
+      busy    = Hash.new(0)
+      overlap = false
+      lock    = Mutex.new
+
+      router.replicas.each do |replica|
+        replica.define_singleton_method(:execute) do |*args|
+          lock.synchronize { overlap ||= (busy[self] += 1) > 1 }
+          begin
+            super(*args)
+          ensure
+            lock.synchronize { busy[self] -= 1 }
+          end
+        end
+      end
+
+      8.times.map {
+        Thread.new { connection.execute("SELECT pg_sleep(0.1)") }
+      }.each(&:join)
+
+      overlap.should be_false
+    end
+
+    it "times out waiting for a free replica" do
+      router.query_timeout = 0.2
+      threads = 6.times.map {
+        Thread.new do
+          begin
+            connection.execute("SELECT pg_sleep(0.15)")
+            :ok
+          rescue RDO::Postgres::TimeoutError
+            :timeout
+          end
+        end
+      }
+      threads.map(&:value).should include(:timeout)
+    end
+  end
+
+  describe "#prepare" do
+    it "routes each execution" do
+      stmt = connection.prepare("SELECT pg_backend_pid() + ?")
+      replica_pids.map{|pid| pid + 1}.should include(stmt.execute(1).first_value)
+    end
+
+    it "prepares again on a replica that has reconnected" do
+      stmt = connection.prepare("SELECT 40 + ?")
+      stmt.execute(1)
+      router.replicas.each { |r| r.close; r.open }
+      stmt.execute(2).first_value.should == 42
+    end
+  end
+end
@@ -0,0 +1,132 @@
+require "spec_helper"
+require "uri"
+
+# Set SHARDS to "host:port/database,..." to run against separate instances.
+# By default the test database is listed three times, and each shard keeps
+# its rows in a temporary table, which only its own connection can see.
+describe RDO::Postgres::ShardingDriver do
+  let(:uri)     { URI.parse(connection_uri) }
+  let(:target)  { "#{uri.host}:#{uri.port || 5432}#{uri.path}" }
+  let(:shards)  { ENV["SHARDS"] || ([target] * 3).join(",") }
+  let(:extra)   { "strategy=hash" }
+  let(:options) do
+    uri.dup.tap { |u| u.scheme = "postgres+sharding"; u.query = "shards=#{shards}&#{extra}&#{uri.query}" }.to_s
+  end
+
+  let(:connection) { RDO.connect(options) }
+  let(:sharded)    { driver_for(connection) }
+
+  before(:each) do
+    sharded.shards.each_with_index do |shard, i|
+      shard.execute("CREATE TEMP TABLE events (id integer, shard integer)")
+      shard.execute("INSERT INTO events SELECT n, ? FROM generate_series(?, 30, 3) n", i, i)
+    end
+  end
+
+  after(:each) { connection.close rescue nil }
+
+  describe "#shard" do
+    it "returns the same shard for the same key" do
+      sharded.shard("tenant-1").should equal(sharded.shard("tenant-1"))
+    end
+
+    it "spreads keys across every shard" do
+      (1..300).map { |k| sharded.shard(k) }.uniq.size.should == 3
+    end
+
+    context "with the range strategy" do
+      let(:extra) { "strategy=range&ranges=100,200" }
+
+      it "maps keys below the first bound to the first shard" do
+        sharded.shard(99).should equal(sharded.shards[0])
+      end
+
+      it "maps each bound to the shard it starts" do
+        sharded.shard(100).should equal(sharded.shards[1])
+        sharded.shard(200).should equal(sharded.shards[2])
+      end
+    end
+  end
+
+  describe "#execute_on" do
+    it "runs on the key's shard" do
+      shard = sharded.shards.index(sharded.shard("tenant-1"))
+      sharded.execute_on("tenant-1", "SELECT DISTINCT shard FROM events").first_value.should == shard
+    end
+  end
+
+  describe "#execute" do
+    it "returns the rows of every shard" do
+      connection.execute("SELECT id FROM events").count.should == 31
+    end
+
+    it "runs on the shards concurrently" do
+      started = Time.now
+      connection.execute("SELECT pg_sleep(0.3)")
+      (Time.now - started).should < 0.6
+    end
+
+    it "sums the row counts" do
+      connection.execute("SELECT id FROM events").info[:count].should == 31
+    end
+
+    it "refuses writes without a shard key" do
+      expect {
+        connection.execute("UPDATE events SET id = id")
+      }.to raise_error(RDO::Exception)
+      sharded.shards.map { |s| s.execute("SELECT id FROM events").count }.inject(:+).should == 31
+    end
+
+    it "raises if any shard fails" do
+      expect {
+        connection.execute("SELECT 1 / (shard - 1) FROM events")
+      }.to raise_error(RDO::Exception)
+    end
+  end
+
+  describe "#fan_out" do
+    it "runs writes on every shard" do
+      sharded.fan_out("UPDATE events SET id = id").map(&:affected_rows).inject(:+).should == 31
+    end
+  end
+
+  describe "#merge" do
+    it "yields the rows of every shard in order" do
+      sharded.merge(:id, "SELECT id FROM events ORDER BY id").map { |r| r[:id] }.should == (0..30).to_a
+    end
+
+    it "merges descending orders" do
+      sharded.merge({id: :desc}, "SELECT id FROM events ORDER BY id DESC").map { |r| r[:id] }.should ==
+        (0..30).to_a.reverse
+    end
+
+    it "leaves the shards usable when stopped early" do
+      sharded.merge(:id, "SELECT id FROM events ORDER BY id").first(2).map { |r| r[:id] }.should == [0, 1]
+      connection.execute("SELECT id FROM events").count.should == 31
+    end
+
+    it "closes each shard's transaction when stopped early" do
+      sharded.merge(:id, "SELECT id FROM events ORDER BY id").first(2)
+      sharded.shards.map(&:in_transaction?).should == [false, false, false]
+    end
+  end
+
+  describe "#prepare" do
+    it "executes on every shard" do
+      connection.prepare("SELECT id FROM events WHERE id < ?").execute(6).count.should == 6
+    end
+
+    it "prepares again on a shard that has reconnected" do
+      stmt = connection.prepare("SELECT ? + 1 AS n")
+      stmt.execute(1)
+      sharded.shards.each { |s| s.close; s.open }
+      stmt.execute(41).map{|r| r[:n]}.should == [42] * sharded.shards.size
+    end
+
+    it "refuses writes" do
+      expect {
+        connection.prepare("DELETE FROM events").execute
+      }.to raise_error(RDO::Exception)
+    end
+  end
+end
@@ -0,0 +1,123 @@
+require "spec_helper"
+
+describe RDO::Postgres::Driver, "simple query mode" do
+  let(:options)    { URI.parse(connection_uri).tap{|u| u.query = "simple_query=true"}.to_s }
+  let(:connection) { RDO.connect(options) }
+  let(:driver)     { driver_for(connection) }
+
+  after(:each) { connection.close rescue nil }
+
+  it "does not prepare statements" do
+    connection.execute("SELECT ?::int AS n", 42).first_value.should == 42
+    connection.execute("SELECT count(*) FROM pg_prepared_statements").first_value.should == 0
+  end
+
+  it "quotes strings" do
+    connection.execute("SELECT ?::text AS s", "it's a \\ test").first_value.should == "it's a \\ test"
+  end
+
+  it "sends nil as NULL" do
+    connection.execute("SELECT ?::text IS NULL AS b", nil).first_value.should == true
+  end
+
+  it "lets the server infer types" do
+    connection.execute("SELECT ? + 1 AS n", 41).first_value.should == 42
+  end
+
+  it "sends arrays" do
+    connection.execute("SELECT ?::int[] AS a", [1, nil, 3]).first_value.should == [1, nil, 3]
+  end
+
+  it "sends Bytea values as bytea" do
+    value = RDO::Postgres::Bytea.new("\x00\x01\xff")
+    connection.execute("SELECT ?::bytea AS b", value).first_value.should == "\x00\x01\xff".b
+  end
+
+  it "sends binary strings that are valid text as text" do
+    connection.execute("SELECT ?::text AS s", "caf\xc3\xa9".b).first_value.should == "café"
+  end
+
+  it "raises for binary strings that are not valid text" do
+    expect {
+      connection.execute("SELECT ?::bytea AS b", "\xff\xfe".b)
+    }.to raise_error(ArgumentError)
+  end
+
+  it "leaves markers in strings, identifiers and comments alone" do
+    connection.execute("SELECT '?' AS \"?\" -- ?").first_value.should == "?"
+  end
+
+  it "raises on a bind parameter count mismatch" do
+    expect {
+      connection.execute("SELECT ? AS a", 1, 2)
+    }.to raise_error(ArgumentError)
+  end
+
+  it "raises on strings containing NUL" do
+    expect {
+      connection.execute("SELECT ?::text AS s", "a\0b")
+    }.to raise_error(ArgumentError)
+  end
+
+  describe "prepared statements" do
+    let(:prepared) { connection.execute("SELECT count(*) FROM pg_prepared_statements").first_value }
+
+    it "executes without preparing" do
+      connection.prepare("SELECT ?::int AS n").execute(42).first_value.should == 42
+      driver.prepare_cached("SELECT ?::int AS n").execute(7).first_value.should == 7
+      prepared.should == 0
+    end
+
+    it "runs execute_many and insert_many without preparing" do
+      connection.execute("CREATE TEMP TABLE simple_rows (n int)")
+      driver.execute_many("INSERT INTO simple_rows VALUES (?)", [[1], [2]]).size.should == 2
+      driver.insert_many(:simple_rows, [:n], [[3], [4]]).should == 2
+      connection.execute("SELECT sum(n) AS n FROM simple_rows").first_value.should == 10
+      prepared.should == 0
+    end
+
+    it "raises for execute_spooled" do
+      expect {
+        driver.execute_spooled("SELECT 1")
+      }.to raise_error(RDO::Exception)
+    end
+  end
+end
+
+describe RDO::Postgres::Driver, "#execute_script" do
+  let(:connection) { RDO.connect(connection_uri) }
+  let(:driver)     { driver_for(connection) }
+
+  after(:each) { connection.close rescue nil }
+
+  it "runs every statement, returning the last result" do
+    driver.execute_script(
+      "CREATE TEMP TABLE rdo_script (n int); INSERT INTO rdo_script VALUES (?), (?); " \
+      "SELECT sum(n) AS n FROM rdo_script", 1, 2
+    ).first_value.should == 3
+  end
+
+  it "raises on errors" do
+    expect {
+      driver.execute_script("SELECT 1; SELECT * FROM rdo_missing_table")
+    }.to raise_error(RDO::Exception)
+  end
+end
+
+describe RDO::Postgres::Driver, "#quote" do
+  let(:connection) { RDO.connect(connection_uri) }
+
+  after(:each) { connection.close rescue nil }
+
+  it "escapes quotes" do
+    connection.quote("it's").should == "it''s"
+  end
+
+  it "keeps the encoding" do
+    connection.quote("日本").encoding.should == Encoding::UTF_8
+  end
+
+  it "raises on NUL rather than truncating" do
+    expect { connection.quote("a\0b") }.to raise_error(ArgumentError)
+  end
+end
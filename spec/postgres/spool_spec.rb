@@ -0,0 +1,82 @@
+require "spec_helper"
+
+describe RDO::Postgres::Driver, "#execute_spooled" do
+  let(:options)    { connection_uri }
+  let(:connection) { RDO.connect(options) }
+  let(:driver)     { driver_for(connection) }
+  let(:sql) do
+    "SELECT i AS id, repeat('x', 100) AS pad, NULLIF(i % 2, 1) AS even " \
+    "FROM generate_series(1, ?) AS i"
+  end
+
+  after(:each) { connection.close rescue nil }
+
+  context "with a result smaller than the spool limit" do
+    let(:result) { driver.execute_spooled(sql, 10) }
+
+    it "keeps the rows in memory" do
+      result.should_not be_spilled
+    end
+
+    it "returns every row" do
+      result.map { |row| row[:id] }.should == (1..10).to_a
+    end
+
+    it "reports the row count" do
+      result.count.should == 10
+    end
+
+    it "returns NULLs as nil" do
+      result[0][:even].should be_nil
+      result[1][:even].should == 0
+    end
+  end
+
+  context "with a result larger than the spool limit" do
+    let(:options) { URI.parse(connection_uri).tap{|u| u.query = "spool_limit=4096"}.to_s }
+    let(:result)  { driver.execute_spooled(sql, 5000) }
+
+    it "spills the rows to a temp file" do
+      result.should be_spilled
+    end
+
+    it "can be iterated more than once" do
+      result.map { |row| row[:id] }.should == (1..5000).to_a
+      result.map { |row| row[:id] }.should == (1..5000).to_a
+    end
+
+    it "reads rows by index" do
+      result[0].should == {id: 1, pad: "x" * 100, even: nil}
+      result[4999][:id].should == 5000
+      result[-1][:id].should == 5000
+      result[5000].should be_nil
+    end
+  end
+
+  context "with no rows" do
+    it "returns an empty result" do
+      result = driver.execute_spooled(sql, 0)
+      result.count.should == 0
+      result.to_a.should == []
+    end
+  end
+
+  context "with an error" do
+    it "raises an RDO::Exception" do
+      expect {
+        driver.execute_spooled("SELECT 1 / (i - 3) FROM generate_series(1, 5) AS i")
+      }.to raise_error(RDO::Exception)
+    end
+
+    it "leaves the connection usable" do
+      driver.execute_spooled("SELECT 1 / (i - 3) FROM generate_series(1, 5) AS i") rescue nil
+      connection.execute("SELECT 1 AS one").first_value.should == 1
+    end
+  end
+
+  it "does not support Arrow export" do
+    expect {
+      driver.execute_spooled(sql, 1).to_arrow_ipc
+    }.to raise_error(RDO::Exception)
+  end
+end
@@ -271,6 +271,198 @@ describe RDO::Postgres::Driver, "type casting" do
     end
   end
 
+  describe "uuid cast" do
+    let(:sql) { "SELECT 'a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11'::uuid" }
+
+    it "returns a String" do
+      value.should == "a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11"
+    end
+
+    it "uses the connection encoding" do
+      value.encoding.should == Encoding.find("utf-8")
+    end
+  end
+
+  describe "json cast" do
+    let(:sql) { %q{SELECT '{"a": [1, 2]}'::json} }
+
+    it "returns a String" do
+      value.should == %q{{"a": [1, 2]}}
+    end
+
+    context "using jsonb" do
+      let(:sql) { %q{SELECT '{"a": [1, 2]}'::jsonb} }
+
+      it "returns a String" do
+        value.should == %q{{"a": [1, 2]}}
+      end
+    end
+
+    context "with parse_json enabled" do
+      let(:options) { connection_uri.sub(/\?.*\z/, "") + "?encoding=utf-8&parse_json=true" }
+
+      it "returns a Hash" do
+        value.should == {"a" => [1, 2]}
+      end
+    end
+  end
+
+  describe "interval cast" do
+    let(:sql) { "SELECT '1 year 2 mons -3 days 04:05:06.789'::interval" }
+
+    it "returns a RDO::Postgres::Interval" do
+      value.should == RDO::Postgres::Interval.new(14, -3, 14_706_789_000)
+    end
+
+    context "with a negative time" do
+      let(:sql) { "SELECT '-1.5 seconds'::interval" }
+
+      it "returns negative microseconds" do
+        value.should == RDO::Postgres::Interval.new(0, 0, -1_500_000)
+      end
+    end
+
+    context "with a non-default IntervalStyle" do
+      before(:each) { connection.execute("SET intervalstyle = iso_8601") }
+      let(:sql) { "SELECT '3 days'::interval" }
+
+      it "returns a String" do
+        value.should == "P3D"
+      end
+    end
+  end
+
+  describe "int4range cast" do
+    let(:sql) { "SELECT '[1,10]'::int4range" }
+
+    it "returns a RDO::Postgres::Range in canonical form" do
+      value.should be_a(RDO::Postgres::Range)
+      value.should == (1...11)
+    end
+
+    context "when empty" do
+      let(:sql) { "SELECT 'empty'::int4range" }
+
+      it "returns an empty range" do
+        value.should be_empty
+        value.should_not include(1)
+      end
+    end
+
+    context "with an infinite bound" do
+      let(:sql) { "SELECT '[5,)'::int4range" }
+
+      it "returns an endless range" do
+        value.should == (5..nil)
+      end
+    end
+  end
+
+  describe "numrange cast" do
+    let(:sql) { "SELECT '(1.5,2.5]'::numrange" }
+
+    it "keeps the exclusive lower bound" do
+      value.exclude_begin?.should be_true
+      value.exclude_end?.should be_false
+      value.should_not include(BigDecimal("1.5"))
+      value.should include(BigDecimal("2.5"))
+    end
+  end
+
+  describe "tstzrange cast" do
+    let(:sql) { "SELECT tstzrange('2020-01-01 00:00:00+00', '2020-01-02 00:00:00+00')" }
+
+    it "returns a range of DateTimes" do
+      value.should == (
+        DateTime.new(2020, 1, 1, 0, 0, 0)...DateTime.new(2020, 1, 2, 0, 0, 0)
+      )
+    end
+  end
+
+  describe "daterange cast" do
+    let(:sql) { "SELECT '[2020-01-01,2020-01-31]'::daterange" }
+
+    it "returns a range of Dates" do
+      value.should == (Date.new(2020, 1, 1)...Date.new(2020, 2, 1))
+    end
+  end
+
+  describe "record cast" do
+    let(:sql) { %q{SELECT ROW(1, 'a b', NULL, 'x"y', '')} }
+
+    it "returns an Array of Strings" do
+      value.should == ["1", "a b", nil, 'x"y', ""]
+    end
+  end
+
+  describe "time cast" do
+    let(:sql) { "SELECT '04:05:06.789'::time" }
+
+    it "returns a String" do
+      value.should == "04:05:06.789"
+    end
+
+    context "using timetz" do
+      let(:sql) { "SELECT '04:05:06+10'::timetz" }
+
+      it "returns a String" do
+        value.should == "04:05:06+10"
+      end
+    end
+  end
+
+  describe "inet cast" do
+    let(:sql) { "SELECT '192.168.0.5'::inet" }
+
+    it "returns an IPAddr" do
+      value.should == IPAddr.new("192.168.0.5")
+    end
+
+    context "with a netmask" do
+      let(:sql) { "SELECT '192.168.0.5/24'::inet" }
+
+      it "keeps the host address" do
+        value.should == IPAddr.new("192.168.0.5")
+        value.prefix.should == 24
+      end
+
+      it "gives the network" do
+        value.network.should == IPAddr.new("192.168.0.0/24")
+      end
+
+      it "round trips as a bind parameter" do
+        connection.execute("SELECT ?::inet::text", value).first_value.should == "192.168.0.5/24"
+      end
+    end
+
+    context "using cidr" do
+      let(:sql) { "SELECT '10.0.0.0/8'::cidr" }
+
+      it "returns an IPAddr for the network" do
+        value.should == IPAddr.new("10.0.0.0/8")
+        value.prefix.should == 8
+      end
+    end
+  end
+
+  describe "money cast" do
+    before(:each) { connection.execute("SET lc_monetary = 'C'") }
+    let(:sql) { "SELECT '-1234.56'::money" }
+
+    it "returns a BigDecimal" do
+      value.should == BigDecimal("-1234.56")
+    end
+
+    context "cast to numeric" do
+      before(:each) { connection.execute("SET lc_monetary = 'de_DE.UTF-8'") rescue nil }
+      let(:sql) { "SELECT '-1234.56'::numeric::money::numeric" }
+
+      it "does not depend on lc_monetary" do
+        value.should == BigDecimal("-1234.56")
+      end
+    end
+  end
+
   describe "text[] cast" do
     let(:sql) { "SELECT ARRAY['a', 'b']::text[]" }
 
@@ -517,4 +709,40 @@ describe RDO::Postgres::Driver, "type casting" do
       ]
     end
   end
+
+  describe "uuid[] cast" do
+    let(:sql) { "SELECT ARRAY['a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11', NULL]::uuid[]" }
+
+    it "returns an Array of Strings" do
+      value.should == ["a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11", nil]
+    end
+  end
+
+  describe "interval[] cast" do
+    let(:sql) { "SELECT ARRAY['1 day', '-02:00:00']::interval[]" }
+
+    it "returns an Array of RDO::Postgres::Intervals" do
+      value.should == [
+        RDO::Postgres::Interval.new(0, 1, 0),
+        RDO::Postgres::Interval.new(0, 0, -7_200_000_000)
+      ]
+    end
+  end
+
+  describe "inet[] cast" do
+    let(:sql) { "SELECT ARRAY['10.0.0.1', NULL]::inet[]" }
+
+    it "returns an Array of IPAddrs" do
+      value.should == [IPAddr.new("10.0.0.1"), nil]
+    end
+  end
+
+  describe "cidr[] cast" do
+    let(:sql) { "SELECT ARRAY['10.0.0.0/8']::cidr[]" }
+
+    it "returns an Array of IPAddrs for the networks" do
+      value.should == [IPAddr.new("10.0.0.0/8")]
+      value.first.prefix.should == 8
+    end
+  end
 end
@@ -0,0 +1,121 @@
+require "spec_helper"
+
+describe RDO::Postgres::TypeMap do
+  let(:connection) { RDO.connect(connection_uri) }
+  let(:driver)     { driver_for(connection) }
+
+  before(:each) do
+    connection.execute("DROP DOMAIN IF EXISTS rdo_posint")
+    connection.execute("DROP TYPE IF EXISTS rdo_mood")
+    connection.execute("CREATE DOMAIN rdo_posint AS integer CHECK (VALUE > 0)")
+    connection.execute("CREATE TYPE rdo_mood AS ENUM ('sad', 'happy')")
+    driver.reload_types
+  end
+
+  after(:each) do
+    connection.execute("DROP DOMAIN IF EXISTS rdo_posint") rescue nil
+    connection.execute("DROP TYPE IF EXISTS rdo_mood") rescue nil
+    connection.close rescue nil
+  end
+
+  it "decodes domains as their base type" do
+    connection.execute("SELECT 42::rdo_posint AS n").first_value.should == 42
+  end
+
+  it "decodes arrays of domains as arrays of their base type" do
+    connection.execute("SELECT ARRAY[1, 2]::rdo_posint[] AS a").first_value.should == [1, 2]
+  end
+
+  it "decodes enums as text" do
+    value = connection.execute("SELECT 'happy'::rdo_mood AS m").first_value
+    value.should == "happy"
+    value.encoding.should == Encoding::UTF_8
+  end
+
+  it "decodes built-in domains from information_schema" do
+    connection.execute(
+      "SELECT 3::information_schema.cardinal_number AS n"
+    ).first_value.should == 3
+  end
+
+  it "is shared by connections to the same database" do
+    other = RDO.connect(connection_uri)
+    begin
+      other.execute("SELECT 7::rdo_posint AS n").first_value.should == 7
+    ensure
+      other.close
+    end
+  end
+
+  context "with a composite type" do
+    before(:each) do
+      connection.execute("DROP TYPE IF EXISTS rdo_pair")
+      connection.execute("CREATE TYPE rdo_pair AS (n rdo_posint, mood rdo_mood, label text)")
+      driver.reload_types
+    end
+
+    after(:each) { connection.execute("DROP TYPE IF EXISTS rdo_pair") rescue nil }
+
+    it "decodes a Hash of its fields by type" do
+      connection.execute(
+        %q{SELECT ROW(3, 'sad', 'a, "b"')::rdo_pair AS p}
+      ).first_value.should == {n: 3, mood: "sad", label: 'a, "b"'}
+    end
+
+    it "decodes NULL fields as nil" do
+      connection.execute(
+        "SELECT ROW(NULL, NULL, NULL)::rdo_pair AS p"
+      ).first_value.should == {n: nil, mood: nil, label: nil}
+    end
+
+    it "decodes the same through a read-ahead cursor" do
+      driver.cursor(
+        %q{SELECT ROW(i, 'sad', 'x')::rdo_pair AS p FROM generate_series(1, 3) i}
+      ).map { |row| row[:p] }.last.should == {n: 3, mood: "sad", label: "x"}
+    end
+
+    it "decodes an Array of Strings if the fields no longer match" do
+      connection.execute("SELECT ROW(3, 'sad', 'a')::rdo_pair AS p").first_value
+      connection.execute("ALTER TYPE rdo_pair ADD ATTRIBUTE extra text")
+      connection.execute(
+        "SELECT ROW(3, 'sad', 'a', 'b')::rdo_pair AS p"
+      ).first_value.should == ["3", "sad", "a", "b"]
+    end
+  end
+
+  context "with a table row type" do
+    before(:each) do
+      connection.execute("CREATE TEMP TABLE rdo_rows (id integer, mood rdo_mood)")
+      connection.execute("INSERT INTO rdo_rows VALUES (1, 'happy')")
+      driver.reload_types
+    end
+
+    it "decodes a Hash of its fields" do
+      connection.execute("SELECT r FROM rdo_rows r").first_value.should == {id: 1, mood: "happy"}
+    end
+  end
+
+  context "with hstore" do
+    before(:each) do
+      connection.execute("CREATE EXTENSION IF NOT EXISTS hstore")
+      driver.reload_types
+    end
+
+    it "decodes a Hash" do
+      connection.execute(
+        %q{SELECT 'a=>1, "b c"=>NULL'::hstore AS h}
+      ).first_value.should == {"a" => "1", "b c" => nil}
+    end
+  end
+
+  context "with type_map=false" do
+    let(:options) { URI.parse(connection_uri).tap{|u| u.query = "type_map=false"}.to_s }
+    let(:plain)   { RDO.connect(options) }
+
+    after(:each) { plain.close rescue nil }
+
+    it "returns domains as strings" do
+      plain.execute("SELECT 42::rdo_posint AS n").first_value.should == "42"
+    end
+  end
+end
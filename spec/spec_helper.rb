@@ -7,4 +7,9 @@ RSpec.configure do |config|
   def connection_uri
     ENV["CONNECTION"]
   end
+
+  # RDO::Connection only exposes the common driver API.
+  def driver_for(connection)
+    connection.instance_variable_get(:@driver)
+  end
 end